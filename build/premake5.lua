@@ -162,3 +162,229 @@ project "Corona"
       defines { "NDEBUG" }
       optimize "On"
 
+
+
+-- headless mesh cooker. writes/validates the cooked files LoadModel maps at startup.
+project "MeshCook"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs {
+            "../src/external",
+            "../src/external/assimp/include",
+            "../src/external/dxc/inc",
+            "../src/"
+               }
+
+   files {
+      "../src/tools/MeshCook.cpp",
+      "../src/MeshCache.h",
+      "../src/MeshCache.cpp",
+      "../src/MeshOptimize.h",
+      "../src/MeshOptimize.cpp",
+      "../src/VertexPacking.h",
+      "../src/VertexPacking.cpp",
+      "../src/MeshletBuilder.h",
+      "../src/MeshletBuilder.cpp",
+      "../src/MeshSimplify.h",
+      "../src/MeshSimplify.cpp",
+      "../src/Utils.h",
+      "../src/Utils.cpp",
+      "../src/external/enkiTS/*.h",
+      "../src/external/enkiTS/*.cpp",
+      }
+
+   libdirs { "../src/external/assimp/lib" }
+   links { "assimp.lib" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+
+-- offline texture compression. writes the "<texture>.cooked.dds" files LoadTextureImage prefers over the sources.
+project "TextureCook"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs {
+            "../src/external",
+            "../src/external/DirectXTex July 2017/Include",
+            "../src/external/assimp/include",
+            "../src/external/dxc/inc",
+            "../src/"
+               }
+
+   files {
+      "../src/tools/TextureCook.cpp",
+      "../src/TextureCooker.h",
+      "../src/TextureCooker.cpp",
+      "../src/MeshCache.h",
+      "../src/MeshCache.cpp",
+      "../src/MeshOptimize.h",
+      "../src/MeshOptimize.cpp",
+      "../src/MeshletBuilder.h",
+      "../src/MeshletBuilder.cpp",
+      "../src/MeshSimplify.h",
+      "../src/MeshSimplify.cpp",
+      "../src/Utils.h",
+      "../src/Utils.cpp",
+      "../src/external/enkiTS/*.h",
+      "../src/external/enkiTS/*.cpp",
+      }
+
+   libdirs {
+      "../src/external/assimp/lib",
+      "../src/external/DirectXTex July 2017/Lib 2017/",
+      }
+   links { "assimp.lib" }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+
+-- checks and benchmarks the placed resource heap allocator and the other device free parts. standard library only, also builds outside windows(see the top of HeapBench.cpp).
+project "HeapBench"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs { "../src/" }
+
+   files {
+      "../src/tools/HeapBench.cpp",
+      "../src/HeapAllocator.h",
+      "../src/HeapAllocator.cpp",
+      "../src/DescriptorAllocator.h",
+      "../src/DescriptorAllocator.cpp",
+      "../src/BindingSlot.h",
+      "../src/BindingSlot.cpp",
+      }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+
+-- checks and times the render graph compiler. standard library only, also builds outside windows(see the top of RenderGraphTest.cpp).
+project "RenderGraphTest"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs { "../src/" }
+
+   files {
+      "../src/tools/RenderGraphTest.cpp",
+      "../src/RenderGraph.h",
+      "../src/RenderGraph.cpp",
+      "../src/HeapAllocator.h",
+      "../src/HeapAllocator.cpp",
+      }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+
+-- checks the shader cache with a stand in compiler and times it on the renderer's shaders. standard library only, also builds outside windows(see the top of ShaderCacheTest.cpp).
+project "ShaderCacheTest"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs { "../src/" }
+
+   files {
+      "../src/tools/ShaderCacheTest.cpp",
+      "../src/ShaderCache.h",
+      "../src/ShaderCache.cpp",
+      }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
+
+
+-- checks the meshlet builder, the LOD simplifier and the vertex packing on generated meshes. standard library and glm only, also builds outside windows(see the top of MeshTest.cpp).
+project "MeshTest"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   systemversion( WIN_SDK_VERSION)
+   staticruntime("off")
+   flags { "NoPCH" }
+   targetdir "../src/"
+   debugdir("../src/")
+
+   includedirs { "../src/external", "../src/" }
+
+   files {
+      "../src/tools/MeshTest.cpp",
+      "../src/CookedVertex.h",
+      "../src/MeshOptimize.h",
+      "../src/MeshOptimize.cpp",
+      "../src/MeshletBuilder.h",
+      "../src/MeshletBuilder.cpp",
+      "../src/MeshSimplify.h",
+      "../src/MeshSimplify.cpp",
+      "../src/VertexPacking.h",
+      "../src/VertexPacking.cpp",
+      "../src/Shaders/VertexFormat.h",
+      }
+
+   filter "configurations:Debug"
+      defines { "DEBUG" }
+      symbols "On"
+
+   filter "configurations:Release"
+      defines { "NDEBUG" }
+      optimize "On"
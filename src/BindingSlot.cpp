@@ -0,0 +1,44 @@
+#include "BindingSlot.h"
+
+#include <algorithm>
+#include <cstring>
+
+BindingSlot BindingLayout::Add(const string& Name)
+{
+	BindingSlot slot;
+
+	const uint32_t hash = HashBindingName(Name.c_str());
+	auto it = lower_bound(Entries.begin(), Entries.end(), make_pair(hash, uint16_t(0)));
+	if (it != Entries.end() && it->first == hash)
+		return slot;
+
+	if (Names.size() >= BINDING_SLOT_INVALID)
+		return slot;
+
+	slot.Index = uint16_t(Names.size());
+	Entries.insert(it, make_pair(hash, slot.Index));
+	Names.push_back(Name);
+	return slot;
+}
+
+BindingSlot BindingLayout::Find(const BindingName& Name) const
+{
+	BindingSlot slot;
+
+	auto it = lower_bound(Entries.begin(), Entries.end(), make_pair(Name.Hash, uint16_t(0)));
+	if (it == Entries.end() || it->first != Name.Hash)
+		return slot;
+
+	// same hash but a name that was never added
+	if (strcmp(Names[it->second].c_str(), Name.Str) != 0)
+		return slot;
+
+	slot.Index = it->second;
+	return slot;
+}
+
+void BindingLayout::Clear()
+{
+	Entries.clear();
+	Names.clear();
+}
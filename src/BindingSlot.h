@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// Binding names resolved once to a small index. no graphics api in here, PipelineStateObject/RTPipelineStateObject in SimpleDX12
+// build a BindingLayout from their bindings in Init and index their binding data with the slot.
+//
+// names are hashed with FNV-1a. the hash is constexpr, so a name written as a constexpr BindingName costs nothing at run time.
+// GetSlot once after Init and keep the slot, the Set* calls taking a slot are one array index. the ones taking a string are the
+// slow path, they hash and search the layout on every call.
+
+#define BINDING_SLOT_INVALID 0xffffu
+
+constexpr uint32_t HashBindingName(const char* Name)
+{
+	uint32_t hash = 2166136261u;
+	for (; *Name; Name++)
+		hash = (hash ^ uint32_t(uint8_t(*Name))) * 16777619u;
+	return hash;
+}
+
+struct BindingName
+{
+	uint32_t Hash;
+	const char* Str;
+
+	constexpr BindingName(const char* InStr) : Hash(HashBindingName(InStr)), Str(InStr) {}
+	BindingName(const string& InStr) : Hash(HashBindingName(InStr.c_str())), Str(InStr.c_str()) {}
+};
+
+struct BindingSlot
+{
+	uint16_t Index = BINDING_SLOT_INVALID;
+
+	bool IsValid() const { return Index != BINDING_SLOT_INVALID; }
+};
+
+class BindingLayout
+{
+	vector<pair<uint32_t, uint16_t>> Entries; // hash -> slot, sorted by hash
+	vector<string> Names; // by slot
+
+public:
+	// slots are given in the order of Add. invalid when the name is already there or its hash collides with another name.
+	BindingSlot Add(const string& Name);
+
+	// invalid when the name isn't in the layout
+	BindingSlot Find(const BindingName& Name) const;
+
+	uint32_t GetNumSlots() const { return uint32_t(Names.size()); }
+	const string& GetName(BindingSlot Slot) const { return Names[Slot.Index]; }
+
+	void Clear();
+};
@@ -0,0 +1,13 @@
+#pragma once
+
+#define GLM_FORCE_CTOR_INIT
+#include "glm/glm.hpp"
+
+// vertex of the cooked vertex stream(MeshCache.h). kept apart so the cpu only mesh code(MeshSimplify, VertexPacking) builds without windows.
+struct CookedVertex
+{
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 UV;
+	glm::vec3 Tangent;
+};
@@ -13,6 +13,7 @@
 #include "Corona.h"
 #include <dxcapi.use.h>
 #include "Utils.h"
+#include "MeshCache.h"
 #include <iostream>
 #include <algorithm>
 #include <array>
@@ -21,9 +22,6 @@
 #include <variant>
 #include <codecvt>
 #include <dxgidebug.h>
-#include "assimp/include/Importer.hpp"
-#include "assimp/include/scene.h"
-#include "assimp/include/postprocess.h"
 
 #if USE_AFTERMATH
 #include "GFSDK_Aftermath/include/GFSDK_Aftermath.h"
@@ -56,6 +54,39 @@ static dxc::DxcDllSupport gDxcDllHelper;
 
 using namespace glm;
 
+// tracked barriers(CommandList::Require). bloom and exposure only say which state they need, the resources they use
+// (LumaBuffer, BloomBlurPingPong, Histogram, ExposureData, LightingWithBloomBuffer) are left in whatever state that was,
+// so every pass reading them Requires too and no hand written ResourceTransition may have them.
+// the g-buffer, ray tracing, lighting and taa/dlss targets are render graph resources, ApplyGraphTransitions Requires the state
+// each pass declared. the denoisers ping-pong within a pass and Require theirs. NRD gets its inputs from the graph in SRV_STATE
+// and only has hand written barriers for its own textures.
+static void Require(GfxCommandList* CmdList, GfxTexture* Tex, D3D12_RESOURCE_STATES State)
+{
+	static_cast<CommandList*>(CmdList)->Require(static_cast<Texture*>(Tex), State);
+}
+
+static void Require(GfxCommandList* CmdList, GfxBuffer* Buf, D3D12_RESOURCE_STATES State)
+{
+	static_cast<CommandList*>(CmdList)->Require(static_cast<Buffer*>(Buf), State);
+}
+
+static void Prepare(GfxCommandList* CmdList, GfxTexture* Tex, D3D12_RESOURCE_STATES State)
+{
+	static_cast<CommandList*>(CmdList)->Prepare(static_cast<Texture*>(Tex), State);
+}
+
+static void Prepare(GfxCommandList* CmdList, GfxBuffer* Buf, D3D12_RESOURCE_STATES State)
+{
+	static_cast<CommandList*>(CmdList)->Prepare(static_cast<Buffer*>(Buf), State);
+}
+
+static void FlushBarriers(GfxCommandList* CmdList)
+{
+	static_cast<CommandList*>(CmdList)->FlushBarriers();
+}
+
+static const D3D12_RESOURCE_STATES SRV_STATE = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+
 Corona::Corona(UINT width, UINT height, UINT renderWidth, UINT renderHeight, std::wstring name) :
 	DXSample(width, height, name),
 	m_scissorRect{ 0, 0, static_cast<LONG>(width), static_cast<LONG>(height) }
@@ -94,6 +125,7 @@ void Corona::OnInit()
 
 	g_TS.Initialize(8);
 
+	QueryPerformanceCounter(&LoadStartTime);
 
 	m_camera.Init({ 458, 781, 185 });
 	m_camera.SetMoveSpeed(200);
@@ -116,6 +148,9 @@ void Corona::LoadPipeline()
 
 void Corona::LoadAssets()
 {
+	// buffer and texture copies below go out in one submission, before the acceleration structures read the vertex buffers
+	dx12_rhi->BeginLoadBatch();
+
 	InitBlueNoiseTexture();
 
 #if USE_IMGUI
@@ -140,6 +175,7 @@ void Corona::LoadAssets()
 	InitNRD();
 #endif
 	InitRTPSO();
+	ReportShaderCache("LoadAssets");
 
 	
 	struct PostVertex
@@ -177,17 +213,19 @@ void Corona::LoadAssets()
 	NAME_TEXTURE(ColorBuffers[1]);
 
 
+	// buffers that are only alive for part of a frame share memory through the transient pool, see DeclareTransientPasses
+
 	// lighting result
-	LightingBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	LightingBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(LightingBuffer);
 
 
-	LightingWithBloomBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	LightingWithBloomBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(LightingWithBloomBuffer);
 
@@ -206,23 +244,23 @@ void Corona::LoadAssets()
 	NAME_TEXTURE(NormalBuffers[1]);
 
 	// geometry world normal
-	GeomNormalBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1, glm::vec4(0.0f, -0.1f, 0.0f, 0.0f)));
+	GeomNormalBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, glm::vec4(0.0f, -0.1f, 0.0f, 0.0f));
 
 	NAME_TEXTURE(GeomNormalBuffer);
 
 	// shadow result
-	ShadowBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R8G8B8A8_UNORM,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	ShadowBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(ShadowBuffer);
 
 	// refleciton result
-	SpeculaGIBufferRaw = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	SpeculaGIBufferRaw = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(SpeculaGIBufferRaw);
 
@@ -252,15 +290,15 @@ void Corona::LoadAssets()
 	NAME_TEXTURE(SpeculaGIMoments[1]);
 	// diffuse gi
 
-	DiffuseGISHRaw = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	DiffuseGISHRaw = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(DiffuseGISHRaw);
 
-	DiffuseGICoCgRaw = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	DiffuseGICoCgRaw = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(DiffuseGICoCgRaw);
 
@@ -292,61 +330,61 @@ void Corona::LoadAssets()
 
 	// NRD result buffers
 	// normal roughness for NRD input
-	NormalRoughness_NRD = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_UNORM,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	NormalRoughness_NRD = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_UNORM,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 	NAME_TEXTURE(NormalRoughness_NRD);
 
 	//  LinearDepth_NRD
-	LinearDepth_NRD = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R32_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, 
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	LinearDepth_NRD = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R32_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 	NAME_TEXTURE(LinearDepth_NRD);
 	
 	// sh
-	DiffuseGI_NRD = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	DiffuseGI_NRD = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(DiffuseGI_NRD);
 
 	// spec
-	SpecularGI_NRD = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	SpecularGI_NRD = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(SpecularGI_NRD);
 
 	// albedo
-	AlbedoBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R8G8B8A8_UNORM,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	AlbedoBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	NAME_TEXTURE(AlbedoBuffer);
 
 	// velocity
-	VelocityBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)));
+	VelocityBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f));
 	NAME_TEXTURE(VelocityBuffer);
 
 	// pixel velocity
-	PixelVelocityBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16_FLOAT,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)));
+	PixelVelocityBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f));
 	NAME_TEXTURE(PixelVelocityBuffer);
 
 	// pbr material
-	RoughnessMetalicBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R8G8B8A8_UNORM,
-		RESOURCE_FLAG_ALLOW_RENDER_TARGET,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1, glm::vec4(0.001f, 0.0f, 0.0f, 0.0f )));
+	RoughnessMetalicBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R8G8B8A8_UNORM,
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, glm::vec4(0.001f, 0.0f, 0.0f, 0.0f ));
 
 	NAME_TEXTURE(RoughnessMetalicBuffer);
 
 	// depth 
-	DepthBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R32_TYPELESS,
-		RESOURCE_FLAG_ALLOW_DEPTH_STENCIL, 
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1));
+	DepthBuffer = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R32_TYPELESS,
+		D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight);
 
 	//NAME_TEXTURE(DepthBuffer);
 
@@ -363,15 +401,28 @@ void Corona::LoadAssets()
 		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RenderWidth, RenderHeight, 1, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)));
 	NAME_TEXTURE(UnjitteredDepthBuffers[1]);
 
-	DefaultWhiteTex = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(L"assets/default/default_white.png", false));
-	DefaultBlackTex = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(L"assets/default/default_black.png", false));
-	DefaultNormalTex = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(L"assets/default/default_normal.png", true));
-	DefaultRougnessTex = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(L"assets/default/default_roughness.png", true));
+	Streamer.Initialize(&g_TS, &TexCache);
+
+	DefaultWhiteTex = TexCache.Load(L"assets/default/default_white.png", false);
+	DefaultBlackTex = TexCache.Load(L"assets/default/default_black.png", false);
+	DefaultNormalTex = TexCache.Load(L"assets/default/default_normal.png", true);
+	DefaultRougnessTex = TexCache.Load(L"assets/default/default_roughness.png", true);
 
 	Sponza = LoadModel("assets/Sponza/Sponza.fbx");
 
 	ShaderBall = LoadModel("assets/shaderball/shaderBall.fbx");
 
+	RegisterMaterials(Sponza);
+	RegisterMaterials(ShaderBall);
+
+	{
+		const TextureCacheStats stats = TexCache.GetStatsSnapshot();
+		stringstream ss;
+		ss << "TextureCache : " << stats.NumMisses << " loaded, " << stats.NumPathHits << " path hits, " << stats.NumContentHits << " content hits, "
+			<< stats.FileBytesSaved / 1024 << " KB file / " << stats.GpuBytesSaved / 1024 << " KB gpu saved\n";
+		OutputDebugStringA(ss.str().c_str());
+	}
+
 	glm::mat4x4 scaleMat = glm::scale(glm::vec3(2.5, 2.5, 2.5));
 	glm::mat4x4 translatemat = glm::translate(glm::vec3(-150, 20, 0));
 	ShaderBall->SetTransform(scaleMat* translatemat );
@@ -430,232 +481,160 @@ void Corona::LoadAssets()
 
 	}
 
+	dx12_rhi->EndLoadBatch();
+
+	{
+		UploadRingStats stats = dx12_rhi->Uploads->GetStats();
+		stringstream ss;
+		ss << "UploadRing : " << stats.BytesUploaded / 1024 << " KB in " << stats.NumCopies << " copies, " << stats.NumSubmissions << " submissions, "
+			<< stats.NumStalls << " stalls, " << stats.NumChunkedCopies << " chunked\n";
+		OutputDebugStringA(ss.str().c_str());
+	}
+
 	InitRaytracingData();
+
+#if USE_BINDLESS_MATERIALS
+	UpdateMaterialBuffer();
+#endif
 }
 
 shared_ptr<Scene> Corona::LoadModel(string fileName)
 {
-	map<wstring, wstring> SponzaRoughnessMap = {
-	{L"Background_Albedo", L"Background_Roughness"},
-	{L"ChainTexture_Albedo", L"ChainTexture_Roughness"},
-	{L"Lion_Albedo", L"Lion_Roughness"},
-	{L"Sponza_Arch_diffuse", L"Sponza_Arch_roughness"},
-	{L"Sponza_Bricks_a_Albedo", L"Sponza_Bricks_a_Roughness"},
-	{L"Sponza_Ceiling_diffuse", L"Sponza_Ceiling_roughness"},
-	{L"Sponza_Column_a_diffuse", L"Sponza_Column_a_roughness"},
-	{L"Sponza_Column_b_diffuse", L"Sponza_Column_b_roughness"},
-	{L"Sponza_Column_c_diffuse", L"Sponza_Column_c_roughness"},
-	{L"Sponza_Curtain_Blue_diffuse", L"Sponza_Curtain_roughness"},
-	{L"Sponza_Curtain_Green_diffuse", L"Sponza_Curtain_roughness"},
-	{L"Sponza_Curtain_Red_diffuse", L"Sponza_Curtain_roughness"},
-	{L"Sponza_Details_diffuse", L"Sponza_Details_roughness"},
-	{L"Sponza_Fabric_Blue_diffuse", L"Sponza_Fabric_roughness"},
-	{L"Sponza_Fabric_Green_diffuse", L"Sponza_Fabric_roughness"},
-	{L"Sponza_Fabric_Red_diffuse", L"Sponza_Fabric_roughness"},
-	{L"Sponza_FlagPole_diffuse", L"Sponza_FlagPole_roughness"},
-	{L"Sponza_Floor_diffuse", L"Sponza_Floor_roughness"},
-	{L"Sponza_Roof_diffuse", L"Sponza_Roof_roughness"},
-	{L"Sponza_Thorn_diffuse", L"Sponza_Thorn_roughness"},
-	{L"Vase_diffuse", L"Vase_roughness"},
-	{L"VaseHanging_diffuse", L"VaseHanging_roughness"},
-	{L"VasePlant_diffuse", L"VasePlant_roughness"},
-	{L"VaseRound_diffuse", L"VaseRound_roughness"}
-	};
-
-	Scene* scene = new Scene;
-
-	Assimp::Importer importer;
-	const aiScene* assimpScene = importer.ReadFile(fileName, 0);
-	
 	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 	wstring wide = converter.from_bytes(fileName);
 
 	wstring dir = GetDirectoryFromFilePath(wide.c_str());
 	//wstring dir = L"Sponza/";
 
-	UINT flags = aiProcess_CalcTangentSpace |
-		aiProcess_Triangulate |
-		aiProcess_JoinIdenticalVertices |
-		aiProcess_MakeLeftHanded |
-		aiProcess_RemoveRedundantMaterials |
-		aiProcess_FlipUVs |
-		aiProcess_FlipWindingOrder;
-
-		flags |= aiProcess_PreTransformVertices /*| aiProcess_OptimizeMeshes*/;
-
-	assimpScene = importer.ApplyPostProcessing(flags);
-
-	const int numMaterials = assimpScene->mNumMaterials;
-	scene->Materials.reserve(numMaterials);
-	for (int i = 0; i < numMaterials; ++i)
+	// assimp runs only when there is no valid cooked file. otherwise streams come straight from the mapped file.
+	// a file that opens but doesn't validate(truncated, corrupt offsets or indices) is cooked again.
+	wstring cookedFile = GetCookedScenePath(wide);
+	CookedScene cooked;
+	MeshImportData importData;
+	string cookedError;
+	if (cooked.Open(cookedFile, wide) && !cooked.Validate(cookedError))
 	{
-		const aiMaterial& aiMat = *assimpScene->mMaterials[i];
-		GfxMaterial* mat = new GfxMaterial;
-		wstring wDiffuseTex;
-		wstring wNormalTex;
-		wstring wRoughnessTex;
-		wstring wMetallicTex;
-
-
-		aiString diffuseTexPath;
-		aiString normalMapPath;
-		aiString rougnessMapPath;
-		aiString metallicMapPath;
+		OutputDebugStringA((fileName + " : cooked file is invalid, cooking again\n" + cookedError).c_str());
+		cooked.Close();
+	}
 
+	if (!cooked.IsOpen())
+	{
+		if (!ImportMeshFromFile(fileName, importData, &g_TS))
+			return nullptr;
 
-		if (aiMat.GetTexture(aiTextureType_DIFFUSE, 0, &diffuseTexPath) == aiReturn_SUCCESS)
-			wDiffuseTex = GetFileName(AnsiToWString(diffuseTexPath.C_Str()).c_str());
-		if (wDiffuseTex.length() != 0)
-		{
-			mat->Diffuse = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(dir + wDiffuseTex, false));
-		}
+		if (!WriteCookedScene(cookedFile, wide, importData) || !cooked.Open(cookedFile, wide))
+			cooked.OpenFromMemory(importData);
+	}
 
-		if (!mat->Diffuse)
-			mat->Diffuse = DefaultWhiteTex;
-		
-		if (aiMat.GetTexture(aiTextureType_NORMALS, 0, &normalMapPath) == aiReturn_SUCCESS
-			|| aiMat.GetTexture(aiTextureType_HEIGHT, 0, &normalMapPath) == aiReturn_SUCCESS)
-			wNormalTex = GetFileName(AnsiToWString(normalMapPath.C_Str()).c_str());
+	Scene* scene = new Scene;
 
-		if (wNormalTex.length() != 0)
-		{
-			mat->Normal = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(dir + wNormalTex, true));
-		}
+	scene->AABBMin = cooked.Header->AABBMin;
+	scene->AABBMax = cooked.Header->AABBMax;
+	scene->BoundingRadius = cooked.Header->BoundingRadius;
 
-		if (!mat->Normal)
-			mat->Normal = DefaultNormalTex;
+	// the slot starts at its default texture and is swapped by the streamer once the file is resident.
+	auto LoadTexture = [&](shared_ptr<GfxMaterial>& mat, shared_ptr<GfxTexture> GfxMaterial::* Member, const wchar_t* TexName, bool nonSRGB, shared_ptr<GfxTexture> DefaultTex)
+	{
+		(*mat).*Member = DefaultTex;
+		if (TexName[0] == 0)
+			return;
 
-		if (aiMat.GetTexture(aiTextureType_AMBIENT, 0, &metallicMapPath) == aiReturn_SUCCESS)
-			wMetallicTex = GetFileName(AnsiToWString(metallicMapPath.C_Str()).c_str());
-		if (wMetallicTex.length() != 0)
+		if (m_syncTextures)
 		{
-			mat->Metallic = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(dir + wMetallicTex, true));
+			if (shared_ptr<GfxTexture> tex = TexCache.Load(dir + TexName, nonSRGB))
+				(*mat).*Member = tex;
 		}
-
-		if (!mat->Metallic)
-			mat->Metallic = DefaultBlackTex;
-		
-		if (wDiffuseTex.length() != 0)
+		else
 		{
-			wstring wNameStr = wstring(wDiffuseTex.substr(0, wDiffuseTex.length() - 4));
-			map<wstring, wstring> ::iterator it = SponzaRoughnessMap.find(wNameStr);
-			if (it != SponzaRoughnessMap.end())
-			{
-				wRoughnessTex = SponzaRoughnessMap[wNameStr] + L".png";
-				mat->Roughness = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTextureFromFile(dir + wRoughnessTex, true));
-			}
+			Streamer.Request(dir + TexName, nonSRGB, mat, Member);
 		}
+	};
 
-		if (!mat->Roughness)
-		{
-			mat->Roughness = DefaultRougnessTex;
-		}
+	const UINT numMaterials = cooked.Header->NumMaterials;
+	scene->Materials.reserve(numMaterials);
+	for (UINT i = 0; i < numMaterials; ++i)
+	{
+		const CookedMaterial& cookedMat = cooked.Materials[i];
+		shared_ptr<GfxMaterial> mat = shared_ptr<GfxMaterial>(new GfxMaterial);
 
-		// HACK!
-		if (wDiffuseTex == L"Sponza_Thorn_diffuse.png" || wDiffuseTex == L"VasePlant_diffuse.png" || wDiffuseTex == L"ChainTexture_Albedo.png")
-			mat->bHasAlpha = true;
+		LoadTexture(mat, &GfxMaterial::Diffuse, cookedMat.Diffuse, false, DefaultWhiteTex);
+		LoadTexture(mat, &GfxMaterial::Normal, cookedMat.Normal, true, DefaultNormalTex);
+		LoadTexture(mat, &GfxMaterial::Metallic, cookedMat.Metallic, true, DefaultBlackTex);
+		LoadTexture(mat, &GfxMaterial::Roughness, cookedMat.Roughness, true, DefaultRougnessTex);
+		mat->bHasAlpha = cookedMat.bHasAlpha != 0;
 
-		scene->Materials.push_back(shared_ptr<GfxMaterial>(mat));
+		scene->Materials.push_back(mat);
 	}
 
-	struct Vertex
-	{
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::vec2 UV;
-		glm::vec3 Tangent;
-	};
-	const UINT numMeshes = assimpScene->mNumMeshes;
+	// every mesh of the scene shares one vertex buffer and one index buffer per index width.
+	// meshes only keep their offsets in the draw call.
+	const CookedSceneHeader* header = cooked.Header;
 
-	UINT totalNumVert = 0;
-	for (UINT i = 0; i < numMeshes; ++i)
+	shared_ptr<GfxVertexBuffer> sceneVb;
+#if USE_PACKED_VERTEX
+	// packed vertices, their quantization(each mesh against its own AABB) and the float positions for BLAS are cooked, they come straight
+	// from the mapped file like the rest.
+	if (header->NumVertices > 0)
 	{
-		aiMesh* asMesh = assimpScene->mMeshes[i];
-
-		totalNumVert += asMesh->mNumVertices;
+		sceneVb = shared_ptr<GfxVertexBuffer>(AbstractGfxLayer::CreateVertexBuffer(sizeof(PackedVertex) * header->NumVertices, sizeof(PackedVertex), (void*)cooked.PackedVertices));
+		BLASPositionBuffers[scene] = shared_ptr<GfxVertexBuffer>(AbstractGfxLayer::CreateVertexBuffer(sizeof(glm::vec3) * header->NumVertices, sizeof(glm::vec3), (void*)cooked.Positions));
 	}
+#else
+	if (header->NumVertices > 0)
+		sceneVb = shared_ptr<GfxVertexBuffer>(AbstractGfxLayer::CreateVertexBuffer(sizeof(CookedVertex) * header->NumVertices, sizeof(CookedVertex), (void*)cooked.Vertices));
+#endif
+
+	shared_ptr<GfxIndexBuffer> sceneIb16;
+	if (header->Index32StreamOffset > 0)
+		sceneIb16 = shared_ptr<GfxIndexBuffer>(AbstractGfxLayer::CreateIndexBuffer(FORMAT_R16_UINT, header->Index32StreamOffset, (void*)cooked.Indices));
+
+	shared_ptr<GfxIndexBuffer> sceneIb32;
+	if (header->IndexStreamSize > header->Index32StreamOffset)
+		sceneIb32 = shared_ptr<GfxIndexBuffer>(AbstractGfxLayer::CreateIndexBuffer(FORMAT_R32_UINT, header->IndexStreamSize - header->Index32StreamOffset, (void*)(cooked.Indices + header->Index32StreamOffset)));
 
+	const UINT numMeshes = header->NumMeshes;
+	vector<MeshExtra>& extras = MeshExtras[scene];
+	extras.resize(numMeshes);
 	for (UINT i = 0; i < numMeshes; ++i)
 	{
-		aiMesh* asMesh = assimpScene->mMeshes[i];
+		const CookedMesh& cookedMesh = cooked.Meshes[i];
+		const bool b16BitIndex = cookedMesh.IndexStride == sizeof(UINT16);
 
 		GfxMesh* mesh = new GfxMesh;
 
-		mesh->NumVertices = asMesh->mNumVertices;
-		mesh->NumIndices = asMesh->mNumFaces * 3;
-
-		vector<Vertex> vertices;
-		vertices.resize(mesh->NumVertices);
-
-		vector<UINT16> indices;
-		indices.resize(mesh->NumIndices);
-
-		if (asMesh->HasPositions())
-		{
-			for (int i = 0; i < mesh->NumVertices; ++i)
-			{
-				vertices[i].Position.x = asMesh->mVertices[i].x;
-				vertices[i].Position.y = asMesh->mVertices[i].y;
-				vertices[i].Position.z = asMesh->mVertices[i].z;
-
-				scene->AABBMin = glm::min(scene->AABBMin, vertices[i].Position);
-				scene->AABBMax = glm::max(scene->AABBMax, vertices[i].Position);
-				scene->BoundingRadius = glm::max(scene->BoundingRadius, glm::length(scene->AABBMin));
-				scene->BoundingRadius = glm::max(scene->BoundingRadius, glm::length(scene->AABBMax));
-			}
-		}
-
-		if (asMesh->HasNormals())
-		{
-			for (int i = 0; i < mesh->NumVertices; ++i)
-			{
-				vertices[i].Normal.x = asMesh->mNormals[i].x;
-				vertices[i].Normal.y = asMesh->mNormals[i].y;
-				vertices[i].Normal.z = asMesh->mNormals[i].z;
-			}
-		}
+		mesh->NumVertices = cookedMesh.NumVertices;
+		mesh->NumIndices = cookedMesh.NumIndices;
 
-		if (asMesh->HasTextureCoords(0))
-		{
-			for (int i = 0; i < mesh->NumVertices; ++i)
-			{
-				vertices[i].UV.x = asMesh->mTextureCoords[0][i].x;
-				vertices[i].UV.y = asMesh->mTextureCoords[0][i].y;
-			}
-		}
+		mesh->Vb = sceneVb;
+		mesh->VertexStride = VERTEX_STRIDE;
+		mesh->Ib = b16BitIndex ? sceneIb16 : sceneIb32;
+		mesh->IndexFormat = b16BitIndex ? FORMAT_R16_UINT : FORMAT_R32_UINT;
+		MeshExtra& extra = extras[i];
+#if USE_PACKED_VERTEX
+		extra.Quantization = cooked.Quantizations[i];
+#endif
 
-		if (asMesh->HasTangentsAndBitangents())
-		{
-			for (int i = 0; i < mesh->NumVertices; ++i)
-			{
-				vertices[i].Tangent.x = asMesh->mTangents[i].x;
-				vertices[i].Tangent.y = asMesh->mTangents[i].y;
-				vertices[i].Tangent.z = asMesh->mTangents[i].z;
-			}
-		}
+		cooked.GetMeshlets(i, extra.Meshlets);
 
-		const UINT numTriangles = asMesh->mNumFaces;
-		for (int triIdx = 0; triIdx < numTriangles; ++triIdx)
+		extra.Center = cookedMesh.Center;
+		extra.Radius = cookedMesh.Radius;
+		for (UINT lod = 0; lod < cookedMesh.NumLods; lod++)
 		{
-			indices[triIdx * 3 + 0] = UINT16(asMesh->mFaces[triIdx].mIndices[0]);
-			indices[triIdx * 3 + 1] = UINT16(asMesh->mFaces[triIdx].mIndices[1]);
-			indices[triIdx * 3 + 2] = UINT16(asMesh->mFaces[triIdx].mIndices[2]);
+			const CookedMeshLod& cookedLod = cookedMesh.Lods[lod];
+			MeshLod meshLod;
+			meshLod.IndexStart = b16BitIndex ? cookedLod.IndexByteOffset / sizeof(UINT16) : (cookedLod.IndexByteOffset - header->Index32StreamOffset) / sizeof(UINT32);
+			meshLod.IndexCount = cookedLod.NumIndices;
+			meshLod.Error = cookedLod.Error;
+			extra.Lods.push_back(meshLod);
 		}
 
-		mesh->Vb = shared_ptr<GfxVertexBuffer>(AbstractGfxLayer::CreateVertexBuffer(sizeof(Vertex) * mesh->NumVertices, sizeof(Vertex), vertices.data()));
-
-		mesh->VertexStride = sizeof(Vertex);
-		mesh->IndexFormat = FORMAT_R16_UINT;
-
-		mesh->Ib = shared_ptr<GfxIndexBuffer>(AbstractGfxLayer::CreateIndexBuffer(mesh->IndexFormat, sizeof(UINT16)*3*numTriangles, indices.data()));
-
-
 		GfxMesh::DrawCall dc;
-		dc.IndexCount = numTriangles * 3;
-		dc.IndexStart = 0;
-		dc.VertexBase = 0;
-		dc.VertexCount = vertices.size();
-		dc.mat = scene->Materials[asMesh->mMaterialIndex];
+		dc.IndexCount = cookedMesh.NumIndices;
+		dc.IndexStart = b16BitIndex ? cookedMesh.IndexByteOffset / sizeof(UINT16) : (cookedMesh.IndexByteOffset - header->Index32StreamOffset) / sizeof(UINT32);
+		dc.VertexBase = cookedMesh.VertexOffset;
+		dc.VertexCount = cookedMesh.NumVertices;
+		dc.mat = scene->Materials[cookedMesh.MaterialIndex];
 		if (dc.mat->bHasAlpha) mesh->bTransparent = true;
 		
 		mesh->Draws.push_back(dc);
@@ -696,27 +675,27 @@ void Corona::InitSpatialDenoisingPass()
 	UINT WidthGI = RenderWidth / GIBufferScale;
 	UINT HeightGI = RenderHeight / GIBufferScale;
 
-	DiffuseGISHSpatial[0] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI, 1));
+	DiffuseGISHSpatial[0] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI);
 
 	NAME_TEXTURE(DiffuseGISHSpatial[0]);
 
-	DiffuseGISHSpatial[1] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI, 1));
+	DiffuseGISHSpatial[1] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI);
 
 	NAME_TEXTURE(DiffuseGISHSpatial[1]);
 
-	DiffuseGICoCgSpatial[0] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI, 1));
+	DiffuseGICoCgSpatial[0] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI);
 
 	NAME_TEXTURE(DiffuseGICoCgSpatial[0]);
 
-	DiffuseGICoCgSpatial[1] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI, 1));
+	DiffuseGICoCgSpatial[1] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, WidthGI, HeightGI);
 
 	NAME_TEXTURE(DiffuseGICoCgSpatial[1]);
 }
@@ -995,22 +974,23 @@ void Corona::InitBloomPass()
 			AddBloomPSO = shared_ptr<GfxPipelineStateObject>(TEMP_AddBloomPSO);
 	}
 
-	BloomBlurPingPong[0] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight, 1));
+	BloomBlurPingPong[0] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight);
 
 	NAME_TEXTURE(BloomBlurPingPong[0]);
 
-	BloomBlurPingPong[1] = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R16G16B16A16_FLOAT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight, 1));
+	BloomBlurPingPong[1] = dx12_rhi->TransientTextures->CreateTexture2D(DXGI_FORMAT_R16G16B16A16_FLOAT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight);
 
 	NAME_TEXTURE(BloomBlurPingPong[1]);
 
 
-	LumaBuffer = shared_ptr<GfxTexture>(AbstractGfxLayer::CreateTexture2D(FORMAT_R8_UINT,
-		RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight, 1));
+	// not transient, the async exposure reads it while the next frame reuses the transient memory
+	LumaBuffer = shared_ptr<GfxTexture>(dx12_rhi->CreateTexture2D(DXGI_FORMAT_R8_UINT,
+		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, BloomBufferWidth, BloomBufferHeight, 1));
 
 	NAME_TEXTURE(LumaBuffer);
 
@@ -1139,6 +1119,16 @@ void Corona::InitResolvePixelVelocityPass()
 
 void Corona::InitGBufferPass()
 {
+#if USE_PACKED_VERTEX
+	// see PackedVertex
+	INPUT_ELEMENT_DESC StandardVertexDescription[] =
+	{
+		{ "POSITION", 0, FORMAT_R16G16B16A16_UINT,  0, 0,  INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL",   0, FORMAT_R16G16_SNORM,       0, 8,  INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT",  0, FORMAT_R16G16_SNORM,       0, 12, INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, FORMAT_R16G16_FLOAT,       0, 16, INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+#else
 	INPUT_ELEMENT_DESC StandardVertexDescription[] =
 	{
 		{ "POSITION", 0, FORMAT_R32G32B32_FLOAT, 0, 0,  INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -1146,6 +1136,7 @@ void Corona::InitGBufferPass()
 		{ "TEXCOORD", 0, FORMAT_R32G32_FLOAT,    0, 24, INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TANGENT",  0, FORMAT_R32G32B32_FLOAT, 0, 32, INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+#endif
 
 	UINT StandardVertexDescriptionNumElements = _countof(StandardVertexDescription);
 
@@ -1234,17 +1225,37 @@ void Corona::InitGBufferPass()
 		
 	GfxPipelineStateObject* TEMP_GBufferPassPSO = AbstractGfxLayer::CreatePSO();
 		
+#if USE_BINDLESS_MATERIALS
+	static_cast<PipelineStateObject*>(TEMP_GBufferPassPSO)->BindSRV("BindlessTextures", 0, -1, BINDLESS_TEXTURE_SPACE);
+	static_cast<PipelineStateObject*>(TEMP_GBufferPassPSO)->BindSRV("Materials", 0, 1, MATERIAL_BUFFER_SPACE);
+#else
 	AbstractGfxLayer::BindSRV(TEMP_GBufferPassPSO, "AlbedoTex", 0, 1);
 	AbstractGfxLayer::BindSRV(TEMP_GBufferPassPSO, "NormalTex", 1, 1);
 	AbstractGfxLayer::BindSRV(TEMP_GBufferPassPSO, "RoughnessTex", 2, 1);
 	AbstractGfxLayer::BindSRV(TEMP_GBufferPassPSO, "MetallicTex", 3, 1);
+#endif
 	AbstractGfxLayer::BindSampler(TEMP_GBufferPassPSO, "samplerWrap", 0);
 	AbstractGfxLayer::BindCBV(TEMP_GBufferPassPSO, "GBufferConstantBuffer", 0, sizeof(GBufferConstantBuffer));
 
 	bool bSuccess = AbstractGfxLayer::InitPSO(TEMP_GBufferPassPSO, &psoDescMesh);
 
 	if (bSuccess)
+	{
 		GBufferPassPSO = shared_ptr<GfxPipelineStateObject>(TEMP_GBufferPassPSO);
+
+		PipelineStateObject* pso = static_cast<PipelineStateObject*>(TEMP_GBufferPassPSO);
+		GBufferSlots.ConstantBuffer = pso->GetSlot("GBufferConstantBuffer");
+		GBufferSlots.SamplerWrap = pso->GetSlot("samplerWrap");
+#if USE_BINDLESS_MATERIALS
+		GBufferSlots.BindlessTextures = pso->GetSlot("BindlessTextures");
+		GBufferSlots.Materials = pso->GetSlot("Materials");
+#else
+		GBufferSlots.AlbedoTex = pso->GetSlot("AlbedoTex");
+		GBufferSlots.NormalTex = pso->GetSlot("NormalTex");
+		GBufferSlots.RoughnessTex = pso->GetSlot("RoughnessTex");
+		GBufferSlots.MetallicTex = pso->GetSlot("MetallicTex");
+#endif
+	}
 }
 
 #if USE_IMGUI
@@ -1257,7 +1268,7 @@ void Corona::InitImgui()
 	io.DisplaySize.x = DisplayWidth;
 	io.DisplaySize.y = DisplayHeight;
 
-	dx12_rhi->TextureDHRing->AllocDescriptor(CpuHandleImguiFontTex, GpuHandleImguiFontTex);
+	dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptor(CpuHandleImguiFontTex, GpuHandleImguiFontTex);
 
 	ImGui_ImplWin32_Init(Win32Application::GetHwnd());
 	ImGui_ImplDX12_Init(dx12_rhi->Device.Get(), dx12_rhi->NumFrame,
@@ -2346,10 +2357,6 @@ void Corona::LightingPass()
 #endif
 	ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "LightingPass");
 	
-	{
-		std::vector<ResourceTransition> Transition = { {LightingBuffer.get(),  RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 	AbstractGfxLayer::SetPSO(LightingPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetSampler("samplerWrap", AbstractGfxLayer::GetGlobalCommandList(), LightingPSO.get(), samplerBilinearWrap.get());
@@ -2431,9 +2438,6 @@ void Corona::LightingPass()
 	AbstractGfxLayer::SetVertexBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, 1, FullScreenVB.get());
 
 	AbstractGfxLayer::DrawInstanced(AbstractGfxLayer::GetGlobalCommandList(), 4, 1, 0, 0);
-	
-	std::vector<ResourceTransition> Transition = { {LightingBuffer.get(),  RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
 }
 
 void Corona::TemporalAAPass()
@@ -2446,11 +2450,6 @@ void Corona::TemporalAAPass()
 	UINT PrevColorBufferIndex = 1 - ColorBufferWriteIndex;
 	GfxTexture* ResolveTarget = ColorBuffers[ColorBufferWriteIndex].get();
 
-	std::array<ResourceTransition, 1> Transition0 = { {
-		{ResolveTarget, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition0.size(), Transition0.data());
-
 	AbstractGfxLayer::SetPSO(TemporalAAPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetSampler("samplerWrap", AbstractGfxLayer::GetGlobalCommandList(), TemporalAAPSO.get(), samplerBilinearWrap.get());
@@ -2459,7 +2458,10 @@ void Corona::TemporalAAPass()
 	AbstractGfxLayer::SetReadTexture(TemporalAAPSO.get(), "CurrentColorTex", LightingWithBloomBuffer.get(), AbstractGfxLayer::GetGlobalCommandList());
 
 
+	// last frame's isn't in the graph, the tone map left it readable
 	GfxTexture* PrevColorBuffer = ColorBuffers[PrevColorBufferIndex].get();
+	Require(AbstractGfxLayer::GetGlobalCommandList(), PrevColorBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 	AbstractGfxLayer::SetReadTexture(TemporalAAPSO.get(), "PrevColorTex", PrevColorBuffer, AbstractGfxLayer::GetGlobalCommandList());
 	AbstractGfxLayer::SetReadTexture(TemporalAAPSO.get(), "VelocityTex", VelocityBuffer.get(), AbstractGfxLayer::GetGlobalCommandList());
 	AbstractGfxLayer::SetReadTexture(TemporalAAPSO.get(), "DepthTex", DepthBuffer.get(), AbstractGfxLayer::GetGlobalCommandList());
@@ -2492,14 +2494,13 @@ void Corona::TemporalAAPass()
 	AbstractGfxLayer::SetVertexBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, 1, FullScreenVB.get());
 	
 	AbstractGfxLayer::DrawInstanced(AbstractGfxLayer::GetGlobalCommandList(), 4, 1, 0, 0);
-		
-	std::array<ResourceTransition, 1> Transition1 = { {
-		{ResolveTarget, RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_UNORDERED_ACCESS},
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition1.size(), Transition1.data());
 
+	// the graph has the resolve target as a render target, the tone map's read Requires it from whatever this leaves
 	if (bDrawHistogram)
 	{
+		Require(AbstractGfxLayer::GetGlobalCommandList(), ResolveTarget, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
+
 		AbstractGfxLayer::SetPSO(DrawHistogramPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
 		AbstractGfxLayer::SetReadBuffer(DrawHistogramPSO.get(), "Histogram", Histogram.get(), AbstractGfxLayer::GetGlobalCommandList());
@@ -2508,11 +2509,6 @@ void Corona::TemporalAAPass()
 
 		AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), 1, 32, 1);
 	}
-
-	std::array<ResourceTransition, 1> Transition2 = { {
-		{ResolveTarget, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition2.size(), Transition2.data());
 }
 
 #if USE_DLSS
@@ -2526,11 +2522,6 @@ void Corona::DLSSPass()
 	UINT PrevColorBufferIndex = 1 - ColorBufferWriteIndex;
 	Texture* ResolveTarget = ColorBuffers[ColorBufferWriteIndex].get();
 
-	std::array<ResourceTransition, 1> Transition0 = { {
-	{ResolveTarget, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition0.size(), Transition0.data());
-
 	NVSDK_NGX_Result Result;
 
 	ID3D12GraphicsCommandList* d3dcommandList = AbstractGfxLayer::GetGlobalCommandList()->CmdList.Get();
@@ -2560,10 +2551,6 @@ void Corona::DLSSPass()
 		OutputDebugStringA(ss.str().c_str());
 
 	}
-	std::array<ResourceTransition, 1> Transition1 = { {
-	{ResolveTarget, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition1.size(), Transition1.data());
 
 	ID3D12DescriptorHeap* ppHeaps[] = { dx12_rhi->SRVCBVDescriptorHeapShaderVisible->DH.Get(), dx12_rhi->SamplerDescriptorHeapShaderVisible->DH.Get() };
 	AbstractGfxLayer::GetGlobalCommandList()->CmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
@@ -2572,13 +2559,6 @@ void Corona::DLSSPass()
 
 void Corona::ResolvePixelVelocityPass()
 {
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-		{PixelVelocityBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-
 	AbstractGfxLayer::SetPSO(ResolvePixelVelocityPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
 
@@ -2614,13 +2594,6 @@ void Corona::ResolvePixelVelocityPass()
 	AbstractGfxLayer::SetVertexBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, 1, FullScreenVB.get());
 
 	AbstractGfxLayer::DrawInstanced(AbstractGfxLayer::GetGlobalCommandList(), 4, 1, 0, 0);
-
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-		{PixelVelocityBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 }
 
 #if USE_RTXGI
@@ -2725,12 +2698,11 @@ void Corona::BloomPass()
 	BloomCB.RcpLogRange = 1.0f / (kInitialMaxLog - kInitialMinLog);*/
 
 	// extraction pass
-	
-	std::array<ResourceTransition, 2> Transition0 = { {
-		{BloomBlurPingPong[0].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		{LumaBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS}
-	} };
-	AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), 2, Transition0.data());
+
+	// the render graph made LightingWithBloomBuffer a render target and ExposureData readable for everyone up to the tone map
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[0].get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), LumaBuffer.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 
 	AbstractGfxLayer::SetPSO(BloomExtractPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
@@ -2746,16 +2718,13 @@ void Corona::BloomPass()
 
 
 	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), BloomBufferWidth / 32, BloomBufferHeight / 32, 1);
-	{
-		std::array<ResourceTransition, 3> Transition = { {
-			{BloomBlurPingPong[0].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{LumaBuffer.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{BloomBlurPingPong[1].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
 
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size() , Transition.data());
-	}
-	
+	// read by ExposurePass after bloom, or by the compute queue next frame
+	Prepare(AbstractGfxLayer::GetGlobalCommandList(), LumaBuffer.get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[0].get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[1].get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetPSO(BloomBlurPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
@@ -2769,13 +2738,9 @@ void Corona::BloomPass()
 
 	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), BloomBufferWidth / 32, BloomBufferHeight / 32, 1);
 
-	{
-		std::array<ResourceTransition, 2> Transition = { {
-		{BloomBlurPingPong[1].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{BloomBlurPingPong[0].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS}
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[1].get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[0].get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetPSO(BloomBlurPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
@@ -2789,58 +2754,11 @@ void Corona::BloomPass()
 
 	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), BloomBufferWidth / 32, BloomBufferHeight / 32, 1);
 
+	Prepare(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[0].get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-	{
-		std::vector<ResourceTransition> Transition = {
-			ResourceTransition(BloomBlurPingPong[0].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-			ResourceTransition(Histogram.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS)
-		};
-
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-
-
-	AbstractGfxLayer::SetPSO(ClearHistogramPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::SetWriteBuffer(ClearHistogramPSO.get(), "Histogram", Histogram.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), 1, 1, 1);
-
-	AbstractGfxLayer::SetPSO(HistogramPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::SetReadTexture(HistogramPSO.get(), "LumaTex", LumaBuffer.get(), AbstractGfxLayer::GetGlobalCommandList());
-	AbstractGfxLayer::SetWriteBuffer(HistogramPSO.get(), "Histogram", Histogram.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), BloomBufferWidth / 16, 1, 1);
-
-	{
-		std::vector<ResourceTransition> Transition = {
-			ResourceTransition(Histogram.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-			ResourceTransition(ExposureData.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS)
-		};
-
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-
-	AbstractGfxLayer::SetPSO(AdapteExposurePSO.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::SetReadBuffer(AdapteExposurePSO.get(), "Histogram", Histogram.get(), AbstractGfxLayer::GetGlobalCommandList());
-	AbstractGfxLayer::SetWriteBuffer(AdapteExposurePSO.get(), "Exposure", ExposureData.get(), AbstractGfxLayer::GetGlobalCommandList());
-
-	AdaptExposureCB.PixelCount = BloomBufferWidth * BloomBufferHeight;
-	
-	AbstractGfxLayer::SetUniformValue(AdapteExposurePSO.get(), "AdaptExposureCB", &AdaptExposureCB, AbstractGfxLayer::GetGlobalCommandList());
-
-	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), 1, 1, 1);
-
-	{
-		std::vector<ResourceTransition> Transition = {
-			ResourceTransition(ExposureData.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-			ResourceTransition(LightingWithBloomBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET)
-		};
-
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	Require(AbstractGfxLayer::GetGlobalCommandList(), LightingWithBloomBuffer.get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), BloomBlurPingPong[0].get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetPSO(AddBloomPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
@@ -2871,14 +2789,44 @@ void Corona::BloomPass()
 	AbstractGfxLayer::SetVertexBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, 1, FullScreenVB.get());
 
 	AbstractGfxLayer::DrawInstanced(AbstractGfxLayer::GetGlobalCommandList(), 4, 1, 0, 0);
+}
 
-	{
-		std::vector<ResourceTransition> Transition = {
-			ResourceTransition(LightingWithBloomBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-		};
+void Corona::ExposurePass(GfxCommandList* CommandList)
+{
+	ProfileGPUScope(CommandList, PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "ExposurePass");
 
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	// no PIXEL_SHADER_RESOURCE in here, it runs on the compute queue too. OnRender leaves everything in a state it takes there.
+	Require(CommandList, Histogram.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	Require(CommandList, LumaBuffer.get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	FlushBarriers(CommandList);
+
+	AbstractGfxLayer::SetPSO(ClearHistogramPSO.get(), CommandList);
+
+	AbstractGfxLayer::SetWriteBuffer(ClearHistogramPSO.get(), "Histogram", Histogram.get(), CommandList);
+
+	AbstractGfxLayer::Dispatch(CommandList, 1, 1, 1);
+
+	AbstractGfxLayer::SetPSO(HistogramPSO.get(), CommandList);
+
+	AbstractGfxLayer::SetReadTexture(HistogramPSO.get(), "LumaTex", LumaBuffer.get(), CommandList);
+	AbstractGfxLayer::SetWriteBuffer(HistogramPSO.get(), "Histogram", Histogram.get(), CommandList);
+
+	AbstractGfxLayer::Dispatch(CommandList, BloomBufferWidth / 16, 1, 1);
+
+	Require(CommandList, Histogram.get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	Require(CommandList, ExposureData.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	FlushBarriers(CommandList);
+
+	AbstractGfxLayer::SetPSO(AdapteExposurePSO.get(), CommandList);
+
+	AbstractGfxLayer::SetReadBuffer(AdapteExposurePSO.get(), "Histogram", Histogram.get(), CommandList);
+	AbstractGfxLayer::SetWriteBuffer(AdapteExposurePSO.get(), "Exposure", ExposureData.get(), CommandList);
+
+	AdaptExposureCB.PixelCount = BloomBufferWidth * BloomBufferHeight;
+	
+	AbstractGfxLayer::SetUniformValue(AdapteExposurePSO.get(), "AdaptExposureCB", &AdaptExposureCB, CommandList);
+
+	AbstractGfxLayer::Dispatch(CommandList, 1, 1, 1);
 }
 
 static const float OneMinusEpsilon = 0.9999999403953552f;
@@ -3053,6 +3001,15 @@ void Corona::OnUpdate()
 // Render the scene.
 void Corona::OnRender()
 {
+	LARGE_INTEGER frameStartTime;
+	QueryPerformanceCounter(&frameStartTime);
+
+	// before anything is recorded, so a swapped texture is used by the whole frame
+	Streamer.Update();
+#if USE_BINDLESS_MATERIALS
+	UpdateMaterialBuffer();
+#endif
+
 	std::list<GfxTexture*> DynamicTexture = {
 	ColorBuffers[0].get(),
 	ColorBuffers[1].get(),
@@ -3108,81 +3065,78 @@ void Corona::OnRender()
 	for (auto& fb : framebuffers)
 		DynamicTexture.push_back(fb.get());
 
-	AbstractGfxLayer::BeginFrame(DynamicTexture);
-	
-	// Record all the commands we need to render the scene into the command list.
+	// the passes only change with the settings, compiled again then
+	BuildRenderGraph();
 
-	GBufferPass();
+	// transient textures get their memory for this frame before the views are made
+	DeclareTransientPasses();
+	dx12_rhi->TransientTextures->Compile();
+	if (dx12_rhi->TransientTextures->GetLayoutVersion() != TransientReportVersion)
+		UpdateTransientReport();
 
-	ResolvePixelVelocityPass();
+	AbstractGfxLayer::BeginFrame(DynamicTexture);
 
+	// gpu timeline, one range from each pass to the next
+	UINT PassRange = ~0u;
+	auto BeginRange = [&](const char* Name)
+	{
+		CommandList* cmd = static_cast<CommandList*>(AbstractGfxLayer::GetGlobalCommandList());
+		dx12_rhi->Timeline->EndRange(cmd, PassRange);
+		PassRange = dx12_rhi->Timeline->BeginRange(cmd, Name, false);
+	};
 
-	RaytraceShadowPass();
+	auto BeginPass = [&](const char* Name)
+	{
+		BeginRange(Name);
+		dx12_rhi->TransientTextures->BeginPass(AbstractGfxLayer::GetGlobalCommandList(), Name);
+	};
 
+	GfxTexture* backbuffer = framebuffers[AbstractGfxLayer::GetCurrentFrameIndex()].get();
+	GraphBindings[GraphBackbuffer].Textures = { backbuffer };
 
-	RaytraceReflectionPass();
-	
-	if (!bDebugDraw)
-	{
-		if(DiffuseGIMethod == PATH_TRACING)
-			RaytraceGIPass();
-#if USE_RTXGI
-		else
-			RTXGIPass();
-#endif
-	}
-	else
-	{
-		RaytraceGIPass();
-#if USE_RTXGI
-		RTXGIPass();
-#endif
-	}
-#if USE_NRD
+	// the ping-pong targets this frame writes, the other ones are last frame's
+	ColorBufferWriteIndex = 1 - ColorBufferWriteIndex;
+	GraphBindings[GraphNormal].Textures = { NormalBuffers[ColorBufferWriteIndex].get() };
+	GraphBindings[GraphUnjitteredDepth].Textures = { UnjitteredDepthBuffers[ColorBufferWriteIndex].get() };
+	GraphBindings[GraphColor].Textures = { ColorBuffers[ColorBufferWriteIndex].get() };
 
-	if (bNRDDenoising)
-	{
-		NRDPass();
-	}
-	else
-#endif
+	// Record all the commands we need to render the scene into the command list.
+	// compute steps go to the compute queue as they come, a direct step waits for the compute step the graph gave it.
+	const vector<RenderGraphStep>& steps = Graph.GetSteps();
+	vector<UINT64> computeFences(steps.size(), 0);
+	for (UINT i = 0; i < steps.size(); i++)
 	{
-		TemporalDenoisingPass();
+		const RenderGraphStep& step = steps[i];
+		const RenderGraphPass& pass = Graph.GetPass(step.Pass);
+
+		if (step.Queue == RENDER_GRAPH_COMPUTE)
+		{
+			// EndAsyncCompute only waits for what is on CmdQ already
+			if (step.WaitStep != RENDER_GRAPH_INVALID)
+				dx12_rhi->InsertCommandLists({});
+
+			CommandList* computeList = dx12_rhi->BeginAsyncCompute();
+			UINT range = dx12_rhi->Timeline->BeginRange(computeList, pass.Name.c_str(), true);
+			ApplyGraphTransitions(computeList, step.Transitions, false);
+			GraphPasses[step.Pass](computeList);
+			ApplyGraphTransitions(computeList, step.SplitBegins, true);
+			dx12_rhi->Timeline->EndRange(computeList, range);
+			computeFences[i] = dx12_rhi->EndAsyncCompute(computeList);
+			continue;
+		}
 
+		if (step.WaitStep != RENDER_GRAPH_INVALID)
+			dx12_rhi->WaitAsyncCompute(computeFences[step.WaitStep]);
 
-		SpatialDenoisingPass();
+		BeginPass(pass.Name.c_str());
+		ApplyGraphTransitions(AbstractGfxLayer::GetGlobalCommandList(), step.Transitions, false);
+		GraphPasses[step.Pass](AbstractGfxLayer::GetGlobalCommandList());
+		ApplyGraphTransitions(AbstractGfxLayer::GetGlobalCommandList(), step.SplitBegins, true);
 	}
 
-	LightingPass();
+	if (Graph.GetFinalWaitStep() != RENDER_GRAPH_INVALID)
+		dx12_rhi->WaitAsyncCompute(computeFences[Graph.GetFinalWaitStep()]);
 
-	BloomPass();
-	
-	if (AAMethod == TEMPORAL_AA || AAMethod == NO_AA)
-		TemporalAAPass();
-#if USE_DLSS
-	else if (AAMethod == DLSS)
-		DLSSPass();
-#endif
-
-	
-	GfxTexture* backbuffer = framebuffers[AbstractGfxLayer::GetCurrentFrameIndex()].get();
-
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-		{backbuffer, RESOURCE_STATE_PRESENT, RESOURCE_STATE_RENDER_TARGET},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-	
-	std::vector<GfxTexture*> Rendertargets = { backbuffer };
-	AbstractGfxLayer::SetRenderTargets(AbstractGfxLayer::GetGlobalCommandList(), Rendertargets.size(), Rendertargets.data(), nullptr);
-	
-	ToneMapPass();
-
-	if(bDebugDraw)
-		DebugPass();
-
-	
 	if (bShowImgui)
 	{
 #if USE_IMGUI
@@ -3215,12 +3169,126 @@ void Corona::OnRender()
 			\nWASD keys : move camera imGui\
 			\nI : show/hide imGui\
 			\nB : show/hide buffer visualization\
-			\nT : cycle AA methods\n\n");
+			\nT : cycle AA methods\
+			\nM : multithreaded g-buffer on/off\n\n");
 
 		ImGui::SliderFloat("Camera turn speed", &m_turnSpeed, 0.0f, glm::half_pi<float>()*2);
 
+		ImGui::Checkbox("Mesh LOD", &bMeshLod);
+		ImGui::SliderFloat("Mesh LOD pixel error", &MeshLodPixelError, 0.1f, 8.0f);
+		ImGui::SliderFloat("Mesh LOD max world error", &MeshLodMaxWorldError, 0.0f, 1.0f);
+		sprintf(fps, "GBuffer triangles : %u", NumGBufferTriangles);
+		ImGui::Text(fps);
+		ImGui::Checkbox("Multithreaded g-buffer", &bMultiThreadRendering);
+		ImGui::SliderInt("G-buffer threads", &GBufferThreads, 1, int(g_TS.GetNumTaskThreads()));
+		snprintf(fps, sizeof(fps), "GBufferPass : %.3f ms cpu, %zu draws", GBufferCpuMs, GBufferDraws.size());
+		ImGui::Text(fps);
+		const TextureCacheStats texCacheStats = TexCache.GetStatsSnapshot();
+		snprintf(fps, sizeof(fps), "Texture cache : %u hits, %u misses, %llu MB saved", texCacheStats.NumPathHits + texCacheStats.NumContentHits,
+			texCacheStats.NumMisses, texCacheStats.GpuBytesSaved / (1024 * 1024));
+		ImGui::Text(fps);
+		snprintf(fps, sizeof(fps), "Streaming textures : %u", Streamer.GetNumPending());
+		ImGui::Text(fps);
+		ImGui::Checkbox("Shader cache", &dx12_rhi->Shaders->bEnabled);
+		{
+			const ShaderCacheStats& stats = ShaderCacheReport;
+			const UINT numShaders = stats.NumHits + stats.NumMisses;
+			snprintf(fps, sizeof(fps), "Shader cache : %u/%u hits(%.0f%%), %u failed, keys %.1f ms, loads %.1f ms, compiles %.1f ms", stats.NumHits, numShaders,
+				numShaders > 0 ? 100.0 * stats.NumHits / numShaders : 0.0, stats.NumFailed, stats.KeyMs, stats.LoadMs, stats.CompileMs);
+			ImGui::Text(fps);
+		}
+		ImGui::Checkbox("Cache BeginFrame views", &dx12_rhi->bCacheFrameViews);
+		snprintf(fps, sizeof(fps), "BeginFrame : %.3f ms cpu, %u views written", dx12_rhi->BeginFrameCpuMs, dx12_rhi->NumFrameViewsWritten);
+		ImGui::Text(fps);
+		{
+			UploadRingStats stats = dx12_rhi->Uploads->GetStats();
+			snprintf(fps, sizeof(fps), "Uploads : %llu MB, %llu copies, %llu submissions, %llu stalls", stats.BytesUploaded / (1024 * 1024),
+				stats.NumCopies, stats.NumSubmissions, stats.NumStalls);
+			ImGui::Text(fps);
+		}
+		snprintf(fps, sizeof(fps), "Command lists : %u, %u recording threads", dx12_rhi->CmdQ->GetNumCommandLists(), dx12_rhi->CmdQ->GetNumThreadPools());
+		ImGui::Text(fps);
+		ImGui::Checkbox("Batch barriers", &dx12_rhi->bBatchBarriers);
+		{
+			// only the passes that Require their states, hand written barriers aren't counted
+			const BarrierStats& stats = dx12_rhi->FrameBarriers;
+			snprintf(fps, sizeof(fps), "Tracked barriers : %llu required, %llu made(%llu split) in %llu calls", stats.NumRequired, stats.NumBarriers,
+				stats.NumSplit, stats.NumCalls);
+			ImGui::Text(fps);
+		}
+		{
+			const RenderGraphStats& stats = Graph.GetStats();
+			snprintf(fps, sizeof(fps), "Render graph : %u passes(%u culled, %u compute), %u transitions(%u merged reads, %u split), %u waits, built in %.3f ms",
+				stats.NumPasses, stats.NumCulled, stats.NumCompute, stats.NumTransitions, stats.NumMergedReads, stats.NumSplit, stats.NumWaits, RenderGraphCompileMs);
+			ImGui::Text(fps);
+		}
+
+		ImGui::Checkbox("Async compute exposure", &bAsyncExposure);
+		{
+			// averaged over the frames the timeline still has
+			double computeUs = 0, overlapUs = 0;
+			auto& history = dx12_rhi->Timeline->GetHistory();
+			for (auto& frame : history)
+			{
+				double frameComputeUs, frameOverlapUs;
+				GpuTimeline::GetComputeOverlap(frame, frameComputeUs, frameOverlapUs);
+				computeUs += frameComputeUs;
+				overlapUs += frameOverlapUs;
+			}
+			const double numFrames = history.empty() ? 1.0 : double(history.size());
+			snprintf(fps, sizeof(fps), "Compute queue : %.3f ms, %.3f ms next to direct queue passes", computeUs / numFrames / 1000.0, overlapUs / numFrames / 1000.0);
+			ImGui::Text(fps);
+		}
+		if (ImGui::Button("Dump gpu timeline"))
+			TimelineDumpStatus = dx12_rhi->Timeline->WriteChromeTrace("timeline.json") ? "timeline.json written(chrome://tracing)" : "timeline.json couldn't be written";
+		if (TimelineDumpStatus.size() > 0)
+		{
+			ImGui::SameLine();
+			ImGui::Text(TimelineDumpStatus.c_str());
+		}
+
+		if (ImGui::TreeNode("Heap pools"))
+		{
+			for (auto& pool : dx12_rhi->HeapPools)
+			{
+				HeapPoolStats stats = pool->GetStats();
+				string name(pool->Name.begin(), pool->Name.end());
+				snprintf(fps, sizeof(fps), "%s : %u heaps, %llu/%llu MB, %u allocs, frag %.2f", name.c_str(), stats.NumBlocks,
+					stats.Allocator.UsedBytes / (1024 * 1024), stats.Allocator.TotalBytes / (1024 * 1024), stats.Allocator.NumAllocations, stats.Allocator.GetFragmentation());
+				ImGui::Text(fps);
+			}
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Descriptor heaps"))
+		{
+			pair<const char*, DescriptorHeap*> heaps[] = { { "CBV_SRV_UAV", dx12_rhi->SRVCBVDescriptorHeapShaderVisible.get() }, { "RTV", dx12_rhi->RTVDescriptorHeap.get() },
+				{ "DSV", dx12_rhi->DSVDescriptorHeap.get() }, { "Sampler", dx12_rhi->SamplerDescriptorHeapShaderVisible.get() } };
+			for (auto& heap : heaps)
+			{
+				DescriptorAllocatorStats stats = heap.second->GetStats();
+				snprintf(fps, sizeof(fps), "%s : %u/%u used, %u pending, peak %u, largest free %u, stale frees %llu", heap.first, stats.NumUsed, stats.Capacity,
+					stats.NumPending, stats.PeakUsed, stats.LargestFreeRange, stats.NumStaleFrees);
+				ImGui::Text(fps);
+			}
+			// per frame CBV descriptors. constant buffers are root CBVs now, only local ones of rt shaders would still take some
+			snprintf(fps, sizeof(fps), "frame ring : %u/%u last frame", dx12_rhi->GlobalDHRing->LastFrameAllocated, dx12_rhi->GlobalDHRing->NumDescriptors);
+			ImGui::Text(fps);
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Transient targets"))
+		{
+			TransientTextureStats stats = dx12_rhi->TransientTextures->GetStats();
+			snprintf(fps, sizeof(fps), "heaps : %llu MB, %u of %u targets used", stats.HeapBytes / (1024 * 1024), stats.NumUsed, stats.NumTextures);
+			ImGui::Text(fps);
+			for (auto& line : TransientReport)
+				ImGui::Text(line.c_str());
+			ImGui::TreePop();
+		}
+
 #if USE_RTXGI
-		ImGui::Checkbox("Draw Irradiance Texture", &bDrawIrradiance);
+		ImGui::Checkbox("Draw Irradiance Texture"", &bDrawIrradiance);
 		ImGui::SliderFloat("Irradiance Scale", &IrradianceScale, 0.1, 1.0f);
 
 		ImGui::Checkbox("Draw Distance Texture", &bDrawDistance);
@@ -3496,17 +3564,28 @@ void Corona::OnRender()
 #endif // USE_IMGUI
 	}
 
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-		{backbuffer, RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_PRESENT},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	dx12_rhi->Timeline->EndRange(static_cast<CommandList*>(AbstractGfxLayer::GetGlobalCommandList()), PassRange);
+
+	// the backbuffer goes back to present. with async exposure this frame's luma is left to the compute queue, it can't transition
+	// from PIXEL_SHADER_RESOURCE so the graph makes what ExposurePass writes UNORDERED_ACCESS here.
+	ApplyGraphTransitions(AbstractGfxLayer::GetGlobalCommandList(), Graph.GetFinalTransitions(), false);
+	if (bAsyncExposure)
+		bExposurePending = true;
 
 	AbstractGfxLayer::ExecuteCommandList(AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::EndFrame();
 
+	UpdateLoadTimings();
+
+	{
+		LARGE_INTEGER frameEndTime, frequency;
+		QueryPerformanceCounter(&frameEndTime);
+		QueryPerformanceFrequency(&frequency);
+		UpdateDrawBench(double(frameEndTime.QuadPart - frameStartTime.QuadPart) * 1000.0 / double(frequency.QuadPart));
+	}
+	UpdateBarrierBench();
+
 	PrevViewProjMat = ViewProjMat;
 	PrevViewMat = ViewMat;
 	PrevProjMat = ProjMat;
@@ -3514,8 +3593,507 @@ void Corona::OnRender()
 	PrevUnjitteredViewProjMat = UnjitteredViewProjMat;
 }
 
+// the frame as a graph. a pass is only recorded when something the frame shows or keeps reads what it writes : RaytraceGI goes
+// without path traced gi(unless the buffers are visualized), ResolvePixelVelocity without DLSS, RTXGI when no one looks at the probes.
+void Corona::BuildRenderGraph()
+{
+	bool bNRD = false;
+#if USE_NRD
+	bNRD = bNRDDenoising;
+#endif
+	const bool bPathTracedGI = DiffuseGIMethod == PATH_TRACING;
+
+	const UINT64 key = UINT64(bDebugDraw) | UINT64(bNRD) << 1 | UINT64(bAsyncExposure) << 2 | UINT64(bExposurePending) << 3 |
+		UINT64(bDrawHistogram) << 4 | UINT64(DiffuseGIMethod) << 8 | UINT64(AAMethod) << 16;
+	if (key == RenderGraphKey)
+		return;
+	RenderGraphKey = key;
+
+	LARGE_INTEGER startTime;
+	QueryPerformanceCounter(&startTime);
+
+	Graph.Clear();
+	GraphBindings.clear();
+	GraphPasses.clear();
+
+	const uint32_t NON_PIXEL = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	const uint32_t PIXEL = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+	const uint32_t SRV = SRV_STATE;
+	const uint32_t UAV = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+	const uint32_t RT = D3D12_RESOURCE_STATE_RENDER_TARGET;
+	const uint32_t DEPTH = D3D12_RESOURCE_STATE_DEPTH_WRITE;
+
+	// lives within the frame, the pool aliases it by the lifetimes of the compiled passes
+	auto transient = [&](const char* Name, std::initializer_list<GfxTexture*> Textures, bool bTracked = false)
+	{
+		RenderGraphBinding binding;
+		binding.Textures = Textures;
+		binding.bTracked = bTracked;
+		GraphBindings.push_back(binding);
+		return Graph.CreateResource(Name);
+	};
+
+	// lives across frames. a ping-pong pair is one resource, OnRender binds the texture of the frame. the gi history isn't bound,
+	// the denoisers Require it themselves.
+	auto imported = [&](const char* Name, GfxTexture* Tex, GfxBuffer* Buf, uint32_t InitialState, uint32_t FinalState, bool bOutput, bool bTracked = false)
+	{
+		RenderGraphBinding binding;
+		if (Tex)
+			binding.Textures.push_back(Tex);
+		binding.Buf = Buf;
+		binding.bTracked = bTracked;
+		GraphBindings.push_back(binding);
+		return Graph.ImportResource(Name, InitialState, FinalState, bOutput);
+	};
+
+	auto addPass = [&](const char* Name, std::function<void(GfxCommandList*)> Func, RenderGraphQueue Queue = RENDER_GRAPH_DIRECT)
+	{
+		GraphPasses.push_back(Func);
+		return Graph.AddPass(Name, Queue);
+	};
+
+	const uint32_t albedo = transient("Albedo", { AlbedoBuffer.get() }, true);
+	const uint32_t geomNormal = transient("GeomNormal", { GeomNormalBuffer.get() }, true);
+	const uint32_t velocity = transient("Velocity", { VelocityBuffer.get() }, true);
+	const uint32_t pixelVelocity = transient("PixelVelocity", { PixelVelocityBuffer.get() }, true);
+	const uint32_t roughnessMetalic = transient("RoughnessMetalic", { RoughnessMetalicBuffer.get() }, true);
+	const uint32_t depth = transient("Depth", { DepthBuffer.get() }, true);
+	const uint32_t shadow = transient("Shadow", { ShadowBuffer.get() }, true);
+	const uint32_t specularRaw = transient("SpecularGIRaw", { SpeculaGIBufferRaw.get() }, true);
+	const uint32_t diffuseRaw = transient("DiffuseGIRaw", { DiffuseGISHRaw.get(), DiffuseGICoCgRaw.get() }, true);
+	// the denoisers ping-pong them within the pass
+	const uint32_t diffuseSpatial = transient("DiffuseGISpatial", { DiffuseGISHSpatial[0].get(), DiffuseGICoCgSpatial[0].get() });
+	const uint32_t diffuseSpatialTemp = transient("DiffuseGISpatialTemp", { DiffuseGISHSpatial[1].get(), DiffuseGICoCgSpatial[1].get() });
+	const uint32_t nrdGuides = transient("NRDGuides", { NormalRoughness_NRD.get(), LinearDepth_NRD.get() });
+	const uint32_t nrdOutput = transient("NRDOutput", { DiffuseGI_NRD.get(), SpecularGI_NRD.get() });
+	const uint32_t lighting = transient("Lighting", { LightingBuffer.get() }, true);
+	const uint32_t lightingWithBloom = transient("LightingWithBloom", { LightingWithBloomBuffer.get() }, true);
+	const uint32_t bloomPingPong0 = transient("BloomPingPong0", { BloomBlurPingPong[0].get() }, true);
+	const uint32_t bloomPingPong1 = transient("BloomPingPong1", { BloomBlurPingPong[1].get() }, true);
+
+	// read by the next frame
+	const uint32_t normal = imported("Normal", nullptr, nullptr, SRV, RENDER_GRAPH_ANY_STATE, true, true);
+	const uint32_t unjitteredDepth = imported("UnjitteredDepth", nullptr, nullptr, SRV, RENDER_GRAPH_ANY_STATE, true, true);
+	const uint32_t giHistory = imported("GIHistory", nullptr, nullptr, SRV, RENDER_GRAPH_ANY_STATE, true);
+	const uint32_t color = imported("Color", nullptr, nullptr, SRV, RENDER_GRAPH_ANY_STATE, true, true);
+	GraphNormal = normal;
+	GraphUnjitteredDepth = unjitteredDepth;
+	GraphColor = color;
+	// only updated while something reads them
+	const uint32_t probes = imported("Probes", nullptr, nullptr, SRV, RENDER_GRAPH_ANY_STATE, false);
+
+	// with async exposure the compute queue takes them over at the start of the next frame in states it can transition from
+	const uint32_t luma = imported("Luma", LumaBuffer.get(), nullptr, NON_PIXEL, bAsyncExposure ? NON_PIXEL : RENDER_GRAPH_ANY_STATE, bAsyncExposure, true);
+	const uint32_t histogram = imported("Histogram", nullptr, Histogram.get(), UAV, bAsyncExposure ? UAV : RENDER_GRAPH_ANY_STATE, false, true);
+	const uint32_t exposure = imported("ExposureData", nullptr, ExposureData.get(), bExposurePending ? UAV : SRV, bAsyncExposure ? UAV : RENDER_GRAPH_ANY_STATE, true, true);
+
+	// OnRender binds the one of the frame
+	GraphBackbuffer = imported("Backbuffer", nullptr, nullptr, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT, true, true);
+
+	// exposure from the last frame's luma. declared before bloom writes this frame's, on the compute queue it runs next to the
+	// g-buffer and rays of this frame and bloom waits for it.
+	if (bExposurePending)
+	{
+		const uint32_t pass = addPass("Exposure", [this](GfxCommandList* CmdList) { ExposurePass(CmdList); bExposurePending = false; }, RENDER_GRAPH_COMPUTE);
+		Graph.Read(pass, luma, NON_PIXEL);
+		Graph.Write(pass, histogram, UAV);
+		Graph.Modify(pass, exposure, UAV);
+	}
+
+	{
+		const uint32_t pass = addPass("GBuffer", [this](GfxCommandList*) { GBufferPass(); });
+		Graph.Write(pass, albedo, RT);
+		Graph.Write(pass, normal, RT);
+		Graph.Write(pass, geomNormal, RT);
+		Graph.Write(pass, velocity, RT);
+		Graph.Write(pass, roughnessMetalic, RT);
+		Graph.Write(pass, unjitteredDepth, RT);
+		Graph.Write(pass, depth, DEPTH);
+	}
+
+	{
+		const uint32_t pass = addPass("ResolvePixelVelocity", [this](GfxCommandList*) { ResolvePixelVelocityPass(); });
+		Graph.Read(pass, velocity, SRV);
+		Graph.Write(pass, pixelVelocity, RT);
+	}
+
+	{
+		const uint32_t pass = addPass("RaytraceShadow", [this](GfxCommandList*) { RaytraceShadowPass(); });
+		Graph.Read(pass, depth, SRV);
+		Graph.Read(pass, geomNormal, SRV);
+		Graph.Write(pass, shadow, UAV);
+	}
+
+	{
+		const uint32_t pass = addPass("RaytraceReflection", [this](GfxCommandList*) { RaytraceReflectionPass(); });
+		Graph.Read(pass, depth, SRV);
+		Graph.Read(pass, geomNormal, SRV);
+		Graph.Read(pass, roughnessMetalic, SRV);
+		Graph.Read(pass, normal, SRV);
+		Graph.Write(pass, specularRaw, UAV);
+	}
+
+	{
+		const uint32_t pass = addPass("RaytraceGI", [this](GfxCommandList*) { RaytraceGIPass(); });
+		Graph.Read(pass, depth, SRV);
+		Graph.Read(pass, normal, SRV);
+		Graph.Write(pass, diffuseRaw, UAV);
+	}
+
+#if USE_RTXGI
+	{
+		const uint32_t pass = addPass("RTXGI", [this](GfxCommandList*) { RTXGIPass(); });
+		Graph.Modify(pass, probes, UAV);
+	}
+#endif
+
+	// the denoisers filter the diffuse gi only when it is path traced, with rtxgi lighting doesn't use their diffuse result
+	if (bNRD)
+	{
+		const uint32_t pass = addPass("NRD", [this](GfxCommandList*) { NRDPass(); });
+		Graph.Read(pass, normal, SRV);
+		Graph.Read(pass, roughnessMetalic, SRV);
+		Graph.Read(pass, depth, SRV);
+		Graph.Read(pass, velocity, SRV);
+		Graph.Read(pass, specularRaw, SRV);
+		if (bPathTracedGI)
+			Graph.Read(pass, diffuseRaw, SRV);
+		Graph.Write(pass, nrdGuides, UAV);
+		Graph.Write(pass, nrdOutput, UAV);
+	}
+	else
+	{
+		const uint32_t temporalPass = addPass("TemporalDenoising", [this](GfxCommandList*) { TemporalDenoisingPass(); });
+		Graph.Read(temporalPass, unjitteredDepth, SRV);
+		Graph.Read(temporalPass, normal, SRV);
+		Graph.Read(temporalPass, roughnessMetalic, SRV);
+		Graph.Read(temporalPass, velocity, SRV);
+		Graph.Read(temporalPass, specularRaw, SRV);
+		if (bPathTracedGI)
+			Graph.Read(temporalPass, diffuseRaw, SRV);
+		Graph.Modify(temporalPass, giHistory, UAV);
+		Graph.Write(temporalPass, diffuseSpatial, UAV);
+
+		const uint32_t spatialPass = addPass("SpatialDenoising", [this](GfxCommandList*) { SpatialDenoisingPass(); });
+		Graph.Read(spatialPass, depth, SRV);
+		Graph.Read(spatialPass, geomNormal, SRV);
+		Graph.Modify(spatialPass, diffuseSpatial, UAV);
+		Graph.Write(spatialPass, diffuseSpatialTemp, UAV);
+	}
+
+	{
+		const uint32_t pass = addPass("Lighting", [this](GfxCommandList*) { LightingPass(); });
+		Graph.Read(pass, albedo, SRV);
+		Graph.Read(pass, normal, SRV);
+		Graph.Read(pass, shadow, SRV);
+		Graph.Read(pass, velocity, SRV);
+		Graph.Read(pass, depth, SRV);
+		Graph.Read(pass, roughnessMetalic, SRV);
+		if (bNRD)
+		{
+			Graph.Read(pass, nrdOutput, SRV);
+		}
+		else
+		{
+			Graph.Read(pass, giHistory, SRV);
+			if (bPathTracedGI)
+				Graph.Read(pass, diffuseSpatial, SRV);
+		}
+#if USE_RTXGI
+		if (!bPathTracedGI)
+			Graph.Read(pass, probes, SRV);
+#endif
+		Graph.Write(pass, lighting, RT);
+	}
+
+	{
+		const uint32_t pass = addPass("Bloom", [this](GfxCommandList*) { BloomPass(); });
+		Graph.Read(pass, lighting, SRV);
+		Graph.Read(pass, exposure, SRV);
+		Graph.Write(pass, bloomPingPong0, UAV);
+		Graph.Write(pass, bloomPingPong1, UAV);
+		Graph.Write(pass, luma, UAV);
+		Graph.Write(pass, lightingWithBloom, RT);
+	}
+
+	// with async exposure this frame's luma goes to the compute queue at the start of the next frame
+	if (!bAsyncExposure)
+	{
+		const uint32_t pass = addPass("Exposure", [this](GfxCommandList* CmdList) { ExposurePass(CmdList); });
+		Graph.Read(pass, luma, NON_PIXEL);
+		Graph.Write(pass, histogram, UAV);
+		Graph.Modify(pass, exposure, UAV);
+	}
+
+	if (AAMethod == TEMPORAL_AA || AAMethod == NO_AA)
+	{
+		const uint32_t pass = addPass("TemporalAA", [this](GfxCommandList*) { TemporalAAPass(); });
+		Graph.Read(pass, lightingWithBloom, PIXEL);
+		Graph.Read(pass, velocity, SRV);
+		Graph.Read(pass, depth, SRV);
+		if (bDrawHistogram)
+		{
+			Graph.Read(pass, histogram, NON_PIXEL);
+			Graph.Read(pass, exposure, NON_PIXEL);
+		}
+		Graph.Modify(pass, color, RT);
+	}
+#if USE_DLSS
+	else if (AAMethod == DLSS)
+	{
+		const uint32_t pass = addPass("DLSS", [this](GfxCommandList*) { DLSSPass(); });
+		Graph.Read(pass, lightingWithBloom, SRV);
+		Graph.Read(pass, pixelVelocity, SRV);
+		Graph.Read(pass, depth, SRV);
+		Graph.Write(pass, color, UAV);
+	}
+#endif
+
+	{
+		const uint32_t pass = addPass("ToneMap", [this](GfxCommandList* CmdList)
+		{
+			std::vector<GfxTexture*> Rendertargets = { framebuffers[AbstractGfxLayer::GetCurrentFrameIndex()].get() };
+			AbstractGfxLayer::SetRenderTargets(CmdList, Rendertargets.size(), Rendertargets.data(), nullptr);
+			ToneMapPass();
+		});
+		Graph.Read(pass, color, PIXEL);
+		Graph.Read(pass, exposure, PIXEL);
+		Graph.Write(pass, GraphBackbuffer, RT);
+	}
+
+	// visualizing the buffers keeps them and the passes writing them alive to the end of the frame
+	if (bDebugDraw)
+	{
+		const uint32_t pass = addPass("Debug", [this](GfxCommandList*) { DebugPass(); });
+		for (uint32_t res : { shadow, geomNormal, diffuseRaw, albedo, velocity, roughnessMetalic, specularRaw, depth, normal, unjitteredDepth, giHistory })
+			Graph.Read(pass, res, SRV);
+		Graph.Read(pass, bloomPingPong0, PIXEL);
+		Graph.Read(pass, bNRD ? nrdOutput : diffuseSpatial, SRV);
+#if USE_RTXGI
+		Graph.Read(pass, probes, SRV);
+#endif
+		Graph.Modify(pass, GraphBackbuffer, RT);
+	}
+
+	Graph.Compile(true);
+
+	LARGE_INTEGER endTime, frequency;
+	QueryPerformanceCounter(&endTime);
+	QueryPerformanceFrequency(&frequency);
+	RenderGraphCompileMs = double(endTime.QuadPart - startTime.QuadPart) * 1000.0 / double(frequency.QuadPart);
+}
+
+// only the bindings marked tracked, the denoisers Require their own targets and NRD's are hand written
+void Corona::ApplyGraphTransitions(GfxCommandList* CmdList, const vector<RenderGraphTransition>& Transitions, bool bSplit)
+{
+	for (const RenderGraphTransition& transition : Transitions)
+	{
+		const RenderGraphBinding& binding = GraphBindings[transition.Resource];
+		if (!binding.bTracked)
+			continue;
+
+		const D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATES(transition.After);
+		for (GfxTexture* tex : binding.Textures)
+		{
+			if (bSplit)
+				Prepare(CmdList, tex, state);
+			else
+				Require(CmdList, tex, state);
+		}
+		if (binding.Buf)
+		{
+			if (bSplit)
+				Prepare(CmdList, binding.Buf, state);
+			else
+				Require(CmdList, binding.Buf, state);
+		}
+	}
+
+	if (!bSplit)
+		FlushBarriers(CmdList);
+}
+
+// the compiled direct queue passes, BeginPass asserts on a pass that wasn't declared. imported resources aren't in the pool,
+// listing them is harmless. compute passes only touch imported ones.
+void Corona::DeclareTransientPasses()
+{
+	TransientTexturePool* pool = dx12_rhi->TransientTextures.get();
+	pool->BeginDeclaration();
+
+	vector<GfxTexture*> textures;
+	for (const RenderGraphStep& step : Graph.GetSteps())
+	{
+		if (step.Queue != RENDER_GRAPH_DIRECT)
+			continue;
+
+		const RenderGraphPass& pass = Graph.GetPass(step.Pass);
+		textures.clear();
+		for (const RenderGraphAccess& access : pass.Accesses)
+		{
+			const vector<GfxTexture*>& bound = GraphBindings[access.Resource].Textures;
+			textures.insert(textures.end(), bound.begin(), bound.end());
+		}
+		pool->DeclarePass(pass.Name, textures);
+	}
+}
+
+void Corona::UpdateTransientReport()
+{
+	TransientReportVersion = dx12_rhi->TransientTextures->GetLayoutVersion();
+	TransientReport.clear();
+
+	struct ReportSize
+	{
+		UINT Width;
+		UINT Height;
+	};
+	const ReportSize sizes[] = { { RenderWidth, RenderHeight }, { 1920, 1080 }, { 3840, 2160 } };
+
+	for (auto& size : sizes)
+	{
+		TransientTextureStats stats = dx12_rhi->TransientTextures->Estimate(float(size.Width) / float(RenderWidth));
+
+		char line[128];
+		snprintf(line, sizeof(line), "%ux%u : %llu MB -> %llu MB aliased", size.Width, size.Height,
+			stats.UnaliasedBytes / (1024 * 1024), stats.AliasedBytes / (1024 * 1024));
+		TransientReport.push_back(line);
+
+		OutputDebugStringA(("transient targets " + string(line) + "\n").c_str());
+	}
+}
+
+void Corona::UpdateLoadTimings()
+{
+	if (TimeToResident != 0)
+		return;
+
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	const double seconds = double(now.QuadPart - LoadStartTime.QuadPart) / double(frequency.QuadPart);
+
+	if (TimeToFirstFrame == 0)
+		TimeToFirstFrame = seconds;
+
+	if (!Streamer.IsIdle())
+		return;
+
+	TimeToResident = seconds;
+
+	UploadRingStats uploadStats = dx12_rhi->Uploads->GetStats();
+
+	stringstream ss;
+	ss << (m_syncTextures ? "sync" : "streamed") << " textures : first frame " << TimeToFirstFrame * 1000.0 << " ms, fully resident "
+		<< TimeToResident * 1000.0 << " ms, " << TexCache.GetStatsSnapshot().NumMisses << " loaded, " << Streamer.GetNumFailed() << " failed, "
+		<< uploadStats.NumSubmissions << " upload submissions, " << uploadStats.NumStalls << " upload stalls\n";
+	OutputDebugStringA(ss.str().c_str());
+
+	// -streambench runs the load once and leaves the numbers next to the executable
+	if (m_streamBench)
+	{
+		ofstream file("streambench.txt", ios::app);
+		file << ss.str();
+		PostQuitMessage(0);
+	}
+}
+
+void Corona::UpdateDrawBench(double FrameMs)
+{
+	if (!m_drawBench || !Streamer.IsIdle())
+		return;
+
+	if (DrawBenchStep < 0)
+	{
+		// everything is loaded, start on the global list
+		DrawBenchStep = 0;
+		DrawBenchFrame = 0;
+		bMultiThreadRendering = false;
+		return;
+	}
+
+	// the first frames of a step grow the command list pools and constant buffer chunks
+	DrawBenchFrame++;
+	if (DrawBenchFrame <= DrawBenchWarmupFrames)
+	{
+		DrawBenchGBufferMs = 0;
+		DrawBenchFrameMs = 0;
+		return;
+	}
+
+	DrawBenchGBufferMs += GBufferCpuMs;
+	DrawBenchFrameMs += FrameMs;
+	if (DrawBenchFrame < DrawBenchWarmupFrames + DrawBenchFrames)
+		return;
+
+	stringstream ss;
+	ss << "g-buffer " << GBufferDraws.size() << " draws, " << (DrawBenchStep == 0 ? string("global list") : to_string(DrawBenchStep) + " threads")
+		<< " : GBufferPass " << DrawBenchGBufferMs / DrawBenchFrames << " ms cpu, frame " << DrawBenchFrameMs / DrawBenchFrames << " ms\n";
+	OutputDebugStringA(ss.str().c_str());
+	DrawBenchReport += ss.str();
+
+	if (DrawBenchStep == int(g_TS.GetNumTaskThreads()))
+	{
+		ofstream file("drawbench.txt", ios::app);
+		file << DrawBenchReport;
+		PostQuitMessage(0);
+		return;
+	}
+
+	DrawBenchStep++;
+	DrawBenchFrame = 0;
+	bMultiThreadRendering = true;
+	GBufferThreads = DrawBenchStep;
+}
+
+void Corona::UpdateBarrierBench()
+{
+	if (!m_barrierBench || !Streamer.IsIdle())
+		return;
+
+	if (BarrierBenchStep < 0)
+	{
+		BarrierBenchStep = 0;
+		BarrierBenchFrame = 0;
+		dx12_rhi->bBatchBarriers = false;
+		return;
+	}
+
+	// FrameBarriers is of the frame before, the first ones are still of the other step
+	BarrierBenchFrame++;
+	if (BarrierBenchFrame <= BarrierBenchWarmupFrames)
+	{
+		BarrierBenchTotal = BarrierStats();
+		return;
+	}
+
+	BarrierBenchTotal += dx12_rhi->FrameBarriers;
+	if (BarrierBenchFrame < BarrierBenchWarmupFrames + BarrierBenchFrames)
+		return;
+
+	stringstream ss;
+	ss << (BarrierBenchStep == 0 ? "not batched" : "batched") << " : " << BarrierBenchTotal.NumRequired / BarrierBenchFrames << " required, "
+		<< BarrierBenchTotal.NumBarriers / BarrierBenchFrames << " made(" << BarrierBenchTotal.NumSplit / BarrierBenchFrames << " split) in "
+		<< BarrierBenchTotal.NumCalls / BarrierBenchFrames << " calls a frame\n";
+	OutputDebugStringA(ss.str().c_str());
+	BarrierBenchReport += ss.str();
+
+	if (BarrierBenchStep == 1)
+	{
+		ofstream file("barrierbench.txt", ios::app);
+		file << BarrierBenchReport;
+		PostQuitMessage(0);
+		return;
+	}
+
+	BarrierBenchStep++;
+	BarrierBenchFrame = 0;
+	dx12_rhi->bBatchBarriers = true;
+}
+
 void Corona::OnDestroy()
 {
+	Streamer.Shutdown();
+
 	AbstractGfxLayer::WaitGPUFlush();
 
 #if USE_IMGUI
@@ -3550,9 +4128,9 @@ void Corona::OnKeyDown(UINT8 key)
 {
 	switch (key)
 	{
-	/*case 'M':
+	case 'M':
 		bMultiThreadRendering = !bMultiThreadRendering;
-		break;*/
+		break;
 	case 'B':
 		bDebugDraw = !bDebugDraw;
 		break;
@@ -3591,210 +4169,346 @@ void Corona::OnKeyUp(UINT8 key)
 	m_camera.OnKeyUp(key);
 }
 
+// records GBufferDraws split evenly over m_SetSize command lists, one per set index. each list comes from the pool of the
+// thread recording it and sets all of its state, the main thread submits them in order after the wait.
 struct ParallelDrawTaskSet : enki::ITaskSet
 {
 	Corona* app;
-	UINT StartIndex;
-	UINT ThisDraw;
-	UINT ThreadIndex;
-	//ThreadDescriptorHeapPool* DHPool;
+	vector<CommandList*> Lists;
+	vector<UINT> NumTriangles;
 
-	ParallelDrawTaskSet(){}
-	ParallelDrawTaskSet(ParallelDrawTaskSet &&) {}
-	ParallelDrawTaskSet(const ParallelDrawTaskSet&) = delete;
+	ParallelDrawTaskSet(Corona* InApp, UINT NumLists) : enki::ITaskSet(NumLists), app(InApp), Lists(NumLists), NumTriangles(NumLists) {}
 
 	virtual void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum)
 	{
-		//app->RecordDraw(StartIndex, ThisDraw, ThreadIndex, const_cast<ThreadDescriptorHeapPool*>(DHPool));
+		const UINT numDraws = UINT(app->GBufferDraws.size());
+		for (uint32_t i = range.start; i < range.end; i++)
+		{
+			CommandList* cmd = dx12_rhi->CmdQ->AllocCmdList();
+			app->SetGBufferState(cmd);
+			NumTriangles[i] = app->DrawGBuffer(cmd, numDraws * i / m_SetSize, numDraws * (i + 1) / m_SetSize);
+			Lists[i] = cmd;
+		}
 	}
 };
 
-void Corona::DrawScene(shared_ptr<Scene> scene, float Roughness, float Metalic, bool bOverrideRoughnessMetallic)
+UINT Corona::SelectMeshLod(const GfxMesh* Mesh, const MeshExtra& Extra)
 {
-	for (auto& mesh : scene->meshes)
-	{
-		AbstractGfxLayer::SetIndexBuffer(AbstractGfxLayer::GetGlobalCommandList(), mesh->Ib.get());
-		AbstractGfxLayer::SetVertexBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, 1, mesh->Vb.get());
+	if (!bMeshLod || Extra.Lods.size() < 2)
+		return 0;
 
-		for (int i = 0; i < mesh->Draws.size(); i++)
-		{
-			GfxMesh::DrawCall& drawcall = mesh->Draws[i];
-			GBufferConstantBuffer objCB;
-			int sizea = sizeof(GBufferConstantBuffer);
+	const glm::mat4& m = Mesh->transform;
+	float scale = glm::max(glm::max(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1]))), glm::length(glm::vec3(m[2])));
+	glm::vec3 center = glm::vec3(m * glm::vec4(Extra.Center, 1));
+	float radius = Extra.Radius * scale;
 
-			objCB.ViewProjectionMatrix = glm::transpose(ViewProjMat);
-			objCB.PrevViewProjectionMatrix = glm::transpose(PrevViewProjMat);
+	// camera in or close to the bounds, sphere projection doesn't hold there.
+	float distance = glm::length(center - m_camera.m_position);
+	if (distance - radius < Near || radius == 0)
+		return 0;
 
-			//glm::mat4 m; // Identity matrix
-			objCB.WorldMatrix = glm::transpose(mesh->transform);
+	// projected bounding sphere radius in pixels. each LOD's error is a fraction of that.
+	float projectedRadius = radius / (distance * glm::tan(Fov * 0.5f)) * RenderHeight * 0.5f;
 
-			objCB.UnjitteredViewProjMat = glm::transpose(UnjitteredViewProjMat);
-			objCB.PrevUnjitteredViewProjMat = glm::transpose(PrevUnjitteredViewProjMat);
-			objCB.ViewDir.x = m_camera.m_lookDirection.x;
-			objCB.ViewDir.y = m_camera.m_lookDirection.y;
-			objCB.ViewDir.z = m_camera.m_lookDirection.z;
+	UINT lod = 0;
+	for (UINT i = 1; i < Extra.Lods.size(); i++)
+	{
+		if (Extra.Lods[i].Error * scale / radius * projectedRadius > MeshLodPixelError || Extra.Lods[i].Error * scale > MeshLodMaxWorldError)
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+void Corona::RegisterMaterials(shared_ptr<Scene> scene)
+{
+	for (auto& mat : scene->Materials)
+	{
+		if (MaterialIndices.find(mat.get()) != MaterialIndices.end())
+			continue;
 
-			objCB.RTSize.x = RenderWidth;
-			objCB.RTSize.y = RenderHeight;
+		MaterialIndices[mat.get()] = BindlessMaterials.size();
+		BindlessMaterials.push_back(mat);
+	}
+}
 
-			objCB.RougnessMetalic.x = Roughness;
-			objCB.RougnessMetalic.y = Metalic;
+void Corona::UpdateMaterialBuffer()
+{
+	// heap index of the texture's static SRV. materials always have a texture(defaults until streamed), the check is for one without SRV yet.
+	auto GetTextureIndex = [](const shared_ptr<GfxTexture>& Tex, const shared_ptr<GfxTexture>& DefaultTex)
+	{
+		Texture* tex = static_cast<Texture*>(Tex.get());
+		if (!tex || !tex->SRV.Handle.IsValid())
+			tex = static_cast<Texture*>(DefaultTex.get());
+		return tex->SRV.Handle.Index;
+	};
 
-			objCB.bOverrideRougnessMetallic = bOverrideRoughnessMetallic ? 1 : 0;
+	vector<glm::uvec4> textureIds;
+	textureIds.reserve(BindlessMaterials.size());
+	for (auto& mat : BindlessMaterials)
+	{
+		textureIds.push_back(glm::uvec4(
+			GetTextureIndex(mat->Diffuse, DefaultWhiteTex),
+			GetTextureIndex(mat->Normal, DefaultNormalTex),
+			GetTextureIndex(mat->Roughness, DefaultRougnessTex),
+			GetTextureIndex(mat->Metallic, DefaultBlackTex)));
+	}
 
-			AbstractGfxLayer::SetUniformValue(GBufferPassPSO.get(), "GBufferConstantBuffer", &objCB, AbstractGfxLayer::GetGlobalCommandList());
+	if (MaterialBuffer && textureIds == MaterialTextureIds)
+		return;
 
-			GfxTexture* AlbedoTex = drawcall.mat->Diffuse.get();
-			if (AlbedoTex)
-				AbstractGfxLayer::SetReadTexture(GBufferPassPSO.get(), "AlbedoTex", AlbedoTex, AbstractGfxLayer::GetGlobalCommandList());
+	MaterialTextureIds = textureIds;
+	if (textureIds.empty())
+		textureIds.push_back(glm::uvec4(0));
 
+	// frames in flight may still read the old one, so a new buffer instead of writing over it. it changes only while textures stream in.
+	dx12_rhi->DeferRelease(MaterialBuffer);
 
-			GfxTexture* NormalTex = drawcall.mat->Normal.get();
-			if (NormalTex)
-				AbstractGfxLayer::SetReadTexture(GBufferPassPSO.get(), "NormalTex", NormalTex, AbstractGfxLayer::GetGlobalCommandList());
+	Buffer* buffer = dx12_rhi->CreateBuffer(textureIds.size(), sizeof(glm::uvec4), D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_NONE, textureIds.data());
+	buffer->MakeStructuredBufferSRV();
+	MaterialBuffer = shared_ptr<GfxBuffer>(buffer);
+	NAME_BUFFER(MaterialBuffer);
+}
 
+#if USE_BINDLESS_MATERIALS
+void Corona::BindBindlessMaterials(GfxRTPipelineStateObject* PSO)
+{
+	RTPipelineStateObject* rtPSO = static_cast<RTPipelineStateObject*>(PSO);
+	rtPSO->BindSRV("global", "BindlessTextures", 0, UINT_MAX, BINDLESS_TEXTURE_SPACE);
+	rtPSO->BindSRV("global", "Materials", 0, 1, MATERIAL_BUFFER_SPACE);
+}
 
-			GfxTexture* RoughnessTex = drawcall.mat->Roughness.get();
-			if (RoughnessTex)
-				AbstractGfxLayer::SetReadTexture(GBufferPassPSO.get(), "RoughnessTex", RoughnessTex, AbstractGfxLayer::GetGlobalCommandList());
+void Corona::SetBindlessMaterials(GfxRTPipelineStateObject* PSO)
+{
+	RTPipelineStateObject* rtPSO = static_cast<RTPipelineStateObject*>(PSO);
+	rtPSO->SetSRV("global", "BindlessTextures", dx12_rhi->GetBindlessTable());
+	rtPSO->SetSRV("global", "Materials", static_cast<Buffer*>(MaterialBuffer.get())->SRV.GpuHandle);
+}
+#endif
 
-			GfxTexture* MetallicTex = drawcall.mat->Metallic.get();
-			if (MetallicTex)
-				AbstractGfxLayer::SetReadTexture(GBufferPassPSO.get(), "MetallicTex", MetallicTex, AbstractGfxLayer::GetGlobalCommandList());
+void Corona::AddSceneDraws(shared_ptr<Scene> scene, float Roughness, float Metalic, bool bOverrideRoughnessMetallic)
+{
+	// every scene comes from LoadModel, which fills its extras
+	auto extrasIt = MeshExtras.find(scene.get());
+	assert(extrasIt != MeshExtras.end() && extrasIt->second.size() == scene->meshes.size());
+	if (extrasIt == MeshExtras.end() || extrasIt->second.size() != scene->meshes.size())
+		return;
 
+	for (size_t m = 0; m < scene->meshes.size(); m++)
+	{
+		const shared_ptr<GfxMesh>& mesh = scene->meshes[m];
+		const MeshExtra& extra = extrasIt->second[m];
+		const UINT lod = mesh->Draws.size() == 1 ? SelectMeshLod(mesh.get(), extra) : 0;
 
-			//AbstractGfxLayer::GetGlobalCommandList()->CmdList->DrawIndexedInstanced(drawcall.IndexCount, 1, drawcall.IndexStart, drawcall.VertexBase, 0);
-			AbstractGfxLayer::DrawIndexedInstanced(AbstractGfxLayer::GetGlobalCommandList(), drawcall.IndexCount, 1, drawcall.IndexStart, drawcall.VertexBase, 0);
+		for (int i = 0; i < mesh->Draws.size(); i++)
+		{
+			GBufferDraw draw;
+			draw.Mesh = mesh.get();
+			draw.Extra = &extra;
+			draw.DrawIndex = i;
+			draw.Lod = lod;
+			auto materialIt = MaterialIndices.find(mesh->Draws[i].mat.get());
+			draw.MaterialIndex = materialIt != MaterialIndices.end() ? materialIt->second : 0;
+			draw.Roughness = Roughness;
+			draw.Metalic = Metalic;
+			draw.bOverrideRoughnessMetallic = bOverrideRoughnessMetallic;
+			GBufferDraws.push_back(draw);
 		}
 	}
 }
 
-void Corona::GBufferPass()
+void Corona::SetGBufferState(GfxCommandList* CmdList)
 {
-	ColorBufferWriteIndex = 1 - ColorBufferWriteIndex;
-	//DepthBufferWriteIndex = 1 - DepthBufferWriteIndex;
-#if USE_AFTERMATH
-	NVAftermathMarker(dx12_rhi->AM_CL_Handle, "GBufferPass");
+	AbstractGfxLayer::SetDescriptorHeap(CmdList);
+
+	ViewPort viewPort = { 0.0f, 0.0f, static_cast<float>(RenderWidth), static_cast<float>(RenderHeight), 0, 1};
+	AbstractGfxLayer::SetViewports(CmdList, 1, &viewPort);
+
+	AbstractGfxLayer::SetScissorRects(CmdList, 1, &m_scissorRect);
+	AbstractGfxLayer::SetPrimitiveTopology(CmdList, PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	
+	std::vector<GfxTexture*> Rendertarget = { AlbedoBuffer.get(), NormalBuffers[ColorBufferWriteIndex].get(),
+		GeomNormalBuffer.get(), VelocityBuffer.get(), RoughnessMetalicBuffer.get(),
+		UnjitteredDepthBuffers[ColorBufferWriteIndex].get()};
+	AbstractGfxLayer::SetRenderTargets(CmdList, Rendertarget.size(), Rendertarget.data(), DepthBuffer.get());
+
+	AbstractGfxLayer::SetPSO(GBufferPassPSO.get(), CmdList);
+
+	// runs on the parallel draw workers too, slots keep them from touching the shared pso
+	PipelineStateObject* pso = static_cast<PipelineStateObject*>(GBufferPassPSO.get());
+	ID3D12GraphicsCommandList* cmdList = static_cast<CommandList*>(CmdList)->CmdList.Get();
+	pso->SetSampler(GBufferSlots.SamplerWrap, static_cast<Sampler*>(samplerAnisoWrap.get()), cmdList);
+
+#if USE_BINDLESS_MATERIALS
+	// textures of every material at once, draws only change the material index in their constant buffer
+	pso->SetSRV(GBufferSlots.BindlessTextures, dx12_rhi->GetBindlessTable(), cmdList);
+	pso->SetSRV(GBufferSlots.Materials, static_cast<Buffer*>(MaterialBuffer.get())->SRV.GpuHandle, cmdList);
 #endif
-	ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "GBufferPass");
+}
 
+UINT Corona::DrawGBuffer(GfxCommandList* CmdList, UINT Begin, UINT End)
+{
+	// meshes share scene wide buffers, so only rebind when they actually change.
+	GfxIndexBuffer* boundIb = nullptr;
+	GfxVertexBuffer* boundVb = nullptr;
+	UINT numTriangles = 0;
+
+	PipelineStateObject* pso = static_cast<PipelineStateObject*>(GBufferPassPSO.get());
+	ID3D12GraphicsCommandList* cmdList = static_cast<CommandList*>(CmdList)->CmdList.Get();
+
+	for (UINT d = Begin; d < End; d++)
 	{
-		std::array<ResourceTransition, 7> Transition = { {
-		{AlbedoBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		{NormalBuffers[ColorBufferWriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		{GeomNormalBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		{VelocityBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		{RoughnessMetalicBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET},
-		{DepthBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE},
-		{UnjitteredDepthBuffers[ColorBufferWriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET}
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+		const GBufferDraw& draw = GBufferDraws[d];
+		const GfxMesh* mesh = draw.Mesh;
+		const MeshExtra& extra = *draw.Extra;
 
-	float clearColor[] = { 0.0f, 0.2f, 0.4f, 1.0f };
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), AlbedoBuffer.get(), clearColor, 0, nullptr);
+		if (mesh->Ib.get() != boundIb)
+		{
+			AbstractGfxLayer::SetIndexBuffer(CmdList, mesh->Ib.get());
+			boundIb = mesh->Ib.get();
+		}
+		if (mesh->Vb.get() != boundVb)
+		{
+			AbstractGfxLayer::SetVertexBuffer(CmdList, 0, 1, mesh->Vb.get());
+			boundVb = mesh->Vb.get();
+		}
 
-	float normalClearColor[] = { 0.0f, -0.1f, 0.0f, 0.0f };
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), NormalBuffers[ColorBufferWriteIndex].get(), normalClearColor, 0, nullptr);
+		const GfxMesh::DrawCall& drawcall = mesh->Draws[draw.DrawIndex];
+		GBufferConstantBuffer objCB;
 
+		objCB.ViewProjectionMatrix = glm::transpose(ViewProjMat);
+		objCB.PrevViewProjectionMatrix = glm::transpose(PrevViewProjMat);
 
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), GeomNormalBuffer.get(), normalClearColor, 0, nullptr);
+		//glm::mat4 m; // Identity matrix
+		objCB.WorldMatrix = glm::transpose(mesh->transform);
 
-	float velocityClearColor[] = { 0.0f, 0.0f, 0.0f, 0.0f};
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), VelocityBuffer.get(), velocityClearColor, 0, nullptr);
+		objCB.UnjitteredViewProjMat = glm::transpose(UnjitteredViewProjMat);
+		objCB.PrevUnjitteredViewProjMat = glm::transpose(PrevUnjitteredViewProjMat);
+		objCB.ViewDir.x = m_camera.m_lookDirection.x;
+		objCB.ViewDir.y = m_camera.m_lookDirection.y;
+		objCB.ViewDir.z = m_camera.m_lookDirection.z;
 
-	float roughnessClearColor[] = { 0.001f, 0.0f, 0.0f, 0.0f };
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), RoughnessMetalicBuffer.get(), roughnessClearColor, 0, nullptr);
+		objCB.RTSize.x = RenderWidth;
+		objCB.RTSize.y = RenderHeight;
 
-	float ujitteredDepthClearColor[] = { 1.0f, 1.0f, 1.0f, 1.0f};
-	AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), UnjitteredDepthBuffers[ColorBufferWriteIndex].get(), ujitteredDepthClearColor, 0, nullptr);
+		objCB.RougnessMetalic.x = draw.Roughness;
+		objCB.RougnessMetalic.y = draw.Metalic;
 
-	AbstractGfxLayer::ClearDepthStencil(AbstractGfxLayer::GetGlobalCommandList(), DepthBuffer.get(), CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+		objCB.bOverrideRougnessMetallic = draw.bOverrideRoughnessMetallic ? 1 : 0;
+		objCB.MaterialIndex = draw.MaterialIndex;
 
-	AbstractGfxLayer::SetDescriptorHeap(AbstractGfxLayer::GetGlobalCommandList());
+		const PositionQuantization& quantization = extra.Quantization;
+		objCB.PositionScale = quantization.Scale;
+		objCB.PositionBias = quantization.Bias;
 
-	ViewPort viewPort = { 0.0f, 0.0f, static_cast<float>(RenderWidth), static_cast<float>(RenderHeight), 0, 1};
-	AbstractGfxLayer::SetViewports(AbstractGfxLayer::GetGlobalCommandList(), 1, &viewPort);
+		pso->SetCBVValue(GBufferSlots.ConstantBuffer, &objCB, cmdList);
 
-	AbstractGfxLayer::SetScissorRects(AbstractGfxLayer::GetGlobalCommandList(), 1, &m_scissorRect);
-	AbstractGfxLayer::SetPrimitiveTopology(AbstractGfxLayer::GetGlobalCommandList(), PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	
-	std::vector<GfxTexture*> Rendertarget = { AlbedoBuffer.get(), NormalBuffers[ColorBufferWriteIndex].get(),
-		GeomNormalBuffer.get(), VelocityBuffer.get(), RoughnessMetalicBuffer.get(),
-		UnjitteredDepthBuffers[ColorBufferWriteIndex].get()};
-	AbstractGfxLayer::SetRenderTargets(AbstractGfxLayer::GetGlobalCommandList(), Rendertarget.size(), Rendertarget.data(), DepthBuffer.get());
+#if !USE_BINDLESS_MATERIALS
+		GfxTexture* AlbedoTex = drawcall.mat->Diffuse.get();
+		if (AlbedoTex)
+			pso->SetSRV(GBufferSlots.AlbedoTex, static_cast<Texture*>(AlbedoTex)->SRV.GpuHandle, cmdList);
 
-	AbstractGfxLayer::SetPSO(GBufferPassPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
-	AbstractGfxLayer::SetSampler("samplerWrap", AbstractGfxLayer::GetGlobalCommandList(), GBufferPassPSO.get(), samplerAnisoWrap.get());
+		GfxTexture* NormalTex = drawcall.mat->Normal.get();
+		if (NormalTex)
+			pso->SetSRV(GBufferSlots.NormalTex, static_cast<Texture*>(NormalTex)->SRV.GpuHandle, cmdList);
 
-	if (!bMultiThreadRendering)
-	{
 
-		
-		DrawScene(Sponza, SponzaRoughnessMultiplier, 0, false);
-		DrawScene(ShaderBall, ShaderBallRoughnessMultiplier, 1, true);
+		GfxTexture* RoughnessTex = drawcall.mat->Roughness.get();
+		if (RoughnessTex)
+			pso->SetSRV(GBufferSlots.RoughnessTex, static_cast<Texture*>(RoughnessTex)->SRV.GpuHandle, cmdList);
+
+		GfxTexture* MetallicTex = drawcall.mat->Metallic.get();
+		if (MetallicTex)
+			pso->SetSRV(GBufferSlots.MetallicTex, static_cast<Texture*>(MetallicTex)->SRV.GpuHandle, cmdList);
+#endif
+
+
+		// LODs index the same vertices, only the index range changes.
+		UINT indexCount = draw.Lod > 0 ? extra.Lods[draw.Lod].IndexCount : drawcall.IndexCount;
+		UINT indexStart = draw.Lod > 0 ? extra.Lods[draw.Lod].IndexStart : drawcall.IndexStart;
+		numTriangles += indexCount / 3;
+
+		//AbstractGfxLayer::GetGlobalCommandList()->CmdList->DrawIndexedInstanced(drawcall.IndexCount, 1, drawcall.IndexStart, drawcall.VertexBase, 0);
+		AbstractGfxLayer::DrawIndexedInstanced(CmdList, indexCount, 1, indexStart, drawcall.VertexBase, 0);
 	}
-	else
-	{
-		//UINT NumThread = dx12_rhi->NumDrawMeshCommandList;
-		//UINT RemainDraw = mesh->Draws.size();
-		//UINT NumDrawThread = mesh->Draws.size() / (NumThread);
-		//UINT StartIndex = 0;
 
-		//vector<ThreadDescriptorHeapPool> vecDHPool;
-		//vecDHPool.resize(NumThread);
+	return numTriangles;
+}
 
-		//vector<ParallelDrawTaskSet> vecTask;
-		//vecTask.resize(NumThread);
+void Corona::GBufferPass()
+{
+	LARGE_INTEGER startTime;
+	QueryPerformanceCounter(&startTime);
 
-		//for (int i = 0; i < NumThread; i++)
-		//{
-		//	UINT ThisDraw = NumDrawThread;
-		//	
-		//	if (i == NumThread - 1)
-		//		ThisDraw = RemainDraw;
+	NumGBufferTriangles = 0;
+	//DepthBufferWriteIndex = 1 - DepthBufferWriteIndex;
 
-		//	ThreadDescriptorHeapPool& DHPool = vecDHPool[i];
-		//	DHPool.AllocPool(RS_Mesh->GetGraphicsBindingDHSize()*ThisDraw);
+	GBufferDraws.clear();
+	AddSceneDraws(Sponza, SponzaRoughnessMultiplier, 0, false);
+	AddSceneDraws(ShaderBall, ShaderBallRoughnessMultiplier, 1, true);
 
-		//	// draw
-		//	ParallelDrawTaskSet& task = vecTask[i];
-		//	task.app = this;
-		//	task.StartIndex = StartIndex;
-		//	task.ThisDraw = ThisDraw;
-		//	task.ThreadIndex = i;
-		//	task.DHPool = &DHPool;
+	// -drawbench draws the scene over and over up to DrawBenchDraws
+	if (DrawBenchStep >= 0 && !GBufferDraws.empty())
+	{
+		const size_t numSceneDraws = GBufferDraws.size();
+		for (size_t i = numSceneDraws; i < DrawBenchDraws; i++)
+			GBufferDraws.push_back(GBufferDraws[i % numSceneDraws]);
+	}
 
-		//	g_TS.AddTaskSetToPipe(&task);
+	{
+#if USE_AFTERMATH
+		NVAftermathMarker(dx12_rhi->AM_CL_Handle, "GBufferPass");
+#endif
+		// the global list is submitted in the middle of the pass when it's multithreaded, so the scope only covers the clears then
+		ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "GBufferPass");
 
-		//	RemainDraw -= ThisDraw;
-		//	StartIndex += ThisDraw;
-		//}
+		float clearColor[] = { 0.0f, 0.2f, 0.4f, 1.0f };
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), AlbedoBuffer.get(), clearColor, 0, nullptr);
 
-		//g_TS.WaitforAll();
+		float normalClearColor[] = { 0.0f, -0.1f, 0.0f, 0.0f };
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), NormalBuffers[ColorBufferWriteIndex].get(), normalClearColor, 0, nullptr);
 
 
-		//UINT NumCL = dx12_rhi->NumDrawMeshCommandList;
-		//vector< ID3D12CommandList*> vecCL;
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), GeomNormalBuffer.get(), normalClearColor, 0, nullptr);
 
-		//for (int i = 0; i < NumCL; i++)
-		//	vecCL.push_back(dx12_rhi->DrawMeshCommandList[i].Get());
+		float velocityClearColor[] = { 0.0f, 0.0f, 0.0f, 0.0f};
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), VelocityBuffer.get(), velocityClearColor, 0, nullptr);
 
+		float roughnessClearColor[] = { 0.001f, 0.0f, 0.0f, 0.0f };
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), RoughnessMetalicBuffer.get(), roughnessClearColor, 0, nullptr);
+
+		float ujitteredDepthClearColor[] = { 1.0f, 1.0f, 1.0f, 1.0f};
+		AbstractGfxLayer::ClearRenderTarget(AbstractGfxLayer::GetGlobalCommandList(), UnjitteredDepthBuffers[ColorBufferWriteIndex].get(), ujitteredDepthClearColor, 0, nullptr);
+
+		AbstractGfxLayer::ClearDepthStencil(AbstractGfxLayer::GetGlobalCommandList(), DepthBuffer.get(), CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+
+		if (!bMultiThreadRendering)
+		{
+			SetGBufferState(AbstractGfxLayer::GetGlobalCommandList());
+			NumGBufferTriangles = DrawGBuffer(AbstractGfxLayer::GetGlobalCommandList(), 0, UINT(GBufferDraws.size()));
+		}
 	}
-	
+
+	if (bMultiThreadRendering)
 	{
-		std::array<ResourceTransition, 7> Transition = { {
-		{AlbedoBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{NormalBuffers[ColorBufferWriteIndex].get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{GeomNormalBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{VelocityBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{RoughnessMetalicBuffer.get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{DepthBuffer.get(), RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		{UnjitteredDepthBuffers[ColorBufferWriteIndex].get(), RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
+		const UINT numLists = UINT(glm::clamp(GBufferThreads, 1, int(g_TS.GetNumTaskThreads())));
+
+		ParallelDrawTaskSet task(this, numLists);
+		g_TS.AddTaskSetToPipe(&task);
+		g_TS.WaitforTask(&task);
+
+		// clears and everything before on the global list, then the draws in order
+		dx12_rhi->InsertCommandLists(task.Lists);
+
+		for (UINT numTriangles : task.NumTriangles)
+			NumGBufferTriangles += numTriangles;
 	}
+
+	LARGE_INTEGER endTime, frequency;
+	QueryPerformanceCounter(&endTime);
+	QueryPerformanceFrequency(&frequency);
+	GBufferCpuMs = double(endTime.QuadPart - startTime.QuadPart) * 1000.0 / double(frequency.QuadPart);
 }
 
 void Corona::SpatialDenoisingPass()
@@ -3811,13 +4525,12 @@ void Corona::SpatialDenoisingPass()
 		WriteIndex = 1 - WriteIndex; // 1
 		ReadIndex = 1 - WriteIndex; // 0
 
-		{
-			std::array<ResourceTransition, 2> Transition = { {
-				{DiffuseGISHSpatial[WriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-				{DiffuseGICoCgSpatial[WriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS}
-			} };
-			AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-		}
+		// the last iteration's result goes back to read in the same call
+		Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGISHSpatial[ReadIndex].get(), SRV_STATE);
+		Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGICoCgSpatial[ReadIndex].get(), SRV_STATE);
+		Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGISHSpatial[WriteIndex].get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGICoCgSpatial[WriteIndex].get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 		AbstractGfxLayer::SetPSO(SpatialDenoisingFilterPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
@@ -3837,15 +4550,10 @@ void Corona::SpatialDenoisingPass()
 		UINT HeightGI = RenderHeight / GIBufferScale;
 
 		AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), WidthGI / 32, HeightGI / 32 + 1, 1);
-
-		{
-			std::array<ResourceTransition, 2> Transition = { {
-				{DiffuseGISHSpatial[WriteIndex].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-				{DiffuseGICoCgSpatial[WriteIndex].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE}
-			} };
-			AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-		}
 	}
+
+	Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGISHSpatial[WriteIndex].get(), SRV_STATE);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), DiffuseGICoCgSpatial[WriteIndex].get(), SRV_STATE);
 }
 
 void Corona::TemporalDenoisingPass()
@@ -3862,16 +4570,13 @@ void Corona::TemporalDenoisingPass()
 	UINT ReadIndex = 1 - WriteIndex;
 
 	// first pass
-	{
-		std::array<ResourceTransition, 5> Transition = { {
-		{DiffuseGISHSpatial[0].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		{DiffuseGICoCgSpatial[0].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		{DiffuseGISHTemporal[WriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		{DiffuseGICoCgTemporal[WriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		{SpeculaGIBufferTemporal[WriteIndex].get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS}
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	for (GfxTexture* tex : { DiffuseGISHSpatial[0].get(), DiffuseGICoCgSpatial[0].get(), DiffuseGISHTemporal[WriteIndex].get(),
+		DiffuseGICoCgTemporal[WriteIndex].get(), SpeculaGIBufferTemporal[WriteIndex].get() })
+		Require(AbstractGfxLayer::GetGlobalCommandList(), tex, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	// last frame's g-buffer isn't in the graph
+	Require(AbstractGfxLayer::GetGlobalCommandList(), UnjitteredDepthBuffers[1 - ColorBufferWriteIndex].get(), SRV_STATE);
+	Require(AbstractGfxLayer::GetGlobalCommandList(), NormalBuffers[1 - ColorBufferWriteIndex].get(), SRV_STATE);
+	FlushBarriers(AbstractGfxLayer::GetGlobalCommandList());
 
 	AbstractGfxLayer::SetPSO(TemporalDenoisingFilterPSO.get(), AbstractGfxLayer::GetGlobalCommandList());
 
@@ -3902,16 +4607,9 @@ void Corona::TemporalDenoisingPass()
 
 	AbstractGfxLayer::Dispatch(AbstractGfxLayer::GetGlobalCommandList(), RenderWidth / 15, RenderHeight / 15, 1);
 
-	{
-		std::array<ResourceTransition, 5> Transition = { {
-			{DiffuseGISHSpatial[0].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{DiffuseGICoCgSpatial[0].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{DiffuseGISHTemporal[WriteIndex].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{DiffuseGICoCgTemporal[WriteIndex].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{SpeculaGIBufferTemporal[WriteIndex].get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
+	for (GfxTexture* tex : { DiffuseGISHSpatial[0].get(), DiffuseGICoCgSpatial[0].get(), DiffuseGISHTemporal[WriteIndex].get(),
+		DiffuseGICoCgTemporal[WriteIndex].get(), SpeculaGIBufferTemporal[WriteIndex].get() })
+		Require(AbstractGfxLayer::GetGlobalCommandList(), tex, SRV_STATE);
 }
 
 #if USE_NRD
@@ -4146,15 +4844,25 @@ void Corona::NRDPass()
 #endif USE_NRD
 
 
-void AddMeshToVec(vector<shared_ptr<GfxRTAS>>& vecBLAS, shared_ptr<Scene> scene)
+void AddMeshToVec(vector<shared_ptr<GfxRTAS>>& vecBLAS, shared_ptr<Scene> scene, shared_ptr<GfxVertexBuffer> PositionVb)
 {
 	for (auto& mesh : scene->meshes)
 	{
-		shared_ptr<GfxRTAS> blas = shared_ptr<GfxRTAS>(AbstractGfxLayer::CreateBLAS(mesh.get()));
+		// with packed vertices, build from the float position stream. it has the same vertex order as the packed buffer.
+		// always the full detail draw, the raster LODs stay within MeshLodMaxWorldError of it(see SelectMeshLod).
+		GfxMesh blasMesh = *mesh;
+		if (PositionVb)
+		{
+			blasMesh.Vb = PositionVb;
+			blasMesh.VertexStride = sizeof(glm::vec3);
+		}
+
+		shared_ptr<GfxRTAS> blas = shared_ptr<GfxRTAS>(AbstractGfxLayer::CreateBLAS(&blasMesh));
 		if (blas == nullptr)
 		{
 			continue;
 		}
+		blas->mesh = mesh.get();
 		vecBLAS.push_back(blas);
 	}
 }
@@ -4177,6 +4885,25 @@ void Corona::RecompileShaders()
 	InitLightingPass();
 	InitTemporalAAPass();
 	InitBloomPass();
+
+	// new exposure buffers start out for the direct queue, the graph binds the new bloom/exposure resources
+	bExposurePending = false;
+	RenderGraphKey = ~0ull;
+
+	ReportShaderCache("RecompileShaders");
+}
+
+// only shaders whose source, includes or defines changed get to dxc, a warm start compiles nothing
+void Corona::ReportShaderCache(const char* What)
+{
+	ShaderCacheReport = dx12_rhi->Shaders->GetStats();
+	dx12_rhi->Shaders->ResetStats();
+
+	const ShaderCacheStats& stats = ShaderCacheReport;
+	stringstream ss;
+	ss << What << " shaders : " << stats.NumHits << " cached, " << stats.NumMisses << " compiled, " << stats.NumFailed << " failed, keys "
+		<< stats.KeyMs << " ms(" << stats.NumFiles << " files), loads " << stats.LoadMs << " ms, compiles " << stats.CompileMs << " ms\n";
+	OutputDebugStringA(ss.str().c_str());
 }
 
 void Corona::InitRaytracingData()
@@ -4184,8 +4911,8 @@ void Corona::InitRaytracingData()
 	UINT NumTotalMesh = Sponza->meshes.size() + ShaderBall->meshes.size();
 	vecBLAS.reserve(NumTotalMesh);
 
-	AddMeshToVec(vecBLAS, Sponza);
-	AddMeshToVec(vecBLAS, ShaderBall);
+	AddMeshToVec(vecBLAS, Sponza, BLASPositionBuffers[Sponza.get()]);
+	AddMeshToVec(vecBLAS, ShaderBall, BLASPositionBuffers[ShaderBall.get()]);
 
 	TLAS = shared_ptr<GfxRTAS>(AbstractGfxLayer::CreateTLAS(vecBLAS));
 
@@ -4193,13 +4920,35 @@ void Corona::InitRaytracingData()
 	NAME_BUFFER(InstancePropertyBuffer);
 
 
+	// quantization of the meshes the BLAS were built from, looked up once here
+	map<const GfxMesh*, const MeshExtra*> blasExtras;
+	for (const shared_ptr<Scene>& scene : { Sponza, ShaderBall })
+	{
+		auto extrasIt = MeshExtras.find(scene.get());
+		if (extrasIt == MeshExtras.end())
+			continue;
+		for (size_t i = 0; i < scene->meshes.size() && i < extrasIt->second.size(); i++)
+			blasExtras[scene->meshes[i].get()] = &extrasIt->second[i];
+	}
+
 	uint8_t* pData;
 	AbstractGfxLayer::MapBuffer(InstancePropertyBuffer.get(), (void**)&pData);
 
 	for (auto& m : vecBLAS)
 	{
-		glm::mat4x4 mat = glm::transpose(m->mesh->transform);
-		memcpy(pData, &mat, sizeof(glm::mat4x4));
+		InstanceProperty prop;
+		prop.WorldMatrix = glm::transpose(m->mesh->transform);
+
+		GfxMesh::DrawCall& dc = m->mesh->Draws[0];
+		UINT indexStride = m->mesh->IndexFormat == FORMAT_R32_UINT ? sizeof(UINT32) : sizeof(UINT16);
+		prop.GeometryInfo = glm::uvec4(dc.VertexBase, dc.IndexStart * indexStride, indexStride, MaterialIndices[dc.mat.get()]);
+
+		auto extraIt = blasExtras.find(m->mesh);
+		const PositionQuantization quantization = extraIt != blasExtras.end() ? extraIt->second->Quantization : PositionQuantization();
+		prop.PositionScale = quantization.Scale;
+		prop.PositionBias = quantization.Bias;
+
+		memcpy(pData, &prop, sizeof(InstanceProperty));
 		pData += sizeof(InstanceProperty);
 	}
 
@@ -4567,8 +5316,8 @@ void Corona::InitRTXGI()
 
 
 	// create descriptors
-	UINT DescriptorSize = dx12_rhi->TextureDHRing->DescriptorSize;
-	dx12_rhi->TextureDHRing->AllocDescriptor(volumeDescriptorTableCPUHandle, volumeDescriptorTableGPUHandle, 5); // descriptor table size is 5
+	UINT DescriptorSize = dx12_rhi->SRVCBVDescriptorHeapShaderVisible->DescriptorSize;
+	dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptors(volumeDescriptorTableCPUHandle, volumeDescriptorTableGPUHandle, 5); // descriptor table size is 5
 	//DHOfsset = volumeDescriptorTableCPUHandle.ptr;
 	volumeResources.descriptorHeap = dx12_rhi->SRVCBVDescriptorHeapShaderVisible->DH.Get();
 	volumeResources.descriptorHeapDescSize = dx12_rhi->Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -4801,7 +5550,11 @@ void Corona::InitRTPSO()
 		AbstractGfxLayer::AddShader(TEMP_PSO_RT_SHADOW.get(), "anyhit", ANYHIT);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_SHADOW.get(), "anyhit", "vertices", 3);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_SHADOW.get(), "anyhit", "indices", 4);
+#if USE_BINDLESS_MATERIALS
+		BindBindlessMaterials(TEMP_PSO_RT_SHADOW.get());
+#else
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_SHADOW.get(), "anyhit", "AlbedoTex", 5);
+#endif
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_SHADOW.get(), "anyhit", "InstanceProperty", 6);
 
 		
@@ -4841,7 +5594,11 @@ void Corona::InitRTPSO()
 		AbstractGfxLayer::AddShader(TEMP_PSO_RT_REFLECTION.get(), "chs", HIT);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_REFLECTION.get(), "chs", "vertices", 3);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_REFLECTION.get(), "chs", "indices", 4);
+#if USE_BINDLESS_MATERIALS
+		BindBindlessMaterials(TEMP_PSO_RT_REFLECTION.get());
+#else
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_REFLECTION.get(), "chs", "AlbedoTex", 5);
+#endif
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_REFLECTION.get(), "chs", "InstanceProperty", 9);
 
 		
@@ -4879,7 +5636,11 @@ void Corona::InitRTPSO()
 		AbstractGfxLayer::AddShader(TEMP_PSO_RT_GI.get(), "chs", HIT);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_GI.get(), "chs", "vertices", 3);
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_GI.get(), "chs", "indices", 4);
+#if USE_BINDLESS_MATERIALS
+		BindBindlessMaterials(TEMP_PSO_RT_GI.get());
+#else
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_GI.get(), "chs", "AlbedoTex", 5);
+#endif
 		AbstractGfxLayer::BindSRV(TEMP_PSO_RT_GI.get(), "chs", "InstanceProperty", 6);
 
 		RTPSO_DESC desc = {
@@ -4906,31 +5667,27 @@ void Corona::RaytraceShadowPass()
 #endif
 	ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand()%255, rand() % 255, rand() % 255), "RaytraceShadowPass");
 
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-			{ShadowBuffer.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-
-
 	AbstractGfxLayer::BeginShaderTable(PSO_RT_SHADOW.get());
 
 	int i = 0;
 	for (auto&as : vecBLAS)
 	{
 		auto& mesh = as->mesh;
+#if !USE_BINDLESS_MATERIALS
 		GfxTexture* diffuseTex = mesh->Draws[0].mat->Diffuse.get();
 
 		if (!diffuseTex)
 			diffuseTex = DefaultWhiteTex.get();
+#endif
 
 		AbstractGfxLayer::ResetHitProgram(PSO_RT_SHADOW.get(), i);
 		AbstractGfxLayer::StartHitProgram(PSO_RT_SHADOW.get(), "HitGroup", i);
 
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_SHADOW.get(), "HitGroup", mesh->Vb.get(), i);
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_SHADOW.get(), "HitGroup", mesh->Ib.get(), i);
+#if !USE_BINDLESS_MATERIALS
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_SHADOW.get(), "HitGroup", diffuseTex, i);
+#endif
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_SHADOW.get(), "HitGroup", InstancePropertyBuffer.get(), i);
 
 		i++;
@@ -4939,6 +5696,9 @@ void Corona::RaytraceShadowPass()
 	AbstractGfxLayer::SetUAV(PSO_RT_SHADOW.get(), "global", "ShadowResult", ShadowBuffer.get());
 
 	AbstractGfxLayer::SetSRV(PSO_RT_SHADOW.get(), "global", "gRtScene", TLAS.get());
+#if USE_BINDLESS_MATERIALS
+	SetBindlessMaterials(PSO_RT_SHADOW.get());
+#endif
 
 	AbstractGfxLayer::SetSRV(PSO_RT_SHADOW.get(), "global", "DepthTex", DepthBuffer.get());
 	AbstractGfxLayer::SetSRV(PSO_RT_SHADOW.get(), "global", "WorldNormalTex", GeomNormalBuffer.get());
@@ -4949,13 +5709,6 @@ void Corona::RaytraceShadowPass()
 	AbstractGfxLayer::EndShaderTable(PSO_RT_SHADOW.get(), vecBLAS.size());
 
 	AbstractGfxLayer::DispatchRay(PSO_RT_SHADOW.get(), RenderWidth, RenderHeight, AbstractGfxLayer::GetGlobalCommandList(), vecBLAS.size());
-
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-			{ShadowBuffer.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 }
 
 void Corona::RaytraceReflectionPass()
@@ -4965,17 +5718,14 @@ void Corona::RaytraceReflectionPass()
 #endif
 	ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "RaytraceReflectionPass");
 
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-			{SpeculaGIBufferRaw.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 	AbstractGfxLayer::BeginShaderTable(PSO_RT_REFLECTION.get());
 
 	AbstractGfxLayer::SetUAV(PSO_RT_REFLECTION.get(), "global", "ReflectionResult", SpeculaGIBufferRaw.get());
 
 	AbstractGfxLayer::SetSRV(PSO_RT_REFLECTION.get(), "global", "gRtScene", TLAS.get());
+#if USE_BINDLESS_MATERIALS
+	SetBindlessMaterials(PSO_RT_REFLECTION.get());
+#endif
 	AbstractGfxLayer::SetSRV(PSO_RT_REFLECTION.get(), "global", "DepthTex", DepthBuffer.get());
 	AbstractGfxLayer::SetSRV(PSO_RT_REFLECTION.get(), "global", "GeoNormalTex", GeomNormalBuffer.get());
 	AbstractGfxLayer::SetSRV(PSO_RT_REFLECTION.get(), "global", "RougnessMetallicTex", RoughnessMetalicBuffer.get());
@@ -4991,16 +5741,20 @@ void Corona::RaytraceReflectionPass()
 	for(auto&as : vecBLAS)
 	{
 		auto& mesh = as->mesh;
+#if !USE_BINDLESS_MATERIALS
 		GfxTexture* diffuseTex = mesh->Draws[0].mat->Diffuse.get();
 
 		if (!diffuseTex)
 			diffuseTex = DefaultWhiteTex.get();
+#endif
 		AbstractGfxLayer::ResetHitProgram(PSO_RT_REFLECTION.get(), i);
 
 		AbstractGfxLayer::StartHitProgram(PSO_RT_REFLECTION.get(), "HitGroup", i);
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_REFLECTION.get(), "HitGroup", mesh->Vb.get(), i);
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_REFLECTION.get(), "HitGroup", mesh->Ib.get(), i);
+#if !USE_BINDLESS_MATERIALS
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_REFLECTION.get(), "HitGroup", diffuseTex, i);
+#endif
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_REFLECTION.get(), "HitGroup", InstancePropertyBuffer.get(), i);
 
 		
@@ -5010,13 +5764,6 @@ void Corona::RaytraceReflectionPass()
 	AbstractGfxLayer::EndShaderTable(PSO_RT_REFLECTION.get(), vecBLAS.size());
 
 	AbstractGfxLayer::DispatchRay(PSO_RT_REFLECTION.get(), RenderWidth, RenderHeight, AbstractGfxLayer::GetGlobalCommandList(), vecBLAS.size());
-
-	{
-		std::array<ResourceTransition, 1> Transition = { {
-			{SpeculaGIBufferRaw.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 }
 
 void Corona::RaytraceGIPass()
@@ -5026,19 +5773,14 @@ void Corona::RaytraceGIPass()
 #endif
 	ProfileGPUScope(AbstractGfxLayer::GetGlobalCommandList(), PIX_COLOR(rand() % 255, rand() % 255, rand() % 255), "RaytraceGIPass");
 
-	{
-		std::array<ResourceTransition, 2> Transition = { {
-			{DiffuseGISHRaw.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS},
-			{DiffuseGICoCgRaw.get(), RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS}
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
-
 	AbstractGfxLayer::BeginShaderTable(PSO_RT_GI.get());
 
 	AbstractGfxLayer::SetUAV(PSO_RT_GI.get(), "global", "GIResultSH", DiffuseGISHRaw.get());
 	AbstractGfxLayer::SetUAV(PSO_RT_GI.get(), "global", "GIResultColor", DiffuseGICoCgRaw.get());
 	AbstractGfxLayer::SetSRV(PSO_RT_GI.get(), "global", "gRtScene", TLAS.get());
+#if USE_BINDLESS_MATERIALS
+	SetBindlessMaterials(PSO_RT_GI.get());
+#endif
 	AbstractGfxLayer::SetSRV(PSO_RT_GI.get(), "global", "DepthTex", DepthBuffer.get());
 	AbstractGfxLayer::SetSRV(PSO_RT_GI.get(), "global", "WorldNormalTex", NormalBuffers[ColorBufferWriteIndex].get());
 	AbstractGfxLayer::SetSRV(PSO_RT_GI.get(), "global", "BlueNoiseTex", BlueNoiseTex.get());
@@ -5060,16 +5802,20 @@ void Corona::RaytraceGIPass()
 	{
 		auto& mesh = as->mesh;
 		
+#if !USE_BINDLESS_MATERIALS
 		GfxTexture* diffuseTex = mesh->Draws[0].mat->Diffuse.get();
 		if (!diffuseTex)
 			diffuseTex = DefaultWhiteTex.get();
+#endif
 
 		AbstractGfxLayer::ResetHitProgram(PSO_RT_GI.get(), i);
 
 		AbstractGfxLayer::StartHitProgram(PSO_RT_GI.get(), "HitGroup", i);
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_GI.get(), "HitGroup", mesh->Vb.get(), i);
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_GI.get(), "HitGroup", mesh->Ib.get(), i);
+#if !USE_BINDLESS_MATERIALS
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_GI.get(), "HitGroup", diffuseTex, i);
+#endif
 		AbstractGfxLayer::AddSRVDescriptor2HitProgram(PSO_RT_GI.get(), "HitGroup", InstancePropertyBuffer.get(), i);
 
 
@@ -5080,12 +5826,4 @@ void Corona::RaytraceGIPass()
 
 
 	AbstractGfxLayer::DispatchRay(PSO_RT_GI.get(), RenderWidth, RenderHeight, AbstractGfxLayer::GetGlobalCommandList(), vecBLAS.size());
-
-	{
-		std::array<ResourceTransition, 2> Transition = { {
-			{DiffuseGISHRaw.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE},
-			{DiffuseGICoCgRaw.get(), RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | RESOURCE_STATE_PIXEL_SHADER_RESOURCE}
-		} };
-		AbstractGfxLayer::TransitionResource(AbstractGfxLayer::GetGlobalCommandList(), Transition.size(), Transition.data());
-	}
 }
@@ -22,6 +22,15 @@
 
 #include "DXSample.h"
 #include "StepTimer.h"
+#include "VertexPacking.h"
+#include "MeshletBuilder.h"
+#include "Shaders/MaterialFormat.h"
+#include "BindingSlot.h"
+#include "RenderGraph.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include <map>
+#include <functional>
 #include "SimpleCamera.h"
 #include "AbstractGfxLayer.h"
 #include "enkiTS/TaskScheduler.h""
@@ -176,11 +185,28 @@ private:
 		glm::vec4 ViewDir;
 		glm::vec2 RTSize;
 		glm::vec2 RougnessMetalic;
+		glm::vec4 PositionScale; // packed vertex position dequantization
+		glm::vec4 PositionBias;
 		UINT32 bOverrideRougnessMetallic;
+		UINT32 MaterialIndex; // into MaterialBuffer, bindless only
 	};
 
 	shared_ptr<GfxPipelineStateObject> GBufferPassPSO;
 
+	// resolved once the pso is made, SetGBufferState/DrawGBuffer bind through these instead of by name. the parallel g-buffer
+	// workers share the pso, a slot never writes it.
+	struct GBufferBindingSlots
+	{
+		BindingSlot ConstantBuffer;
+		BindingSlot AlbedoTex;
+		BindingSlot NormalTex;
+		BindingSlot RoughnessTex;
+		BindingSlot MetallicTex;
+		BindingSlot BindlessTextures;
+		BindingSlot Materials;
+		BindingSlot SamplerWrap;
+	} GBufferSlots;
+
 	// spatial denoising
 	struct SpatialFilterConstant
 	{
@@ -456,6 +482,20 @@ AdaptExposureCB.MaxExposure = 64.0f;*/
 
 	// blue noise texture
 	shared_ptr<GfxTexture> BlueNoiseTex;
+	// every texture loaded from a file goes through here
+	TextureCache TexCache;
+	// material textures load in the background. slots hold the default textures below until theirs are resident.
+	TextureStreamer Streamer;
+
+	// seconds from the start of OnInit, reported once all material textures are resident
+	LARGE_INTEGER LoadStartTime = {};
+	double TimeToFirstFrame = 0;
+	double TimeToResident = 0;
+
+	// transient target memory at the render size, 1080p and 4k, redone when the aliasing layout changes
+	vector<string> TransientReport;
+	UINT TransientReportVersion = 0;
+
 	shared_ptr<GfxTexture> DefaultWhiteTex;
 	shared_ptr<GfxTexture> DefaultBlackTex;
 	shared_ptr<GfxTexture> DefaultNormalTex;
@@ -479,6 +519,30 @@ AdaptExposureCB.MaxExposure = 64.0f;*/
 	float ShaderBallRoughnessMultiplier = 0.15;
 	shared_ptr<Scene> ShaderBall;
 
+	struct MeshLod
+	{
+		UINT IndexStart; // in the mesh's index buffer, like DrawCall::IndexStart
+		UINT IndexCount;
+		float Error; // mesh space units
+	};
+
+	// per mesh data that doesn't fit in GfxMesh.
+	struct MeshExtra
+	{
+		PositionQuantization Quantization; // packed vertex position dequantization
+		MeshletData Meshlets; // offsets and vertex indices are mesh local
+
+		// bounding sphere in mesh space
+		glm::vec3 Center;
+		float Radius = 0;
+		vector<MeshLod> Lods; // Lods[0] is the full detail draw
+	};
+	// extras of scene->meshes[i] are MeshExtras[scene][i]. per frame code finds the scene once and indexes, nothing is inserted after LoadModel.
+	map<const Scene*, vector<MeshExtra>> MeshExtras;
+
+	// float position stream BLAS of each scene are built from when vertices are packed.
+	map<const Scene*, shared_ptr<GfxVertexBuffer>> BLASPositionBuffers;
+
 	// time & camera
 	StepTimer m_timer;
 
@@ -521,14 +585,61 @@ AdaptExposureCB.MaxExposure = 64.0f;*/
 	struct InstanceProperty
 	{
 		glm::mat4x4 WorldMatrix;
+		glm::uvec4 GeometryInfo; // x : vertex base, y : index byte offset, z : index stride, w : material index
+		glm::vec4 PositionScale;
+		glm::vec4 PositionBias;
 	};
 
 	std::shared_ptr<GfxBuffer> InstancePropertyBuffer;
+
+	// every material of the loaded scenes has an index(RegisterMaterials). with USE_BINDLESS_MATERIALS, MaterialBuffer holds the
+	// bindless texture indices of each one and is made again when streamed textures replace the defaults.
+	map<const GfxMaterial*, UINT> MaterialIndices;
+	vector<shared_ptr<GfxMaterial>> BindlessMaterials;
+	vector<glm::uvec4> MaterialTextureIds;
+	shared_ptr<GfxBuffer> MaterialBuffer;
 	shared_ptr<GfxRTAS> TLAS;
 	vector<shared_ptr<GfxRTAS>> vecBLAS;
 	
-	// ...
+	// g-buffer draws recorded on GBufferThreads command lists by g_TS workers instead of on the global list(M key / UI)
 	bool bMultiThreadRendering = false;
+	int GBufferThreads = 4;
+	double GBufferCpuMs = 0; // GBufferPass on the cpu, recording and submitting
+
+	// -drawbench : once textures are resident the g-buffer draws are repeated up to DrawBenchDraws, then recorded on the global list
+	// and on 1..GetNumTaskThreads() lists for DrawBenchFrames frames each. the numbers go to drawbench.txt.
+	static const UINT DrawBenchDraws = 10000;
+	static const UINT DrawBenchWarmupFrames = 10;
+	static const UINT DrawBenchFrames = 100;
+	int DrawBenchStep = -1; // -1 : not running, 0 : global list, N : N threads
+	UINT DrawBenchFrame = 0;
+	double DrawBenchGBufferMs = 0;
+	double DrawBenchFrameMs = 0;
+	string DrawBenchReport;
+
+	// -barrierbench : once textures are resident FrameBarriers is averaged over BarrierBenchFrames frames with bBatchBarriers off,
+	// then on. the numbers go to barrierbench.txt.
+	static const UINT BarrierBenchWarmupFrames = 10;
+	static const UINT BarrierBenchFrames = 100;
+	int BarrierBenchStep = -1; // -1 : not running, 0 : not batched, 1 : batched
+	UINT BarrierBenchFrame = 0;
+	BarrierStats BarrierBenchTotal;
+	string BarrierBenchReport;
+
+	// histogram + AdaptExposure on the compute queue. the luma of a frame is done at the start of the next one, next to its g-buffer
+	// and rays, and its BloomPass waits for it. exposure is a frame later than on the global list.
+	bool bAsyncExposure = true;
+	bool bExposurePending = false; // the last frame left LumaBuffer/Histogram/ExposureData for the compute queue
+	string TimelineDumpStatus;
+
+	// coarsest LOD whose simplification error projects under this many pixels is drawn
+	bool bMeshLod = true;
+	float MeshLodPixelError = 1.0f;
+	// LODs are raster only, the BLAS stays at full detail. shadow/GI/reflection rays start on the g-buffer pushed out along the normal by
+	// 0.5(GI, reflections) to 1(shadows) world units, so a LOD that is further than that from the full detail surface could end up behind
+	// the BLAS and shadow or reflect itself. coarser LODs than this world space error are never picked, whatever their pixel error.
+	float MeshLodMaxWorldError = 0.5f;
+	UINT NumGBufferTriangles = 0;
 
 	bool bDebugDraw = false;
 
@@ -548,6 +659,9 @@ AdaptExposureCB.MaxExposure = 64.0f;*/
 	bool bShowImgui = true;
 	void RecompileShaders();
 
+	ShaderCacheStats ShaderCacheReport; // of the shaders made by the last load or RecompileShaders
+	void ReportShaderCache(const char* What);
+
 #if USE_DLSS
 	bool m_ngxInitialized = false;
 	bool m_bDlssAvailable = false;
@@ -637,6 +751,16 @@ public:
 
 	shared_ptr<Scene> LoadModel(string fileName);
 
+	void RegisterMaterials(shared_ptr<Scene> scene);
+
+	void UpdateMaterialBuffer();
+
+#if USE_BINDLESS_MATERIALS
+	void BindBindlessMaterials(GfxRTPipelineStateObject* PSO);
+
+	void SetBindlessMaterials(GfxRTPipelineStateObject* PSO);
+#endif
+
 	void InitRTPSO();
 
 	void InitSpatialDenoisingPass();
@@ -661,7 +785,60 @@ public:
 
 	void InitBlueNoiseTexture();
 
-	void DrawScene(shared_ptr<Scene> scene, float Roughness, float Metalic, bool bOverrideRoughnessMetallic);
+	UINT SelectMeshLod(const GfxMesh* Mesh, const MeshExtra& Extra);
+
+	void UpdateLoadTimings();
+
+	// the passes of the frame and what they read/write, compiled once per setting that changes them(RenderGraphKey). OnRender records
+	// the compiled steps, the graph transitions are made for the bindings whose state is tracked(CommandList::Require).
+	struct RenderGraphBinding
+	{
+		vector<GfxTexture*> Textures;
+		GfxBuffer* Buf = nullptr;
+		bool bTracked = false;
+	};
+	RenderGraph Graph;
+	vector<RenderGraphBinding> GraphBindings; // by graph resource
+	vector<std::function<void(GfxCommandList*)>> GraphPasses; // by graph pass
+	uint32_t GraphBackbuffer = RENDER_GRAPH_INVALID;
+	uint32_t GraphNormal = RENDER_GRAPH_INVALID; // ping-pong, OnRender binds the ones of the frame
+	uint32_t GraphUnjitteredDepth = RENDER_GRAPH_INVALID;
+	uint32_t GraphColor = RENDER_GRAPH_INVALID;
+	UINT64 RenderGraphKey = ~0ull;
+	double RenderGraphCompileMs = 0;
+
+	void BuildRenderGraph();
+	void ApplyGraphTransitions(GfxCommandList* CmdList, const vector<RenderGraphTransition>& Transitions, bool bSplit);
+
+	// the compiled direct queue passes and the transient textures each one touches, in recording order
+	void DeclareTransientPasses();
+
+	void UpdateTransientReport();
+
+	// one g-buffer draw. gathered on the main thread, so recording threads only read them.
+	struct GBufferDraw
+	{
+		const GfxMesh* Mesh;
+		const MeshExtra* Extra;
+		UINT DrawIndex; // into Mesh->Draws
+		UINT Lod;
+		UINT MaterialIndex;
+		float Roughness;
+		float Metalic;
+		bool bOverrideRoughnessMetallic;
+	};
+	vector<GBufferDraw> GBufferDraws;
+
+	void AddSceneDraws(shared_ptr<Scene> scene, float Roughness, float Metalic, bool bOverrideRoughnessMetallic);
+
+	// heaps, targets, viewport, pso and the bindings all draws share. every list that draws the g-buffer needs it.
+	void SetGBufferState(GfxCommandList* CmdList);
+
+	// GBufferDraws[Begin, End), returns the number of triangles. any thread.
+	UINT DrawGBuffer(GfxCommandList* CmdList, UINT Begin, UINT End);
+
+	void UpdateDrawBench(double FrameMs);
+	void UpdateBarrierBench();
 
 	void GBufferPass();
 
@@ -681,6 +858,10 @@ public:
 
 	void BloomPass();
 
+	// LumaBuffer -> Histogram -> ExposureData, compute only. all three are in NON_PIXEL_SHADER_RESOURCE before and after,
+	// so it can go to the compute queue.
+	void ExposurePass(GfxCommandList* CommandList);
+
 
 
 	void ToneMapPass();
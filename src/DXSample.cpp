@@ -19,7 +19,11 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
 	m_width(width),
 	m_height(height),
 	m_title(name),
-	m_useWarpDevice(false)
+	m_useWarpDevice(false),
+	m_streamBench(false),
+	m_syncTextures(false),
+	m_drawBench(false),
+	m_barrierBench(false)
 {
 	WCHAR assetsPath[512];
 	GetAssetsPath(assetsPath, _countof(assetsPath));
@@ -89,6 +93,22 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
 			m_useWarpDevice = true;
 			m_title = m_title + L" (WARP)";
 		}
+		else if (_wcsicmp(argv[i], L"-streambench") == 0)
+		{
+			m_streamBench = true;
+		}
+		else if (_wcsicmp(argv[i], L"-synctextures") == 0)
+		{
+			m_syncTextures = true;
+		}
+		else if (_wcsicmp(argv[i], L"-drawbench") == 0)
+		{
+			m_drawBench = true;
+		}
+		else if (_wcsicmp(argv[i], L"-barrierbench") == 0)
+		{
+			m_barrierBench = true;
+		}
 	}
 }
 
@@ -54,6 +54,17 @@ protected:
 	// Adapter info.
 	bool m_useWarpDevice;
 
+	// Texture loading. -streambench quits once every texture is resident and reports the timings,
+	// -synctextures loads them all in OnInit like before for comparison.
+	bool m_streamBench;
+	bool m_syncTextures;
+
+	// -drawbench times g-buffer recording of a 10k draw scene on the global list and on 1..N threads, then quits.
+	bool m_drawBench;
+
+	// -barrierbench counts the tracked barriers of a frame with and without batching, then quits.
+	bool m_barrierBench;
+
 private:
 	// Root assets path.
 	std::wstring m_assetsPath;
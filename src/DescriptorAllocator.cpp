@@ -0,0 +1,210 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+
+DescriptorAllocator::DescriptorAllocator(uint32_t InCapacity)
+{
+	Capacity = InCapacity;
+	Generations.assign(Capacity, 1);
+	RangeCounts.assign(Capacity, 0);
+	Counters.Capacity = Capacity;
+
+	if (Capacity > 0)
+		InsertFree(0, Capacity);
+}
+
+void DescriptorAllocator::InsertFree(uint32_t Index, uint32_t Count)
+{
+	// merge with the free ranges right before and after
+	auto next = FreeByOffset.lower_bound(Index);
+	if (next != FreeByOffset.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == Index)
+		{
+			Index = prev->first;
+			Count += prev->second;
+			RemoveFreeBySize(prev->first, prev->second);
+			FreeByOffset.erase(prev);
+		}
+	}
+
+	if (next != FreeByOffset.end() && Index + Count == next->first)
+	{
+		Count += next->second;
+		RemoveFreeBySize(next->first, next->second);
+		FreeByOffset.erase(next);
+	}
+
+	FreeByOffset[Index] = Count;
+	FreeBySize.insert({ Count, Index });
+}
+
+void DescriptorAllocator::RemoveFreeBySize(uint32_t Index, uint32_t Count)
+{
+	auto range = FreeBySize.equal_range(Count);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second == Index)
+		{
+			FreeBySize.erase(it);
+			return;
+		}
+	}
+}
+
+DescriptorHandle DescriptorAllocator::Allocate(uint32_t Count)
+{
+	DescriptorHandle handle;
+
+	auto it = Count > 0 ? FreeBySize.lower_bound(Count) : FreeBySize.end();
+	if (it == FreeBySize.end())
+	{
+		Counters.NumFailed++;
+		return handle;
+	}
+
+	const uint32_t freeCount = it->first;
+	const uint32_t index = it->second;
+	FreeBySize.erase(it);
+	FreeByOffset.erase(index);
+
+	// the rest stays free. nothing to merge, the range after a free one is never free.
+	if (freeCount > Count)
+	{
+		FreeByOffset[index + Count] = freeCount - Count;
+		FreeBySize.insert({ freeCount - Count, index + Count });
+	}
+
+	RangeCounts[index] = Count;
+
+	handle.Index = index;
+	handle.Count = Count;
+	handle.Generation = Generations[index];
+
+	Counters.NumAllocs++;
+	Counters.NumUsed += Count;
+	Counters.NumRanges++;
+	Counters.PeakUsed = std::max(Counters.PeakUsed, Counters.NumUsed);
+	return handle;
+}
+
+bool DescriptorAllocator::Free(const DescriptorHandle& Handle, uint64_t FenceValue)
+{
+	if (!IsValid(Handle))
+	{
+		Counters.NumStaleFrees++;
+		return false;
+	}
+
+	// the handle is dead from here on, even while the range waits for its fence
+	Generations[Handle.Index]++;
+	RangeCounts[Handle.Index] = 0;
+
+	Counters.NumFrees++;
+	Counters.NumUsed -= Handle.Count;
+	Counters.NumRanges--;
+
+	if (FenceValue == 0)
+	{
+		InsertFree(Handle.Index, Handle.Count);
+	}
+	else
+	{
+		PendingFrees.push_back({ Handle.Index, Handle.Count, FenceValue });
+		Counters.NumPending += Handle.Count;
+	}
+	return true;
+}
+
+void DescriptorAllocator::ProcessPendingFrees(uint64_t CompletedFenceValue)
+{
+	auto it = std::remove_if(PendingFrees.begin(), PendingFrees.end(), [&](const PendingFree& pending)
+	{
+		if (pending.FenceValue > CompletedFenceValue)
+			return false;
+
+		InsertFree(pending.Index, pending.Count);
+		Counters.NumPending -= pending.Count;
+		return true;
+	});
+	PendingFrees.erase(it, PendingFrees.end());
+}
+
+bool DescriptorAllocator::IsValid(const DescriptorHandle& Handle) const
+{
+	return Handle.Index < Capacity && Handle.Count > 0 && RangeCounts[Handle.Index] == Handle.Count && Generations[Handle.Index] == Handle.Generation;
+}
+
+DescriptorAllocatorStats DescriptorAllocator::GetStats() const
+{
+	DescriptorAllocatorStats stats = Counters;
+	stats.NumFree = 0;
+	stats.LargestFreeRange = FreeBySize.empty() ? 0 : FreeBySize.rbegin()->first;
+	stats.NumFreeRanges = uint32_t(FreeByOffset.size());
+	for (auto& range : FreeByOffset)
+		stats.NumFree += range.second;
+	return stats;
+}
+
+bool DescriptorAllocator::Validate() const
+{
+	vector<uint8_t> covered(Capacity, 0);
+	auto Cover = [&](uint32_t Index, uint32_t Count)
+	{
+		if (Count == 0 || uint64_t(Index) + Count > Capacity)
+			return false;
+		for (uint32_t i = Index; i < Index + Count; i++)
+		{
+			if (covered[i]++)
+				return false;
+		}
+		return true;
+	};
+
+	uint32_t numUsed = 0, numRanges = 0;
+	for (uint32_t i = 0; i < Capacity; i++)
+	{
+		if (RangeCounts[i] == 0)
+			continue;
+		if (!Cover(i, RangeCounts[i]))
+			return false;
+		numUsed += RangeCounts[i];
+		numRanges++;
+	}
+
+	uint32_t numPending = 0;
+	for (auto& pending : PendingFrees)
+	{
+		if (!Cover(pending.Index, pending.Count))
+			return false;
+		numPending += pending.Count;
+	}
+
+	uint32_t prevEnd = DESCRIPTOR_INVALID;
+	for (auto& range : FreeByOffset)
+	{
+		// neighbouring free ranges are always merged
+		if (range.first == prevEnd || !Cover(range.first, range.second))
+			return false;
+		prevEnd = range.first + range.second;
+
+		bool bFound = false;
+		auto sizeRange = FreeBySize.equal_range(range.second);
+		for (auto it = sizeRange.first; it != sizeRange.second; ++it)
+			bFound |= it->second == range.first;
+		if (!bFound)
+			return false;
+	}
+
+	if (FreeBySize.size() != FreeByOffset.size())
+		return false;
+
+	for (uint8_t c : covered)
+	{
+		if (c != 1)
+			return false;
+	}
+
+	return numUsed == Counters.NumUsed && numRanges == Counters.NumRanges && numPending == Counters.NumPending;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+// Allocator for ranges of a descriptor heap. no graphics api in here, DescriptorHeap in SimpleDX12 owns the d3d12 heap and turns
+// indices into cpu/gpu handles with DescriptorAddressing.
+//
+// best fit over free ranges kept by offset(merged with their neighbours) and by size. a freed range goes back only once the fence
+// value it was freed with is completed, frames in flight may still read it. every range carries a generation that changes when it is
+// freed, so a handle kept after its free is caught instead of silently pointing at somebody else's descriptors.
+
+#define DESCRIPTOR_INVALID 0xffffffffu
+
+struct DescriptorHandle
+{
+	uint32_t Index = DESCRIPTOR_INVALID;
+	uint32_t Count = 0;
+	uint32_t Generation = 0;
+
+	bool IsValid() const { return Index != DESCRIPTOR_INVALID; }
+};
+
+// the only part that depends on the real heap. plain numbers so it works without a device.
+struct DescriptorAddressing
+{
+	uint64_t CpuStart = 0;
+	uint64_t GpuStart = 0;
+	uint32_t Increment = 0;
+
+	uint64_t GetCpu(uint32_t Index) const { return CpuStart + uint64_t(Index) * Increment; }
+	uint64_t GetGpu(uint32_t Index) const { return GpuStart + uint64_t(Index) * Increment; }
+	uint32_t GetIndex(uint64_t Cpu) const { return uint32_t((Cpu - CpuStart) / Increment); }
+};
+
+struct DescriptorAllocatorStats
+{
+	uint32_t Capacity = 0;
+	uint32_t NumUsed = 0; // descriptors in live ranges
+	uint32_t NumPending = 0; // freed, waiting for their fence
+	uint32_t NumFree = 0;
+	uint32_t LargestFreeRange = 0;
+	uint32_t NumRanges = 0;
+	uint32_t NumFreeRanges = 0;
+	uint32_t PeakUsed = 0;
+	uint64_t NumAllocs = 0;
+	uint64_t NumFrees = 0;
+	uint64_t NumFailed = 0;
+	uint64_t NumStaleFrees = 0; // double frees and frees of handles from an older generation
+
+	float GetOccupancy() const { return Capacity > 0 ? float(double(NumUsed + NumPending) / double(Capacity)) : 0.0f; }
+};
+
+class DescriptorAllocator
+{
+	struct PendingFree
+	{
+		uint32_t Index;
+		uint32_t Count;
+		uint64_t FenceValue;
+	};
+
+	uint32_t Capacity = 0;
+	map<uint32_t, uint32_t> FreeByOffset; // first index -> count
+	multimap<uint32_t, uint32_t> FreeBySize; // count -> first index
+	vector<uint32_t> Generations; // per index, the generation of a range starting there
+	vector<uint32_t> RangeCounts; // per index, count of the live range starting there. 0 when none starts there
+	vector<PendingFree> PendingFrees;
+	DescriptorAllocatorStats Counters;
+
+	void InsertFree(uint32_t Index, uint32_t Count);
+	void RemoveFreeBySize(uint32_t Index, uint32_t Count);
+
+public:
+	DescriptorAllocator(uint32_t InCapacity = 0);
+
+	// Count contiguous descriptors. an invalid handle when no free range is big enough.
+	DescriptorHandle Allocate(uint32_t Count = 1);
+
+	// the range is reusable once ProcessPendingFrees gets a completed fence of at least FenceValue, 0 gives it back right away.
+	// false when the handle is stale(already freed, or from before its range was freed and handed out again).
+	bool Free(const DescriptorHandle& Handle, uint64_t FenceValue);
+	void ProcessPendingFrees(uint64_t CompletedFenceValue);
+
+	bool IsValid(const DescriptorHandle& Handle) const;
+
+	uint32_t GetCapacity() const { return Capacity; }
+	DescriptorAllocatorStats GetStats() const;
+
+	// checks that live, pending and free ranges cover every index exactly once and the free maps agree with each other
+	bool Validate() const;
+};
@@ -0,0 +1,661 @@
+#include "HeapAllocator.h"
+
+#include <cassert>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint32_t LowestBit(uint64_t v)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return index;
+#else
+	return uint32_t(__builtin_ctzll(v));
+#endif
+}
+
+static uint32_t HighestBit(uint64_t v)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return index;
+#else
+	return 63 - uint32_t(__builtin_clzll(v));
+#endif
+}
+
+static uint64_t AlignUp(uint64_t v, uint64_t Alignment)
+{
+	return (v + Alignment - 1) & ~(Alignment - 1);
+}
+
+TLSFAllocator::TLSFAllocator(uint64_t InSize)
+{
+	for (uint32_t fl = 0; fl < NumFL; fl++)
+		for (uint32_t sl = 0; sl < NumSL; sl++)
+			FreeHeads[fl][sl] = HEAP_ALLOCATOR_INVALID;
+
+	Size = InSize & ~(HEAP_ALLOCATOR_GRANULARITY - 1);
+	if (Size == 0)
+		return;
+
+	Head = NewNode();
+	Nodes[Head].Offset = 0;
+	Nodes[Head].Size = Size;
+	InsertFree(Head);
+}
+
+uint32_t TLSFAllocator::NewNode()
+{
+	if (UnusedNodes.size() > 0)
+	{
+		uint32_t index = UnusedNodes.back();
+		UnusedNodes.pop_back();
+		Nodes[index] = Node();
+		return index;
+	}
+
+	Nodes.push_back(Node());
+	return uint32_t(Nodes.size() - 1);
+}
+
+// size classes : the first level is the power of two, the second level splits it in NumSL linear steps.
+// every size here is >= HEAP_ALLOCATOR_GRANULARITY so the first level is always >= SLBits.
+static void MapSize(uint64_t Size, uint32_t SLBits, uint32_t& OutFL, uint32_t& OutSL)
+{
+	OutFL = HighestBit(Size);
+	OutSL = uint32_t(Size >> (OutFL - SLBits)) ^ (1u << SLBits);
+}
+
+void TLSFAllocator::InsertFree(uint32_t Index)
+{
+	Node& node = Nodes[Index];
+
+	uint32_t fl, sl;
+	MapSize(node.Size, SLBits, fl, sl);
+
+	node.bFree = true;
+	node.PrevFree = HEAP_ALLOCATOR_INVALID;
+	node.NextFree = FreeHeads[fl][sl];
+	if (node.NextFree != HEAP_ALLOCATOR_INVALID)
+		Nodes[node.NextFree].PrevFree = Index;
+	FreeHeads[fl][sl] = Index;
+
+	FLBitmap |= 1ull << fl;
+	SLBitmap[fl] |= 1u << sl;
+	NumFreeBlocks++;
+}
+
+void TLSFAllocator::RemoveFree(uint32_t Index)
+{
+	Node& node = Nodes[Index];
+
+	uint32_t fl, sl;
+	MapSize(node.Size, SLBits, fl, sl);
+
+	if (node.PrevFree != HEAP_ALLOCATOR_INVALID)
+		Nodes[node.PrevFree].NextFree = node.NextFree;
+	else
+		FreeHeads[fl][sl] = node.NextFree;
+
+	if (node.NextFree != HEAP_ALLOCATOR_INVALID)
+		Nodes[node.NextFree].PrevFree = node.PrevFree;
+
+	if (FreeHeads[fl][sl] == HEAP_ALLOCATOR_INVALID)
+	{
+		SLBitmap[fl] &= ~(1u << sl);
+		if (SLBitmap[fl] == 0)
+			FLBitmap &= ~(1ull << fl);
+	}
+
+	node.bFree = false;
+	node.PrevFree = node.NextFree = HEAP_ALLOCATOR_INVALID;
+	NumFreeBlocks--;
+}
+
+// good fit : MinSize is rounded up to the next class, so the head of any list at or above it is big enough.
+uint32_t TLSFAllocator::FindFree(uint64_t MinSize) const
+{
+	uint32_t fl = HighestBit(MinSize);
+	const uint64_t roundUp = (1ull << (fl - SLBits)) - 1;
+
+	uint32_t sl;
+	MapSize(MinSize + roundUp, SLBits, fl, sl);
+
+	uint32_t slMap = SLBitmap[fl] & (~0u << sl);
+	if (slMap == 0)
+	{
+		const uint64_t flMap = fl + 1 < NumFL ? FLBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap != 0)
+		{
+			fl = LowestBit(flMap);
+			slMap = SLBitmap[fl];
+		}
+	}
+
+	if (slMap != 0)
+		return FreeHeads[fl][LowestBit(slMap)];
+
+	// nothing in the bigger classes. the class of MinSize itself may still hold a range that fits,
+	// e.g. the whole of an empty dedicated block.
+	MapSize(MinSize, SLBits, fl, sl);
+	for (uint32_t index = FreeHeads[fl][sl]; index != HEAP_ALLOCATOR_INVALID; index = Nodes[index].NextFree)
+	{
+		if (Nodes[index].Size >= MinSize)
+			return index;
+	}
+	return HEAP_ALLOCATOR_INVALID;
+}
+
+// splits the first FrontSize bytes of a used node into a new node in front of it. returns the new node.
+uint32_t TLSFAllocator::SplitFront(uint32_t Index, uint64_t FrontSize)
+{
+	uint32_t front = NewNode();
+	Node& node = Nodes[Index];
+
+	Nodes[front].Offset = node.Offset;
+	Nodes[front].Size = FrontSize;
+	Nodes[front].PrevPhys = node.PrevPhys;
+	Nodes[front].NextPhys = Index;
+	if (node.PrevPhys != HEAP_ALLOCATOR_INVALID)
+		Nodes[node.PrevPhys].NextPhys = front;
+	else
+		Head = front;
+
+	node.PrevPhys = front;
+	node.Offset += FrontSize;
+	node.Size -= FrontSize;
+	return front;
+}
+
+TLSFAllocation TLSFAllocator::Allocate(uint64_t InSize, uint64_t Alignment, void* UserData)
+{
+	if (InSize == 0)
+		return TLSFAllocation();
+
+	const uint64_t size = AlignUp(InSize, HEAP_ALLOCATOR_GRANULARITY);
+	Alignment = max(Alignment, HEAP_ALLOCATOR_GRANULARITY);
+
+	if (size > Size)
+		return TLSFAllocation();
+
+	auto Fits = [&](uint32_t Index)
+	{
+		return Index != HEAP_ALLOCATOR_INVALID && AlignUp(Nodes[Index].Offset, Alignment) - Nodes[Index].Offset + size <= Nodes[Index].Size;
+	};
+
+	// the range found for the plain size is often aligned already. otherwise search again with room for the worst case padding,
+	// free ranges are granularity aligned so at most Alignment - granularity is skipped.
+	uint32_t index = FindFree(size);
+	if (!Fits(index))
+	{
+		const uint64_t searchSize = size + Alignment - HEAP_ALLOCATOR_GRANULARITY;
+		index = searchSize <= Size ? FindFree(searchSize) : HEAP_ALLOCATOR_INVALID;
+		if (!Fits(index))
+			return TLSFAllocation();
+	}
+
+	RemoveFree(index);
+
+	const uint64_t padding = AlignUp(Nodes[index].Offset, Alignment) - Nodes[index].Offset;
+	if (padding > 0)
+		InsertFree(SplitFront(index, padding));
+
+	if (Nodes[index].Size > size)
+	{
+		uint32_t used = SplitFront(index, size);
+		InsertFree(index);
+		index = used;
+	}
+
+	Node& node = Nodes[index];
+	node.bFree = false;
+	node.Alignment = Alignment;
+	node.UserData = UserData;
+
+	UsedBytes += node.Size;
+	NumAllocations++;
+
+	TLSFAllocation allocation;
+	allocation.Offset = node.Offset;
+	allocation.Size = node.Size;
+	allocation.Node = index;
+	return allocation;
+}
+
+void TLSFAllocator::Free(const TLSFAllocation& Allocation)
+{
+	uint32_t index = Allocation.Node;
+	assert(index < Nodes.size() && !Nodes[index].bFree && Nodes[index].Offset == Allocation.Offset);
+
+	UsedBytes -= Nodes[index].Size;
+	NumAllocations--;
+	Nodes[index].UserData = nullptr;
+
+	// merge with the previous range
+	uint32_t prev = Nodes[index].PrevPhys;
+	if (prev != HEAP_ALLOCATOR_INVALID && Nodes[prev].bFree)
+	{
+		RemoveFree(prev);
+		Nodes[prev].Size += Nodes[index].Size;
+		Nodes[prev].NextPhys = Nodes[index].NextPhys;
+		if (Nodes[index].NextPhys != HEAP_ALLOCATOR_INVALID)
+			Nodes[Nodes[index].NextPhys].PrevPhys = prev;
+
+		UnusedNodes.push_back(index);
+		index = prev;
+	}
+
+	// and the next one
+	uint32_t next = Nodes[index].NextPhys;
+	if (next != HEAP_ALLOCATOR_INVALID && Nodes[next].bFree)
+	{
+		RemoveFree(next);
+		Nodes[index].Size += Nodes[next].Size;
+		Nodes[index].NextPhys = Nodes[next].NextPhys;
+		if (Nodes[next].NextPhys != HEAP_ALLOCATOR_INVALID)
+			Nodes[Nodes[next].NextPhys].PrevPhys = index;
+
+		UnusedNodes.push_back(next);
+	}
+
+	InsertFree(index);
+}
+
+HeapAllocatorStats TLSFAllocator::GetStats() const
+{
+	HeapAllocatorStats stats;
+	stats.TotalBytes = Size;
+	stats.UsedBytes = UsedBytes;
+	stats.FreeBytes = Size - UsedBytes;
+	stats.NumAllocations = NumAllocations;
+	stats.NumFreeBlocks = NumFreeBlocks;
+
+	// the largest free range is somewhere in the highest non empty list
+	if (FLBitmap != 0)
+	{
+		const uint32_t fl = HighestBit(FLBitmap);
+		const uint32_t sl = HighestBit(SLBitmap[fl]);
+		for (uint32_t index = FreeHeads[fl][sl]; index != HEAP_ALLOCATOR_INVALID; index = Nodes[index].NextFree)
+			stats.LargestFreeBlock = max(stats.LargestFreeBlock, Nodes[index].Size);
+	}
+	return stats;
+}
+
+void TLSFAllocator::ForEachBlock(const function<void(const TLSFBlockInfo& Info)>& Func) const
+{
+	for (uint32_t index = Head; index != HEAP_ALLOCATOR_INVALID; index = Nodes[index].NextPhys)
+	{
+		const Node& node = Nodes[index];
+
+		TLSFBlockInfo info;
+		info.Allocation.Offset = node.Offset;
+		info.Allocation.Size = node.Size;
+		info.Allocation.Node = index;
+		info.Alignment = node.Alignment;
+		info.UserData = node.UserData;
+		info.bFree = node.bFree;
+		Func(info);
+	}
+}
+
+bool TLSFAllocator::Validate() const
+{
+	if (Head == HEAP_ALLOCATOR_INVALID)
+		return Size == 0;
+
+	// physical chain covers [0, Size) without gaps and no two free ranges touch
+	uint64_t offset = 0;
+	uint64_t used = 0;
+	uint32_t numUsed = 0;
+	uint32_t numFree = 0;
+	bool bPrevFree = false;
+	bool bValid = true;
+	ForEachBlock([&](const TLSFBlockInfo& Info)
+	{
+		if (Info.Allocation.Offset != offset || Info.Allocation.Size == 0 || (Info.bFree && bPrevFree))
+			bValid = false;
+
+		offset += Info.Allocation.Size;
+		bPrevFree = Info.bFree;
+		if (Info.bFree)
+		{
+			numFree++;
+		}
+		else
+		{
+			used += Info.Allocation.Size;
+			numUsed++;
+			if (Info.Allocation.Offset % Info.Alignment != 0)
+				bValid = false;
+		}
+	});
+
+	if (!bValid || offset != Size || used != UsedBytes || numUsed != NumAllocations || numFree != NumFreeBlocks)
+		return false;
+
+	// every free node sits in the list of its class and the bitmaps match the lists
+	uint32_t numListed = 0;
+	for (uint32_t fl = 0; fl < NumFL; fl++)
+	{
+		for (uint32_t sl = 0; sl < NumSL; sl++)
+		{
+			const bool bBit = (SLBitmap[fl] >> sl) & 1;
+			if (bBit != (FreeHeads[fl][sl] != HEAP_ALLOCATOR_INVALID))
+				return false;
+
+			uint32_t prev = HEAP_ALLOCATOR_INVALID;
+			for (uint32_t index = FreeHeads[fl][sl]; index != HEAP_ALLOCATOR_INVALID; index = Nodes[index].NextFree)
+			{
+				uint32_t nodeFL, nodeSL;
+				MapSize(Nodes[index].Size, SLBits, nodeFL, nodeSL);
+				if (!Nodes[index].bFree || Nodes[index].PrevFree != prev || nodeFL != fl || nodeSL != sl)
+					return false;
+
+				prev = index;
+				numListed++;
+			}
+		}
+
+		if (((FLBitmap >> fl) & 1) != (SLBitmap[fl] != 0))
+			return false;
+	}
+
+	return numListed == NumFreeBlocks;
+}
+
+HeapPool::HeapPool(uint64_t InBlockSize, uint64_t InBlockGranularity)
+	: BlockSize(AlignUp(InBlockSize, InBlockGranularity)), BlockGranularity(InBlockGranularity)
+{
+}
+
+HeapPool::~HeapPool()
+{
+	for (uint32_t i = 0; i < Blocks.size(); i++)
+	{
+		if (Blocks[i].Allocator)
+			DestroyBlock(i);
+	}
+}
+
+uint32_t HeapPool::CreateBlock(uint64_t InSize, bool bDedicated)
+{
+	uint32_t index = 0;
+	while (index < Blocks.size() && Blocks[index].Allocator)
+		index++;
+
+	if (OnCreateBlock && !OnCreateBlock(index, InSize))
+		return HEAP_ALLOCATOR_INVALID;
+
+	if (index == Blocks.size())
+		Blocks.push_back(Block());
+
+	Blocks[index].Allocator = make_unique<TLSFAllocator>(InSize);
+	Blocks[index].bDedicated = bDedicated;
+
+	ReservedBytes += InSize;
+	Counters.PeakBytes = max(Counters.PeakBytes, ReservedBytes);
+	return index;
+}
+
+void HeapPool::DestroyBlock(uint32_t Index)
+{
+	if (OnDestroyBlock)
+		OnDestroyBlock(Index);
+
+	ReservedBytes -= Blocks[Index].Allocator->GetSize();
+	Blocks[Index].Allocator = nullptr;
+	Blocks[Index].bDedicated = false;
+}
+
+bool HeapPool::HasOtherEmptyBlock(uint32_t Index) const
+{
+	for (uint32_t i = 0; i < Blocks.size(); i++)
+	{
+		if (i != Index && Blocks[i].Allocator && !Blocks[i].bDedicated && Blocks[i].Allocator->IsEmpty())
+			return true;
+	}
+	return false;
+}
+
+HeapAllocation HeapPool::Allocate(uint64_t Size, uint64_t Alignment, void* UserData)
+{
+	HeapAllocation allocation;
+	allocation.UserData = UserData;
+
+	// doesn't fit a regular block even when it is empty. its own heap starts at offset 0, aligned to anything.
+	if (Size + Alignment > BlockSize)
+	{
+		allocation.Block = CreateBlock(AlignUp(Size, BlockGranularity), true);
+		if (allocation.Block == HEAP_ALLOCATOR_INVALID)
+		{
+			Counters.NumFailed++;
+			return allocation;
+		}
+
+		allocation.Range = Blocks[allocation.Block].Allocator->Allocate(Size, 1, UserData);
+		Counters.NumAllocs++;
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i < Blocks.size(); i++)
+	{
+		if (!Blocks[i].Allocator || Blocks[i].bDedicated)
+			continue;
+
+		allocation.Range = Blocks[i].Allocator->Allocate(Size, Alignment, UserData);
+		if (allocation.Range.IsValid())
+		{
+			allocation.Block = i;
+			Counters.NumAllocs++;
+			return allocation;
+		}
+	}
+
+	allocation.Block = CreateBlock(BlockSize, false);
+	if (allocation.Block == HEAP_ALLOCATOR_INVALID)
+	{
+		Counters.NumFailed++;
+		return allocation;
+	}
+
+	allocation.Range = Blocks[allocation.Block].Allocator->Allocate(Size, Alignment, UserData);
+	Counters.NumAllocs++;
+	return allocation;
+}
+
+void HeapPool::Free(const HeapAllocation& Allocation)
+{
+	if (!Allocation.IsValid())
+		return;
+
+	Block& block = Blocks[Allocation.Block];
+	block.Allocator->Free(Allocation.Range);
+	Counters.NumFrees++;
+
+	if (block.Allocator->IsEmpty() && (block.bDedicated || HasOtherEmptyBlock(Allocation.Block)))
+		DestroyBlock(Allocation.Block);
+}
+
+vector<HeapMove> HeapPool::PlanDefragmentation(uint32_t MaxMoves)
+{
+	vector<HeapMove> moves;
+
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < Blocks.size(); i++)
+	{
+		if (Blocks[i].Allocator && !Blocks[i].bDedicated && !Blocks[i].Allocator->IsEmpty())
+			order.push_back(i);
+	}
+
+	// emptiest first as sources, fullest first as destinations
+	sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return Blocks[a].Allocator->GetStats().UsedBytes < Blocks[b].Allocator->GetStats().UsedBytes;
+	});
+
+	vector<bool> bSource(Blocks.size(), false);
+	vector<bool> bDestination(Blocks.size(), false);
+
+	for (uint32_t source : order)
+	{
+		if (bDestination[source])
+			continue;
+
+		vector<TLSFBlockInfo> used;
+		Blocks[source].Allocator->ForEachBlock([&](const TLSFBlockInfo& Info)
+		{
+			if (!Info.bFree)
+				used.push_back(Info);
+		});
+
+		if (moves.size() + used.size() > MaxMoves)
+			break;
+
+		// all or nothing, a half emptied block doesn't give anything back
+		vector<HeapMove> blockMoves;
+		for (const TLSFBlockInfo& info : used)
+		{
+			HeapMove move;
+			move.From.Block = source;
+			move.From.Range = info.Allocation;
+			move.From.UserData = info.UserData;
+
+			for (auto it = order.rbegin(); it != order.rend(); ++it)
+			{
+				const uint32_t dest = *it;
+				if (dest == source || bSource[dest])
+					continue;
+
+				move.To.Range = Blocks[dest].Allocator->Allocate(info.Allocation.Size, info.Alignment, info.UserData);
+				if (move.To.Range.IsValid())
+				{
+					move.To.Block = dest;
+					move.To.UserData = info.UserData;
+					break;
+				}
+			}
+
+			if (!move.To.IsValid())
+				break;
+
+			blockMoves.push_back(move);
+		}
+
+		if (blockMoves.size() != used.size())
+		{
+			for (HeapMove& move : blockMoves)
+				Blocks[move.To.Block].Allocator->Free(move.To.Range);
+			continue;
+		}
+
+		bSource[source] = true;
+		for (HeapMove& move : blockMoves)
+		{
+			bDestination[move.To.Block] = true;
+			Counters.NumAllocs++;
+			moves.push_back(move);
+		}
+	}
+
+	return moves;
+}
+
+HeapPoolStats HeapPool::GetStats() const
+{
+	HeapPoolStats stats = Counters;
+	for (const Block& block : Blocks)
+	{
+		if (!block.Allocator)
+			continue;
+
+		HeapAllocatorStats blockStats = block.Allocator->GetStats();
+		stats.Allocator.TotalBytes += blockStats.TotalBytes;
+		stats.Allocator.UsedBytes += blockStats.UsedBytes;
+		stats.Allocator.FreeBytes += blockStats.FreeBytes;
+		stats.Allocator.LargestFreeBlock = max(stats.Allocator.LargestFreeBlock, blockStats.LargestFreeBlock);
+		stats.Allocator.NumAllocations += blockStats.NumAllocations;
+		stats.Allocator.NumFreeBlocks += blockStats.NumFreeBlocks;
+
+		stats.NumBlocks++;
+		if (block.bDedicated)
+			stats.NumDedicatedBlocks++;
+	}
+	return stats;
+}
+
+bool HeapPool::Validate() const
+{
+	uint64_t reserved = 0;
+	for (const Block& block : Blocks)
+	{
+		if (!block.Allocator)
+			continue;
+
+		if (!block.Allocator->Validate())
+			return false;
+		reserved += block.Allocator->GetSize();
+	}
+	return reserved == ReservedBytes;
+}
+
+uint64_t PlanTransientOffsets(vector<TransientRange>& Ranges)
+{
+	vector<uint32_t> order;
+	for (uint32_t i = 0; i < Ranges.size(); i++)
+	{
+		if (Ranges[i].IsUsed())
+			order.push_back(i);
+	}
+
+	sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		if (Ranges[a].Size != Ranges[b].Size)
+			return Ranges[a].Size > Ranges[b].Size;
+		return Ranges[a].FirstPass < Ranges[b].FirstPass;
+	});
+
+	uint64_t heapSize = 0;
+	vector<uint32_t> placed;
+	vector<pair<uint64_t, uint64_t>> busy;
+	for (uint32_t index : order)
+	{
+		TransientRange& range = Ranges[index];
+		const uint64_t alignment = max(range.Alignment, HEAP_ALLOCATOR_GRANULARITY);
+
+		busy.clear();
+		for (uint32_t other : placed)
+		{
+			if (range.Overlaps(Ranges[other]))
+				busy.push_back({ Ranges[other].Offset, Ranges[other].Offset + Ranges[other].Size });
+		}
+		sort(busy.begin(), busy.end());
+
+		// the offset only moves up, so whatever was skipped before stays behind it
+		uint64_t offset = 0;
+		for (auto& b : busy)
+		{
+			if (offset < b.second && offset + range.Size > b.first)
+				offset = AlignUp(b.second, alignment);
+		}
+
+		range.Offset = offset;
+		heapSize = max(heapSize, offset + range.Size);
+		placed.push_back(index);
+	}
+
+	for (TransientRange& range : Ranges)
+	{
+		if (!range.IsUsed())
+		{
+			range.Offset = 0;
+			heapSize = max(heapSize, range.Size);
+		}
+	}
+	return heapSize;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+
+using namespace std;
+
+// Offset allocators for sub allocating gpu heaps. no graphics api in here, the d3d12 side (PlacedHeapPool in SimpleDX12)
+// only creates the heaps the pool asks for and places resources at the offsets it hands out.
+//
+// TLSFAllocator : two level segregated fit over one range. O(1) allocate/free, free neighbours are merged right away.
+// HeapPool : a growing list of TLSFAllocators ("blocks", one per heap). requests bigger than the block size get a dedicated block.
+// PlanTransientOffsets : offsets for resources that live between two passes of a frame, ones that are never alive together share memory.
+
+#define HEAP_ALLOCATOR_INVALID 0xffffffffu
+
+// every offset and size is a multiple of this. smaller than any d3d12 placement alignment.
+#define HEAP_ALLOCATOR_GRANULARITY uint64_t(256)
+
+struct TLSFAllocation
+{
+	uint64_t Offset = 0;
+	uint64_t Size = 0;
+	uint32_t Node = HEAP_ALLOCATOR_INVALID;
+
+	bool IsValid() const { return Node != HEAP_ALLOCATOR_INVALID; }
+};
+
+struct TLSFBlockInfo
+{
+	TLSFAllocation Allocation;
+	uint64_t Alignment = 0;
+	void* UserData = nullptr;
+	bool bFree = false;
+};
+
+struct HeapAllocatorStats
+{
+	uint64_t TotalBytes = 0;
+	uint64_t UsedBytes = 0;
+	uint64_t FreeBytes = 0;
+	uint64_t LargestFreeBlock = 0;
+	uint32_t NumAllocations = 0;
+	uint32_t NumFreeBlocks = 0;
+
+	// 0 when all free memory is one range, towards 1 when it is scattered in small pieces
+	float GetFragmentation() const { return FreeBytes > 0 ? 1.0f - float(double(LargestFreeBlock) / double(FreeBytes)) : 0.0f; }
+};
+
+class TLSFAllocator
+{
+	static const uint32_t SLBits = 4;
+	static const uint32_t NumSL = 1 << SLBits;
+	static const uint32_t NumFL = 64;
+
+	struct Node
+	{
+		uint64_t Offset = 0;
+		uint64_t Size = 0;
+		uint32_t PrevPhys = HEAP_ALLOCATOR_INVALID;
+		uint32_t NextPhys = HEAP_ALLOCATOR_INVALID;
+		uint32_t PrevFree = HEAP_ALLOCATOR_INVALID;
+		uint32_t NextFree = HEAP_ALLOCATOR_INVALID;
+		uint64_t Alignment = 0;
+		void* UserData = nullptr;
+		bool bFree = false;
+	};
+
+	uint64_t Size = 0;
+	vector<Node> Nodes;
+	vector<uint32_t> UnusedNodes;
+	uint32_t Head = HEAP_ALLOCATOR_INVALID; // node at offset 0
+
+	uint64_t FLBitmap = 0;
+	uint32_t SLBitmap[NumFL] = {};
+	uint32_t FreeHeads[NumFL][NumSL];
+
+	uint64_t UsedBytes = 0;
+	uint32_t NumAllocations = 0;
+	uint32_t NumFreeBlocks = 0;
+
+	uint32_t NewNode();
+	void InsertFree(uint32_t Index);
+	void RemoveFree(uint32_t Index);
+	uint32_t FindFree(uint64_t MinSize) const;
+	uint32_t SplitFront(uint32_t Index, uint64_t FrontSize);
+
+public:
+	TLSFAllocator(uint64_t InSize);
+
+	// Alignment has to be a power of two. returns an invalid allocation when nothing fits.
+	TLSFAllocation Allocate(uint64_t InSize, uint64_t Alignment, void* UserData = nullptr);
+	void Free(const TLSFAllocation& Allocation);
+
+	uint64_t GetSize() const { return Size; }
+	bool IsEmpty() const { return NumAllocations == 0; }
+	HeapAllocatorStats GetStats() const;
+
+	// walks the range in address order, used and free blocks alike
+	void ForEachBlock(const function<void(const TLSFBlockInfo& Info)>& Func) const;
+
+	// checks the free lists, the bitmaps and the physical chain against each other
+	bool Validate() const;
+};
+
+struct HeapAllocation
+{
+	uint32_t Block = HEAP_ALLOCATOR_INVALID;
+	TLSFAllocation Range;
+	void* UserData = nullptr;
+
+	bool IsValid() const { return Block != HEAP_ALLOCATOR_INVALID; }
+	uint64_t GetOffset() const { return Range.Offset; }
+};
+
+// To is already allocated. the owner of From copies its data over, switches to To and frees From.
+struct HeapMove
+{
+	HeapAllocation From;
+	HeapAllocation To;
+};
+
+struct HeapPoolStats
+{
+	HeapAllocatorStats Allocator; // summed over the blocks. LargestFreeBlock is the largest of them
+	uint32_t NumBlocks = 0;
+	uint32_t NumDedicatedBlocks = 0;
+	uint64_t PeakBytes = 0;
+	uint64_t NumAllocs = 0;
+	uint64_t NumFrees = 0;
+	uint64_t NumFailed = 0;
+};
+
+class HeapPool
+{
+	struct Block
+	{
+		unique_ptr<TLSFAllocator> Allocator;
+		bool bDedicated = false;
+	};
+
+	vector<Block> Blocks; // destroyed blocks leave a hole so indices of the live ones stay put
+	uint64_t BlockSize = 0;
+	uint64_t BlockGranularity = 0;
+	uint64_t ReservedBytes = 0;
+	HeapPoolStats Counters;
+
+	uint32_t CreateBlock(uint64_t InSize, bool bDedicated);
+	void DestroyBlock(uint32_t Index);
+	bool HasOtherEmptyBlock(uint32_t Index) const;
+
+public:
+	// the backend creates/releases the heap behind a block. returning false from OnCreateBlock fails the allocation.
+	function<bool(uint32_t Block, uint64_t Size)> OnCreateBlock;
+	function<void(uint32_t Block)> OnDestroyBlock;
+
+	// dedicated block sizes are rounded up to InBlockGranularity
+	HeapPool(uint64_t InBlockSize, uint64_t InBlockGranularity);
+	~HeapPool();
+
+	HeapAllocation Allocate(uint64_t Size, uint64_t Alignment, void* UserData = nullptr);
+
+	// empty blocks are released right away. one empty regular block is kept so alloc/free at the edge doesn't recreate heaps.
+	void Free(const HeapAllocation& Allocation);
+
+	// moves allocations out of the emptiest blocks into the others, at most MaxMoves.
+	// once every From is freed those blocks are empty and get released.
+	vector<HeapMove> PlanDefragmentation(uint32_t MaxMoves);
+
+	HeapPoolStats GetStats() const;
+	uint64_t GetBlockSize() const { return BlockSize; }
+	bool Validate() const;
+};
+
+// a resource that only holds data from the first to the last pass using it within a frame
+struct TransientRange
+{
+	uint64_t Size = 0;
+	uint64_t Alignment = 0;
+	uint32_t FirstPass = HEAP_ALLOCATOR_INVALID; // invalid when no pass uses it
+	uint32_t LastPass = 0;
+
+	uint64_t Offset = 0; // filled by PlanTransientOffsets
+
+	bool IsUsed() const { return FirstPass != HEAP_ALLOCATOR_INVALID; }
+	bool Overlaps(const TransientRange& Other) const { return FirstPass <= Other.LastPass && Other.FirstPass <= LastPass; }
+};
+
+// places the ranges in one heap so ranges with overlapping pass lifetimes never share bytes. biggest first, each at the lowest
+// offset that fits. unused ranges go to offset 0, they alias everything. returns the heap size the placement needs.
+uint64_t PlanTransientOffsets(vector<TransientRange>& Ranges);
@@ -0,0 +1,872 @@
+#include "MeshCache.h"
+#include "MeshOptimize.h"
+#include "MeshSimplify.h"
+#include "Utils.h"
+
+#include <map>
+#include <codecvt>
+#include <sstream>
+#include "assimp/include/Importer.hpp"
+#include "assimp/include/scene.h"
+#include "assimp/include/postprocess.h"
+#include "enkiTS/TaskScheduler.h"
+
+#define align_to(_alignment, _val) (((_val + _alignment - 1) / _alignment) * _alignment)
+
+static bool GetSourceFileInfo(const wstring& SourceFile, UINT64& OutSize, UINT64& OutWriteTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExW(SourceFile.c_str(), GetFileExInfoStandard, &attr))
+		return false;
+
+	OutSize = (UINT64(attr.nFileSizeHigh) << 32) | attr.nFileSizeLow;
+	OutWriteTime = (UINT64(attr.ftLastWriteTime.dwHighDateTime) << 32) | attr.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+static void CopyTextureName(wchar_t* Dst, const wstring& Src)
+{
+	wcsncpy_s(Dst, COOKED_TEXTURE_NAME_LENGTH, Src.c_str(), _TRUNCATE);
+}
+
+// one unit of work for the mesh conversion task. a mesh is split into ranges of at most MeshConvertChunkSize vertices/triangles.
+static const UINT MeshConvertChunkSize = 16 * 1024;
+
+struct MeshConvertWork
+{
+	const aiMesh* asMesh;
+	CookedVertex* Vertices;
+	UINT8* Indices;
+	UINT IndexStride;
+	UINT VertexStart;
+	UINT VertexEnd;
+	UINT TriStart;
+	UINT TriEnd;
+
+	glm::vec3 AABBMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	glm::vec3 AABBMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+};
+
+// single pass that writes each vertex once.
+static void ConvertMeshRange(MeshConvertWork& work)
+{
+	const aiMesh* asMesh = work.asMesh;
+	const bool bHasPositions = asMesh->HasPositions();
+	const bool bHasNormals = asMesh->HasNormals();
+	const bool bHasUVs = asMesh->HasTextureCoords(0);
+	const bool bHasTangents = asMesh->HasTangentsAndBitangents();
+
+	for (UINT i = work.VertexStart; i < work.VertexEnd; ++i)
+	{
+		CookedVertex& v = work.Vertices[i];
+
+		if (bHasPositions)
+		{
+			v.Position = glm::vec3(asMesh->mVertices[i].x, asMesh->mVertices[i].y, asMesh->mVertices[i].z);
+			work.AABBMin = glm::min(work.AABBMin, v.Position);
+			work.AABBMax = glm::max(work.AABBMax, v.Position);
+		}
+		else
+			v.Position = glm::vec3(0, 0, 0);
+
+		v.Normal = bHasNormals ? glm::vec3(asMesh->mNormals[i].x, asMesh->mNormals[i].y, asMesh->mNormals[i].z) : glm::vec3(0, 0, 0);
+		v.UV = bHasUVs ? glm::vec2(asMesh->mTextureCoords[0][i].x, asMesh->mTextureCoords[0][i].y) : glm::vec2(0, 0);
+		v.Tangent = bHasTangents ? glm::vec3(asMesh->mTangents[i].x, asMesh->mTangents[i].y, asMesh->mTangents[i].z) : glm::vec3(0, 0, 0);
+	}
+
+	if (work.IndexStride == sizeof(UINT16))
+	{
+		UINT16* indices = reinterpret_cast<UINT16*>(work.Indices);
+		for (UINT triIdx = work.TriStart; triIdx < work.TriEnd; ++triIdx)
+		{
+			indices[triIdx * 3 + 0] = UINT16(asMesh->mFaces[triIdx].mIndices[0]);
+			indices[triIdx * 3 + 1] = UINT16(asMesh->mFaces[triIdx].mIndices[1]);
+			indices[triIdx * 3 + 2] = UINT16(asMesh->mFaces[triIdx].mIndices[2]);
+		}
+	}
+	else
+	{
+		UINT32* indices = reinterpret_cast<UINT32*>(work.Indices);
+		for (UINT triIdx = work.TriStart; triIdx < work.TriEnd; ++triIdx)
+		{
+			indices[triIdx * 3 + 0] = asMesh->mFaces[triIdx].mIndices[0];
+			indices[triIdx * 3 + 1] = asMesh->mFaces[triIdx].mIndices[1];
+			indices[triIdx * 3 + 2] = asMesh->mFaces[triIdx].mIndices[2];
+		}
+	}
+}
+
+struct ConvertMeshTaskSet : enki::ITaskSet
+{
+	vector<MeshConvertWork>* Works;
+
+	virtual void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum)
+	{
+		for (uint32_t i = range.start; i < range.end; i++)
+			ConvertMeshRange((*Works)[i]);
+	}
+};
+
+// optional reorder of one mesh in place, then packed vertices, meshlets and LODs from the final order.
+// indices are widened to 32 bit for all of them and written back at the mesh's stride. LOD indices are returned in OutLodIndices[1..]
+// since their size isn't known when the index stream is laid out.
+static void FinalizeCookedMesh(CookedMesh& Mesh, MeshImportData& Data, bool bOptimize, PositionQuantization& OutQuantization, MeshletData& OutMeshlets,
+	vector<vector<UINT32>>& OutLodIndices)
+{
+	vector<UINT32> indices(Mesh.NumIndices);
+	UINT8* src = Data.Indices.data() + Mesh.IndexByteOffset;
+	for (UINT i = 0; i < Mesh.NumIndices; i++)
+		indices[i] = Mesh.IndexStride == sizeof(UINT16) ? reinterpret_cast<UINT16*>(src)[i] : reinterpret_cast<UINT32*>(src)[i];
+
+	CookedVertex* vertices = Data.Vertices.data() + Mesh.VertexOffset;
+
+	if (bOptimize)
+	{
+		OptimizeMesh(indices.data(), Mesh.NumIndices, vertices, Mesh.NumVertices);
+
+		for (UINT i = 0; i < Mesh.NumIndices; i++)
+		{
+			if (Mesh.IndexStride == sizeof(UINT16))
+				reinterpret_cast<UINT16*>(src)[i] = UINT16(indices[i]);
+			else
+				reinterpret_cast<UINT32*>(src)[i] = indices[i];
+		}
+	}
+
+	PackMeshVertices(vertices, Mesh.NumVertices, Data.PackedVertices.data() + Mesh.VertexOffset, OutQuantization);
+	for (UINT i = 0; i < Mesh.NumVertices; i++)
+		Data.Positions[Mesh.VertexOffset + i] = vertices[i].Position;
+
+	Mesh.NumLods = 1;
+	Mesh.Lods[0] = { Mesh.IndexByteOffset, Mesh.NumIndices, 0 };
+	Mesh.Center = glm::vec3(0, 0, 0);
+	Mesh.Radius = 0;
+
+	if (Mesh.NumVertices == 0)
+		return;
+
+	BuildMeshlets(indices.data(), Mesh.NumIndices, &vertices[0].Position.x, sizeof(CookedVertex), Mesh.NumVertices, OutMeshlets);
+
+	glm::vec3 aabbMin = vertices[0].Position;
+	glm::vec3 aabbMax = vertices[0].Position;
+	for (UINT i = 1; i < Mesh.NumVertices; i++)
+	{
+		aabbMin = glm::min(aabbMin, vertices[i].Position);
+		aabbMax = glm::max(aabbMax, vertices[i].Position);
+	}
+	Mesh.Center = (aabbMin + aabbMax) * 0.5f;
+	for (UINT i = 0; i < Mesh.NumVertices; i++)
+		Mesh.Radius = glm::max(Mesh.Radius, glm::length(vertices[i].Position - Mesh.Center));
+
+	// each LOD halves the previous one. error is accumulated since every step only measures against its source.
+	OutLodIndices.resize(MESH_MAX_LODS);
+	const vector<UINT32>* lodSource = &indices;
+	float error = 0;
+	for (UINT lod = 1; lod < MESH_MAX_LODS; lod++)
+	{
+		const UINT numSourceTriangles = lodSource->size() / 3;
+		if (numSourceTriangles < MESH_LOD_MIN_TRIANGLES)
+			break;
+
+		vector<UINT32>& lodIndices = OutLodIndices[lod];
+		float lodError = 0;
+		SimplifyMesh(lodSource->data(), lodSource->size(), vertices, Mesh.NumVertices, numSourceTriangles / 2 * 3, lodIndices, lodError);
+
+		// mostly seams and borders, not worth another draw range
+		if (lodIndices.size() > lodSource->size() * 3 / 4)
+		{
+			lodIndices.clear();
+			break;
+		}
+
+		if (bOptimize)
+			OptimizeVertexCache(lodIndices.data(), lodIndices.size(), Mesh.NumVertices);
+
+		error += lodError;
+		Mesh.Lods[lod] = { 0, UINT32(lodIndices.size()), error };
+		Mesh.NumLods++;
+		lodSource = &lodIndices;
+	}
+}
+
+struct FinalizeMeshTaskSet : enki::ITaskSet
+{
+	MeshImportData* Data;
+	vector<MeshletData>* Meshlets;
+	vector<vector<vector<UINT32>>>* LodIndices;
+	bool bOptimize;
+
+	virtual void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum)
+	{
+		for (uint32_t i = range.start; i < range.end; i++)
+			FinalizeCookedMesh(Data->Meshes[i], *Data, bOptimize, Data->Quantizations[i], (*Meshlets)[i], (*LodIndices)[i]);
+	}
+};
+
+// lays the index stream out again with the LODs of each mesh right after its full detail indices.
+// 16 bit meshes still come first so both widths keep their own section.
+static void AppendLodIndices(MeshImportData& Data, const vector<vector<vector<UINT32>>>& LodIndices)
+{
+	vector<UINT8> stream;
+	stream.reserve(Data.Indices.size() * 2);
+
+	for (UINT stride : { sizeof(UINT16), sizeof(UINT32) })
+	{
+		if (stride == sizeof(UINT32))
+		{
+			stream.resize(align_to(4, stream.size()), 0);
+			Data.Index32StreamOffset = stream.size();
+		}
+
+		for (UINT i = 0; i < Data.Meshes.size(); i++)
+		{
+			CookedMesh& mesh = Data.Meshes[i];
+			if (mesh.IndexStride != stride)
+				continue;
+
+			const UINT8* src = Data.Indices.data() + mesh.IndexByteOffset;
+			mesh.IndexByteOffset = stream.size();
+			mesh.Lods[0].IndexByteOffset = mesh.IndexByteOffset;
+			stream.insert(stream.end(), src, src + mesh.NumIndices * stride);
+
+			for (UINT lod = 1; lod < mesh.NumLods; lod++)
+			{
+				const vector<UINT32>& indices = LodIndices[i][lod];
+				mesh.Lods[lod].IndexByteOffset = stream.size();
+				stream.resize(stream.size() + indices.size() * stride);
+
+				UINT8* dst = stream.data() + mesh.Lods[lod].IndexByteOffset;
+				for (UINT j = 0; j < indices.size(); j++)
+				{
+					if (stride == sizeof(UINT16))
+						reinterpret_cast<UINT16*>(dst)[j] = UINT16(indices[j]);
+					else
+						reinterpret_cast<UINT32*>(dst)[j] = indices[j];
+				}
+			}
+		}
+	}
+
+	Data.Indices.swap(stream);
+}
+
+wstring GetCookedScenePath(const wstring& SourceFile)
+{
+	return SourceFile + L".cooked";
+}
+
+static UINT32 GetCookFlags(bool bOptimize)
+{
+	return bOptimize ? COOKED_SCENE_OPTIMIZED : 0;
+}
+
+bool ImportMeshFromFile(const string& FileName, MeshImportData& OutData, enki::TaskScheduler* TS, bool bOptimize)
+{
+	map<wstring, wstring> SponzaRoughnessMap = {
+	{L"Background_Albedo", L"Background_Roughness"},
+	{L"ChainTexture_Albedo", L"ChainTexture_Roughness"},
+	{L"Lion_Albedo", L"Lion_Roughness"},
+	{L"Sponza_Arch_diffuse", L"Sponza_Arch_roughness"},
+	{L"Sponza_Bricks_a_Albedo", L"Sponza_Bricks_a_Roughness"},
+	{L"Sponza_Ceiling_diffuse", L"Sponza_Ceiling_roughness"},
+	{L"Sponza_Column_a_diffuse", L"Sponza_Column_a_roughness"},
+	{L"Sponza_Column_b_diffuse", L"Sponza_Column_b_roughness"},
+	{L"Sponza_Column_c_diffuse", L"Sponza_Column_c_roughness"},
+	{L"Sponza_Curtain_Blue_diffuse", L"Sponza_Curtain_roughness"},
+	{L"Sponza_Curtain_Green_diffuse", L"Sponza_Curtain_roughness"},
+	{L"Sponza_Curtain_Red_diffuse", L"Sponza_Curtain_roughness"},
+	{L"Sponza_Details_diffuse", L"Sponza_Details_roughness"},
+	{L"Sponza_Fabric_Blue_diffuse", L"Sponza_Fabric_roughness"},
+	{L"Sponza_Fabric_Green_diffuse", L"Sponza_Fabric_roughness"},
+	{L"Sponza_Fabric_Red_diffuse", L"Sponza_Fabric_roughness"},
+	{L"Sponza_FlagPole_diffuse", L"Sponza_FlagPole_roughness"},
+	{L"Sponza_Floor_diffuse", L"Sponza_Floor_roughness"},
+	{L"Sponza_Roof_diffuse", L"Sponza_Roof_roughness"},
+	{L"Sponza_Thorn_diffuse", L"Sponza_Thorn_roughness"},
+	{L"Vase_diffuse", L"Vase_roughness"},
+	{L"VaseHanging_diffuse", L"VaseHanging_roughness"},
+	{L"VasePlant_diffuse", L"VasePlant_roughness"},
+	{L"VaseRound_diffuse", L"VaseRound_roughness"}
+	};
+
+	Assimp::Importer importer;
+	const aiScene* assimpScene = importer.ReadFile(FileName, 0);
+	if (!assimpScene)
+		return false;
+
+	UINT flags = aiProcess_CalcTangentSpace |
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_MakeLeftHanded |
+		aiProcess_RemoveRedundantMaterials |
+		aiProcess_FlipUVs |
+		aiProcess_FlipWindingOrder;
+
+		flags |= aiProcess_PreTransformVertices /*| aiProcess_OptimizeMeshes*/;
+
+	assimpScene = importer.ApplyPostProcessing(flags);
+	if (!assimpScene)
+		return false;
+
+	OutData.CookFlags = GetCookFlags(bOptimize);
+
+	const int numMaterials = assimpScene->mNumMaterials;
+	OutData.Materials.resize(numMaterials);
+	for (int i = 0; i < numMaterials; ++i)
+	{
+		const aiMaterial& aiMat = *assimpScene->mMaterials[i];
+		CookedMaterial& mat = OutData.Materials[i];
+		ZeroMemory(&mat, sizeof(CookedMaterial));
+
+		wstring wDiffuseTex;
+		wstring wNormalTex;
+		wstring wRoughnessTex;
+		wstring wMetallicTex;
+
+		aiString diffuseTexPath;
+		aiString normalMapPath;
+		aiString metallicMapPath;
+
+		if (aiMat.GetTexture(aiTextureType_DIFFUSE, 0, &diffuseTexPath) == aiReturn_SUCCESS)
+			wDiffuseTex = GetFileName(AnsiToWString(diffuseTexPath.C_Str()).c_str());
+
+		if (aiMat.GetTexture(aiTextureType_NORMALS, 0, &normalMapPath) == aiReturn_SUCCESS
+			|| aiMat.GetTexture(aiTextureType_HEIGHT, 0, &normalMapPath) == aiReturn_SUCCESS)
+			wNormalTex = GetFileName(AnsiToWString(normalMapPath.C_Str()).c_str());
+
+		if (aiMat.GetTexture(aiTextureType_AMBIENT, 0, &metallicMapPath) == aiReturn_SUCCESS)
+			wMetallicTex = GetFileName(AnsiToWString(metallicMapPath.C_Str()).c_str());
+
+		if (wDiffuseTex.length() != 0)
+		{
+			wstring wNameStr = wstring(wDiffuseTex.substr(0, wDiffuseTex.length() - 4));
+			map<wstring, wstring> ::iterator it = SponzaRoughnessMap.find(wNameStr);
+			if (it != SponzaRoughnessMap.end())
+				wRoughnessTex = it->second + L".png";
+		}
+
+		CopyTextureName(mat.Diffuse, wDiffuseTex);
+		CopyTextureName(mat.Normal, wNormalTex);
+		CopyTextureName(mat.Roughness, wRoughnessTex);
+		CopyTextureName(mat.Metallic, wMetallicTex);
+
+		// HACK!
+		if (wDiffuseTex == L"Sponza_Thorn_diffuse.png" || wDiffuseTex == L"VasePlant_diffuse.png" || wDiffuseTex == L"ChainTexture_Albedo.png")
+			mat.bHasAlpha = 1;
+	}
+
+	const UINT numMeshes = assimpScene->mNumMeshes;
+
+	// index width is picked per mesh. 16 bit meshes are packed first and 32 bit ones after, so the renderer can
+	// put each width in its own scene wide index buffer.
+	OutData.Meshes.resize(numMeshes);
+
+	UINT totalNumVert = 0;
+	UINT index16StreamSize = 0;
+	UINT index32StreamSize = 0;
+	for (UINT i = 0; i < numMeshes; ++i)
+	{
+		aiMesh* asMesh = assimpScene->mMeshes[i];
+		CookedMesh& mesh = OutData.Meshes[i];
+
+		mesh.VertexOffset = totalNumVert;
+		mesh.NumVertices = asMesh->mNumVertices;
+		mesh.NumIndices = asMesh->mNumFaces * 3;
+		mesh.IndexStride = mesh.NumVertices > 0xFFFF ? sizeof(UINT32) : sizeof(UINT16);
+		mesh.MaterialIndex = asMesh->mMaterialIndex;
+
+		if (mesh.IndexStride == sizeof(UINT16))
+		{
+			mesh.IndexByteOffset = index16StreamSize;
+			index16StreamSize += mesh.NumIndices * mesh.IndexStride;
+		}
+		else
+		{
+			mesh.IndexByteOffset = index32StreamSize;
+			index32StreamSize += mesh.NumIndices * mesh.IndexStride;
+		}
+
+		totalNumVert += mesh.NumVertices;
+	}
+
+	OutData.Index32StreamOffset = align_to(4, index16StreamSize);
+	for (auto& mesh : OutData.Meshes)
+	{
+		if (mesh.IndexStride == sizeof(UINT32))
+			mesh.IndexByteOffset += OutData.Index32StreamOffset;
+	}
+
+	OutData.Vertices.resize(totalNumVert);
+	OutData.Indices.resize(OutData.Index32StreamOffset + index32StreamSize, 0);
+
+	// offsets are known up front, so meshes can be split into vertex/triangle ranges and converted in any order.
+	vector<MeshConvertWork> works;
+	for (UINT i = 0; i < numMeshes; ++i)
+	{
+		aiMesh* asMesh = assimpScene->mMeshes[i];
+		const CookedMesh& mesh = OutData.Meshes[i];
+
+		const UINT numTriangles = asMesh->mNumFaces;
+		const UINT numChunks = glm::max(1u, (glm::max(mesh.NumVertices, numTriangles) + MeshConvertChunkSize - 1) / MeshConvertChunkSize);
+		for (UINT chunk = 0; chunk < numChunks; chunk++)
+		{
+			MeshConvertWork work;
+			work.asMesh = asMesh;
+			work.Vertices = OutData.Vertices.data() + mesh.VertexOffset;
+			work.Indices = OutData.Indices.data() + mesh.IndexByteOffset;
+			work.IndexStride = mesh.IndexStride;
+			work.VertexStart = UINT64(mesh.NumVertices) * chunk / numChunks;
+			work.VertexEnd = UINT64(mesh.NumVertices) * (chunk + 1) / numChunks;
+			work.TriStart = UINT64(numTriangles) * chunk / numChunks;
+			work.TriEnd = UINT64(numTriangles) * (chunk + 1) / numChunks;
+			works.push_back(work);
+		}
+	}
+
+	if (TS && works.size() > 1)
+	{
+		ConvertMeshTaskSet task;
+		task.Works = &works;
+		task.m_SetSize = works.size();
+		TS->AddTaskSetToPipe(&task);
+		TS->WaitforTask(&task);
+	}
+	else
+	{
+		for (auto& work : works)
+			ConvertMeshRange(work);
+	}
+
+	// meshes don't share vertices or indices, so each one is optimized, split into meshlets and simplified independently.
+	vector<MeshletData> meshlets(numMeshes);
+	vector<vector<vector<UINT32>>> lodIndices(numMeshes);
+	OutData.PackedVertices.resize(totalNumVert);
+	OutData.Quantizations.resize(numMeshes);
+	OutData.Positions.resize(totalNumVert);
+	if (TS && numMeshes > 1)
+	{
+		FinalizeMeshTaskSet task;
+		task.Data = &OutData;
+		task.Meshlets = &meshlets;
+		task.LodIndices = &lodIndices;
+		task.bOptimize = bOptimize;
+		task.m_SetSize = numMeshes;
+		TS->AddTaskSetToPipe(&task);
+		TS->WaitforTask(&task);
+	}
+	else
+	{
+		for (UINT i = 0; i < numMeshes; ++i)
+			FinalizeCookedMesh(OutData.Meshes[i], OutData, bOptimize, OutData.Quantizations[i], meshlets[i], lodIndices[i]);
+	}
+
+	AppendLodIndices(OutData, lodIndices);
+
+	// concatenate per mesh meshlets into the scene wide sections
+	for (UINT i = 0; i < numMeshes; ++i)
+	{
+		CookedMesh& mesh = OutData.Meshes[i];
+		MeshletData& src = meshlets[i];
+		MeshletData& dst = OutData.Meshlets;
+
+		mesh.MeshletOffset = dst.Meshlets.size();
+		mesh.NumMeshlets = src.Meshlets.size();
+
+		UINT32 vertexBase = dst.Vertices.size();
+		UINT32 triangleBase = dst.Triangles.size() / 3;
+		for (auto& m : src.Meshlets)
+		{
+			m.VertexOffset += vertexBase;
+			m.TriangleOffset += triangleBase;
+		}
+
+		dst.Meshlets.insert(dst.Meshlets.end(), src.Meshlets.begin(), src.Meshlets.end());
+		dst.Vertices.insert(dst.Vertices.end(), src.Vertices.begin(), src.Vertices.end());
+		dst.Triangles.insert(dst.Triangles.end(), src.Triangles.begin(), src.Triangles.end());
+	}
+
+	// merge per-task bounds
+	for (auto& work : works)
+	{
+		OutData.AABBMin = glm::min(OutData.AABBMin, work.AABBMin);
+		OutData.AABBMax = glm::max(OutData.AABBMax, work.AABBMax);
+	}
+	if (totalNumVert > 0)
+		OutData.BoundingRadius = glm::max(glm::length(OutData.AABBMin), glm::length(OutData.AABBMax));
+
+	return true;
+}
+
+static void FillHeader(const MeshImportData& Data, CookedSceneHeader& header)
+{
+	header = {};
+	header.Magic = COOKED_SCENE_MAGIC;
+	header.Version = COOKED_SCENE_VERSION;
+
+	header.NumMeshes = Data.Meshes.size();
+	header.NumMaterials = Data.Materials.size();
+	header.NumVertices = Data.Vertices.size();
+	header.IndexStreamSize = Data.Indices.size();
+	header.Index32StreamOffset = Data.Index32StreamOffset;
+	header.CookFlags = Data.CookFlags;
+
+	header.MeshOffset = align_to(16, sizeof(CookedSceneHeader));
+	header.MaterialOffset = align_to(16, header.MeshOffset + sizeof(CookedMesh) * header.NumMeshes);
+	header.VertexOffset = align_to(16, header.MaterialOffset + sizeof(CookedMaterial) * header.NumMaterials);
+	header.IndexOffset = align_to(16, header.VertexOffset + sizeof(CookedVertex) * header.NumVertices);
+
+	header.NumMeshlets = Data.Meshlets.Meshlets.size();
+	header.NumMeshletVertices = Data.Meshlets.Vertices.size();
+	header.NumMeshletTriangles = Data.Meshlets.Triangles.size() / 3;
+	header.MeshletOffset = align_to(16, header.IndexOffset + header.IndexStreamSize);
+	header.MeshletVertexOffset = align_to(16, header.MeshletOffset + sizeof(Meshlet) * header.NumMeshlets);
+	header.MeshletTriangleOffset = align_to(16, header.MeshletVertexOffset + sizeof(UINT32) * header.NumMeshletVertices);
+
+	header.PackedVertexOffset = align_to(16, header.MeshletTriangleOffset + header.NumMeshletTriangles * 3);
+	header.QuantizationOffset = align_to(16, header.PackedVertexOffset + sizeof(PackedVertex) * header.NumVertices);
+	header.PositionOffset = align_to(16, header.QuantizationOffset + sizeof(PositionQuantization) * header.NumMeshes);
+
+	header.AABBMin = Data.AABBMin;
+	header.AABBMax = Data.AABBMax;
+	header.BoundingRadius = Data.BoundingRadius;
+}
+
+bool WriteCookedScene(const wstring& CookedFile, const wstring& SourceFile, const MeshImportData& Data)
+{
+	CookedSceneHeader header;
+	FillHeader(Data, header);
+	GetSourceFileInfo(SourceFile, header.SourceSize, header.SourceWriteTime);
+
+	UINT64 fileSize = header.PositionOffset + sizeof(glm::vec3) * header.NumVertices;
+	vector<UINT8> blob(fileSize, 0);
+
+	memcpy(&blob[0], &header, sizeof(CookedSceneHeader));
+	if (header.NumMeshes)
+		memcpy(&blob[header.MeshOffset], Data.Meshes.data(), sizeof(CookedMesh) * header.NumMeshes);
+	if (header.NumMaterials)
+		memcpy(&blob[header.MaterialOffset], Data.Materials.data(), sizeof(CookedMaterial) * header.NumMaterials);
+	if (header.NumVertices)
+	{
+		memcpy(&blob[header.VertexOffset], Data.Vertices.data(), sizeof(CookedVertex) * header.NumVertices);
+		memcpy(&blob[header.PackedVertexOffset], Data.PackedVertices.data(), sizeof(PackedVertex) * header.NumVertices);
+		memcpy(&blob[header.PositionOffset], Data.Positions.data(), sizeof(glm::vec3) * header.NumVertices);
+	}
+	if (header.NumMeshes)
+		memcpy(&blob[header.QuantizationOffset], Data.Quantizations.data(), sizeof(PositionQuantization) * header.NumMeshes);
+	if (header.IndexStreamSize)
+		memcpy(&blob[header.IndexOffset], Data.Indices.data(), header.IndexStreamSize);
+	if (header.NumMeshlets)
+	{
+		memcpy(&blob[header.MeshletOffset], Data.Meshlets.Meshlets.data(), sizeof(Meshlet) * header.NumMeshlets);
+		memcpy(&blob[header.MeshletVertexOffset], Data.Meshlets.Vertices.data(), sizeof(UINT32) * header.NumMeshletVertices);
+		memcpy(&blob[header.MeshletTriangleOffset], Data.Meshlets.Triangles.data(), header.NumMeshletTriangles * 3);
+	}
+
+	// write to temp file and rename, so a crash in the middle never leaves a half written cache behind.
+	wstring tempFile = CookedFile + L".tmp";
+	HANDLE file = CreateFileW(tempFile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD written = 0;
+	BOOL bWritten = WriteFile(file, blob.data(), (DWORD)blob.size(), &written, nullptr);
+	CloseHandle(file);
+
+	if (!bWritten || written != blob.size())
+	{
+		DeleteFileW(tempFile.c_str());
+		return false;
+	}
+
+	return MoveFileExW(tempFile.c_str(), CookedFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+// every section has to lie in the file after the header, 16 byte aligned like FillHeader puts it.
+// 64 bit math, so counts from a corrupt header can't wrap around.
+static void CheckSections(const CookedSceneHeader& Header, UINT64 FileSize, stringstream& ss)
+{
+	auto CheckSection = [&](const char* Name, UINT64 Offset, UINT64 Count, UINT64 ElementSize)
+	{
+		if (Offset < sizeof(CookedSceneHeader) || Offset % 16 != 0 || Offset > FileSize || Count * ElementSize > FileSize - Offset)
+			ss << Name << " section (offset " << Offset << ", " << Count << " x " << ElementSize << " bytes) is outside of the " << FileSize << " byte file\n";
+	};
+
+	CheckSection("mesh", Header.MeshOffset, Header.NumMeshes, sizeof(CookedMesh));
+	CheckSection("material", Header.MaterialOffset, Header.NumMaterials, sizeof(CookedMaterial));
+	CheckSection("vertex", Header.VertexOffset, Header.NumVertices, sizeof(CookedVertex));
+	CheckSection("index", Header.IndexOffset, Header.IndexStreamSize, 1);
+	CheckSection("meshlet", Header.MeshletOffset, Header.NumMeshlets, sizeof(Meshlet));
+	CheckSection("meshlet vertex", Header.MeshletVertexOffset, Header.NumMeshletVertices, sizeof(UINT32));
+	CheckSection("meshlet triangle", Header.MeshletTriangleOffset, Header.NumMeshletTriangles, 3);
+	CheckSection("packed vertex", Header.PackedVertexOffset, Header.NumVertices, sizeof(PackedVertex));
+	CheckSection("quantization", Header.QuantizationOffset, Header.NumMeshes, sizeof(PositionQuantization));
+	CheckSection("position", Header.PositionOffset, Header.NumVertices, sizeof(glm::vec3));
+
+	if (Header.Index32StreamOffset > Header.IndexStreamSize || Header.Index32StreamOffset % 4 != 0)
+		ss << "32 bit indices start at " << Header.Index32StreamOffset << " of " << Header.IndexStreamSize << " index bytes\n";
+}
+
+bool CookedScene::Open(const wstring& CookedFile, const wstring& SourceFile, bool bOptimize)
+{
+	Close();
+
+	File = CreateFileW(CookedFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(File, &size) || size.QuadPart < sizeof(CookedSceneHeader))
+	{
+		Close();
+		return false;
+	}
+	FileSize = size.QuadPart;
+
+	Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!Mapping)
+	{
+		Close();
+		return false;
+	}
+
+	View = (const UINT8*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!View)
+	{
+		Close();
+		return false;
+	}
+
+	Header = (const CookedSceneHeader*)View;
+	if (Header->Magic != COOKED_SCENE_MAGIC || Header->Version != COOKED_SCENE_VERSION || Header->CookFlags != GetCookFlags(bOptimize))
+	{
+		Close();
+		return false;
+	}
+
+	if (SourceFile.length() > 0)
+	{
+		UINT64 sourceSize = 0;
+		UINT64 sourceWriteTime = 0;
+		if (GetSourceFileInfo(SourceFile, sourceSize, sourceWriteTime)
+			&& (sourceSize != Header->SourceSize || sourceWriteTime != Header->SourceWriteTime))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	// the streams are only pointed at, what's in them is left to Validate
+	stringstream sectionErrors;
+	CheckSections(*Header, FileSize, sectionErrors);
+	if (sectionErrors.tellp() > 0)
+	{
+		Close();
+		return false;
+	}
+
+	Meshes = (const CookedMesh*)(View + Header->MeshOffset);
+	Materials = (const CookedMaterial*)(View + Header->MaterialOffset);
+	Vertices = (const CookedVertex*)(View + Header->VertexOffset);
+	Indices = View + Header->IndexOffset;
+	Meshlets = (const Meshlet*)(View + Header->MeshletOffset);
+	MeshletVertices = (const UINT32*)(View + Header->MeshletVertexOffset);
+	MeshletTriangles = View + Header->MeshletTriangleOffset;
+	PackedVertices = (const PackedVertex*)(View + Header->PackedVertexOffset);
+	Quantizations = (const PositionQuantization*)(View + Header->QuantizationOffset);
+	Positions = (const glm::vec3*)(View + Header->PositionOffset);
+
+	return true;
+}
+
+void CookedScene::OpenFromMemory(const MeshImportData& Data)
+{
+	Close();
+
+	FillHeader(Data, MemoryHeader);
+	Header = &MemoryHeader;
+	Meshes = Data.Meshes.data();
+	Materials = Data.Materials.data();
+	Vertices = Data.Vertices.data();
+	Indices = Data.Indices.data();
+	Meshlets = Data.Meshlets.Meshlets.data();
+	MeshletVertices = Data.Meshlets.Vertices.data();
+	MeshletTriangles = Data.Meshlets.Triangles.data();
+	PackedVertices = Data.PackedVertices.data();
+	Quantizations = Data.Quantizations.data();
+	Positions = Data.Positions.data();
+}
+
+void CookedScene::Close()
+{
+	if (View)
+		UnmapViewOfFile(View);
+	if (Mapping)
+		CloseHandle(Mapping);
+	if (File != INVALID_HANDLE_VALUE)
+		CloseHandle(File);
+
+	File = INVALID_HANDLE_VALUE;
+	Mapping = nullptr;
+	View = nullptr;
+	FileSize = 0;
+
+	Header = nullptr;
+	Meshes = nullptr;
+	Materials = nullptr;
+	Vertices = nullptr;
+	Indices = nullptr;
+	Meshlets = nullptr;
+	MeshletVertices = nullptr;
+	MeshletTriangles = nullptr;
+	PackedVertices = nullptr;
+	Quantizations = nullptr;
+	Positions = nullptr;
+}
+
+void CookedScene::GetMeshlets(UINT MeshIndex, MeshletData& OutData) const
+{
+	OutData = MeshletData();
+
+	const CookedMesh& mesh = Meshes[MeshIndex];
+	if (mesh.NumMeshlets == 0)
+		return;
+
+	const Meshlet* meshlets = Meshlets + mesh.MeshletOffset;
+	const Meshlet& first = meshlets[0];
+	const Meshlet& last = meshlets[mesh.NumMeshlets - 1];
+
+	OutData.Meshlets.assign(meshlets, meshlets + mesh.NumMeshlets);
+	OutData.Vertices.assign(MeshletVertices + first.VertexOffset, MeshletVertices + last.VertexOffset + last.VertexCount);
+	OutData.Triangles.assign(MeshletTriangles + first.TriangleOffset * 3, MeshletTriangles + (last.TriangleOffset + last.TriangleCount) * 3);
+
+	for (auto& m : OutData.Meshlets)
+	{
+		m.VertexOffset -= first.VertexOffset;
+		m.TriangleOffset -= first.TriangleOffset;
+	}
+}
+
+bool CookedScene::Validate(string& ErrorString) const
+{
+	stringstream ss;
+
+	if (!IsOpen())
+	{
+		ErrorString = "cooked scene is not open\n";
+		return false;
+	}
+
+	const float eps = 1e-3f;
+
+	// a scene opened from memory has no file to be outside of
+	if (View)
+		CheckSections(*Header, FileSize, ss);
+
+	for (UINT i = 0; i < Header->NumMeshes && ss.tellp() == 0; i++)
+	{
+		const CookedMesh& mesh = Meshes[i];
+
+		if (UINT64(mesh.VertexOffset) + mesh.NumVertices > Header->NumVertices)
+			ss << "mesh " << i << " : vertex range out of bound\n";
+
+		if (mesh.IndexStride != 2 && mesh.IndexStride != 4)
+			ss << "mesh " << i << " : invalid index stride " << mesh.IndexStride << "\n";
+		else if (mesh.IndexStride == 2 && mesh.NumVertices > 0xFFFF)
+			ss << "mesh " << i << " : " << mesh.NumVertices << " vertices can't be addressed with 16 bit indices\n";
+		else if (mesh.NumLods == 0 || mesh.NumLods > MESH_MAX_LODS
+			|| mesh.Lods[0].IndexByteOffset != mesh.IndexByteOffset || mesh.Lods[0].NumIndices != mesh.NumIndices)
+			ss << "mesh " << i << " : invalid LOD table, " << mesh.NumLods << " LODs\n";
+		else
+		{
+			for (UINT lod = 0; lod < mesh.NumLods && ss.tellp() == 0; lod++)
+			{
+				const CookedMeshLod& range = mesh.Lods[lod];
+				const UINT64 rangeEnd = UINT64(range.IndexByteOffset) + UINT64(range.NumIndices) * mesh.IndexStride;
+				if (rangeEnd > Header->IndexStreamSize)
+					ss << "mesh " << i << " LOD " << lod << " : index range out of bound\n";
+				else if (range.IndexByteOffset % mesh.IndexStride != 0
+					|| (mesh.IndexStride == 2 && rangeEnd > Header->Index32StreamOffset)
+					|| (mesh.IndexStride == 4 && range.IndexByteOffset < Header->Index32StreamOffset))
+					ss << "mesh " << i << " LOD " << lod << " : " << mesh.IndexStride * 8 << " bit indices outside of their section\n";
+				else if (lod > 0 && (range.NumIndices > mesh.Lods[lod - 1].NumIndices || range.Error < mesh.Lods[lod - 1].Error))
+					ss << "mesh " << i << " LOD " << lod << " : not coarser than LOD " << lod - 1 << "\n";
+				else
+				{
+					for (UINT j = 0; j < range.NumIndices; j++)
+					{
+						const UINT8* p = Indices + range.IndexByteOffset + j * mesh.IndexStride;
+						UINT index = mesh.IndexStride == 2 ? *(const UINT16*)p : *(const UINT32*)p;
+						if (index >= mesh.NumVertices)
+						{
+							ss << "mesh " << i << " LOD " << lod << " : index " << j << " references vertex " << index << " of " << mesh.NumVertices << "\n";
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if (UINT64(mesh.MeshletOffset) + mesh.NumMeshlets > Header->NumMeshlets)
+			ss << "mesh " << i << " : meshlet range out of bound\n";
+		else
+		{
+			for (UINT j = 0; j < mesh.NumMeshlets && ss.tellp() == 0; j++)
+			{
+				const Meshlet& m = Meshlets[mesh.MeshletOffset + j];
+				if (m.VertexCount > MESHLET_MAX_VERTICES || m.TriangleCount > MESHLET_MAX_TRIANGLES
+					|| UINT64(m.VertexOffset) + m.VertexCount > Header->NumMeshletVertices || UINT64(m.TriangleOffset) + m.TriangleCount > Header->NumMeshletTriangles)
+				{
+					ss << "mesh " << i << " : meshlet " << j << " out of bound\n";
+					break;
+				}
+
+				// meshlet vertices are mesh local, triangles index the meshlet's vertices
+				for (UINT k = 0; k < m.VertexCount; k++)
+				{
+					if (MeshletVertices[m.VertexOffset + k] >= mesh.NumVertices)
+					{
+						ss << "mesh " << i << " : meshlet " << j << " references vertex " << MeshletVertices[m.VertexOffset + k] << " of " << mesh.NumVertices << "\n";
+						break;
+					}
+				}
+				for (UINT k = 0; k < m.TriangleCount * 3 && ss.tellp() == 0; k++)
+				{
+					if (MeshletTriangles[m.TriangleOffset * 3 + k] >= m.VertexCount)
+						ss << "mesh " << i << " : meshlet " << j << " triangle " << k / 3 << " references a vertex outside of the meshlet\n";
+				}
+			}
+		}
+
+		if (mesh.MaterialIndex >= Header->NumMaterials)
+			ss << "mesh " << i << " : invalid material index " << mesh.MaterialIndex << " of " << Header->NumMaterials << "\n";
+
+		// the packed positions decode to Bias .. Bias + Scale * 65535, that has to stay in the scene
+		const PositionQuantization& q = Quantizations[i];
+		const glm::vec3 decodedMax = glm::vec3(q.Bias) + glm::vec3(q.Scale) * 65535.0f;
+		if (glm::any(glm::isnan(q.Scale)) || glm::any(glm::isinf(q.Scale)) || glm::any(glm::isnan(q.Bias)) || glm::any(glm::isinf(q.Bias))
+			|| glm::any(glm::lessThan(glm::vec3(q.Scale), glm::vec3(0))))
+			ss << "mesh " << i << " : invalid position quantization\n";
+		else if (mesh.NumVertices > 0 && (glm::any(glm::lessThan(glm::vec3(q.Bias), Header->AABBMin - eps))
+			|| glm::any(glm::greaterThan(decodedMax, Header->AABBMax + glm::vec3(q.Scale) + eps))))
+			ss << "mesh " << i << " : packed positions decode outside of scene AABB\n";
+	}
+
+	// the float positions BLAS is built from. the float vertex stream holds the same ones and isn't read, LoadModel doesn't touch it
+	// with USE_PACKED_VERTEX.
+	for (UINT i = 0; i < Header->NumVertices && ss.tellp() == 0; i++)
+	{
+		const glm::vec3& p = Positions[i];
+		if (glm::any(glm::isnan(p)) || glm::any(glm::isinf(p)))
+			ss << "vertex " << i << " : position is not finite\n";
+		else if (glm::any(glm::lessThan(p, Header->AABBMin - eps)) || glm::any(glm::greaterThan(p, Header->AABBMax + eps)))
+			ss << "vertex " << i << " : position is outside of scene AABB\n";
+	}
+
+	ErrorString = ss.str();
+	return ErrorString.length() == 0;
+}
+
+CookedScene::~CookedScene()
+{
+	Close();
+}
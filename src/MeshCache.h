@@ -0,0 +1,191 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_CTOR_INIT
+#include "glm/glm.hpp"
+
+#include "CookedVertex.h"
+#include "VertexPacking.h"
+#include "MeshletBuilder.h"
+
+using namespace std;
+
+namespace enki
+{
+	class TaskScheduler;
+}
+
+// Cooked mesh cache.
+// assimp import + post processing is done once and the final vertex/index streams are written to "<model>.cooked".
+// later runs map the file and hand the streams to CreateVertexBuffer/CreateIndexBuffer directly. the packed vertices(VertexPacking.h),
+// their per mesh quantization and the float positions BLAS is built from are cooked too, so nothing is converted at load time.
+
+#define COOKED_SCENE_MAGIC 0x48534D43 // 'CMSH'
+#define COOKED_SCENE_VERSION 7
+#define COOKED_TEXTURE_NAME_LENGTH 128
+#define MESH_MAX_LODS 4
+
+// CookedSceneHeader::CookFlags, the ImportMeshFromFile options the file was cooked with
+#define COOKED_SCENE_OPTIMIZED 0x1
+
+struct CookedMeshLod
+{
+	UINT32 IndexByteOffset; // same stride and section as the mesh's full detail indices
+	UINT32 NumIndices;
+	float Error; // simplification error in mesh space units, 0 for LOD 0
+};
+
+struct CookedMesh
+{
+	UINT32 VertexOffset; // in vertices, from the start of vertex stream
+	UINT32 NumVertices;
+	UINT32 IndexByteOffset; // in bytes, from the start of index stream
+	UINT32 NumIndices;
+	UINT32 IndexStride; // 2, or 4 when the mesh has more than 65535 vertices
+	UINT32 MaterialIndex;
+	UINT32 MeshletOffset; // into meshlet section
+	UINT32 NumMeshlets;
+
+	// bounding sphere in mesh space, for LOD selection
+	glm::vec3 Center;
+	float Radius;
+
+	// Lods[0] is the full detail index range above. coarser ones index the same vertices.
+	UINT32 NumLods;
+	CookedMeshLod Lods[MESH_MAX_LODS];
+};
+
+struct CookedMaterial
+{
+	// texture file names relative to the model directory. empty means default texture.
+	wchar_t Diffuse[COOKED_TEXTURE_NAME_LENGTH];
+	wchar_t Normal[COOKED_TEXTURE_NAME_LENGTH];
+	wchar_t Roughness[COOKED_TEXTURE_NAME_LENGTH];
+	wchar_t Metallic[COOKED_TEXTURE_NAME_LENGTH];
+	UINT32 bHasAlpha;
+};
+
+struct CookedSceneHeader
+{
+	UINT32 Magic;
+	UINT32 Version;
+
+	// source model, used to detect stale cache
+	UINT64 SourceSize;
+	UINT64 SourceWriteTime;
+
+	UINT32 NumMeshes;
+	UINT32 NumMaterials;
+	UINT32 NumVertices;
+	UINT32 IndexStreamSize; // in bytes
+	// 16 bit meshes are packed first, 32 bit meshes start at this byte offset (4 byte aligned). equals IndexStreamSize when there are none.
+	// LOD indices of a mesh follow its full detail indices.
+	UINT32 Index32StreamOffset;
+	UINT32 CookFlags; // COOKED_SCENE_*, a file cooked with other options than asked for is rejected like a stale one
+
+	// byte offsets from the beginning of file. every section is 16 byte aligned.
+	UINT64 MeshOffset;
+	UINT64 MaterialOffset;
+	UINT64 VertexOffset;
+	UINT64 IndexOffset;
+
+	// meshlets of every mesh. Meshlet::VertexOffset/TriangleOffset are from the start of the scene wide sections,
+	// meshlet vertices are mesh local vertex indices.
+	UINT32 NumMeshlets;
+	UINT32 NumMeshletVertices;
+	UINT32 NumMeshletTriangles;
+	UINT32 Pad2;
+	UINT64 MeshletOffset;
+	UINT64 MeshletVertexOffset;
+	UINT64 MeshletTriangleOffset;
+
+	// NumVertices packed vertices, NumMeshes quantizations and NumVertices float positions.
+	// packed vertices of a mesh are quantized against its own AABB, the positions are the same as in the float vertex stream.
+	UINT64 PackedVertexOffset;
+	UINT64 QuantizationOffset;
+	UINT64 PositionOffset;
+
+	glm::vec3 AABBMin;
+	glm::vec3 AABBMax;
+	float BoundingRadius;
+};
+
+// cpu side result of assimp import. this is what gets written to the cooked file.
+struct MeshImportData
+{
+	vector<CookedVertex> Vertices;
+	vector<UINT8> Indices;
+	vector<CookedMesh> Meshes;
+	vector<CookedMaterial> Materials;
+	UINT32 Index32StreamOffset = 0;
+	UINT32 CookFlags = 0;
+	MeshletData Meshlets;
+
+	vector<PackedVertex> PackedVertices;
+	vector<PositionQuantization> Quantizations; // per mesh
+	vector<glm::vec3> Positions;
+
+	glm::vec3 AABBMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	glm::vec3 AABBMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	float BoundingRadius = 0;
+};
+
+// read only view of a cooked file. streams point directly into the mapped file.
+class CookedScene
+{
+	HANDLE File = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = nullptr;
+	const UINT8* View = nullptr;
+	UINT64 FileSize = 0;
+
+	CookedSceneHeader MemoryHeader;
+
+public:
+	const CookedSceneHeader* Header = nullptr;
+	const CookedMesh* Meshes = nullptr;
+	const CookedMaterial* Materials = nullptr;
+	const CookedVertex* Vertices = nullptr;
+	const UINT8* Indices = nullptr;
+	const Meshlet* Meshlets = nullptr;
+	const UINT32* MeshletVertices = nullptr;
+	const UINT8* MeshletTriangles = nullptr;
+	const PackedVertex* PackedVertices = nullptr;
+	const PositionQuantization* Quantizations = nullptr;
+	const glm::vec3* Positions = nullptr;
+
+	// SourceFile is optional. when given, the cache is rejected if the source has changed since cooking.
+	// bOptimize is the option the file has to be cooked with, see ImportMeshFromFile.
+	bool Open(const wstring& CookedFile, const wstring& SourceFile = wstring(), bool bOptimize = true);
+
+	// view in-memory import data the same way. used when the cooked file can't be written.
+	void OpenFromMemory(const MeshImportData& Data);
+	void Close();
+
+	bool IsOpen() const { return Header != nullptr; }
+
+	// copy of one mesh's meshlets with offsets rebased to the returned arrays.
+	void GetMeshlets(UINT MeshIndex, MeshletData& OutData) const;
+
+	// bounds/consistency check of every section : section ranges against the file size, mesh/LOD/meshlet ranges, indices and material indices
+	// against their counts. returns false and fills ErrorString on the first problem found. LoadModel cooks again when it fails.
+	bool Validate(string& ErrorString) const;
+
+	CookedScene() {}
+	CookedScene(const CookedScene&) = delete;
+	CookedScene& operator=(const CookedScene&) = delete;
+	virtual ~CookedScene();
+};
+
+// run assimp with the same post processing LoadModel always used.
+// vertex/index conversion is spread over TS when given.
+// bOptimize reorders triangles and vertices of every mesh for the post transform cache and vertex fetch (see MeshOptimize.h).
+// meshlets are built after that, from the final index order. then up to MESH_MAX_LODS - 1 coarser LODs are simplified from it (see MeshSimplify.h).
+// the packed vertices and positions are made from the final vertex order.
+bool ImportMeshFromFile(const string& FileName, MeshImportData& OutData, enki::TaskScheduler* TS = nullptr, bool bOptimize = true);
+
+bool WriteCookedScene(const wstring& CookedFile, const wstring& SourceFile, const MeshImportData& Data);
+
+wstring GetCookedScenePath(const wstring& SourceFile);
@@ -0,0 +1,322 @@
+#include "MeshOptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* Indices, uint32_t NumIndices, uint32_t NumVertices, uint32_t CacheSize)
+{
+	VertexCacheStats stats;
+	stats.NumTriangles = NumIndices / 3;
+
+	// a vertex is still in the fifo when fewer than CacheSize misses happened since it was last transformed.
+	vector<uint32_t> timestamps(NumVertices, 0);
+	uint32_t time = CacheSize + 1;
+
+	for (uint32_t i = 0; i < NumIndices; i++)
+	{
+		uint32_t v = Indices[i];
+		if (timestamps[v] == 0)
+			stats.NumReferenced++;
+
+		if (time - timestamps[v] > CacheSize)
+		{
+			timestamps[v] = time++;
+			stats.NumTransformed++;
+		}
+	}
+
+	return stats;
+}
+
+static float ForsythVertexScore(int CachePosition, uint32_t Valence)
+{
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// no triangle left to draw
+	if (Valence == 0)
+		return -1.0f;
+
+	float score = 0;
+	if (CachePosition >= 0)
+	{
+		// the 3 vertices of the last triangle get a fixed score so the next triangle doesn't just reuse them.
+		if (CachePosition < 3)
+			score = LastTriScore;
+		else
+		{
+			const float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = powf(1.0f - (CachePosition - 3) * scaler, CacheDecayPower);
+		}
+	}
+
+	// boost vertices with few triangles left so lone triangles don't get stranded.
+	score += ValenceBoostScale * powf(float(Valence), -ValenceBoostPower);
+	return score;
+}
+
+void OptimizeVertexCache(uint32_t* Indices, uint32_t NumIndices, uint32_t NumVertices)
+{
+	const uint32_t numTriangles = NumIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	// per vertex list of triangles not emitted yet. valence is the length of the list.
+	vector<uint32_t> valence(NumVertices, 0);
+	for (uint32_t i = 0; i < NumIndices; i++)
+		valence[Indices[i]]++;
+
+	vector<uint32_t> adjacencyOffset(NumVertices + 1, 0);
+	for (uint32_t v = 0; v < NumVertices; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+	vector<uint32_t> adjacency(NumIndices);
+	vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (uint32_t t = 0; t < numTriangles; t++)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+			adjacency[fill[Indices[t * 3 + k]]++] = t;
+	}
+
+	vector<int> cachePosition(NumVertices, -1);
+	vector<float> vertexScore(NumVertices);
+	for (uint32_t v = 0; v < NumVertices; v++)
+		vertexScore[v] = ForsythVertexScore(-1, valence[v]);
+
+	vector<float> triangleScore(numTriangles);
+	vector<bool> bEmitted(numTriangles, false);
+
+	int bestTriangle = -1;
+	float bestScore = -1.0f;
+	for (uint32_t t = 0; t < numTriangles; t++)
+	{
+		triangleScore[t] = vertexScore[Indices[t * 3 + 0]] + vertexScore[Indices[t * 3 + 1]] + vertexScore[Indices[t * 3 + 2]];
+		if (triangleScore[t] > bestScore)
+		{
+			bestScore = triangleScore[t];
+			bestTriangle = t;
+		}
+	}
+
+	vector<uint32_t> output;
+	output.reserve(NumIndices);
+
+	uint32_t cache[VERTEX_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	uint32_t scanCursor = 0;
+
+	while (output.size() < numTriangles * 3)
+	{
+		// dead end, nothing in the cache has triangles left. continue with the first triangle not emitted yet.
+		if (bestTriangle < 0)
+		{
+			while (bEmitted[scanCursor])
+				scanCursor++;
+			bestTriangle = scanCursor;
+		}
+
+		const uint32_t* tri = &Indices[bestTriangle * 3];
+		bEmitted[bestTriangle] = true;
+
+		uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+		uint32_t newCount = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t v = tri[k];
+			output.push_back(v);
+			newCache[newCount++] = v;
+
+			uint32_t* adj = &adjacency[adjacencyOffset[v]];
+			for (uint32_t j = 0; j < valence[v]; j++)
+			{
+				if (adj[j] == uint32_t(bestTriangle))
+				{
+					adj[j] = adj[valence[v] - 1];
+					break;
+				}
+			}
+			valence[v]--;
+		}
+
+		for (uint32_t j = 0; j < cacheCount; j++)
+		{
+			uint32_t v = cache[j];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		// pushed out of the cache
+		for (uint32_t j = VERTEX_CACHE_SIZE; j < newCount; j++)
+		{
+			cachePosition[newCache[j]] = -1;
+			vertexScore[newCache[j]] = ForsythVertexScore(-1, valence[newCache[j]]);
+		}
+
+		cacheCount = min(newCount, uint32_t(VERTEX_CACHE_SIZE));
+		for (uint32_t j = 0; j < cacheCount; j++)
+		{
+			uint32_t v = newCache[j];
+			cache[j] = v;
+			cachePosition[v] = j;
+			vertexScore[v] = ForsythVertexScore(j, valence[v]);
+		}
+
+		// only triangles touching the cache changed score, the best next triangle is one of them.
+		bestTriangle = -1;
+		bestScore = -1.0f;
+		for (uint32_t j = 0; j < cacheCount; j++)
+		{
+			uint32_t v = cache[j];
+			const uint32_t* adj = &adjacency[adjacencyOffset[v]];
+			for (uint32_t k = 0; k < valence[v]; k++)
+			{
+				uint32_t t = adj[k];
+				triangleScore[t] = vertexScore[Indices[t * 3 + 0]] + vertexScore[Indices[t * 3 + 1]] + vertexScore[Indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	memcpy(Indices, output.data(), sizeof(uint32_t) * output.size());
+}
+
+static const glm::vec3& GetPosition(const float* Positions, uint32_t PositionStride, uint32_t Index)
+{
+	return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const uint8_t*>(Positions) + size_t(Index) * PositionStride);
+}
+
+void OptimizeOverdraw(uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices)
+{
+	const uint32_t numTriangles = NumIndices / 3;
+	if (numTriangles < 2)
+		return;
+
+	VertexCacheStats before = AnalyzeVertexCache(Indices, numTriangles * 3, NumVertices, VERTEX_CACHE_SIZE);
+
+	// a new cluster starts wherever all three vertices of a triangle miss the cache, reordering clusters then costs
+	// only a few extra misses at the boundaries.
+	vector<uint32_t> clusterStart;
+	{
+		vector<uint32_t> timestamps(NumVertices, 0);
+		uint32_t time = VERTEX_CACHE_SIZE + 1;
+		for (uint32_t t = 0; t < numTriangles; t++)
+		{
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t v = Indices[t * 3 + k];
+				if (time - timestamps[v] > VERTEX_CACHE_SIZE)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+
+			if (t == 0 || misses == 3)
+				clusterStart.push_back(t);
+		}
+	}
+
+	const uint32_t numClusters = clusterStart.size();
+	if (numClusters < 2)
+		return;
+	clusterStart.push_back(numTriangles);
+
+	vector<glm::vec3> clusterCentroid(numClusters, glm::vec3(0, 0, 0));
+	vector<glm::vec3> clusterNormal(numClusters, glm::vec3(0, 0, 0));
+	glm::vec3 meshCentroid(0, 0, 0);
+	float meshArea = 0;
+
+	for (uint32_t c = 0; c < numClusters; c++)
+	{
+		float clusterArea = 0;
+		for (uint32_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+		{
+			const glm::vec3& p0 = GetPosition(Positions, PositionStride, Indices[t * 3 + 0]);
+			const glm::vec3& p1 = GetPosition(Positions, PositionStride, Indices[t * 3 + 1]);
+			const glm::vec3& p2 = GetPosition(Positions, PositionStride, Indices[t * 3 + 2]);
+
+			// length of the cross product is twice the area, so the sum is an area weighted normal.
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(n);
+
+			clusterNormal[c] += n;
+			clusterCentroid[c] += (p0 + p1 + p2) * (area / 3.0f);
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroid[c];
+		meshArea += clusterArea;
+
+		if (clusterArea > 0)
+			clusterCentroid[c] /= clusterArea;
+	}
+
+	if (meshArea > 0)
+		meshCentroid /= meshArea;
+
+	// clusters facing away from the center are likely to occlude the rest, draw them first.
+	vector<float> clusterSortKey(numClusters);
+	vector<uint32_t> clusterOrder(numClusters);
+	for (uint32_t c = 0; c < numClusters; c++)
+	{
+		float normalLength = glm::length(clusterNormal[c]);
+		glm::vec3 n = normalLength > 0 ? clusterNormal[c] / normalLength : glm::vec3(0, 0, 0);
+		clusterSortKey[c] = glm::dot(clusterCentroid[c] - meshCentroid, n);
+		clusterOrder[c] = c;
+	}
+
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b) { return clusterSortKey[a] > clusterSortKey[b]; });
+
+	vector<uint32_t> output;
+	output.reserve(numTriangles * 3);
+	for (uint32_t c : clusterOrder)
+		output.insert(output.end(), Indices + clusterStart[c] * 3, Indices + clusterStart[c + 1] * 3);
+
+	VertexCacheStats after = AnalyzeVertexCache(output.data(), output.size(), NumVertices, VERTEX_CACHE_SIZE);
+	if (after.ACMR() > before.ACMR() * OVERDRAW_ACMR_THRESHOLD)
+		return;
+
+	memcpy(Indices, output.data(), sizeof(uint32_t) * output.size());
+}
+
+void OptimizeVertexFetch(uint32_t* Indices, uint32_t NumIndices, void* Vertices, uint32_t VertexStride, uint32_t NumVertices)
+{
+	vector<uint32_t> remap(NumVertices, uint32_t(~0u));
+	uint32_t next = 0;
+
+	for (uint32_t i = 0; i < NumIndices; i++)
+	{
+		uint32_t& v = Indices[i];
+		if (remap[v] == ~0u)
+			remap[v] = next++;
+		v = remap[v];
+	}
+
+	for (uint32_t v = 0; v < NumVertices; v++)
+	{
+		if (remap[v] == ~0u)
+			remap[v] = next++;
+	}
+
+	uint8_t* vertices = static_cast<uint8_t*>(Vertices);
+	vector<uint8_t> reordered(size_t(NumVertices) * VertexStride);
+	for (uint32_t v = 0; v < NumVertices; v++)
+		memcpy(&reordered[size_t(remap[v]) * VertexStride], vertices + size_t(v) * VertexStride, VertexStride);
+
+	memcpy(vertices, reordered.data(), reordered.size());
+}
+
+void OptimizeMesh(uint32_t* Indices, uint32_t NumIndices, CookedVertex* Vertices, uint32_t NumVertices)
+{
+	OptimizeVertexCache(Indices, NumIndices, NumVertices);
+	OptimizeOverdraw(Indices, NumIndices, &Vertices[0].Position.x, sizeof(CookedVertex), NumVertices);
+	OptimizeVertexFetch(Indices, NumIndices, Vertices, sizeof(CookedVertex), NumVertices);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "CookedVertex.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Index/vertex reordering run on every mesh while cooking.
+// all functions work on mesh local 32 bit indices and plain arrays, no dependency on the renderer. Positions/Vertices point at the
+// first vertex of the mesh, strides are in bytes.
+
+#define VERTEX_CACHE_SIZE 32
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+struct VertexCacheStats
+{
+	uint32_t NumTriangles = 0;
+	uint32_t NumTransformed = 0; // simulated cache misses
+	uint32_t NumReferenced = 0; // unique vertices used by the index buffer
+
+	float ACMR() const { return NumTriangles ? float(NumTransformed) / NumTriangles : 0; } // average cache miss ratio
+	float ATVR() const { return NumReferenced ? float(NumTransformed) / NumReferenced : 0; } // average transform to vertex ratio
+
+	void Add(const VertexCacheStats& Other)
+	{
+		NumTriangles += Other.NumTriangles;
+		NumTransformed += Other.NumTransformed;
+		NumReferenced += Other.NumReferenced;
+	}
+};
+
+// fifo post transform cache simulation.
+VertexCacheStats AnalyzeVertexCache(const uint32_t* Indices, uint32_t NumIndices, uint32_t NumVertices, uint32_t CacheSize = 16);
+
+// Forsyth's linear speed vertex cache optimization.
+void OptimizeVertexCache(uint32_t* Indices, uint32_t NumIndices, uint32_t NumVertices);
+
+// splits the cache optimized order into clusters at cache restarts and draws outward facing clusters first (Sander et al.)
+// the result is dropped when it makes ACMR worse than OVERDRAW_ACMR_THRESHOLD times the input.
+void OptimizeOverdraw(uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices);
+
+// renumbers vertices in order of first use so vertex fetch walks memory forward. vertices never referenced go last.
+void OptimizeVertexFetch(uint32_t* Indices, uint32_t NumIndices, void* Vertices, uint32_t VertexStride, uint32_t NumVertices);
+
+// all of the above in the order they are meant to run.
+void OptimizeMesh(uint32_t* Indices, uint32_t NumIndices, CookedVertex* Vertices, uint32_t NumVertices);
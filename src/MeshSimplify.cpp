@@ -0,0 +1,337 @@
+#include "MeshSimplify.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <cfloat>
+
+// symmetric 4x4 matrix sum of plane equations. Evaluate is the weighted mean squared distance to the planes.
+struct Quadric
+{
+	double a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+	double ab = 0, ac = 0, ad = 0;
+	double bc = 0, bd = 0, cd = 0;
+	double w = 0;
+
+	void AddPlane(const glm::dvec3& n, double d, double weight)
+	{
+		a2 += n.x * n.x * weight;
+		b2 += n.y * n.y * weight;
+		c2 += n.z * n.z * weight;
+		d2 += d * d * weight;
+		ab += n.x * n.y * weight;
+		ac += n.x * n.z * weight;
+		ad += n.x * d * weight;
+		bc += n.y * n.z * weight;
+		bd += n.y * d * weight;
+		cd += n.z * d * weight;
+		w += weight;
+	}
+
+	void Add(const Quadric& q)
+	{
+		a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+		ab += q.ab; ac += q.ac; ad += q.ad;
+		bc += q.bc; bd += q.bd; cd += q.cd;
+		w += q.w;
+	}
+
+	double Evaluate(const glm::dvec3& p) const
+	{
+		double r = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z + d2
+			+ 2 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+			+ 2 * (ad * p.x + bd * p.y + cd * p.z);
+		return w > 0 ? glm::abs(r) / w : 0;
+	}
+};
+
+enum VertexKind : uint8_t
+{
+	VERTEX_MANIFOLD,
+	VERTEX_BORDER,
+	VERTEX_LOCKED,
+};
+
+// border edges pull harder than faces so open edges keep their outline
+static const double BorderWeight = 10.0;
+
+struct PositionHash
+{
+	size_t operator()(const glm::vec3& p) const
+	{
+		// + 0 folds -0 into 0 so equal positions always hash the same
+		glm::vec3 q = p + glm::vec3(0.0f);
+		const uint32_t* u = reinterpret_cast<const uint32_t*>(&q);
+		return size_t(u[0] * 73856093u) ^ size_t(u[1] * 19349663u) ^ size_t(u[2] * 83492791u);
+	}
+};
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+void SimplifyMesh(const uint32_t* Indices, uint32_t NumIndices, const CookedVertex* Vertices, uint32_t NumVertices, uint32_t TargetIndexCount,
+	vector<uint32_t>& OutIndices, float& OutError)
+{
+	OutIndices.assign(Indices, Indices + NumIndices);
+	OutError = 0;
+
+	if (NumIndices <= TargetIndexCount || NumVertices == 0)
+		return;
+
+	// vertices split by uv/normal seams share a position. topology is looked at on positions.
+	vector<uint32_t> group(NumVertices);
+	vector<uint32_t> groupSize(NumVertices, 0);
+	{
+		unordered_map<glm::vec3, uint32_t, PositionHash> firstVertex;
+		firstVertex.reserve(NumVertices);
+		for (uint32_t v = 0; v < NumVertices; v++)
+		{
+			auto it = firstVertex.emplace(Vertices[v].Position, v).first;
+			group[v] = it->second;
+			groupSize[it->second]++;
+		}
+	}
+
+	unordered_map<uint64_t, uint32_t> edgeCount;
+	edgeCount.reserve(NumIndices);
+	for (uint32_t i = 0; i + 2 < NumIndices; i += 3)
+	{
+		for (uint32_t k = 0; k < 3; k++)
+			edgeCount[EdgeKey(group[Indices[i + k]], group[Indices[i + (k + 1) % 3]])]++;
+	}
+
+	auto IsBorderEdge = [&](uint32_t a, uint32_t b)
+	{
+		auto it = edgeCount.find(EdgeKey(group[a], group[b]));
+		return it != edgeCount.end() && it->second == 1;
+	};
+
+	vector<uint32_t> numBorderEdges(NumVertices, 0);
+	vector<glm::uvec2> borderNeighbors(NumVertices);
+	vector<bool> bNonManifold(NumVertices, false);
+	for (auto& edge : edgeCount)
+	{
+		uint32_t a = uint32_t(edge.first >> 32);
+		uint32_t b = uint32_t(edge.first & 0xFFFFFFFF);
+		if (edge.second == 1)
+		{
+			if (numBorderEdges[a] < 2)
+				borderNeighbors[a][numBorderEdges[a]] = b;
+			if (numBorderEdges[b] < 2)
+				borderNeighbors[b][numBorderEdges[b]] = a;
+			numBorderEdges[a]++;
+			numBorderEdges[b]++;
+		}
+		else if (edge.second > 2)
+		{
+			bNonManifold[a] = true;
+			bNonManifold[b] = true;
+		}
+	}
+
+	// a border vertex is a corner unless its two border edges are close to a straight line, corners can't slide either way
+	auto IsBorderCorner = [&](uint32_t g)
+	{
+		glm::vec3 p = Vertices[g].Position;
+		glm::vec3 d0 = Vertices[borderNeighbors[g].x].Position - p;
+		glm::vec3 d1 = Vertices[borderNeighbors[g].y].Position - p;
+		return glm::dot(d0, d1) > -0.9f * glm::length(d0) * glm::length(d1);
+	};
+
+	vector<VertexKind> kind(NumVertices);
+	for (uint32_t v = 0; v < NumVertices; v++)
+	{
+		uint32_t g = group[v];
+		if (groupSize[g] > 1 || bNonManifold[g] || (numBorderEdges[g] != 0 && numBorderEdges[g] != 2) || (numBorderEdges[g] == 2 && IsBorderCorner(g)))
+			kind[v] = VERTEX_LOCKED;
+		else
+			kind[v] = numBorderEdges[g] == 2 ? VERTEX_BORDER : VERTEX_MANIFOLD;
+	}
+
+	vector<glm::dvec3> positions(NumVertices);
+	for (uint32_t v = 0; v < NumVertices; v++)
+		positions[v] = glm::dvec3(Vertices[v].Position);
+
+	// area weighted planes of the original triangles, plus planes perpendicular to the border edges.
+	vector<Quadric> quadrics(NumVertices);
+	for (uint32_t i = 0; i + 2 < NumIndices; i += 3)
+	{
+		const uint32_t* tri = &Indices[i];
+		glm::dvec3 n = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+		double length = glm::length(n);
+		if (length == 0)
+			continue;
+		n /= length;
+
+		for (uint32_t k = 0; k < 3; k++)
+			quadrics[tri[k]].AddPlane(n, -glm::dot(n, positions[tri[k]]), length * 0.5);
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t a = tri[k];
+			uint32_t b = tri[(k + 1) % 3];
+			if (!IsBorderEdge(a, b))
+				continue;
+
+			glm::dvec3 edge = positions[b] - positions[a];
+			glm::dvec3 edgeNormal = glm::cross(edge, n);
+			double edgeLength = glm::length(edgeNormal);
+			if (edgeLength == 0)
+				continue;
+			edgeNormal /= edgeLength;
+
+			double d = -glm::dot(edgeNormal, positions[a]);
+			double weight = glm::dot(edge, edge) * BorderWeight;
+			quadrics[a].AddPlane(edgeNormal, d, weight);
+			quadrics[b].AddPlane(edgeNormal, d, weight);
+		}
+	}
+
+	struct Collapse
+	{
+		uint32_t v; // moves onto u
+		uint32_t u;
+		double Cost;
+	};
+
+	vector<uint32_t>& indices = OutIndices;
+	double maxCost = 0;
+
+	vector<uint32_t> adjacencyOffset(NumVertices + 1);
+	vector<uint32_t> adjacency;
+	vector<Collapse> collapses;
+	vector<uint32_t> target(NumVertices);
+	vector<bool> bTouched(NumVertices);
+
+	// each pass collapses the cheapest edges whose surroundings are still untouched in this pass, then drops degenerate triangles.
+	while (indices.size() > TargetIndexCount)
+	{
+		const uint32_t numTriangles = indices.size() / 3;
+
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (uint32_t v : indices)
+			adjacencyOffset[v + 1]++;
+		for (uint32_t v = 0; v < NumVertices; v++)
+			adjacencyOffset[v + 1] += adjacencyOffset[v];
+
+		adjacency.resize(indices.size());
+		vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (uint32_t t = 0; t < numTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+				adjacency[fill[indices[t * 3 + k]]++] = t;
+		}
+
+		collapses.clear();
+		for (uint32_t v = 0; v < NumVertices; v++)
+		{
+			if (kind[v] == VERTEX_LOCKED)
+				continue;
+
+			Collapse best = { v, v, DBL_MAX };
+			for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++)
+			{
+				const uint32_t* tri = &indices[adjacency[a] * 3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					uint32_t u = tri[k];
+					if (u == v)
+						continue;
+
+					// border vertices only move along the border, otherwise the outline caves in
+					if (kind[v] == VERTEX_BORDER && !IsBorderEdge(v, u))
+						continue;
+
+					Quadric q = quadrics[v];
+					q.Add(quadrics[u]);
+					double cost = q.Evaluate(positions[u]);
+					if (cost < best.Cost)
+					{
+						best.u = u;
+						best.Cost = cost;
+					}
+				}
+			}
+
+			if (best.u != v)
+				collapses.push_back(best);
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost; });
+
+		for (uint32_t v = 0; v < NumVertices; v++)
+			target[v] = v;
+		std::fill(bTouched.begin(), bTouched.end(), false);
+
+		const uint32_t trianglesToRemove = (indices.size() - TargetIndexCount + 2) / 3;
+		uint32_t numRemoved = 0;
+		uint32_t numCollapsed = 0;
+
+		for (auto& c : collapses)
+		{
+			if (numRemoved >= trianglesToRemove)
+				break;
+
+			if (bTouched[c.v] || bTouched[c.u])
+				continue;
+
+			// reject when a remaining triangle around v would flip or turn into a sliver. <= so one collapsing to a line is rejected too
+			bool bFlip = false;
+			for (uint32_t a = adjacencyOffset[c.v]; a < adjacencyOffset[c.v + 1] && !bFlip; a++)
+			{
+				const uint32_t* tri = &indices[adjacency[a] * 3];
+				if (tri[0] == c.u || tri[1] == c.u || tri[2] == c.u)
+					continue;
+
+				glm::dvec3 p[3];
+				glm::dvec3 q[3];
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					p[k] = positions[tri[k]];
+					q[k] = tri[k] == c.v ? positions[c.u] : p[k];
+				}
+
+				glm::dvec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::dvec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+				bFlip = glm::dot(n0, n1) <= 0.25 * glm::length(n0) * glm::length(n1);
+			}
+			if (bFlip)
+				continue;
+
+			target[c.v] = c.u;
+			quadrics[c.u].Add(quadrics[c.v]);
+			maxCost = glm::max(maxCost, c.Cost);
+
+			// the flip test above relies on the ring of v staying put for the rest of this pass
+			for (uint32_t a = adjacencyOffset[c.v]; a < adjacencyOffset[c.v + 1]; a++)
+			{
+				const uint32_t* tri = &indices[adjacency[a] * 3];
+				bTouched[tri[0]] = bTouched[tri[1]] = bTouched[tri[2]] = true;
+			}
+
+			numRemoved += kind[c.v] == VERTEX_BORDER ? 1 : 2;
+			numCollapsed++;
+		}
+
+		if (numCollapsed == 0)
+			break;
+
+		uint32_t numOut = 0;
+		for (uint32_t t = 0; t < numTriangles; t++)
+		{
+			uint32_t a = target[indices[t * 3 + 0]];
+			uint32_t b = target[indices[t * 3 + 1]];
+			uint32_t c = target[indices[t * 3 + 2]];
+			if (group[a] == group[b] || group[b] == group[c] || group[c] == group[a])
+				continue;
+
+			indices[numOut++] = a;
+			indices[numOut++] = b;
+			indices[numOut++] = c;
+		}
+		indices.resize(numOut);
+	}
+
+	OutError = float(glm::sqrt(maxCost));
+}
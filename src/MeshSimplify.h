@@ -0,0 +1,19 @@
+#pragma once
+
+#include "CookedVertex.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Quadric error edge collapse simplifier.
+// vertices are only collapsed onto other existing vertices, so every LOD reuses the mesh's vertex range and only needs its own indices.
+// uv seams, non manifold edges and border corners are locked. border vertices only slide along the border.
+
+// minimum triangles of the previous LOD to try another one
+#define MESH_LOD_MIN_TRIANGLES 64
+
+// OutError is the largest collapse error in mesh space units (distance from the collapsed vertex to its original planes).
+void SimplifyMesh(const uint32_t* Indices, uint32_t NumIndices, const CookedVertex* Vertices, uint32_t NumVertices, uint32_t TargetIndexCount,
+	vector<uint32_t>& OutIndices, float& OutError);
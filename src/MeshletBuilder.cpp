@@ -0,0 +1,254 @@
+#include "MeshletBuilder.h"
+
+#include <sstream>
+#include <algorithm>
+
+static const glm::vec3& GetPosition(const float* Positions, uint32_t PositionStride, uint32_t Index)
+{
+	return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const uint8_t*>(Positions) + size_t(Index) * PositionStride);
+}
+
+static void ComputeMeshletBounds(Meshlet& M, const MeshletData& Data, const float* Positions, uint32_t PositionStride)
+{
+	const uint32_t* vertices = &Data.Vertices[M.VertexOffset];
+
+	// Ritter's sphere. start from two far apart points and grow to include the rest.
+	glm::vec3 p0 = GetPosition(Positions, PositionStride, vertices[0]);
+	glm::vec3 p1 = p0;
+	float maxDist = 0;
+	for (uint32_t i = 0; i < M.VertexCount; i++)
+	{
+		const glm::vec3& p = GetPosition(Positions, PositionStride, vertices[i]);
+		float d = glm::length(p - p0);
+		if (d > maxDist)
+		{
+			maxDist = d;
+			p1 = p;
+		}
+	}
+
+	glm::vec3 p2 = p1;
+	maxDist = 0;
+	for (uint32_t i = 0; i < M.VertexCount; i++)
+	{
+		const glm::vec3& p = GetPosition(Positions, PositionStride, vertices[i]);
+		float d = glm::length(p - p1);
+		if (d > maxDist)
+		{
+			maxDist = d;
+			p2 = p;
+		}
+	}
+
+	glm::vec3 center = (p1 + p2) * 0.5f;
+	float radius = maxDist * 0.5f;
+	for (uint32_t i = 0; i < M.VertexCount; i++)
+	{
+		const glm::vec3& p = GetPosition(Positions, PositionStride, vertices[i]);
+		float d = glm::length(p - center);
+		if (d > radius)
+		{
+			float newRadius = (radius + d) * 0.5f;
+			center += (p - center) * ((newRadius - radius) / d);
+			radius = newRadius;
+		}
+	}
+
+	M.Center = center;
+	M.Radius = radius * 1.0001f; // float error while growing
+
+	// normal cone from the triangle normals
+	glm::vec3 normalSum(0, 0, 0);
+	vector<glm::vec3> normals;
+	normals.reserve(M.TriangleCount);
+	for (uint32_t t = 0; t < M.TriangleCount; t++)
+	{
+		const uint8_t* tri = &Data.Triangles[(M.TriangleOffset + t) * 3];
+		const glm::vec3& a = GetPosition(Positions, PositionStride, vertices[tri[0]]);
+		const glm::vec3& b = GetPosition(Positions, PositionStride, vertices[tri[1]]);
+		const glm::vec3& c = GetPosition(Positions, PositionStride, vertices[tri[2]]);
+
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float length = glm::length(n);
+		if (length == 0)
+			continue;
+
+		n /= length;
+		normals.push_back(n);
+		normalSum += n;
+	}
+
+	M.ConeAxis = glm::vec3(0, 0, 1);
+	M.ConeCutoff = 1;
+
+	float axisLength = glm::length(normalSum);
+	if (normals.size() == 0 || axisLength == 0)
+		return;
+
+	glm::vec3 axis = normalSum / axisLength;
+	float minDot = 1;
+	for (auto& n : normals)
+		minDot = glm::min(minDot, glm::dot(n, axis));
+
+	M.ConeAxis = axis;
+
+	// cone wider than ~84 degrees half angle is useless for culling.
+	if (minDot > 0.1f)
+		M.ConeCutoff = glm::sqrt(1 - minDot * minDot);
+}
+
+void BuildMeshlets(const uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices, MeshletData& OutData)
+{
+	OutData.Meshlets.clear();
+	OutData.Vertices.clear();
+	OutData.Triangles.clear();
+
+	const uint32_t numTriangles = NumIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	OutData.Meshlets.reserve(numTriangles / MESHLET_MAX_TRIANGLES + 1);
+	OutData.Vertices.reserve(NumIndices / 2);
+	OutData.Triangles.reserve(numTriangles * 3);
+
+	// local index of a vertex in the meshlet being built, 0xff when not in it.
+	vector<uint8_t> localIndex(NumVertices, 0xff);
+
+	Meshlet current = {};
+
+	auto Flush = [&]()
+	{
+		if (current.TriangleCount == 0)
+			return;
+
+		for (uint32_t i = 0; i < current.VertexCount; i++)
+			localIndex[OutData.Vertices[current.VertexOffset + i]] = 0xff;
+
+		ComputeMeshletBounds(current, OutData, Positions, PositionStride);
+		OutData.Meshlets.push_back(current);
+
+		current = {};
+		current.VertexOffset = OutData.Vertices.size();
+		current.TriangleOffset = OutData.Triangles.size() / 3;
+	};
+
+	for (uint32_t t = 0; t < numTriangles; t++)
+	{
+		const uint32_t* tri = &Indices[t * 3];
+
+		uint32_t numNewVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			if (localIndex[tri[k]] == 0xff)
+				numNewVertices++;
+		}
+
+		if (current.VertexCount + numNewVertices > MESHLET_MAX_VERTICES || current.TriangleCount + 1 > MESHLET_MAX_TRIANGLES)
+			Flush();
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t v = tri[k];
+			if (localIndex[v] == 0xff)
+			{
+				localIndex[v] = uint8_t(current.VertexCount++);
+				OutData.Vertices.push_back(v);
+			}
+			OutData.Triangles.push_back(localIndex[v]);
+		}
+		current.TriangleCount++;
+	}
+
+	Flush();
+}
+
+bool IsMeshletBackfacing(const Meshlet& M, const glm::vec3& CameraPosition)
+{
+	glm::vec3 v = M.Center - CameraPosition;
+	return glm::dot(v, M.ConeAxis) >= M.ConeCutoff * glm::length(v) + M.Radius;
+}
+
+bool ValidateMeshlets(const MeshletData& Data, const uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices, string& ErrorString)
+{
+	stringstream ss;
+
+	// every source triangle must come out exactly once. compare as sorted lists of rotated triangles.
+	auto Canonical = [](uint32_t a, uint32_t b, uint32_t c)
+	{
+		// rotate so the smallest index comes first, keeps winding
+		if (b < a && b < c)
+			return glm::uvec3(b, c, a);
+		if (c < a && c < b)
+			return glm::uvec3(c, a, b);
+		return glm::uvec3(a, b, c);
+	};
+	auto Less = [](const glm::uvec3& x, const glm::uvec3& y)
+	{
+		if (x.x != y.x) return x.x < y.x;
+		if (x.y != y.y) return x.y < y.y;
+		return x.z < y.z;
+	};
+
+	vector<glm::uvec3> source;
+	for (uint32_t i = 0; i + 2 < NumIndices; i += 3)
+		source.push_back(Canonical(Indices[i], Indices[i + 1], Indices[i + 2]));
+
+	vector<glm::uvec3> built;
+	for (uint32_t m = 0; m < Data.Meshlets.size() && ss.tellp() == 0; m++)
+	{
+		const Meshlet& M = Data.Meshlets[m];
+
+		if (M.VertexCount == 0 || M.VertexCount > MESHLET_MAX_VERTICES || M.TriangleCount == 0 || M.TriangleCount > MESHLET_MAX_TRIANGLES)
+		{
+			ss << "meshlet " << m << " : " << M.VertexCount << " vertices, " << M.TriangleCount << " triangles\n";
+			break;
+		}
+
+		if (M.VertexOffset + M.VertexCount > Data.Vertices.size() || (M.TriangleOffset + M.TriangleCount) * 3 > Data.Triangles.size())
+		{
+			ss << "meshlet " << m << " : range out of bound\n";
+			break;
+		}
+
+		for (uint32_t i = 0; i < M.VertexCount; i++)
+		{
+			uint32_t v = Data.Vertices[M.VertexOffset + i];
+			if (v >= NumVertices)
+			{
+				ss << "meshlet " << m << " : vertex " << v << " of " << NumVertices << "\n";
+				break;
+			}
+
+			float d = glm::length(GetPosition(Positions, PositionStride, v) - M.Center);
+			if (d > M.Radius * 1.001f + 1e-5f)
+			{
+				ss << "meshlet " << m << " : vertex " << v << " is outside of bounding sphere\n";
+				break;
+			}
+		}
+
+		for (uint32_t t = 0; t < M.TriangleCount && ss.tellp() == 0; t++)
+		{
+			const uint8_t* tri = &Data.Triangles[(M.TriangleOffset + t) * 3];
+			if (tri[0] >= M.VertexCount || tri[1] >= M.VertexCount || tri[2] >= M.VertexCount)
+			{
+				ss << "meshlet " << m << " : triangle " << t << " references a vertex outside of meshlet\n";
+				break;
+			}
+
+			const uint32_t* vertices = &Data.Vertices[M.VertexOffset];
+			built.push_back(Canonical(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]));
+		}
+	}
+
+	if (ss.tellp() == 0)
+	{
+		std::sort(source.begin(), source.end(), Less);
+		std::sort(built.begin(), built.end(), Less);
+		if (source.size() != built.size() || !std::equal(source.begin(), source.end(), built.begin()))
+			ss << "meshlets cover " << built.size() << " triangles, source has " << source.size() << " or they differ\n";
+	}
+
+	ErrorString = ss.str();
+	return ErrorString.length() == 0;
+}
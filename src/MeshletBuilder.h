@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_CTOR_INIT
+#include "glm/glm.hpp"
+
+using namespace std;
+
+// Meshlet (cluster) builder.
+// cpu only, no dependency on the renderer. triangles are taken in index buffer order, so run it after vertex cache optimization.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet
+{
+	uint32_t VertexOffset; // into MeshletData::Vertices
+	uint32_t TriangleOffset; // in triangles, into MeshletData::Triangles
+	uint32_t VertexCount;
+	uint32_t TriangleCount;
+
+	// bounding sphere in mesh space
+	glm::vec3 Center;
+	float Radius;
+
+	// normal cone. culled when dot(Center - Camera, ConeAxis) >= ConeCutoff * length(Center - Camera) + Radius
+	// ConeCutoff is 1 when the cone is too wide to ever cull.
+	glm::vec3 ConeAxis;
+	float ConeCutoff;
+};
+
+struct MeshletData
+{
+	vector<Meshlet> Meshlets;
+	vector<uint32_t> Vertices; // mesh vertex index of each meshlet vertex
+	vector<uint8_t> Triangles; // 3 meshlet local vertex indices per triangle
+};
+
+// Positions points at the first position, PositionStride is in bytes.
+void BuildMeshlets(const uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices, MeshletData& OutData);
+
+bool IsMeshletBackfacing(const Meshlet& M, const glm::vec3& CameraPosition);
+
+// checks limits, that every triangle of the source is in exactly one meshlet, and that bounds hold every vertex.
+bool ValidateMeshlets(const MeshletData& Data, const uint32_t* Indices, uint32_t NumIndices, const float* Positions, uint32_t PositionStride, uint32_t NumVertices, string& ErrorString);
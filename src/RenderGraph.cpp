@@ -0,0 +1,467 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <functional>
+#include <cassert>
+
+uint32_t RenderGraph::CreateResource(const string& Name, uint64_t Size, uint64_t Alignment)
+{
+	RenderGraphResource res;
+	res.Name = Name;
+	res.Size = Size;
+	res.Alignment = Alignment;
+	Resources.push_back(res);
+	return uint32_t(Resources.size() - 1);
+}
+
+uint32_t RenderGraph::ImportResource(const string& Name, uint32_t InitialState, uint32_t FinalState, bool bOutput)
+{
+	RenderGraphResource res;
+	res.Name = Name;
+	res.bImported = true;
+	res.bOutput = bOutput;
+	res.InitialState = InitialState;
+	res.FinalState = FinalState;
+	Resources.push_back(res);
+	return uint32_t(Resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const string& Name, RenderGraphQueue Queue, bool bSideEffect)
+{
+	RenderGraphPass pass;
+	pass.Name = Name;
+	pass.Queue = Queue;
+	pass.bSideEffect = bSideEffect;
+	Passes.push_back(pass);
+	return uint32_t(Passes.size() - 1);
+}
+
+void RenderGraph::Access(uint32_t Pass, uint32_t Resource, uint32_t State, uint8_t Flags)
+{
+	assert(Pass < Passes.size() && Resource < Resources.size());
+
+	for (RenderGraphAccess& access : Passes[Pass].Accesses)
+	{
+		if (access.Resource != Resource)
+			continue;
+
+		if (Flags & RENDER_GRAPH_WRITE)
+			access.State = State;
+		else if (!(access.Flags & RENDER_GRAPH_WRITE))
+			access.State |= State;
+		access.Flags |= Flags;
+		return;
+	}
+
+	Passes[Pass].Accesses.push_back({ Resource, State, Flags });
+}
+
+void RenderGraph::Cull()
+{
+	const uint32_t numPasses = uint32_t(Passes.size());
+
+	// the passes whose writes each pass reads
+	LastWriter.assign(Resources.size(), RENDER_GRAPH_INVALID);
+	Needs.resize(numPasses);
+	for (uint32_t p = 0; p < numPasses; p++)
+	{
+		Needs[p].clear();
+		for (const RenderGraphAccess& access : Passes[p].Accesses)
+		{
+			if ((access.Flags & RENDER_GRAPH_READ) && LastWriter[access.Resource] != RENDER_GRAPH_INVALID)
+				Needs[p].push_back(LastWriter[access.Resource]);
+		}
+		for (const RenderGraphAccess& access : Passes[p].Accesses)
+		{
+			if (access.Flags & RENDER_GRAPH_WRITE)
+				LastWriter[access.Resource] = p;
+		}
+	}
+
+	Live.assign(numPasses, 0);
+	for (uint32_t p = 0; p < numPasses; p++)
+	{
+		if (Passes[p].bSideEffect)
+			Live[p] = 1;
+	}
+	for (uint32_t r = 0; r < Resources.size(); r++)
+	{
+		if (Resources[r].bOutput && LastWriter[r] != RENDER_GRAPH_INVALID)
+			Live[LastWriter[r]] = 1;
+	}
+
+	// what a pass needs is declared before it, one walk back reaches everything
+	for (uint32_t p = numPasses; p-- > 0;)
+	{
+		if (!Live[p])
+		{
+			Stats.NumCulled++;
+			continue;
+		}
+		for (uint32_t need : Needs[p])
+			Live[need] = 1;
+	}
+}
+
+void RenderGraph::Schedule(bool bAllowAsyncCompute)
+{
+	const uint32_t numPasses = uint32_t(Passes.size());
+
+	LastWriter.assign(Resources.size(), RENDER_GRAPH_INVALID);
+	Readers.resize(Resources.size());
+	for (vector<uint32_t>& readers : Readers)
+		readers.clear();
+	Edges.resize(numPasses);
+	for (vector<uint32_t>& edges : Edges)
+		edges.clear();
+	NumDeps.assign(numPasses, 0);
+	Mark.assign(numPasses, RENDER_GRAPH_INVALID);
+
+	auto addEdge = [&](uint32_t From, uint32_t To)
+	{
+		// the edges to a pass are added together, Mark drops the same one twice
+		if (From == RENDER_GRAPH_INVALID || From == To || Mark[From] == To)
+			return;
+		Mark[From] = To;
+		Edges[From].push_back(To);
+		NumDeps[To]++;
+	};
+
+	uint32_t numLive = 0;
+	for (uint32_t p = 0; p < numPasses; p++)
+	{
+		if (!Live[p])
+			continue;
+		numLive++;
+
+		for (const RenderGraphAccess& access : Passes[p].Accesses)
+		{
+			// read after write and write after write
+			addEdge(LastWriter[access.Resource], p);
+
+			// write after read
+			if (access.Flags & RENDER_GRAPH_WRITE)
+			{
+				for (uint32_t reader : Readers[access.Resource])
+					addEdge(reader, p);
+			}
+		}
+
+		for (const RenderGraphAccess& access : Passes[p].Accesses)
+		{
+			if (access.Flags & RENDER_GRAPH_WRITE)
+			{
+				LastWriter[access.Resource] = p;
+				Readers[access.Resource].clear();
+			}
+			else
+			{
+				Readers[access.Resource].push_back(p);
+			}
+		}
+	}
+
+	auto queueOf = [&](uint32_t p)
+	{
+		return (bAllowAsyncCompute && Passes[p].Queue == RENDER_GRAPH_COMPUTE) ? RENDER_GRAPH_COMPUTE : RENDER_GRAPH_DIRECT;
+	};
+
+	// ready passes by compute first, then declaration order. compute passes start as soon as they can so they overlap more of
+	// the direct queue, the direct queue keeps the order it was written in.
+	auto key = [&](uint32_t p) { return (uint64_t(queueOf(p) == RENDER_GRAPH_COMPUTE ? 0 : 1) << 32) | p; };
+
+	Ready.clear();
+	for (uint32_t p = 0; p < numPasses; p++)
+	{
+		if (Live[p] && NumDeps[p] == 0)
+			Ready.push_back(key(p));
+	}
+	make_heap(Ready.begin(), Ready.end(), greater<uint64_t>());
+
+	Steps.reserve(numLive);
+	while (!Ready.empty())
+	{
+		pop_heap(Ready.begin(), Ready.end(), greater<uint64_t>());
+		const uint32_t p = uint32_t(Ready.back() & 0xffffffffu);
+		Ready.pop_back();
+
+		RenderGraphStep step;
+		step.Pass = p;
+		step.Queue = queueOf(p);
+		Passes[p].Step = uint32_t(Steps.size());
+		Steps.push_back(step);
+		if (step.Queue == RENDER_GRAPH_COMPUTE)
+			Stats.NumCompute++;
+
+		for (uint32_t next : Edges[p])
+		{
+			if (--NumDeps[next] == 0)
+			{
+				Ready.push_back(key(next));
+				push_heap(Ready.begin(), Ready.end(), greater<uint64_t>());
+			}
+		}
+	}
+
+	// edges only go from earlier to later declarations, there is no cycle to leave passes behind
+	assert(Steps.size() == numLive);
+}
+
+void RenderGraph::DeriveTransitions()
+{
+	const uint32_t numResources = uint32_t(Resources.size());
+
+	struct Tracking
+	{
+		uint32_t State;
+		uint32_t StateStep = RENDER_GRAPH_INVALID; // step of the transition to State
+		RenderGraphQueue StateQueue = RENDER_GRAPH_DIRECT;
+		uint32_t LastStep = RENDER_GRAPH_INVALID;
+		RenderGraphQueue LastQueue = RENDER_GRAPH_DIRECT;
+		uint32_t LastOnQueue[RENDER_GRAPH_NUM_QUEUES] = { RENDER_GRAPH_INVALID, RENDER_GRAPH_INVALID };
+
+		// reads since the last write. GroupStep/GroupIndex is the transition the reads on GroupQueue add their states to.
+		bool bReadGroup = false;
+		RenderGraphQueue GroupQueue = RENDER_GRAPH_DIRECT;
+		uint32_t GroupStep = RENDER_GRAPH_INVALID;
+		uint32_t GroupIndex = 0;
+	};
+
+	vector<Tracking> tracking(numResources);
+	for (uint32_t r = 0; r < numResources; r++)
+		tracking[r].State = Resources[r].bImported ? Resources[r].InitialState : RENDER_GRAPH_UNDEFINED_STATE;
+
+	ExtraWaits.resize(Steps.size());
+	for (vector<uint32_t>& waits : ExtraWaits)
+		waits.clear();
+
+	// position of each step within its queue, a split only helps with another step of the queue in between
+	QueuePos.resize(Steps.size());
+	uint32_t queueCount[RENDER_GRAPH_NUM_QUEUES] = {};
+	for (uint32_t s = 0; s < Steps.size(); s++)
+		QueuePos[s] = queueCount[Steps[s].Queue]++;
+
+	for (uint32_t s = 0; s < Steps.size(); s++)
+	{
+		RenderGraphStep& step = Steps[s];
+		const RenderGraphQueue q = step.Queue;
+		const RenderGraphQueue other = q == RENDER_GRAPH_DIRECT ? RENDER_GRAPH_COMPUTE : RENDER_GRAPH_DIRECT;
+
+		for (const RenderGraphAccess& access : Passes[step.Pass].Accesses)
+		{
+			RenderGraphResource& res = Resources[access.Resource];
+			Tracking& t = tracking[access.Resource];
+
+			if (res.FirstStep == RENDER_GRAPH_INVALID)
+				res.FirstStep = s;
+			res.LastStep = s;
+
+			const uint32_t splitStep = (t.LastStep != RENDER_GRAPH_INVALID && t.LastQueue == q) ? t.LastStep : RENDER_GRAPH_INVALID;
+
+			auto addTransition = [&]()
+			{
+				step.Transitions.push_back({ access.Resource, t.State, access.State, splitStep });
+				t.State = access.State;
+				t.StateStep = s;
+				t.StateQueue = q;
+			};
+
+			// a read that takes the state as it is still has to come after the transition to it
+			auto waitForState = [&]()
+			{
+				if (t.StateStep != RENDER_GRAPH_INVALID && t.StateQueue != q)
+					ExtraWaits[s].push_back(t.StateStep);
+			};
+
+			if (access.Flags & RENDER_GRAPH_WRITE)
+			{
+				if (t.State != access.State)
+					addTransition();
+				t.bReadGroup = false;
+			}
+			else if (t.bReadGroup && t.GroupStep != RENDER_GRAPH_INVALID && t.GroupQueue == q)
+			{
+				// the first read of the group already transitions it, that one takes this state too
+				RenderGraphTransition& groupTransition = Steps[t.GroupStep].Transitions[t.GroupIndex];
+				if (access.State & ~groupTransition.After)
+				{
+					groupTransition.After |= access.State;
+					t.State = groupTransition.After;
+					Stats.NumMergedReads++;
+				}
+			}
+			else if (t.State != RENDER_GRAPH_UNDEFINED_STATE && (access.State & ~t.State) == 0)
+			{
+				waitForState();
+				if (!t.bReadGroup)
+				{
+					t.bReadGroup = true;
+					t.GroupQueue = q;
+					t.GroupStep = RENDER_GRAPH_INVALID;
+				}
+			}
+			else
+			{
+				// readers on the other queue have to be done before the state changes under them
+				if (t.LastOnQueue[other] != RENDER_GRAPH_INVALID)
+					ExtraWaits[s].push_back(t.LastOnQueue[other]);
+
+				addTransition();
+				t.bReadGroup = true;
+				t.GroupQueue = q;
+				t.GroupStep = s;
+				t.GroupIndex = uint32_t(step.Transitions.size() - 1);
+			}
+
+			t.LastStep = s;
+			t.LastQueue = q;
+			t.LastOnQueue[q] = s;
+		}
+	}
+
+	for (uint32_t r = 0; r < numResources; r++)
+	{
+		const RenderGraphResource& res = Resources[r];
+		const Tracking& t = tracking[r];
+		if (!res.bImported || res.FinalState == RENDER_GRAPH_ANY_STATE || res.FinalState == t.State)
+			continue;
+
+		const uint32_t splitStep = (t.LastStep != RENDER_GRAPH_INVALID && t.LastQueue == RENDER_GRAPH_DIRECT) ? t.LastStep : RENDER_GRAPH_INVALID;
+		FinalTransitions.push_back({ r, t.State, res.FinalState, splitStep });
+	}
+
+	// after the merged reads are done, the split begins carry the final After
+	for (uint32_t s = 0; s < Steps.size(); s++)
+	{
+		Stats.NumTransitions += uint32_t(Steps[s].Transitions.size());
+		for (const RenderGraphTransition& transition : Steps[s].Transitions)
+		{
+			if (transition.SplitStep != RENDER_GRAPH_INVALID && QueuePos[s] > QueuePos[transition.SplitStep] + 1)
+			{
+				Steps[transition.SplitStep].SplitBegins.push_back(transition);
+				Stats.NumSplit++;
+			}
+		}
+	}
+
+	Stats.NumTransitions += uint32_t(FinalTransitions.size());
+	for (const RenderGraphTransition& transition : FinalTransitions)
+	{
+		if (transition.SplitStep != RENDER_GRAPH_INVALID && queueCount[RENDER_GRAPH_DIRECT] > QueuePos[transition.SplitStep] + 1)
+		{
+			Steps[transition.SplitStep].SplitBegins.push_back(transition);
+			Stats.NumSplit++;
+		}
+	}
+}
+
+void RenderGraph::DeriveWaits()
+{
+	// latest step of the other queue each step depends on
+	NeedStep.assign(Steps.size(), RENDER_GRAPH_INVALID);
+	auto need = [&](uint32_t Step, uint32_t From)
+	{
+		if (NeedStep[Step] == RENDER_GRAPH_INVALID || NeedStep[Step] < From)
+			NeedStep[Step] = From;
+	};
+
+	for (uint32_t s = 0; s < Steps.size(); s++)
+	{
+		for (uint32_t next : Edges[Steps[s].Pass])
+		{
+			const uint32_t nextStep = Passes[next].Step;
+			if (Steps[nextStep].Queue != Steps[s].Queue)
+				need(nextStep, s);
+		}
+		for (uint32_t from : ExtraWaits[s])
+			need(s, from);
+	}
+
+	// a queue runs in order, waiting for a step covers every step of the other queue before it
+	uint32_t waited[RENDER_GRAPH_NUM_QUEUES] = { RENDER_GRAPH_INVALID, RENDER_GRAPH_INVALID };
+	uint32_t lastCompute = RENDER_GRAPH_INVALID;
+	for (uint32_t s = 0; s < Steps.size(); s++)
+	{
+		RenderGraphStep& step = Steps[s];
+		if (step.Queue == RENDER_GRAPH_COMPUTE)
+			lastCompute = s;
+
+		const uint32_t from = NeedStep[s];
+		if (from == RENDER_GRAPH_INVALID)
+			continue;
+		if (waited[step.Queue] != RENDER_GRAPH_INVALID && waited[step.Queue] >= from)
+			continue;
+
+		step.WaitStep = from;
+		waited[step.Queue] = from;
+		Stats.NumWaits++;
+	}
+
+	// the frame ends on the direct queue, the compute work has to be done by then
+	if (lastCompute != RENDER_GRAPH_INVALID && (waited[RENDER_GRAPH_DIRECT] == RENDER_GRAPH_INVALID || waited[RENDER_GRAPH_DIRECT] < lastCompute))
+	{
+		FinalWaitStep = lastCompute;
+		Stats.NumWaits++;
+	}
+}
+
+void RenderGraph::Compile(bool bAllowAsyncCompute)
+{
+	Steps.clear();
+	FinalTransitions.clear();
+	FinalWaitStep = RENDER_GRAPH_INVALID;
+	Stats = RenderGraphStats();
+	Stats.NumPasses = uint32_t(Passes.size());
+
+	for (RenderGraphResource& res : Resources)
+	{
+		res.FirstStep = RENDER_GRAPH_INVALID;
+		res.LastStep = 0;
+	}
+	for (RenderGraphPass& pass : Passes)
+		pass.Step = RENDER_GRAPH_INVALID;
+
+	Cull();
+	Schedule(bAllowAsyncCompute);
+	DeriveTransitions();
+	DeriveWaits();
+}
+
+vector<TransientRange> RenderGraph::GetTransientRanges(vector<uint32_t>* OutResources) const
+{
+	vector<TransientRange> ranges;
+	if (OutResources)
+		OutResources->clear();
+
+	for (uint32_t r = 0; r < Resources.size(); r++)
+	{
+		const RenderGraphResource& res = Resources[r];
+		if (res.bImported)
+			continue;
+
+		TransientRange range;
+		range.Size = res.Size;
+		range.Alignment = res.Alignment;
+		if (res.FirstStep != RENDER_GRAPH_INVALID)
+		{
+			range.FirstPass = res.FirstStep;
+			range.LastPass = res.LastStep;
+		}
+		ranges.push_back(range);
+
+		if (OutResources)
+			OutResources->push_back(r);
+	}
+
+	return ranges;
+}
+
+void RenderGraph::Clear()
+{
+	Resources.clear();
+	Passes.clear();
+	Steps.clear();
+	FinalTransitions.clear();
+	FinalWaitStep = RENDER_GRAPH_INVALID;
+	Stats = RenderGraphStats();
+}
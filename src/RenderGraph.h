@@ -0,0 +1,161 @@
+#pragma once
+
+#include "HeapAllocator.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// Frame graph compiler. no graphics api in here, Corona declares its passes in BuildRenderGraph and records the compiled steps in
+// OnRender. passes declare the resources they read and write, Compile
+//   culls the passes whose writes nothing reads(unless they have side effects or write an output),
+//   orders the rest(read after write, write after read and write after write, compute passes first when they are ready),
+//   puts them on their queue and gives each step the step of the other queue it has to wait for,
+//   derives the transitions before each step and the first/last step of every resource(TransientRange for aliasing).
+//
+// states are opaque bit masks(D3D12_RESOURCE_STATES in Corona). reads that follow each other on a queue share one transition to the
+// union of their states. Write replaces the contents, a pass that draws over what is there(overlay on the backbuffer) or reads
+// last frame's half of a ping-pong pair declares Modify. declaration order is the order of the frame : a read sees the last write
+// declared before it.
+
+#define RENDER_GRAPH_INVALID 0xffffffffu
+#define RENDER_GRAPH_ANY_STATE 0xffffffffu // final state : left as the last pass had it
+#define RENDER_GRAPH_UNDEFINED_STATE 0xfffffffeu // transient resources before their first pass
+
+enum RenderGraphQueue : uint8_t
+{
+	RENDER_GRAPH_DIRECT,
+	RENDER_GRAPH_COMPUTE,
+	RENDER_GRAPH_NUM_QUEUES,
+};
+
+enum RenderGraphAccessFlags : uint8_t
+{
+	RENDER_GRAPH_READ = 1,
+	RENDER_GRAPH_WRITE = 2,
+	RENDER_GRAPH_MODIFY = RENDER_GRAPH_READ | RENDER_GRAPH_WRITE,
+};
+
+struct RenderGraphResource
+{
+	string Name;
+	bool bImported = false; // lives across frames(history, backbuffer), never aliased
+	bool bOutput = false; // used after the frame, its last writer is never culled
+	uint32_t InitialState = RENDER_GRAPH_UNDEFINED_STATE;
+	uint32_t FinalState = RENDER_GRAPH_ANY_STATE;
+	uint64_t Size = 0; // transient only, for PlanTransientOffsets
+	uint64_t Alignment = 0;
+
+	// Compile, in step order. FirstStep is invalid when no step uses it.
+	uint32_t FirstStep = RENDER_GRAPH_INVALID;
+	uint32_t LastStep = 0;
+};
+
+struct RenderGraphAccess
+{
+	uint32_t Resource;
+	uint32_t State;
+	uint8_t Flags;
+};
+
+struct RenderGraphPass
+{
+	string Name;
+	RenderGraphQueue Queue = RENDER_GRAPH_DIRECT; // asked for, Compile may put a compute pass on the direct queue
+	bool bSideEffect = false; // never culled
+	vector<RenderGraphAccess> Accesses; // one per resource
+
+	uint32_t Step = RENDER_GRAPH_INVALID; // Compile, invalid when culled
+};
+
+struct RenderGraphTransition
+{
+	uint32_t Resource;
+	uint32_t Before;
+	uint32_t After;
+	uint32_t SplitStep; // the resource is idle from after this step of the same queue, invalid when there is no such step
+};
+
+struct RenderGraphStep
+{
+	uint32_t Pass;
+	RenderGraphQueue Queue;
+	uint32_t WaitStep = RENDER_GRAPH_INVALID; // step of the other queue to wait for before this one
+	vector<RenderGraphTransition> Transitions; // before the pass, on its queue
+	vector<RenderGraphTransition> SplitBegins; // transitions of later steps that can begin after this one(split barriers)
+};
+
+struct RenderGraphStats
+{
+	uint32_t NumPasses = 0;
+	uint32_t NumCulled = 0;
+	uint32_t NumCompute = 0;
+	uint32_t NumTransitions = 0; // final ones included
+	uint32_t NumMergedReads = 0; // reads that joined the transition of an earlier read
+	uint32_t NumSplit = 0;
+	uint32_t NumWaits = 0;
+};
+
+class RenderGraph
+{
+	vector<RenderGraphResource> Resources;
+	vector<RenderGraphPass> Passes;
+
+	vector<RenderGraphStep> Steps;
+	vector<RenderGraphTransition> FinalTransitions;
+	uint32_t FinalWaitStep = RENDER_GRAPH_INVALID;
+	RenderGraphStats Stats;
+
+	// Compile scratch
+	vector<uint32_t> LastWriter;
+	vector<vector<uint32_t>> Readers;
+	vector<vector<uint32_t>> Edges; // pass -> passes that depend on it
+	vector<uint32_t> NumDeps;
+	vector<uint32_t> Mark;
+	vector<vector<uint32_t>> Needs; // pass -> passes whose writes it reads
+	vector<uint8_t> Live;
+	vector<uint64_t> Ready;
+	vector<vector<uint32_t>> ExtraWaits; // step -> steps of the other queue it waits for besides its dependencies
+	vector<uint32_t> QueuePos;
+	vector<uint32_t> NeedStep;
+
+	void Access(uint32_t Pass, uint32_t Resource, uint32_t State, uint8_t Flags);
+	void Cull();
+	void Schedule(bool bAllowAsyncCompute);
+	void DeriveTransitions();
+	void DeriveWaits();
+
+public:
+	// transient resources only live within the frame. Size/Alignment are only needed for GetTransientRanges.
+	uint32_t CreateResource(const string& Name, uint64_t Size = 0, uint64_t Alignment = 0);
+	uint32_t ImportResource(const string& Name, uint32_t InitialState, uint32_t FinalState = RENDER_GRAPH_ANY_STATE, bool bOutput = true);
+
+	uint32_t AddPass(const string& Name, RenderGraphQueue Queue = RENDER_GRAPH_DIRECT, bool bSideEffect = false);
+
+	// a resource twice in a pass is one access : Read + Write is Modify in the written state, two reads are the union
+	void Read(uint32_t Pass, uint32_t Resource, uint32_t State) { Access(Pass, Resource, State, RENDER_GRAPH_READ); }
+	void Write(uint32_t Pass, uint32_t Resource, uint32_t State) { Access(Pass, Resource, State, RENDER_GRAPH_WRITE); }
+	void Modify(uint32_t Pass, uint32_t Resource, uint32_t State) { Access(Pass, Resource, State, RENDER_GRAPH_MODIFY); }
+
+	// without async compute every pass goes to the direct queue
+	void Compile(bool bAllowAsyncCompute);
+
+	const vector<RenderGraphStep>& GetSteps() const { return Steps; }
+	// after the last step, on the direct queue once it waited for FinalWaitStep
+	const vector<RenderGraphTransition>& GetFinalTransitions() const { return FinalTransitions; }
+	// last compute step no direct step waits for, invalid when there is none
+	uint32_t GetFinalWaitStep() const { return FinalWaitStep; }
+
+	uint32_t GetNumPasses() const { return uint32_t(Passes.size()); }
+	uint32_t GetNumResources() const { return uint32_t(Resources.size()); }
+	const RenderGraphPass& GetPass(uint32_t Pass) const { return Passes[Pass]; }
+	const RenderGraphResource& GetResource(uint32_t Resource) const { return Resources[Resource]; }
+	const RenderGraphStats& GetStats() const { return Stats; }
+
+	// lifetimes of the transient resources in steps, ready for PlanTransientOffsets. OutResources gets the resource of each range.
+	vector<TransientRange> GetTransientRanges(vector<uint32_t>* OutResources = nullptr) const;
+
+	void Clear();
+};
@@ -0,0 +1,317 @@
+#include "ShaderCache.h"
+
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <set>
+
+namespace fs = std::filesystem;
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+// fnv-1a over everything that can change the dxil. strings go in with their length so "ab"+"c" and "a"+"bc" differ.
+struct ShaderKeyHasher
+{
+	uint64_t Hash = 0xcbf29ce484222325ull;
+	uint64_t Size = 0;
+
+	void Add(const void* Data, size_t NumBytes)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(Data);
+		for (size_t i = 0; i < NumBytes; i++)
+			Hash = (Hash ^ bytes[i]) * 0x100000001b3ull;
+		Size += NumBytes;
+	}
+
+	void Add(uint64_t Value) { Add(&Value, sizeof(Value)); }
+	void Add(const string& Str) { Add(uint64_t(Str.size())); Add(Str.data(), Str.size()); }
+	void Add(const wstring& Str) { Add(uint64_t(Str.size())); Add(Str.data(), Str.size() * sizeof(wchar_t)); }
+};
+
+static bool ReadWholeFile(const fs::path& Path, string& Out)
+{
+	ifstream file(Path, ios::binary);
+	if (!file)
+		return false;
+
+	Out.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	return true;
+}
+
+// names of the #include "x" and #include <x> lines
+static void FindIncludes(const string& Source, vector<string>& OutNames)
+{
+	auto skipSpaces = [&](size_t i, size_t end)
+	{
+		while (i < end && (Source[i] == ' ' || Source[i] == '\t'))
+			i++;
+		return i;
+	};
+
+	size_t pos = 0;
+	while (pos < Source.size())
+	{
+		size_t end = Source.find('\n', pos);
+		if (end == string::npos)
+			end = Source.size();
+
+		size_t i = skipSpaces(pos, end);
+		if (i < end && Source[i] == '#')
+		{
+			i = skipSpaces(i + 1, end);
+			if (Source.compare(i, 7, "include") == 0)
+			{
+				i = skipSpaces(i + 7, end);
+				if (i < end && (Source[i] == '"' || Source[i] == '<'))
+				{
+					const char close = Source[i] == '"' ? '"' : '>';
+					const size_t nameEnd = Source.find(close, i + 1);
+					if (nameEnd != string::npos && nameEnd < end)
+						OutNames.push_back(Source.substr(i + 1, nameEnd - i - 1));
+				}
+			}
+		}
+
+		pos = end + 1;
+	}
+}
+
+ShaderCache::ShaderCache(const wstring& InDirectory, const string& InCompilerVersion)
+	: Directory(InDirectory), CompilerVersion(InCompilerVersion)
+{
+}
+
+bool ShaderCache::MakeKey(const ShaderCacheDesc& Desc, ShaderCacheKey& OutKey, vector<wstring>* OutFiles, string* OutSource)
+{
+	auto startTime = chrono::high_resolution_clock::now();
+
+	ShaderKeyHasher hasher;
+	hasher.Add(uint64_t(SHADER_CACHE_VERSION));
+	hasher.Add(CompilerVersion);
+	hasher.Add(Desc.EntryPoint);
+	hasher.Add(Desc.Target);
+	hasher.Add(uint64_t(Desc.Defines.size()));
+	for (auto& define : Desc.Defines)
+	{
+		hasher.Add(define.first);
+		hasher.Add(define.second);
+	}
+	hasher.Add(uint64_t(Desc.Arguments.size()));
+	for (auto& argument : Desc.Arguments)
+		hasher.Add(argument);
+
+	// -I dir, -Idir, /I dir and /Idir
+	vector<fs::path> includeDirs;
+	for (size_t i = 0; i < Desc.Arguments.size(); i++)
+	{
+		const wstring& argument = Desc.Arguments[i];
+		if (argument.size() < 2 || (argument[0] != L'-' && argument[0] != L'/') || argument[1] != L'I')
+			continue;
+
+		if (argument.size() > 2)
+			includeDirs.push_back(argument.substr(2));
+		else if (i + 1 < Desc.Arguments.size())
+			includeDirs.push_back(Desc.Arguments[++i]);
+	}
+
+	// the source first, then its includes in the order they are found. a file included twice is hashed once.
+	const fs::path mainPath = fs::path(Desc.FileName).lexically_normal();
+	vector<fs::path> files = { mainPath };
+	set<fs::path> visited = { mainPath };
+
+	string source;
+	vector<string> includes;
+	uint32_t numFiles = 0;
+	bool bResult = true;
+	for (size_t f = 0; f < files.size(); f++)
+	{
+		if (!ReadWholeFile(files[f], source))
+		{
+			// includes were only queued when they exist, only the source itself gets here
+			bResult = false;
+			break;
+		}
+		numFiles++;
+		hasher.Add(source);
+		if (f == 0 && OutSource)
+			*OutSource = source;
+
+		includes.clear();
+		FindIncludes(source, includes);
+		for (const string& name : includes)
+		{
+			hasher.Add(name);
+
+			// next to the file that includes it, next to the source, then the include directories in order
+			vector<fs::path> searchDirs = { files[f].parent_path(), mainPath.parent_path() };
+			searchDirs.insert(searchDirs.end(), includeDirs.begin(), includeDirs.end());
+
+			fs::path found;
+			for (const fs::path& dir : searchDirs)
+			{
+				fs::path candidate = (dir / fs::path(name)).lexically_normal();
+				error_code ec;
+				if (fs::is_regular_file(candidate, ec))
+				{
+					found = candidate;
+					break;
+				}
+			}
+
+			// an include that can't be found changes the key when it shows up
+			hasher.Add(uint64_t(found.empty() ? 0 : 1));
+			if (!found.empty() && visited.insert(found).second)
+				files.push_back(found);
+		}
+	}
+
+	if (OutFiles)
+	{
+		OutFiles->clear();
+		for (size_t f = 0; f < numFiles; f++)
+			OutFiles->push_back(files[f].wstring());
+	}
+
+	OutKey.Hash = hasher.Hash;
+	OutKey.Size = hasher.Size;
+
+	lock_guard<mutex> lock(Mtx);
+	Stats.NumFiles += numFiles;
+	Stats.BytesHashed += hasher.Size;
+	Stats.KeyMs += ElapsedMS(startTime);
+	return bResult;
+}
+
+wstring ShaderCache::GetEntryPath(const ShaderCacheKey& Key) const
+{
+	static const wchar_t digits[] = L"0123456789abcdef";
+
+	wstring name(16, L'0');
+	for (int i = 0; i < 16; i++)
+		name[15 - i] = digits[(Key.Hash >> (i * 4)) & 0xf];
+
+	return (fs::path(Directory) / (name + L".dxil")).wstring();
+}
+
+bool ShaderCache::Load(const ShaderCacheKey& Key, vector<uint8_t>& OutBlob)
+{
+	const fs::path path = GetEntryPath(Key);
+
+	error_code ec;
+	const uintmax_t fileSize = fs::file_size(path, ec);
+	if (ec || fileSize < sizeof(ShaderCacheEntryHeader))
+		return false;
+
+	ifstream file(path, ios::binary);
+	if (!file)
+		return false;
+
+	ShaderCacheEntryHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if (header.Magic != SHADER_CACHE_MAGIC || header.Version != SHADER_CACHE_VERSION || header.KeyHash != Key.Hash || header.KeySize != Key.Size ||
+		header.BlobSize != fileSize - sizeof(header))
+		return false;
+
+	OutBlob.resize(size_t(header.BlobSize));
+	return bool(file.read(reinterpret_cast<char*>(OutBlob.data()), OutBlob.size()));
+}
+
+// written next to the entry and renamed, a run that dies half way never leaves a partial entry
+bool ShaderCache::Store(const ShaderCacheKey& Key, const void* Data, size_t Size)
+{
+	error_code ec;
+	fs::create_directories(Directory, ec);
+
+	const fs::path path = GetEntryPath(Key);
+	fs::path tempPath = path;
+	tempPath += L".tmp";
+
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file)
+			return false;
+
+		ShaderCacheEntryHeader header;
+		header.Magic = SHADER_CACHE_MAGIC;
+		header.Version = SHADER_CACHE_VERSION;
+		header.KeyHash = Key.Hash;
+		header.KeySize = Key.Size;
+		header.BlobSize = Size;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(static_cast<const char*>(Data), Size);
+		if (!file)
+		{
+			file.close();
+			fs::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tempPath, path, ec);
+	if (ec)
+	{
+		fs::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+bool ShaderCache::GetOrCompile(const ShaderCacheDesc& Desc, const function<bool(const string& Source, vector<uint8_t>&)>& Compile, vector<uint8_t>& OutBlob)
+{
+	ShaderCacheKey key;
+	string source;
+	if (!MakeKey(Desc, key, nullptr, &source))
+	{
+		lock_guard<mutex> lock(Mtx);
+		Stats.NumFailed++;
+		return false;
+	}
+
+	if (bEnabled)
+	{
+		auto loadStart = chrono::high_resolution_clock::now();
+		const bool bHit = Load(key, OutBlob);
+		const double loadMs = ElapsedMS(loadStart);
+
+		lock_guard<mutex> lock(Mtx);
+		Stats.LoadMs += loadMs;
+		if (bHit)
+		{
+			Stats.NumHits++;
+			Stats.BytesLoaded += OutBlob.size();
+			return true;
+		}
+	}
+
+	auto compileStart = chrono::high_resolution_clock::now();
+	OutBlob.clear();
+	const bool bCompiled = Compile(source, OutBlob);
+	const bool bStored = bCompiled && bEnabled && Store(key, OutBlob.data(), OutBlob.size());
+	const double compileMs = ElapsedMS(compileStart);
+
+	lock_guard<mutex> lock(Mtx);
+	Stats.NumMisses++;
+	Stats.CompileMs += compileMs;
+	if (!bCompiled)
+		Stats.NumFailed++;
+	if (bStored)
+		Stats.BytesStored += OutBlob.size();
+	return bCompiled;
+}
+
+ShaderCacheStats ShaderCache::GetStats()
+{
+	lock_guard<mutex> lock(Mtx);
+	return Stats;
+}
+
+void ShaderCache::ResetStats()
+{
+	lock_guard<mutex> lock(Mtx);
+	Stats = ShaderCacheStats();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+
+using namespace std;
+
+// On disk cache of compiled shaders. no graphics api in here, SimpleDX12::CompileDXC hashes the shader, loads the blob on a hit and
+// only calls dxc on a miss.
+//
+// entries are addressed by their content : the key hashes the source, every file it includes(followed recursively, resolved like dxc
+// does relative to the including file, then in the -I directories of the arguments), the defines, entry point, target, arguments and the compiler version. includes are found by
+// scanning for #include lines instead of running the preprocessor, inside a disabled #if they are hashed too, which only costs a miss.
+// nothing is ever invalidated : an edit makes a new key, going back to the old source finds the old entry again.
+
+#define SHADER_CACHE_MAGIC 0x4C495844 // 'DXIL'
+#define SHADER_CACHE_VERSION 1
+
+struct ShaderCacheDesc
+{
+	wstring FileName;
+	wstring EntryPoint; // empty for libraries
+	wstring Target;
+	vector<pair<wstring, wstring>> Defines;
+	vector<wstring> Arguments;
+};
+
+struct ShaderCacheKey
+{
+	uint64_t Hash = 0;
+	uint64_t Size = 0; // bytes that went into the hash, checked against the entry
+};
+
+struct ShaderCacheEntryHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t KeyHash;
+	uint64_t KeySize;
+	uint64_t BlobSize;
+};
+
+struct ShaderCacheStats
+{
+	uint32_t NumHits = 0;
+	uint32_t NumMisses = 0;
+	uint32_t NumFailed = 0; // sources that can't be read and compile errors, nothing is stored
+	uint32_t NumFiles = 0; // sources and includes read for keys
+	uint64_t BytesHashed = 0;
+	uint64_t BytesLoaded = 0;
+	uint64_t BytesStored = 0;
+	double KeyMs = 0;
+	double LoadMs = 0;
+	double CompileMs = 0; // the Compile callbacks of misses, stores included
+};
+
+class ShaderCache
+{
+	wstring Directory;
+	string CompilerVersion;
+
+	mutex Mtx;
+	ShaderCacheStats Stats;
+
+public:
+	bool bEnabled = true; // off : every shader is compiled and nothing is read or written, the key is still made
+
+	ShaderCache(const wstring& InDirectory, const string& InCompilerVersion);
+
+	// false when the source can't be read. OutFiles gets the source and the includes that were found, OutSource the bytes of the source
+	// that went into the key.
+	bool MakeKey(const ShaderCacheDesc& Desc, ShaderCacheKey& OutKey, vector<wstring>* OutFiles = nullptr, string* OutSource = nullptr);
+
+	// false on a miss or an entry that doesn't match the key(truncated, other version)
+	bool Load(const ShaderCacheKey& Key, vector<uint8_t>& OutBlob);
+	bool Store(const ShaderCacheKey& Key, const void* Data, size_t Size);
+
+	// Compile gets the source the key was made from, so the entry always matches its key even when the file changes in between.
+	// it fills the blob and returns false on errors. false when the source can't be read or doesn't compile.
+	bool GetOrCompile(const ShaderCacheDesc& Desc, const function<bool(const string& Source, vector<uint8_t>&)>& Compile, vector<uint8_t>& OutBlob);
+
+	wstring GetEntryPath(const ShaderCacheKey& Key) const;
+	const wstring& GetDirectory() const { return Directory; }
+	const string& GetCompilerVersion() const { return CompilerVersion; }
+
+	ShaderCacheStats GetStats();
+	void ResetStats();
+};
@@ -1,3 +1,6 @@
+#include "VertexFormat.h"
+#include "MaterialFormat.h"
+
 #define PI 3.14159265
 
 #define DOWNSAMPLE_SIZE 3
@@ -284,9 +287,74 @@ struct Vertex
 //     return index;
 // }
 
-uint3 GetIndices(ByteAddressBuffer ib, uint triangleIndex)
+// InstanceProperty layout : float4x4 WorldMatrix, uint4 GeometryInfo (vertex base, index byte offset, index stride, material index),
+// float4 PositionScale, float4 PositionBias
+// meshes live in scene wide vertex/index buffers, GeometryInfo locates the instance inside them.
+#define INSTANCE_PROPERTY_STRIDE 112
+
+#if USE_BINDLESS_MATERIALS
+// the whole shader visible heap. see MaterialFormat.h
+Texture2D BindlessTextures[] : register(t0, space1);
+// per material (albedo, normal, roughness, metallic) indices into BindlessTextures
+StructuredBuffer<uint4> Materials : register(t0, space2);
+
+uint4 GetInstanceMaterial(uint instanceID, ByteAddressBuffer ip)
+{
+    uint materialIndex = ip.Load(instanceID * INSTANCE_PROPERTY_STRIDE + 16*4 + 12);
+    return Materials[materialIndex];
+}
+#endif
+
+// packed vertex decode. see VertexFormat.h
+float3 OctDecode(float2 p)
+{
+    float3 n = float3(p.x, p.y, 1 - abs(p.x) - abs(p.y));
+    float t = saturate(-n.z);
+    n.xy += (n.xy >= 0) ? -t : t;
+    return normalize(n);
+}
+
+float3 DecodePackedPosition(uint2 packed, float3 scale, float3 bias)
+{
+    float3 q = float3(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff);
+    return q * scale + bias;
+}
+
+float3 DecodePackedDirection(uint packed)
+{
+    int2 snorm = int2(packed << 16, packed) >> 16;
+    return OctDecode(max(float2(snorm) / 32767.0, -1.0));
+}
+
+float2 DecodePackedUV(uint packed)
 {
-    uint baseIndex = (triangleIndex * 3 * 2) ;
+    return f16tof32(uint2(packed & 0xffff, packed >> 16));
+}
+
+float3 LoadVertexPosition(ByteAddressBuffer vb, uint index, float3 scale, float3 bias)
+{
+#if USE_PACKED_VERTEX
+    return DecodePackedPosition(vb.Load2(index * VERTEX_STRIDE), scale, bias);
+#else
+    return asfloat(vb.Load3(index * VERTEX_STRIDE));
+#endif
+}
+
+float2 LoadVertexUV(ByteAddressBuffer vb, uint index)
+{
+#if USE_PACKED_VERTEX
+    return DecodePackedUV(vb.Load(index * VERTEX_STRIDE + 16));
+#else
+    return asfloat(vb.Load2(index * VERTEX_STRIDE + 24));
+#endif
+}
+
+uint3 GetIndices(ByteAddressBuffer ib, uint indexByteOffset, uint indexStride, uint triangleIndex)
+{
+    if (indexStride == 4)
+        return ib.Load3(indexByteOffset + triangleIndex * 3 * 4);
+
+    uint baseIndex = indexByteOffset + (triangleIndex * 3 * 2) ;
     uint3 index;
 
     // ByteAdressBuffer loads must be aligned at a 4 byte boundary.
@@ -318,21 +386,26 @@ uint3 GetIndices(ByteAddressBuffer ib, uint triangleIndex)
 
 Vertex GetVertexAttributes(uint instanceID, ByteAddressBuffer vb, ByteAddressBuffer ib, ByteAddressBuffer ip, uint triangleIndex, float3 barycentrics)
 {
-   uint3 index = GetIndices(ib, triangleIndex);
+    uint propertyOffset = instanceID * INSTANCE_PROPERTY_STRIDE;
+    uint3 geometryInfo = ip.Load3(propertyOffset + 16*4);
+    float3 positionScale = asfloat(ip.Load3(propertyOffset + 16*5));
+    float3 positionBias = asfloat(ip.Load3(propertyOffset + 16*6));
+
+    uint3 index = GetIndices(ib, geometryInfo.y, geometryInfo.z, triangleIndex) + geometryInfo.x;
     Vertex v;
     v.position = float3(0, 0, 0);
     v.uv = float2(0, 0);
 
 
-    float3 p0 = asfloat(vb.Load3(index[0] * 44));
-    float3 p1 = asfloat(vb.Load3(index[1] * 44));
-    float3 p2 = asfloat(vb.Load3(index[2] * 44));
+    float3 p0 = LoadVertexPosition(vb, index[0], positionScale, positionBias);
+    float3 p1 = LoadVertexPosition(vb, index[1], positionScale, positionBias);
+    float3 p2 = LoadVertexPosition(vb, index[2], positionScale, positionBias);
 
     float4x4 WorldMatrix = {
-        asfloat(ip.Load4(instanceID*4*16)), 
-        asfloat(ip.Load4(instanceID*4*16 + 16)), 
-        asfloat(ip.Load4(instanceID*4*16 + 16*2)),
-        asfloat(ip.Load4(instanceID*4*16 + 16*3)),
+        asfloat(ip.Load4(propertyOffset)), 
+        asfloat(ip.Load4(propertyOffset + 16)), 
+        asfloat(ip.Load4(propertyOffset + 16*2)),
+        asfloat(ip.Load4(propertyOffset + 16*3)),
     };
 
 
@@ -342,9 +415,9 @@ Vertex GetVertexAttributes(uint instanceID, ByteAddressBuffer vb, ByteAddressBuf
 
     v.position = mul(float4(v.position, 1), WorldMatrix).xyz;
 
-    float2 uv0 = asfloat(vb.Load2(index[0] * 44 + 24));
-    float2 uv1 = asfloat(vb.Load2(index[1] * 44 + 24));
-    float2 uv2 = asfloat(vb.Load2(index[2] * 44 + 24));
+    float2 uv0 = LoadVertexUV(vb, index[0]);
+    float2 uv1 = LoadVertexUV(vb, index[1]);
+    float2 uv2 = LoadVertexUV(vb, index[2]);
 
     v.uv += uv0 * barycentrics[0];
     v.uv += uv1 * barycentrics[1];
@@ -9,10 +9,14 @@
 //
 //*********************************************************
 
+#include "Common.hlsl"
+
+#if !USE_BINDLESS_MATERIALS
 Texture2D AlbedoTex : register(t0);
 Texture2D NormalTex : register(t1);
 Texture2D RoughnessTex : register(t2);
 Texture2D MetallicTex : register(t3);
+#endif
 
 
 
@@ -28,9 +32,21 @@ cbuffer GBufferConstantBuffer : register(b0)
     float4 ViewDir;
     float2 RTSize;
     float2 RougnessMetalic;
+    float4 PositionScale; // packed vertex position dequantization
+    float4 PositionBias;
     uint bOverrideRougnessMetallic;
+    uint MaterialIndex; // into Materials, bindless only
 };
 
+#if USE_PACKED_VERTEX
+struct VSInput
+{
+    uint4 position : POSITION; // 16 bit integers, see DecodePackedPosition
+    float2 normal : NORMAL; // octahedral snorm16
+    float2 uv : TEXCOORD0;
+    float2 tangent : TANGENT; // octahedral snorm16
+};
+#else
 struct VSInput
 {
     float3 position : POSITION;
@@ -38,6 +54,7 @@ struct VSInput
     float2 uv : TEXCOORD0;
     float3 tangent : TANGENT;
 };
+#endif
 
 struct PSInput
 {
@@ -53,15 +70,24 @@ PSInput VSMain(
     VSInput input)
 {
     PSInput result;
-	float4 worldPos = mul(float4(input.position, 1.0f), WorldMatrix);
+#if USE_PACKED_VERTEX
+    float3 position = float3(input.position.xyz) * PositionScale.xyz + PositionBias.xyz;
+    float3 normal = OctDecode(input.normal);
+    float3 tangent = OctDecode(input.tangent);
+#else
+    float3 position = input.position;
+    float3 normal = input.normal;
+    float3 tangent = input.tangent;
+#endif
+	float4 worldPos = mul(float4(position, 1.0f), WorldMatrix);
     result.position = mul(worldPos, ViewProjectionMatrix);
 
     result.unjitteredPosition = mul(worldPos, UnjitteredViewProjMat);
 
     result.prevPosition = mul(worldPos, PrevUnjitteredViewProjMat);
 
-	result.normal = normalize(mul(float4(input.normal, 0), WorldMatrix));
-    result.tangent = normalize(mul(float4(input.tangent, 0), WorldMatrix));
+	result.normal = normalize(mul(float4(normal, 0), WorldMatrix));
+    result.tangent = normalize(mul(float4(tangent, 0), WorldMatrix));
     result.uv = input.uv;
 	
     return result;
@@ -69,7 +95,7 @@ PSInput VSMain(
 
 
 
-float3 CalcPerPixelNormal(float2 vTexcoord, float3 vVertNormal, float3 vVertTangent)
+float3 CalcPerPixelNormal(Texture2D NormalTex, float2 vTexcoord, float3 vVertNormal, float3 vVertTangent)
 {
     vVertNormal = normalize(vVertNormal);
     vVertTangent = normalize(vVertTangent);
@@ -78,9 +104,10 @@ float3 CalcPerPixelNormal(float2 vTexcoord, float3 vVertNormal, float3 vVertTang
     float3x3 TBN = (float3x3(vVertTangent, vVertBinormal, vVertNormal));
 
 	// Compute per-pixel normal.
-    float3 vBumpNormal = (float3) NormalTex.Sample(sampleWrap, vTexcoord);
-
-    vBumpNormal = 2.0f * vBumpNormal - 1.0f;
+    // z is rebuilt from xy so cooked BC5 normal maps (xy only) and rgba8 ones decode the same
+    float3 vBumpNormal;
+    vBumpNormal.xy = 2.0f * NormalTex.Sample(sampleWrap, vTexcoord).xy - 1.0f;
+    vBumpNormal.z = sqrt(saturate(1.0f - dot(vBumpNormal.xy, vBumpNormal.xy)));
 
     return mul(vBumpNormal, TBN);
     //return vVertNormal;
@@ -115,6 +142,15 @@ PS_OUTPUT PSMain(PSInput input) : SV_TARGET
 
     velocity.xy /= RTSize.xy;
 
+#if USE_BINDLESS_MATERIALS
+    // same material for the whole draw, no NonUniformResourceIndex needed
+    uint4 material = Materials[MaterialIndex];
+    Texture2D AlbedoTex = BindlessTextures[material.x];
+    Texture2D NormalTex = BindlessTextures[material.y];
+    Texture2D RoughnessTex = BindlessTextures[material.z];
+    Texture2D MetallicTex = BindlessTextures[material.w];
+#endif
+
     float4 Albedo = AlbedoTex.Sample(sampleWrap, input.uv);
     float Roughness = RoughnessTex.Sample(sampleWrap, input.uv).x;
     float Metallic = MetallicTex.Sample(sampleWrap, input.uv).x;
@@ -122,7 +158,7 @@ PS_OUTPUT PSMain(PSInput input) : SV_TARGET
     if(Albedo.w < 0.1)
         discard;
 
-    float3 WorldNormal = CalcPerPixelNormal(input.uv, input.normal, input.tangent);
+    float3 WorldNormal = CalcPerPixelNormal(NormalTex, input.uv, input.normal, input.tangent);
 	
     PS_OUTPUT output;
     output.Albedo.xyz = Albedo.xyz;
@@ -0,0 +1,11 @@
+// material binding switch, included by both c++ and hlsl.
+
+// 1 : bindless. shaders read material textures from one unbounded SRV table over the whole shader visible heap, at the heap index
+//     of the texture's static SRV. MaterialBuffer holds one uint4 of those indices per material(albedo, normal, roughness, metallic).
+//     the g-buffer gets the material index from its constant buffer, hit shaders from InstanceProperty.GeometryInfo.w.
+// 0 : the textures are bound per draw(g-buffer) and per hit group(raytracing).
+#define USE_BINDLESS_MATERIALS 1
+
+// register spaces of BindlessTextures(t0, space1) and Materials(t0, space2) in Common.hlsl
+#define BINDLESS_TEXTURE_SPACE 1
+#define MATERIAL_BUFFER_SPACE 2
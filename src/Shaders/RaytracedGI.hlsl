@@ -10,7 +10,9 @@ Texture2D DepthTex : register(t1);
 Texture2D WorldNormalTex : register(t2);
 ByteAddressBuffer vertices : register(t3);
 ByteAddressBuffer indices : register(t4);
+#if !USE_BINDLESS_MATERIALS
 Texture2D AlbedoTex : register(t5);
+#endif
 ByteAddressBuffer InstanceProperty : register(t6);
 Texture3D BlueNoiseTex : register(t7);
 
@@ -250,6 +252,9 @@ void chs(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
     payload.position = vertex.position;
     payload.normal = vertex.normal;
 
+#if USE_BINDLESS_MATERIALS
+    Texture2D AlbedoTex = BindlessTextures[NonUniformResourceIndex(GetInstanceMaterial(InstanceID(), InstanceProperty).x)];
+#endif
     uint w, h;
     AlbedoTex.GetDimensions(w, h);
     float halfLog2NumTexPixels = 0.5 * log2(w * h);
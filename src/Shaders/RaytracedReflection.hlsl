@@ -7,7 +7,9 @@ Texture2D DepthTex : register(t1);
 Texture2D GeoNormalTex : register(t2);
 ByteAddressBuffer vertices : register(t3);
 ByteAddressBuffer indices : register(t4);
+#if !USE_BINDLESS_MATERIALS
 Texture2D AlbedoTex : register(t5);
+#endif
 Texture2D RougnessMetallicTex : register(t6);
 Texture3D BlueNoiseTex : register(t7);
 Texture2D WorldNormalTex : register(t8);
@@ -301,6 +303,9 @@ void chs(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
     payload.position = vertex.position;
     payload.normal = vertex.normal;
 
+#if USE_BINDLESS_MATERIALS
+    Texture2D AlbedoTex = BindlessTextures[NonUniformResourceIndex(GetInstanceMaterial(InstanceID(), InstanceProperty).x)];
+#endif
     uint w, h;
     AlbedoTex.GetDimensions(w, h);
     float halfLog2NumTexPixels = 0.5 * log2(w * h);
@@ -7,7 +7,9 @@ Texture2D DepthTex : register(t1);
 Texture2D WorldNormalTex : register(t2);
 ByteAddressBuffer vertices : register(t3);
 ByteAddressBuffer indices : register(t4);
+#if !USE_BINDLESS_MATERIALS
 Texture2D AlbedoTex : register(t5);
+#endif
 ByteAddressBuffer InstanceProperty : register(t6);
 
 
@@ -127,6 +129,9 @@ void anyhit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes a
     uint triangleIndex = PrimitiveIndex();
     Vertex vertex = GetVertexAttributes(InstanceID(), vertices, indices, InstanceProperty, triangleIndex, barycentrics);
 
+#if USE_BINDLESS_MATERIALS
+    Texture2D AlbedoTex = BindlessTextures[NonUniformResourceIndex(GetInstanceMaterial(InstanceID(), InstanceProperty).x)];
+#endif
     float opacity = AlbedoTex.SampleLevel(sampleWrap, vertex.uv, 5).w;
 
         // payload.bHit = false;
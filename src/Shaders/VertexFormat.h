@@ -0,0 +1,15 @@
+// vertex layout switch, included by both c++ and hlsl.
+
+// 1 : 20 byte vertex. positions quantized to 16 bit integers against the mesh AABB, octahedral snorm16 normal/tangent, half UV.
+//     BLAS is built from a float position stream, both are cooked into the mesh cache.
+// 0 : 44 byte float vertex (float3 position, float3 normal, float2 uv, float3 tangent)
+#define USE_PACKED_VERTEX 1
+
+#define UNPACKED_VERTEX_STRIDE 44
+#define PACKED_VERTEX_STRIDE 20
+
+#if USE_PACKED_VERTEX
+#define VERTEX_STRIDE PACKED_VERTEX_STRIDE
+#else
+#define VERTEX_STRIDE UNPACKED_VERTEX_STRIDE
+#endif
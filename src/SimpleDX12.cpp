@@ -2,6 +2,7 @@
 
 #include <DirectXMath.h>
 #include "DirectXTex.h"
+#include "TextureCooker.h"
 #include "Utils.h"
 #include "d3dx12.h"
 #define GLM_FORCE_CTOR_INIT
@@ -14,7 +15,9 @@
 #include "Utils.h"
 
 #include <sstream>
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <D3Dcompiler.h>
 
 #include <assert.h>
@@ -53,6 +56,14 @@ SimpleDX12* g_dx12_rhi;
 //	PoolIndex++;
 //}
 
+void Descriptor::Free()
+{
+	if (!Heap || !g_dx12_rhi)
+		return;
+
+	Heap->Free(*this);
+}
+
 void DescriptorHeap::Init(D3D12_DESCRIPTOR_HEAP_DESC& InHeapDesc)
 {
 	HeapDesc = InHeapDesc;
@@ -63,1512 +74,2060 @@ void DescriptorHeap::Init(D3D12_DESCRIPTOR_HEAP_DESC& InHeapDesc)
 	NAME_D3D12_OBJECT(DH);
 
 	CPUHeapStart = DH->GetCPUDescriptorHandleForHeapStart().ptr;
-	GPUHeapStart = DH->GetGPUDescriptorHandleForHeapStart().ptr;
+	// non shader visible heaps have no gpu handle
+	GPUHeapStart = (HeapDesc.Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE) ? DH->GetGPUDescriptorHandleForHeapStart().ptr : 0;
+
+	Allocator = DescriptorAllocator(MaxNumDescriptors);
+	Addressing.CpuStart = CPUHeapStart;
+	Addressing.GpuStart = GPUHeapStart;
+	Addressing.Increment = DescriptorSize;
 }
 
-void DescriptorHeap::AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle)
+void DescriptorHeap::Alloc(Descriptor& OutDescriptor, UINT Num)
 {
-	if (NumAllocated >= MaxNumDescriptors)
-		NumAllocated = 0;
+	// a descriptor made again gives back its old range
+	OutDescriptor.Free();
 
-	cpuHandle.ptr = CPUHeapStart + NumAllocated * DescriptorSize ;
-	gpuHandle.ptr = GPUHeapStart + NumAllocated * DescriptorSize;
-
-	NumAllocated++;
-}
+	std::lock_guard<std::mutex> lock(Mtx);
 
-void DescriptorHeap::AllocDescriptors(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT num)
-{
-	cpuHandle.ptr = CPUHeapStart + NumAllocated * DescriptorSize;
-	gpuHandle.ptr = GPUHeapStart + NumAllocated * DescriptorSize;
+	DescriptorHandle handle = Allocator.Allocate(Num);
+	if (!handle.IsValid())
+		ThrowIfFailed(E_OUTOFMEMORY);
 
-	NumAllocated += num;
+	OutDescriptor.Heap = this;
+	OutDescriptor.Handle = handle;
+	OutDescriptor.CpuHandle.ptr = Addressing.GetCpu(handle.Index);
+	OutDescriptor.GpuHandle.ptr = Addressing.GetGpu(handle.Index);
 }
 
-void SimpleDX12::BeginFrame(std::list<Texture*>& DynamicTexture)
+void DescriptorHeap::Free(Descriptor& InDescriptor)
 {
-	CurrentFrameIndex = m_swapChain->GetCurrentBackBufferIndex();
+	// Free can run on any thread. the fence value is read before Mtx so the queue lock is never taken inside it
+	const UINT64 fenceValue = g_dx12_rhi->CmdQ->GetCurrentFenceValue();
+	{
+		std::lock_guard<std::mutex> lock(Mtx);
 
-	// wait until gpu processing for this frame resource is completed
-	UINT64 ThisFrameFenceValue = FrameFenceValueVec[CurrentFrameIndex];
-	
-	CmdQ->WaitFenceValue(ThisFrameFenceValue);
+		// false means the handle was freed already or its range has been given to somebody else since
+		bool bFreed = Allocator.Free(InDescriptor.Handle, fenceValue);
+		assert(bFreed);
+		(void)bFreed;
+	}
 
-	
-	GlobalCmdList = CmdQ->AllocCmdList();
-	GlobalCmdList->Fence = CmdQ->CurrentFenceValue;
+	InDescriptor.Heap = nullptr;
+	InDescriptor.Handle = DescriptorHandle();
+}
 
-	ID3D12DescriptorHeap* ppHeaps[] = { SRVCBVDescriptorHeapShaderVisible->DH.Get(), SamplerDescriptorHeapShaderVisible->DH.Get() };
-	GlobalCmdList->CmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
-	
+void DescriptorHeap::ProcessPendingFrees(UINT64 CompletedFenceValue)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	Allocator.ProcessPendingFrees(CompletedFenceValue);
+}
 
-	g_dx12_rhi->GlobalDHRing->Advance();
+DescriptorAllocatorStats DescriptorHeap::GetStats()
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	return Allocator.GetStats();
+}
 
-	g_dx12_rhi->GlobalCBRing->Advance();
+void DescriptorHeap::AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle)
+{
+	AllocDescriptors(cpuHandle, gpuHandle, 1);
+}
 
-	g_dx12_rhi->GlobalRTDHRing->Advance();
+void DescriptorHeap::AllocDescriptors(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT num)
+{
+	Descriptor descriptor;
+	Alloc(descriptor, num);
 
+	cpuHandle = descriptor.CpuHandle;
+	gpuHandle = descriptor.GpuHandle;
+}
 
-	
-	for (auto& tex : DynamicTexture)
+PlacedHeapPool::PlacedHeapPool(const wstring& InName, D3D12_HEAP_TYPE InHeapType, D3D12_HEAP_FLAGS InHeapFlags, UINT64 BlockSize)
+	: Name(InName), HeapType(InHeapType), HeapFlags(InHeapFlags), Pool(BlockSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+{
+	Pool.OnCreateBlock = [this](UINT32 Block, UINT64 Size)
 	{
-		if (tex->textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
-		{
-			g_dx12_rhi->GlobalDHRing->AllocDescriptor(tex->UAV.CpuHandle, tex->UAV.GpuHandle);
+		D3D12_HEAP_DESC heapDesc = {};
+		heapDesc.SizeInBytes = Size;
+		heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(HeapType);
+		heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		heapDesc.Flags = HeapFlags;
+
+		ComPtr<ID3D12Heap> heap;
+		if (FAILED(g_dx12_rhi->Device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap))))
+			return false;
+
+		SetNameIndexed(heap.Get(), Name.c_str(), Block);
+
+		if (Block >= Heaps.size())
+			Heaps.resize(Block + 1);
+		Heaps[Block] = heap;
+		return true;
+	};
 
+	Pool.OnDestroyBlock = [this](UINT32 Block)
+	{
+		Heaps[Block].Reset();
+	};
+}
 
-			D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-			uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-			uavDesc.Format = tex->textureDesc.Format;
+bool PlacedHeapPool::CreateResource(const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitState, const D3D12_CLEAR_VALUE* ClearValue, ComPtr<ID3D12Resource>& OutResource, HeapAllocation& OutAllocation)
+{
+	D3D12_RESOURCE_DESC desc = Desc;
+	D3D12_RESOURCE_ALLOCATION_INFO info = {};
 
-			g_dx12_rhi->Device->CreateUnorderedAccessView(tex->resource.Get(), nullptr, &uavDesc, tex->UAV.CpuHandle);
-		}
+	// alignment classes : small textures can go down to 4KB, everything else is 64KB. msaa(4MB) isn't placed.
+	const bool bSmallCandidate = desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER && desc.SampleDesc.Count == 1
+		&& !(desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL));
+	if (bSmallCandidate)
+	{
+		desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+		info = g_dx12_rhi->Device->GetResourceAllocationInfo(0, 1, &desc);
+		if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+			desc.Alignment = 0;
+	}
 
-		if (tex->textureDesc.Flags & RESOURCE_FLAG_ALLOW_RENDER_TARGET)
-		{
-			g_dx12_rhi->GlobalRTDHRing->AllocDescriptor(tex->RTV.CpuHandle, tex->RTV.GpuHandle);
+	if (desc.Alignment == 0)
+		info = g_dx12_rhi->Device->GetResourceAllocationInfo(0, 1, &desc);
 
-			D3D12_RENDER_TARGET_VIEW_DESC desc = {};
-			//desc.Format = Format;
-			desc.Format = tex->isRT ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : tex->textureDesc.Format;
+	if (info.SizeInBytes == UINT64_MAX || info.Alignment > D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)
+		return false;
 
-			desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+	std::lock_guard<std::mutex> lock(Mtx);
 
-			g_dx12_rhi->Device->CreateRenderTargetView(tex->resource.Get(), nullptr, tex->RTV.CpuHandle);
-		}
+	HeapAllocation allocation = Pool.Allocate(info.SizeInBytes, info.Alignment);
+	if (!allocation.IsValid())
+		return false;
 
+	if (FAILED(g_dx12_rhi->Device->CreatePlacedResource(Heaps[allocation.Block].Get(), allocation.GetOffset(), &desc, InitState, ClearValue, IID_PPV_ARGS(&OutResource))))
+	{
+		// never used by the gpu, no need to wait
+		Pool.Free(allocation);
+		return false;
+	}
 
-		if (!tex->isRT)
-		{
+	OutAllocation = allocation;
+	return true;
+}
 
-			// alloc dh and create srv
-			//g_dx12_rhi->GlobalDHRing->AllocDescriptor(tex->CpuHandleSRV, tex->GpuHandleSRV);
-			g_dx12_rhi->GlobalDHRing->AllocDescriptor(tex->SRV.CpuHandle, tex->SRV.GpuHandle);
+void PlacedHeapPool::Free(const HeapAllocation& Allocation)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
 
+	if (!g_dx12_rhi)
+	{
+		Pool.Free(Allocation);
+		return;
+	}
 
-			D3D12_SHADER_RESOURCE_VIEW_DESC SrvDesc = {};
-			SrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-			if (tex->textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
-				SrvDesc.Format = DXGI_FORMAT_R32_FLOAT;// DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
-			else
-				SrvDesc.Format = tex->textureDesc.Format;
+	// everything recorded so far is done once the fence reaches the value the next EndFrame/WaitGPU signals
+	PendingFrees.push_back({ Allocation, g_dx12_rhi->CmdQ->GetCurrentFenceValue() });
+}
 
-			SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-			SrvDesc.Texture2D.MipLevels = tex->textureDesc.MipLevels;
-			g_dx12_rhi->Device->CreateShaderResourceView(tex->resource.Get(), &SrvDesc, tex->SRV.CpuHandle);
-		}
-	}
+void PlacedHeapPool::ProcessPendingFrees(UINT64 CompletedFenceValue)
+{
+	std::lock_guard<std::mutex> lock(Mtx);
 
-	for (auto& buffer : DynamicBuffers)
+	for (auto it = PendingFrees.begin(); it != PendingFrees.end();)
 	{
-		g_dx12_rhi->GlobalDHRing->AllocDescriptor(buffer->UAV.CpuHandle, buffer->UAV.GpuHandle);
-
-		if (buffer->Type == Buffer::BYTE_ADDRESS)
+		if (it->FenceValue <= CompletedFenceValue)
 		{
-			D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-			uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-			uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-			uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
-			uavDesc.Buffer.NumElements = buffer->NumElements;
-
-			g_dx12_rhi->Device->CreateUnorderedAccessView(buffer->resource.Get(), nullptr, &uavDesc, buffer->UAV.CpuHandle);
+			Pool.Free(it->Allocation);
+			it = PendingFrees.erase(it);
 		}
-		else if (buffer->Type == Buffer::STRUCTURED)
+		else
 		{
-			D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-			uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-			uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-			uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
-			uavDesc.Buffer.StructureByteStride = buffer->ElementSize;
-			uavDesc.Buffer.NumElements = buffer->NumElements;
-
-			g_dx12_rhi->Device->CreateUnorderedAccessView(buffer->resource.Get(), nullptr, &uavDesc, buffer->UAV.CpuHandle);
+			++it;
 		}
 	}
+}
 
+HeapPoolStats PlacedHeapPool::GetStats()
+{
+	std::lock_guard<std::mutex> lock(Mtx);
+	return Pool.GetStats();
 }
 
-void SimpleDX12::EndFrame()
+TransientTexturePool::TransientTexturePool()
 {
-#if USE_AFTERMATH
-	ThrowIfFailed(m_swapChain->Present(0, 0), &g_dx12_rhi->AM_CL_Handle);
-#else
-	ThrowIfFailed(m_swapChain->Present(0, 0), nullptr);
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	g_dx12_rhi->Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options));
 
-#endif
-	FrameFenceValueVec[CurrentFrameIndex] = CmdQ->CurrentFenceValue;;
-	CmdQ->SignalCurrentFence();
+	if (options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2)
+	{
+		NumGroups = 1;
+		GroupHeapFlags[0] = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+	}
+	else
+	{
+		NumGroups = 2;
+		GroupHeapFlags[0] = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+		GroupHeapFlags[1] = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+	}
 }
 
-Sampler* SimpleDX12::CreateSampler(D3D12_SAMPLER_DESC& InSamplerDesc)
+UINT TransientTexturePool::GetGroup(D3D12_RESOURCE_FLAGS Flags) const
 {
-	Sampler* sampler = new Sampler;
-	sampler->SamplerDesc = InSamplerDesc;
-	SamplerDescriptorHeapShaderVisible->AllocDescriptor(sampler->Descriptor.CpuHandle, sampler->Descriptor.GpuHandle);
-	Device->CreateSampler(&sampler->SamplerDesc, sampler->Descriptor.CpuHandle);
+	if (NumGroups == 1)
+		return 0;
+	return (Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) ? 0 : 1;
+}
 
-	return sampler;
+D3D12_RESOURCE_ALLOCATION_INFO TransientTexturePool::GetAllocationInfo(const D3D12_RESOURCE_DESC& Desc) const
+{
+	D3D12_RESOURCE_DESC desc = Desc;
+	desc.Alignment = 0;
+	return g_dx12_rhi->Device->GetResourceAllocationInfo(0, 1, &desc);
 }
 
-Buffer* SimpleDX12::CreateBuffer(UINT InNumElements, UINT InElementSize, D3D12_HEAP_TYPE InType, D3D12_RESOURCE_STATES initResState, D3D12_RESOURCE_FLAGS InFlags, void* SrcData)
+shared_ptr<Texture> TransientTexturePool::CreateTexture2D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES InitState, int width, int height, std::optional<glm::vec4> clearColor)
 {
-	Buffer * buffer = new Buffer;
-	D3D12_RESOURCE_DESC bufDesc = {};
-	bufDesc.Alignment = 0;
-	bufDesc.DepthOrArraySize = 1;
-	bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	bufDesc.Flags = InFlags;// D3D12_RESOURCE_FLAG_NONE;
-	//if (isUAV)
-		//bufDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-	bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-	bufDesc.Height = 1;
-	bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	bufDesc.MipLevels = 1;
-	bufDesc.SampleDesc.Count = 1;
-	bufDesc.SampleDesc.Quality = 0;
-	bufDesc.Width = InNumElements * InElementSize;
+	shared_ptr<Texture> tex = make_shared<Texture>();
 
-	buffer->NumElements = InNumElements;
-	buffer->ElementSize = InElementSize;
+	D3D12_RESOURCE_DESC textureDesc = {};
+	textureDesc.MipLevels = 1;
+	textureDesc.Format = format;
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.DepthOrArraySize = 1;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	textureDesc.Flags = resFlags;
 
-	D3D12_HEAP_PROPERTIES heapProp;
-	heapProp.Type = InType;
-	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProp.CreationNodeMask = 1;
-	heapProp.VisibleNodeMask = 1;
-	
-	ThrowIfFailed(Device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &bufDesc,
-		initResState, nullptr, IID_PPV_ARGS(&buffer->resource)));
+	tex->textureDesc = textureDesc;
 
-	if (SrcData)
+	Entry entry;
+	entry.Tex = tex;
+	entry.State = InitState;
+	entry.Group = GetGroup(resFlags);
+
+	// same optimized clear values SimpleDX12::CreateTexture2D uses
+	if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+	{
+		D3D12_CLEAR_VALUE clearValue = {};
+		clearValue.Format = DXGI_FORMAT_D32_FLOAT;
+		clearValue.DepthStencil = { 1.0f, 0 };
+		entry.ClearValue = clearValue;
+	}
+	else if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
 	{
-		CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+		const glm::vec4 color = clearColor.value_or(glm::vec4(0.0f, 0.2f, 0.4f, 1.0f));
+
+		D3D12_CLEAR_VALUE clearValue = {};
+		clearValue.Format = format;
+		clearValue.Color[0] = color.x;
+		clearValue.Color[1] = color.y;
+		clearValue.Color[2] = color.z;
+		clearValue.Color[3] = color.w;
+		entry.ClearValue = clearValue;
+	}
 
-		cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(buffer->resource.Get(), initResState, D3D12_RESOURCE_STATE_COPY_DEST));
+	D3D12_RESOURCE_ALLOCATION_INFO info = GetAllocationInfo(textureDesc);
+	entry.Range.Size = info.SizeInBytes;
+	entry.Range.Alignment = info.Alignment;
 
-		UINT Size = buffer->NumElements * buffer->ElementSize;
+	CD3DX12_HEAP_PROPERTIES heapProp(D3D12_HEAP_TYPE_DEFAULT);
+	ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &textureDesc, InitState,
+		entry.ClearValue ? &entry.ClearValue.value() : nullptr, IID_PPV_ARGS(&tex->resource)));
+	tex->Tracked.Reset(InitState);
 
-		ComPtr<ID3D12Resource> UploadHeap;
+	if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+		tex->MakeDSV();
 
-		ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(Size),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&UploadHeap)));
+	EntryIndex[tex.get()] = UINT(Entries.size());
+	Entries.push_back(entry);
+	return tex;
+}
 
-		UINT8* pData = nullptr;
-		UploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&pData));
-		memcpy(reinterpret_cast<void*>(pData), SrcData, Size);
-		UploadHeap->Unmap(0, nullptr);
+void TransientTexturePool::BeginDeclaration()
+{
+	Passes.clear();
+}
 
-		cmd->CmdList->CopyBufferRegion(buffer->resource.Get(), 0, UploadHeap.Get(), 0, Size);
-		cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(buffer->resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, initResState));
+void TransientTexturePool::DeclarePass(const string& Name, const vector<GfxTexture*>& Textures)
+{
+	Pass pass;
+	pass.Name = Name;
 
+	for (GfxTexture* tex : Textures)
+	{
+		auto it = EntryIndex.find(tex);
+		if (it == EntryIndex.end())
+			continue;
 
-		CmdQ->ExecuteCommandList(cmd);
-		CmdQ->WaitGPU();
+		if (std::find(pass.Entries.begin(), pass.Entries.end(), it->second) == pass.Entries.end())
+			pass.Entries.push_back(it->second);
 	}
 
-	//// create shader resource view
-	//D3D12_SHADER_RESOURCE_VIEW_DESC bufferSRVDesc;
-	//bufferSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-	//bufferSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	//bufferSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-	//bufferSRVDesc.Buffer.StructureByteStride = 0;
-	//bufferSRVDesc.Buffer.FirstElement = 0;
-	//bufferSRVDesc.Buffer.NumElements = InNumElements;// static_cast<UINT>(Size) / sizeof(float); // byte address buffer
-	//bufferSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-
-	//// TODO : should be GlobalDHRing? if object instance are to move.
-	//TextureDHRing->AllocDescriptor(buffer->CpuHandleSRV, buffer->GpuHandleSRV);
-
-	//Device->CreateShaderResourceView(buffer->resource.Get(), &bufferSRVDesc, buffer->CpuHandleSRV);
-
-	//shared_ptr<Buffer> ptr = shared_ptr<Buffer>(buffer);
-	if (InFlags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
-		g_dx12_rhi->DynamicBuffers.push_back(buffer);
-
-	return buffer;
+	Passes.push_back(pass);
 }
 
-IndexBuffer* SimpleDX12::CreateIndexBuffer(DXGI_FORMAT Format, UINT Size, void* SrcData)
+void TransientTexturePool::PlanGroups(vector<TransientRange>& Ranges, UINT64 OutSizes[2]) const
 {
-	CommandList* cmd = CmdQ->AllocCmdList();
+	for (UINT group = 0; group < NumGroups; group++)
+	{
+		vector<TransientRange> ranges;
+		vector<UINT> indices;
+		for (UINT i = 0; i < Entries.size(); i++)
+		{
+			if (Entries[i].Group != group)
+				continue;
 
-	IndexBuffer* ib = new IndexBuffer;
+			ranges.push_back(Ranges[i]);
+			indices.push_back(i);
+		}
 
-	/*stringstream ss;
-	ss << "CreateIndexBuffer : " << Size << "\n";
-	OutputDebugStringA(ss.str().c_str());*/
+		OutSizes[group] = PlanTransientOffsets(ranges);
 
-	ThrowIfFailed(Device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(Size),
-		D3D12_RESOURCE_STATE_COPY_DEST,
-		nullptr,
-		IID_PPV_ARGS(&ib->resource)));
+		for (UINT i = 0; i < indices.size(); i++)
+			Ranges[indices[i]].Offset = ranges[i].Offset;
+	}
+}
 
-	NAME_D3D12_OBJECT(ib->resource);
+void TransientTexturePool::Compile()
+{
+	const UINT64 CompletedFenceValue = g_dx12_rhi->CmdQ->m_fence->GetCompletedValue();
+	RetiredObjects.remove_if([&](const Retired& r) { return r.FenceValue <= CompletedFenceValue; });
 
-	ib->view.BufferLocation = ib->resource->GetGPUVirtualAddress();
-	ib->view.Format = Format;
-	ib->view.SizeInBytes = Size;
+	vector<TransientRange> ranges;
+	for (auto& entry : Entries)
+	{
+		TransientRange range = entry.Range;
+		range.FirstPass = HEAP_ALLOCATOR_INVALID;
+		range.LastPass = 0;
+		ranges.push_back(range);
+	}
 
-	if (Format == DXGI_FORMAT_R32_UINT)
+	for (UINT pass = 0; pass < Passes.size(); pass++)
 	{
-		ib->numIndices = Size / 4;
+		for (UINT index : Passes[pass].Entries)
+		{
+			if (!ranges[index].IsUsed())
+				ranges[index].FirstPass = pass;
+			ranges[index].LastPass = pass;
+		}
 	}
-	else if (Format == DXGI_FORMAT_R16_UINT)
+
+	// the layout of the frame before still fits, nothing moves
+	bool bSameLifetimes = PlacedRanges.size() == ranges.size();
+	for (UINT i = 0; bSameLifetimes && i < ranges.size(); i++)
+		bSameLifetimes = PlacedRanges[i].FirstPass == ranges[i].FirstPass && PlacedRanges[i].LastPass == ranges[i].LastPass;
+
+	for (UINT i = 0; i < Entries.size(); i++)
 	{
-		ib->numIndices = Size / 2;
+		Entries[i].Range.FirstPass = ranges[i].FirstPass;
+		Entries[i].Range.LastPass = ranges[i].LastPass;
 	}
 
+	if (bSameLifetimes)
+		return;
 
-	if (SrcData)
+	PlanGroups(ranges, PlannedSizes);
+
+	// frames in flight still use the old heaps/resources. the frame being recorded is the first with the new ones.
+	Retired retired;
+	retired.FenceValue = g_dx12_rhi->CmdQ->CurrentFenceValue;
+
+	for (UINT group = 0; group < NumGroups; group++)
 	{
-		D3D12_SUBRESOURCE_DATA indexData = {};
-		indexData.pData = SrcData;
-		indexData.RowPitch = Size;
-		indexData.SlicePitch = indexData.RowPitch;
+		if (PlannedSizes[group] <= HeapSizes[group])
+			continue;
 
-		ComPtr<ID3D12Resource> UploadHeap;
+		if (Heaps[group])
+			retired.Objects.push_back(Heaps[group]);
 
-		ThrowIfFailed(Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(Size),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&UploadHeap)));
+		D3D12_HEAP_DESC heapDesc = {};
+		heapDesc.SizeInBytes = PlannedSizes[group];
+		heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		heapDesc.Flags = GroupHeapFlags[group];
 
-		UpdateSubresources<1>(cmd->CmdList.Get(), ib->resource.Get(), UploadHeap.Get(), 0, 0, 1, &indexData);
-		cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ib->resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+		ThrowIfFailed(g_dx12_rhi->Device->CreateHeap(&heapDesc, IID_PPV_ARGS(&Heaps[group])));
+		SetNameIndexed(Heaps[group].Get(), L"TransientTextureHeap", group);
+		HeapSizes[group] = PlannedSizes[group];
+	}
 
-		// create shader resource view
-		D3D12_SHADER_RESOURCE_VIEW_DESC vertexSRVDesc;
-		vertexSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-		vertexSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-		vertexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-		vertexSRVDesc.Buffer.StructureByteStride = 0;
-		vertexSRVDesc.Buffer.FirstElement = 0;
-		vertexSRVDesc.Buffer.NumElements = static_cast<UINT>(Size) / sizeof(float); // byte address buffer
-		vertexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	for (UINT i = 0; i < Entries.size(); i++)
+	{
+		Entry& entry = Entries[i];
+		Texture* tex = entry.Tex.get();
+		entry.Range.Offset = ranges[i].Offset;
 
-		//g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptor(ib->CpuHandleSRV, ib->GpuHandleSRV);
-		GeomtryDHRing->AllocDescriptor(ib->Descriptor.CpuHandle, ib->Descriptor.GpuHandle);
+		retired.Objects.push_back(tex->resource);
 
-		Device->CreateShaderResourceView(ib->resource.Get(), &vertexSRVDesc, ib->Descriptor.CpuHandle);
+		ThrowIfFailed(g_dx12_rhi->Device->CreatePlacedResource(Heaps[entry.Group].Get(), entry.Range.Offset, &tex->textureDesc, entry.State,
+			entry.ClearValue ? &entry.ClearValue.value() : nullptr, IID_PPV_ARGS(&tex->resource)));
+		SetName(tex->resource.Get(), tex->name.c_str());
+		tex->Tracked.Reset(entry.State);
 
-		CmdQ->ExecuteCommandList(cmd);
-		CmdQ->WaitGPU();
+		// dsv is static, rewrite it in place. command lists already recorded have their own copy.
+		if (tex->textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+		{
+			D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+			depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;
+			depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+			depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
+			g_dx12_rhi->Device->CreateDepthStencilView(tex->resource.Get(), &depthStencilDesc, tex->DSV.CpuHandle);
+		}
 	}
 
-	return ib;
+	RetiredObjects.push_back(retired);
+	PlacedRanges = ranges;
+	LayoutVersion++;
 }
 
-VertexBuffer* SimpleDX12::CreateVertexBuffer(UINT Size, UINT Stride, void* SrcData)
+void TransientTexturePool::BeginPass(CommandList* cmd, const string& Name)
 {
-	CommandList* cmd = CmdQ->AllocCmdList();
+	UINT passIndex = 0;
+	while (passIndex < Passes.size() && Passes[passIndex].Name != Name)
+		passIndex++;
 
-	VertexBuffer* vb = new VertexBuffer;
-	
-	/*stringstream ss;
-	ss << "CreateVertexBuffer : " << Size << "\n";
-	OutputDebugStringA(ss.str().c_str());*/
-	
-	ThrowIfFailed(Device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(Size),
-		D3D12_RESOURCE_STATE_COPY_DEST,
-		nullptr,
-		IID_PPV_ARGS(&vb->resource)));
+	assert(passIndex < Passes.size());
+	if (passIndex == Passes.size())
+		return;
 
-	NAME_D3D12_OBJECT(vb->resource);
+	// tracked barriers recorded so far come first
+	cmd->FlushBarriers();
 
-	if (SrcData)
+	vector<D3D12_RESOURCE_BARRIER> aliasing;
+	vector<D3D12_RESOURCE_BARRIER> toDiscard;
+	vector<D3D12_RESOURCE_BARRIER> fromDiscard;
+	vector<ID3D12Resource*> discards;
+
+	for (UINT index : Passes[passIndex].Entries)
 	{
-		D3D12_SUBRESOURCE_DATA vertexData = {};
-		vertexData.pData = SrcData;
-		vertexData.RowPitch = Size;
-		vertexData.SlicePitch = vertexData.RowPitch;
+		const Entry& entry = Entries[index];
+		if (entry.Range.FirstPass != passIndex)
+			continue;
 
-		ComPtr<ID3D12Resource> UploadHeap;
+		// whatever used this memory before, in this frame or the last one, is done with it
+		ID3D12Resource* resource = entry.Tex->resource.Get();
+		aliasing.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource));
 
-		ThrowIfFailed(Device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(Size),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&UploadHeap)));
+		// render targets come out of aliasing with undefined compression metadata
+		const D3D12_RESOURCE_FLAGS flags = entry.Tex->textureDesc.Flags;
+		if (flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		{
+			// entry.State, unless passes that Require their states left it in another one the frame before
+			const D3D12_RESOURCE_STATES state = entry.Tex->Tracked.State;
+			assert(entry.Tex->Tracked.Subresources.empty() && !entry.Tex->Tracked.SplitList);
 
-		UpdateSubresources<1>(cmd->CmdList.Get(), vb->resource.Get(), UploadHeap.Get(), 0, 0, 1, &vertexData);
-		cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(vb->resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+			const D3D12_RESOURCE_STATES discardState = (flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) ? D3D12_RESOURCE_STATE_DEPTH_WRITE : D3D12_RESOURCE_STATE_RENDER_TARGET;
+			if (state != discardState)
+			{
+				toDiscard.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, state, discardState));
+				fromDiscard.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, discardState, state));
+			}
+			discards.push_back(resource);
+		}
+	}
 
-		// Initialize the vertex buffer view.
-		vb->view.BufferLocation = vb->resource->GetGPUVirtualAddress();
-		vb->view.StrideInBytes = Stride;
-		vb->view.SizeInBytes = Size;
-		vb->numVertices = Size / Stride;
+	if (aliasing.size() > 0)
+		cmd->CmdList->ResourceBarrier(UINT(aliasing.size()), aliasing.data());
 
-		// create shader resource view
-		D3D12_SHADER_RESOURCE_VIEW_DESC vertexSRVDesc;
-		vertexSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-		vertexSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-		vertexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-		vertexSRVDesc.Buffer.StructureByteStride = 0;
-		vertexSRVDesc.Buffer.FirstElement = 0;
-		vertexSRVDesc.Buffer.NumElements = static_cast<UINT>(Size) / sizeof(float); // byte address buffer
-		vertexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	if (toDiscard.size() > 0)
+		cmd->CmdList->ResourceBarrier(UINT(toDiscard.size()), toDiscard.data());
 
-		//g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptor(vb->CpuHandleSRV, vb->GpuHandleSRV);
-		GeomtryDHRing->AllocDescriptor(vb->Descriptor.CpuHandle, vb->Descriptor.GpuHandle);
+	for (ID3D12Resource* resource : discards)
+		cmd->CmdList->DiscardResource(resource, nullptr);
 
-		Device->CreateShaderResourceView(vb->resource.Get(), &vertexSRVDesc, vb->Descriptor.CpuHandle);
+	if (fromDiscard.size() > 0)
+		cmd->CmdList->ResourceBarrier(UINT(fromDiscard.size()), fromDiscard.data());
+}
 
-		CmdQ->ExecuteCommandList(cmd);
-		CmdQ->WaitGPU();
+TransientTextureStats TransientTexturePool::GetStats() const
+{
+	TransientTextureStats stats;
+	for (auto& entry : Entries)
+	{
+		stats.NumTextures++;
+		if (entry.Range.IsUsed())
+			stats.NumUsed++;
+		stats.UnaliasedBytes += entry.Range.Size;
 	}
 
-	return vb;
+	for (UINT group = 0; group < NumGroups; group++)
+	{
+		stats.AliasedBytes += PlannedSizes[group];
+		stats.HeapBytes += HeapSizes[group];
+	}
+	return stats;
 }
 
-void SimpleDX12::PresentBarrier(Texture* rt)
+TransientTextureStats TransientTexturePool::Estimate(float Scale) const
 {
-	D3D12_RESOURCE_BARRIER BarrierDesc = {};
-	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	BarrierDesc.Transition.pResource = rt->resource.Get();
-	BarrierDesc.Transition.Subresource = 0;
-	BarrierDesc.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	BarrierDesc.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-	GlobalCmdList->CmdList->ResourceBarrier(1, &BarrierDesc);
-}
-
-void SimpleDX12::OnSizeChanged(UINT width, UINT height)
-{
-}
+	TransientTextureStats stats;
 
-void SimpleDX12::GetFrameBuffers(std::vector<std::shared_ptr<Texture>>& FrameFuffers)
-{
-	for (UINT i = 0; i < NumFrame; i++)
+	vector<TransientRange> ranges;
+	for (auto& entry : Entries)
 	{
-		ComPtr<ID3D12Resource> rendertarget;
-		ThrowIfFailed(m_swapChain->GetBuffer(i, IID_PPV_ARGS(&rendertarget)));
+		D3D12_RESOURCE_DESC desc = entry.Tex->textureDesc;
+		desc.Width = glm::max<UINT64>(1, UINT64(ceil(double(desc.Width) * Scale)));
+		desc.Height = glm::max<UINT>(1, UINT(ceil(double(desc.Height) * Scale)));
 
-		// create each rtv for one actual resource(swapchain)
-		shared_ptr<Texture> rt = CreateTexture2DFromResource(rendertarget);
-		rt->isRT = true;
+		D3D12_RESOURCE_ALLOCATION_INFO info = GetAllocationInfo(desc);
 
-		rt->textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-		rt->textureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+		TransientRange range = entry.Range;
+		range.Size = info.SizeInBytes;
+		range.Alignment = info.Alignment;
+		ranges.push_back(range);
 
-		NAME_D3D12_TEXTURE(rt);
-		FrameFuffers.push_back(rt);
+		stats.NumTextures++;
+		if (range.IsUsed())
+			stats.NumUsed++;
+		stats.UnaliasedBytes += range.Size;
 	}
+
+	UINT64 sizes[2] = {};
+	PlanGroups(ranges, sizes);
+	for (UINT group = 0; group < NumGroups; group++)
+		stats.AliasedBytes += sizes[group];
+	stats.HeapBytes = stats.AliasedBytes;
+
+	return stats;
 }
 
-SimpleDX12::SimpleDX12(HWND hWnd, UINT DisplayWidth, UINT DisplayHeight)
+void SimpleDX12::BeginFrame(std::list<Texture*>& DynamicTexture)
 {
-	CoInitialize(NULL);
+	CurrentFrameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
-	UINT dxgiFactoryFlags = 0;
+	// wait until gpu processing for this frame resource is completed
+	UINT64 ThisFrameFenceValue = FrameFenceValueVec[CurrentFrameIndex];
+	
+	CmdQ->WaitFenceValue(ThisFrameFenceValue);
 
-#if defined(_DEBUG)
-	// Enable the debug layer (requires the Graphics Tools "optional feature").
-	// NOTE: Enabling the debug layer after device creation will invalidate the active device.
-	{
-		ComPtr<ID3D12Debug> debugController;
-		if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
-		{
-			debugController->EnableDebugLayer();
+	LARGE_INTEGER startTime;
+	QueryPerformanceCounter(&startTime);
+
+	const UINT64 CompletedFenceValue = CmdQ->m_fence->GetCompletedValue();
+	for (auto& pool : HeapPools)
+		pool->ProcessPendingFrees(CompletedFenceValue);
+	RTVDescriptorHeap->ProcessPendingFrees(CompletedFenceValue);
+	DSVDescriptorHeap->ProcessPendingFrees(CompletedFenceValue);
+	SamplerDescriptorHeapShaderVisible->ProcessPendingFrees(CompletedFenceValue);
+	SRVCBVDescriptorHeapShaderVisible->ProcessPendingFrees(CompletedFenceValue);
+	DeferredReleases.remove_if([&](const pair<shared_ptr<void>, UINT64>& release) { return release.second <= CompletedFenceValue; });
+
+	// compute work of that frame was waited for on CmdQ before its frame fence, it's done too
+	Timeline->BeginFrame(CurrentFrameIndex, CmdQ.get(), ComputeQ.get());
+
+	// lists of the frame before were all submitted in its EndFrame
+	BarrierStats submitted = CmdQ->GetBarrierStats();
+	submitted += ComputeQ->GetBarrierStats();
+	FrameBarriers = submitted - SubmittedBarriers;
+	SubmittedBarriers = submitted;
+	
+	GlobalCmdList = CmdQ->AllocCmdList();
 
-			// Enable additional debug layers.
-			dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
+	ID3D12DescriptorHeap* ppHeaps[] = { SRVCBVDescriptorHeapShaderVisible->DH.Get(), SamplerDescriptorHeapShaderVisible->DH.Get() };
+	GlobalCmdList->CmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-		}
+	// textures the streamer made visible in Update are among them, their copies were done when it looked
+	AcquireUploads(GlobalCmdList);
 
-		ComPtr<ID3D12Debug1> spDebugController1;
-		debugController->QueryInterface(IID_PPV_ARGS(&spDebugController1));
-		//spDebugController1->SetEnableGPUBasedValidation(true);
-	}
-#endif
+	g_dx12_rhi->GlobalDHRing->Advance();
 
-	ComPtr<IDXGIFactory4> factory;
-	ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
+	g_dx12_rhi->GlobalCBRing->Advance();
 
-	// check tearing support
-	{
-		ComPtr<IDXGIFactory6> factory6;
-		HRESULT hr = CreateDXGIFactory1(IID_PPV_ARGS(&factory6));
-		BOOL allowTearing = FALSE;
-		if (SUCCEEDED(hr))
-		{
-			hr = factory6->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing));
-		}
+	g_dx12_rhi->GlobalRTDHRing->Advance();
 
-		m_tearingSupport = SUCCEEDED(hr) && allowTearing;
-	}
 
-	//GetHardwareAdapter(factory.Get(), &hardwareAdapter);
-	for (uint32_t i = 0; DXGI_ERROR_NOT_FOUND != factory->EnumAdapters1(i, &m_hardwareAdapter); i++)
+	// views stay valid across frames, only textures that are new or got a new resource(resize, transient relayout, aa mode change) need them
+	NumFrameViewsWritten = 0;
+	for (auto& tex : DynamicTexture)
 	{
-		DXGI_ADAPTER_DESC1 desc;
-		m_hardwareAdapter->GetDesc1(&desc);
+		if (!bCacheFrameViews || tex->ViewResourceSerial != GetResourceSerial(tex->resource.Get()))
+			tex->MakeFrameViews();
+	}
 
-		// Skip SW adapters
-		if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
+	for (auto& buffer : DynamicBuffers)
+	{
+		if (!bCacheFrameViews || buffer->ViewResourceSerial != GetResourceSerial(buffer->resource.Get()) || buffer->ViewType != buffer->Type)
+			buffer->MakeFrameViews();
+	}
 
-		ThrowIfFailed(D3D12CreateDevice(
-			m_hardwareAdapter.Get(),
-			D3D_FEATURE_LEVEL_12_1,
-			IID_PPV_ARGS(&Device)
-		));
+	LARGE_INTEGER endTime, frequency;
+	QueryPerformanceCounter(&endTime);
+	QueryPerformanceFrequency(&frequency);
+	BeginFrameCpuMs = double(endTime.QuadPart - startTime.QuadPart) * 1000.0 / double(frequency.QuadPart);
+}
 
-		D3D12_FEATURE_DATA_D3D12_OPTIONS5 features5;
-		HRESULT hr = Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &features5, sizeof(D3D12_FEATURE_DATA_D3D12_OPTIONS5));
-		if (FAILED(hr) || features5.RaytracingTier == D3D12_RAYTRACING_TIER_NOT_SUPPORTED)
-		{
-			//msgBox("Raytracing is not supported on this device. Make sure your GPU supports DXR (such as Nvidia's Volta or Turing RTX) and you're on the latest drivers. The DXR fallback layer is not supported.");
-			ThrowIfFailed(hr);
-		}
+void SimpleDX12::DeferRelease(shared_ptr<void> Object)
+{
+	if (Object)
+		DeferredReleases.push_back(make_pair(Object, CmdQ->CurrentFenceValue));
+}
 
+void SimpleDX12::InsertCommandLists(const vector<CommandList*>& Lists)
+{
+	vector<CommandList*> cmdLists;
+	cmdLists.reserve(Lists.size() + 1);
+	cmdLists.push_back(GlobalCmdList);
+	cmdLists.insert(cmdLists.end(), Lists.begin(), Lists.end());
+	CmdQ->ExecuteCommandLists(UINT(cmdLists.size()), cmdLists.data());
 
-		/*ComPtr<IDXGIAdapter3> pDXGIAdapter3;
-		hardwareAdapter->QueryInterface(IID_PPV_ARGS(&pDXGIAdapter3));
+	GlobalCmdList = CmdQ->AllocCmdList();
 
-		ThrowIfFailed(pDXGIAdapter3->SetVideoMemoryReservation(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, 2213100441));
+	ID3D12DescriptorHeap* ppHeaps[] = { SRVCBVDescriptorHeapShaderVisible->DH.Get(), SamplerDescriptorHeapShaderVisible->DH.Get() };
+	GlobalCmdList->CmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+}
 
+CommandList* SimpleDX12::BeginAsyncCompute()
+{
+	CommandList* cmd = ComputeQ->AllocCmdList();
 
-		DXGI_QUERY_VIDEO_MEMORY_INFO LocalVideoMemoryInfo;
-		ThrowIfFailed(pDXGIAdapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &LocalVideoMemoryInfo));*/
+	ID3D12DescriptorHeap* ppHeaps[] = { SRVCBVDescriptorHeapShaderVisible->DH.Get(), SamplerDescriptorHeapShaderVisible->DH.Get() };
+	cmd->CmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
+	return cmd;
+}
 
-		// break on error
+UINT64 SimpleDX12::EndAsyncCompute(CommandList* Cmd)
+{
+	// GlobalCmdList isn't submitted yet, only what is already on CmdQ comes before the compute work
+	const UINT64 directFenceValue = CmdQ->SignalCurrentFence();
+	ComputeQ->WaitForQueue(CmdQ.get(), directFenceValue);
 
-		ComPtr<ID3D12InfoQueue> d3dInfoQueue;
-		if (SUCCEEDED(Device->QueryInterface(__uuidof(ID3D12InfoQueue), (void**)&d3dInfoQueue)))
-		{
-			d3dInfoQueue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_CORRUPTION, true);
-			d3dInfoQueue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_ERROR, true);
+	ComputeQ->ExecuteCommandList(Cmd);
+	UnwaitedComputeFence = ComputeQ->SignalCurrentFence();
+	return UnwaitedComputeFence;
+}
 
-			//D3D12_MESSAGE_ID blockedIds[] = {
-			//	/*	D3D12_MESSAGE_ID_CLEARRENDERTARGETVIEW_MISMATCHINGCLEARVALUE,
-			//		D3D12_MESSAGE_ID_CLEARDEPTHSTENCILVIEW_MISMATCHINGCLEARVALUE, */
-			//		D3D12_MESSAGE_ID_COPY_DESCRIPTORS_INVALID_RANGES
-			//};
-			//D3D12_INFO_QUEUE_FILTER filter = {};
-			//filter.DenyList.pIDList = blockedIds;
-			//filter.DenyList.NumIDs = 1;
-			//d3dInfoQueue->AddRetrievalFilterEntries(&filter);
-			//d3dInfoQueue->AddStorageFilterEntries(&filter);
-		}
-		break;
-	}
+void SimpleDX12::WaitAsyncCompute(UINT64 FenceValue)
+{
+	// what was recorded up to here doesn't need the compute work, it goes first and can run next to it
+	InsertCommandLists({});
+	CmdQ->WaitForQueue(ComputeQ.get(), FenceValue);
 
-	// Describe and create the swap chain.
-	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-	swapChainDesc.BufferCount = NumFrame;
-	swapChainDesc.Width = DisplayWidth;
-	swapChainDesc.Height = DisplayHeight;
-	swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-	swapChainDesc.SampleDesc.Count = 1;
+	if (FenceValue >= UnwaitedComputeFence)
+		UnwaitedComputeFence = 0;
+}
 
-	g_dx12_rhi = this;
+D3D12_GPU_DESCRIPTOR_HANDLE SimpleDX12::GetBindlessTable()
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE handle;
+	handle.ptr = SRVCBVDescriptorHeapShaderVisible->GPUHeapStart;
+	return handle;
+}
 
-	CmdQ = unique_ptr<CommandQueue>(new CommandQueue);
+void SimpleDX12::EndFrame()
+{
+#if USE_AFTERMATH
+	ThrowIfFailed(m_swapChain->Present(0, 0), &g_dx12_rhi->AM_CL_Handle);
+#else
+	ThrowIfFailed(m_swapChain->Present(0, 0), nullptr);
 
+#endif
+	// BeginFrame counts on the frame fence covering the compute work of the frame
+	assert(UnwaitedComputeFence == 0);
 
-	ComPtr<IDXGISwapChain1> swapChain;
-	ThrowIfFailed(factory->CreateSwapChainForHwnd(
-		CmdQ->CmdQueue.Get(),		// Swap chain needs the queue so that it can force a flush on it.
-		hWnd,
-		&swapChainDesc,
-		nullptr,
-		nullptr,
-		&swapChain
-	));
+	FrameFenceValueVec[CurrentFrameIndex] = CmdQ->CurrentFenceValue;;
+	CmdQ->SignalCurrentFence();
+}
 
-	// This sample does not support fullscreen transitions.
-	//ThrowIfFailed(factory->MakeWindowAssociation(Win32Application::GetHwnd(), DXGI_MWA_NO_ALT_ENTER));
+void SimpleDX12::BeginLoadBatch()
+{
+	assert(!LoadBatch);
+	LoadBatch = make_unique<UploadBatch>(Uploads->BeginBatch());
+}
 
-	ThrowIfFailed(swapChain.As(&m_swapChain));
-	//dx12_rhi->m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
+void SimpleDX12::EndLoadBatch()
+{
+	Uploads->Wait(Uploads->Submit(*LoadBatch));
+	LoadBatch = nullptr;
+	AcquireUploads(nullptr);
+}
 
-	m_swapChain = m_swapChain;
+UploadBatch* SimpleDX12::BeginUpload(UploadBatch& Immediate)
+{
+	if (LoadBatch)
+		return LoadBatch.get();
 
-	
+	Immediate = Uploads->BeginBatch();
+	return &Immediate;
+}
 
+void SimpleDX12::EndUpload(UploadBatch* Batch)
+{
+	if (Batch != LoadBatch.get())
+	{
+		Uploads->Wait(Uploads->Submit(*Batch));
+		AcquireUploads(nullptr);
+	}
+}
 
-	//ThrowIfFailed(swapChain->SetFullscreenState(true, nullptr));
+void SimpleDX12::AcquireUploads(CommandList* Cmd)
+{
+	vector<D3D12_RESOURCE_BARRIER> barriers;
+	Uploads->TakeCompletedAcquires(barriers);
+	if (barriers.empty())
+		return;
 
+	if (Cmd)
+	{
+		Cmd->CmdList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+		return;
+	}
 
-#if USE_AFTERMATH
-	GFSDK_Aftermath_Result result = GFSDK_Aftermath_DX12_Initialize(GFSDK_Aftermath_Version::GFSDK_Aftermath_Version_API, GFSDK_Aftermath_FeatureFlags::GFSDK_Aftermath_FeatureFlags_Maximum, Device.Get());
-#endif
+	// goes in front of everything submitted to CmdQ later, the copies are already done so nothing waits
+	CommandList* cmd = CmdQ->AllocCmdList();
+	cmd->CmdList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+	CmdQ->ExecuteCommandList(cmd);
+}
 
+Sampler* SimpleDX12::CreateSampler(D3D12_SAMPLER_DESC& InSamplerDesc)
+{
+	Sampler* sampler = new Sampler;
+	sampler->SamplerDesc = InSamplerDesc;
+	SamplerDescriptorHeapShaderVisible->Alloc(sampler->Descriptor);
+	Device->CreateSampler(&sampler->SamplerDesc, sampler->Descriptor.CpuHandle);
 
-	FrameFenceValueVec.resize(NumFrame);
+	return sampler;
+}
 
+Buffer* SimpleDX12::CreateBuffer(UINT InNumElements, UINT InElementSize, D3D12_HEAP_TYPE InType, D3D12_RESOURCE_STATES initResState, D3D12_RESOURCE_FLAGS InFlags, void* SrcData)
+{
+	Buffer * buffer = new Buffer;
+	D3D12_RESOURCE_DESC bufDesc = {};
+	bufDesc.Alignment = 0;
+	bufDesc.DepthOrArraySize = 1;
+	bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	bufDesc.Flags = InFlags;// D3D12_RESOURCE_FLAG_NONE;
+	//if (isUAV)
+		//bufDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+	bufDesc.Height = 1;
+	bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	bufDesc.MipLevels = 1;
+	bufDesc.SampleDesc.Count = 1;
+	bufDesc.SampleDesc.Quality = 0;
+	bufDesc.Width = InNumElements * InElementSize;
 
-	{
-		RTVDescriptorHeap = std::make_unique<DescriptorHeap>();
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.NumDescriptors = 90;
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-		RTVDescriptorHeap->Init(HeapDesc);
+	buffer->NumElements = InNumElements;
+	buffer->ElementSize = InElementSize;
 
-		NAME_D3D12_OBJECT(RTVDescriptorHeap->DH);
-	}
-	
+	// uploaded ones start in COPY_DEST for the copy queue and reach initResState through Acquire
+	const bool bUpload = SrcData && InType != D3D12_HEAP_TYPE_UPLOAD;
+	buffer->resource = CreateResourceInPool(GetBufferPool(InType), InType, bufDesc, bUpload ? D3D12_RESOURCE_STATE_COPY_DEST : initResState, nullptr, buffer->Memory);
+	buffer->Tracked.Reset(initResState);
 
+	if (SrcData)
 	{
-		DSVDescriptorHeap = std::make_unique<DescriptorHeap>();
-
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.NumDescriptors = 2;
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-		DSVDescriptorHeap->Init(HeapDesc);
+		UINT Size = buffer->NumElements * buffer->ElementSize;
 
-		NAME_D3D12_OBJECT(DSVDescriptorHeap->DH);
-	}
-	
-	// shader visible CBV_SRV_UAV
-	{
-		SRVCBVDescriptorHeapShaderVisible = std::make_unique<DescriptorHeap>();
+		if (InType == D3D12_HEAP_TYPE_UPLOAD)
+		{
+			// already cpu visible, no copy needed
+			UINT8* pData = nullptr;
+			buffer->resource->Map(0, nullptr, reinterpret_cast<void**>(&pData));
+			memcpy(reinterpret_cast<void*>(pData), SrcData, Size);
+			buffer->resource->Unmap(0, nullptr);
+		}
+		else
+		{
+			UploadBatch immediate;
+			UploadBatch* batch = BeginUpload(immediate);
 
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.NumDescriptors = 1000000;
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		SRVCBVDescriptorHeapShaderVisible->Init(HeapDesc);
+			Uploads->UploadBuffer(*batch, buffer->resource.Get(), 0, SrcData, Size);
+			Uploads->Acquire(*batch, buffer->resource.Get(), initResState);
 
-		NAME_D3D12_OBJECT(SRVCBVDescriptorHeapShaderVisible->DH);
+			EndUpload(batch);
+		}
 	}
 
-	// non shader visible(storage) CBV_SRV_UAV
-	{
-		SRVCBVDescriptorHeapStorage = std::make_unique<DescriptorHeap>();
-
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.NumDescriptors = 2000000;
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-		SRVCBVDescriptorHeapStorage->Init(HeapDesc);
+	//// create shader resource view
+	//D3D12_SHADER_RESOURCE_VIEW_DESC bufferSRVDesc;
+	//bufferSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	//bufferSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	//bufferSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+	//bufferSRVDesc.Buffer.StructureByteStride = 0;
+	//bufferSRVDesc.Buffer.FirstElement = 0;
+	//bufferSRVDesc.Buffer.NumElements = InNumElements;// static_cast<UINT>(Size) / sizeof(float); // byte address buffer
+	//bufferSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-		NAME_D3D12_OBJECT(SRVCBVDescriptorHeapStorage->DH);
-	}
+	//// TODO : should be GlobalDHRing? if object instance are to move.
+	//TextureDHRing->AllocDescriptor(buffer->CpuHandleSRV, buffer->GpuHandleSRV);
 
-	// shader visible sampler
-	{
-		SamplerDescriptorHeapShaderVisible = std::make_unique<DescriptorHeap>();
+	//Device->CreateShaderResourceView(buffer->resource.Get(), &bufferSRVDesc, buffer->CpuHandleSRV);
 
-		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
-		HeapDesc.NumDescriptors = 1024*2;
-		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
-		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-		SamplerDescriptorHeapShaderVisible->Init(HeapDesc);
+	//shared_ptr<Buffer> ptr = shared_ptr<Buffer>(buffer);
+	if (InFlags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
+		g_dx12_rhi->DynamicBuffers.push_back(buffer);
 
-		NAME_D3D12_OBJECT(SamplerDescriptorHeapShaderVisible->DH);
+	return buffer;
+}
+
+IndexBuffer* SimpleDX12::CreateIndexBuffer(DXGI_FORMAT Format, UINT Size, void* SrcData)
+{
+	IndexBuffer* ib = new IndexBuffer;
+
+	/*stringstream ss;
+	ss << "CreateIndexBuffer : " << Size << "\n";
+	OutputDebugStringA(ss.str().c_str());*/
+
+	ib->resource = CreateResourceInPool(BufferPool, D3D12_HEAP_TYPE_DEFAULT, CD3DX12_RESOURCE_DESC::Buffer(Size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, ib->Memory);
+
+	NAME_D3D12_OBJECT(ib->resource);
+
+	ib->view.BufferLocation = ib->resource->GetGPUVirtualAddress();
+	ib->view.Format = Format;
+	ib->view.SizeInBytes = Size;
+
+	if (Format == DXGI_FORMAT_R32_UINT)
+	{
+		ib->numIndices = Size / 4;
+	}
+	else if (Format == DXGI_FORMAT_R16_UINT)
+	{
+		ib->numIndices = Size / 2;
 	}
-	
 
 
-	TextureDHRing = std::make_unique<DescriptorHeapRing>();
-	TextureDHRing->Init(SRVCBVDescriptorHeapShaderVisible.get(), 10000, NumFrame);
+	if (SrcData)
+	{
+		UploadBatch immediate;
+		UploadBatch* batch = BeginUpload(immediate);
 
-	GlobalDHRing = std::make_unique<DescriptorHeapRing>();
-	GlobalDHRing->Init(SRVCBVDescriptorHeapShaderVisible.get(), 10000, NumFrame);
+		Uploads->UploadBuffer(*batch, ib->resource.Get(), 0, SrcData, Size);
+		Uploads->Acquire(*batch, ib->resource.Get(), D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-	GeomtryDHRing = std::make_unique<DescriptorHeapRing>();
-	GeomtryDHRing->Init(SRVCBVDescriptorHeapShaderVisible.get(), 10000, NumFrame);
+		// create shader resource view
+		D3D12_SHADER_RESOURCE_VIEW_DESC vertexSRVDesc;
+		vertexSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		vertexSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		vertexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+		vertexSRVDesc.Buffer.StructureByteStride = 0;
+		vertexSRVDesc.Buffer.FirstElement = 0;
+		vertexSRVDesc.Buffer.NumElements = static_cast<UINT>(Size) / sizeof(float); // byte address buffer
+		vertexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-	GlobalCBRing = std::make_unique<ConstantBufferRingBuffer>(1024 * 1024 * 10, NumFrame);
-	
+		//g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptor(ib->CpuHandleSRV, ib->GpuHandleSRV);
+		SRVCBVDescriptorHeapShaderVisible->Alloc(ib->Descriptor);
 
-	GlobalRTDHRing = std::make_unique<DescriptorHeapRing>();
-	GlobalRTDHRing->Init(RTVDescriptorHeap.get(), 30, NumFrame);
+		Device->CreateShaderResourceView(ib->resource.Get(), &vertexSRVDesc, ib->Descriptor.CpuHandle);
 
-	CmdQ->WaitGPU();
-}
+		EndUpload(batch);
+	}
 
-SimpleDX12::~SimpleDX12()
-{
-	CmdQ->WaitGPU();
+	return ib;
 }
 
-void PipelineStateObject::BindUAV(string name, int baseRegister)
+VertexBuffer* SimpleDX12::CreateVertexBuffer(UINT Size, UINT Stride, void* SrcData)
 {
-	BindingData binding;
-	binding.name = name;
-	binding.baseRegister = baseRegister;
-	binding.numDescriptors = 1;
-	uavBinding.insert(pair<string, BindingData>(name, binding));
-}
+	VertexBuffer* vb = new VertexBuffer;
+	
+	/*stringstream ss;
+	ss << "CreateVertexBuffer : " << Size << "\n";
+	OutputDebugStringA(ss.str().c_str());*/
+	
+	vb->resource = CreateResourceInPool(BufferPool, D3D12_HEAP_TYPE_DEFAULT, CD3DX12_RESOURCE_DESC::Buffer(Size), D3D12_RESOURCE_STATE_COPY_DEST, nullptr, vb->Memory);
 
-void PipelineStateObject::BindSRV(string name, int baseRegister, int num)
-{
-	BindingData binding;
-	binding.name = name;
-	binding.baseRegister = baseRegister;
-	binding.numDescriptors = num;
-	textureBinding.insert(pair<string, BindingData>(name, binding));
-}
+	NAME_D3D12_OBJECT(vb->resource);
 
-void PipelineStateObject::BindCBV(string name, int baseRegister, int size)
-{
-	BindingData binding;
-	binding.name = name;
-	binding.baseRegister = baseRegister;
-	binding.numDescriptors = 1;
-	//binding.cbSize = size;
+	if (SrcData)
+	{
+		UploadBatch immediate;
+		UploadBatch* batch = BeginUpload(immediate);
 
-	int div = size / 256;
-	binding.cbSize = (div) * 256;
+		Uploads->UploadBuffer(*batch, vb->resource.Get(), 0, SrcData, Size);
+		Uploads->Acquire(*batch, vb->resource.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-	if (size % 256 > 0)
-		binding.cbSize += 256;
+		// Initialize the vertex buffer view.
+		vb->view.BufferLocation = vb->resource->GetGPUVirtualAddress();
+		vb->view.StrideInBytes = Stride;
+		vb->view.SizeInBytes = Size;
+		vb->numVertices = Size / Stride;
 
-	constantBufferBinding.insert(pair<string, BindingData>(name, binding));
-}
+		// create shader resource view
+		D3D12_SHADER_RESOURCE_VIEW_DESC vertexSRVDesc;
+		vertexSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		vertexSRVDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		vertexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+		vertexSRVDesc.Buffer.StructureByteStride = 0;
+		vertexSRVDesc.Buffer.FirstElement = 0;
+		vertexSRVDesc.Buffer.NumElements = static_cast<UINT>(Size) / sizeof(float); // byte address buffer
+		vertexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-void PipelineStateObject::BindRootConstant(string name, int baseRegister)
-{
-	BindingData binding;
-	binding.name = name;
-	binding.baseRegister = baseRegister;
-	binding.numDescriptors = 1;
+		//g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->AllocDescriptor(vb->CpuHandleSRV, vb->GpuHandleSRV);
+		SRVCBVDescriptorHeapShaderVisible->Alloc(vb->Descriptor);
 
-	rootBinding.insert(pair<string, BindingData>(name, binding));
-}
+		Device->CreateShaderResourceView(vb->resource.Get(), &vertexSRVDesc, vb->Descriptor.CpuHandle);
 
-void PipelineStateObject::BindSampler(string name, int baseRegister)
-{
-	BindingData binding;
-	binding.name = name;
-	binding.baseRegister = baseRegister;
-	binding.numDescriptors = 1;
+		EndUpload(batch);
+	}
 
-	samplerBinding.insert(pair<string, BindingData>(name, binding));
+	return vb;
 }
 
-void PipelineStateObject::SetSRV(string name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList)
+void SimpleDX12::PresentBarrier(Texture* rt)
 {
-	//textureBinding[name].texture = texture;
-
-	UINT RPI = textureBinding[name].rootParamIndex;
-	if (IsCompute)
-		CommandList->SetComputeRootDescriptorTable(RPI, GpuHandleSRV);
-	else
-		CommandList->SetGraphicsRootDescriptorTable(RPI, GpuHandleSRV);
+	D3D12_RESOURCE_BARRIER BarrierDesc = {};
+	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	BarrierDesc.Transition.pResource = rt->resource.Get();
+	BarrierDesc.Transition.Subresource = 0;
+	BarrierDesc.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
+	BarrierDesc.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
+	GlobalCmdList->CmdList->ResourceBarrier(1, &BarrierDesc);
 }
 
-void PipelineStateObject::SetUAV(string name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList)
+void SimpleDX12::OnSizeChanged(UINT width, UINT height)
 {
-	//uavBinding[name].texture = texture;
-	D3D12_CPU_DESCRIPTOR_HANDLE ShaderVisibleCPUHandle;
-	D3D12_GPU_DESCRIPTOR_HANDLE ShaderVisibleGpuHandle;
-
-	UINT RPI = uavBinding[name].rootParamIndex;
-	if (IsCompute)
-		CommandList->SetComputeRootDescriptorTable(RPI, GpuHandleUAV);
-	else
-		CommandList->SetGraphicsRootDescriptorTable(RPI, GpuHandleUAV);
 }
-void PipelineStateObject::SetSampler(string name, Sampler* sampler, ID3D12GraphicsCommandList* CommandList)
+
+void SimpleDX12::GetFrameBuffers(std::vector<std::shared_ptr<Texture>>& FrameFuffers)
 {
-	samplerBinding[name].sampler = sampler;
+	for (UINT i = 0; i < NumFrame; i++)
+	{
+		ComPtr<ID3D12Resource> rendertarget;
+		ThrowIfFailed(m_swapChain->GetBuffer(i, IID_PPV_ARGS(&rendertarget)));
 
-	D3D12_CPU_DESCRIPTOR_HANDLE ShaderVisibleCPUHandle;
-	D3D12_GPU_DESCRIPTOR_HANDLE ShaderVisibleGpuHandle;
+		// create each rtv for one actual resource(swapchain)
+		shared_ptr<Texture> rt = CreateTexture2DFromResource(rendertarget);
+		rt->isRT = true;
 
-	if (IsCompute)
-		CommandList->SetComputeRootDescriptorTable(samplerBinding[name].rootParamIndex, sampler->Descriptor.GpuHandle);
-	else
-		CommandList->SetGraphicsRootDescriptorTable(samplerBinding[name].rootParamIndex, sampler->Descriptor.GpuHandle);
+		rt->textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+		rt->textureDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+		NAME_D3D12_TEXTURE(rt);
+		FrameFuffers.push_back(rt);
+	}
 }
 
-void PipelineStateObject::SetCBVValue(string name, void* pData, ID3D12GraphicsCommandList* CommandList)
+SimpleDX12::SimpleDX12(HWND hWnd, UINT DisplayWidth, UINT DisplayHeight)
 {
-	map<string, BindingData> ::iterator it = constantBufferBinding.find(name);
-	assert(it != constantBufferBinding.end());
-	
-	BindingData& binding = it->second;// constantBufferBinding[name];
-	auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(binding.cbSize);
-	UINT64 GPUAddr = std::get<0>(Alloc);
-	UINT8* pMapped = std::get<1>(Alloc);
+	CoInitialize(NULL);
 
-	memcpy((void*)pMapped, pData, binding.cbSize);
+	UINT dxgiFactoryFlags = 0;
 
-	D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-	D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+#if defined(_DEBUG)
+	// Enable the debug layer (requires the Graphics Tools "optional feature").
+	// NOTE: Enabling the debug layer after device creation will invalidate the active device.
+	{
+		ComPtr<ID3D12Debug> debugController;
+		if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController))))
+		{
+			debugController->EnableDebugLayer();
 
-	// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-	g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+			// Enable additional debug layers.
+			dxgiFactoryFlags |= DXGI_CREATE_FACTORY_DEBUG;
 
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-	cbvDesc.BufferLocation = GPUAddr;
-	cbvDesc.SizeInBytes = binding.cbSize;
+		}
 
-	g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+		ComPtr<ID3D12Debug1> spDebugController1;
+		debugController->QueryInterface(IID_PPV_ARGS(&spDebugController1));
+		//spDebugController1->SetEnableGPUBasedValidation(true);
+	}
+#endif
 
-	if (IsCompute)
-		CommandList->SetComputeRootDescriptorTable(binding.rootParamIndex, GpuHandle);
-	else
-		CommandList->SetGraphicsRootDescriptorTable(binding.rootParamIndex, GpuHandle);
-}
+	ComPtr<IDXGIFactory4> factory;
+	ThrowIfFailed(CreateDXGIFactory2(dxgiFactoryFlags, IID_PPV_ARGS(&factory)));
 
-void PipelineStateObject::SetCBVValue(string name, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList)
-{
-	map<string, BindingData> ::iterator it = constantBufferBinding.find(name);
-	assert(it != constantBufferBinding.end());
+	// check tearing support
+	{
+		ComPtr<IDXGIFactory6> factory6;
+		HRESULT hr = CreateDXGIFactory1(IID_PPV_ARGS(&factory6));
+		BOOL allowTearing = FALSE;
+		if (SUCCEEDED(hr))
+		{
+			hr = factory6->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allowTearing, sizeof(allowTearing));
+		}
 
-	BindingData& binding = it->second;// constantBufferBinding[name];
-	/*auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(binding.cbSize);
-	UINT64 GPUAddr = std::get<0>(Alloc);
-	UINT8* pMapped = std::get<1>(Alloc);
+		m_tearingSupport = SUCCEEDED(hr) && allowTearing;
+	}
 
-	memcpy((void*)pMapped, pData, binding.cbSize);*/
+	//GetHardwareAdapter(factory.Get(), &hardwareAdapter);
+	for (uint32_t i = 0; DXGI_ERROR_NOT_FOUND != factory->EnumAdapters1(i, &m_hardwareAdapter); i++)
+	{
+		DXGI_ADAPTER_DESC1 desc;
+		m_hardwareAdapter->GetDesc1(&desc);
 
-	D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-	D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+		// Skip SW adapters
+		if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
 
-	// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-	g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+		ThrowIfFailed(D3D12CreateDevice(
+			m_hardwareAdapter.Get(),
+			D3D_FEATURE_LEVEL_12_1,
+			IID_PPV_ARGS(&Device)
+		));
 
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-	cbvDesc.BufferLocation = GPUAddr;
-	cbvDesc.SizeInBytes = binding.cbSize;
+		D3D12_FEATURE_DATA_D3D12_OPTIONS5 features5;
+		HRESULT hr = Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &features5, sizeof(D3D12_FEATURE_DATA_D3D12_OPTIONS5));
+		if (FAILED(hr) || features5.RaytracingTier == D3D12_RAYTRACING_TIER_NOT_SUPPORTED)
+		{
+			//msgBox("Raytracing is not supported on this device. Make sure your GPU supports DXR (such as Nvidia's Volta or Turing RTX) and you're on the latest drivers. The DXR fallback layer is not supported.");
+			ThrowIfFailed(hr);
+		}
 
-	g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
 
-	if (IsCompute)
-		CommandList->SetComputeRootDescriptorTable(binding.rootParamIndex, GpuHandle);
-	else
-		CommandList->SetGraphicsRootDescriptorTable(binding.rootParamIndex, GpuHandle);
-}
+		/*ComPtr<IDXGIAdapter3> pDXGIAdapter3;
+		hardwareAdapter->QueryInterface(IID_PPV_ARGS(&pDXGIAdapter3));
 
+		ThrowIfFailed(pDXGIAdapter3->SetVideoMemoryReservation(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, 2213100441));
 
-void PipelineStateObject::SetRootConstant(string name, UINT value, ID3D12GraphicsCommandList* CommandList)
-{
-	rootBinding[name].rootConst = value;
-	if(IsCompute)
-		CommandList->SetComputeRoot32BitConstant(rootBinding[name].rootParamIndex, rootBinding[name].rootConst, 0);
-	else
-		CommandList->SetGraphicsRoot32BitConstant(rootBinding[name].rootParamIndex, rootBinding[name].rootConst, 0);
-}
-
-bool PipelineStateObject::Init()
-{
-	if (!IsCompute &&(!vs || !ps)) return false;
-	if (IsCompute && !cs) return false;
 
+		DXGI_QUERY_VIDEO_MEMORY_INFO LocalVideoMemoryInfo;
+		ThrowIfFailed(pDXGIAdapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &LocalVideoMemoryInfo));*/
 
-	vector<CD3DX12_ROOT_PARAMETER1> rootParamVec;
+		// break on error
 
-	vector<CD3DX12_DESCRIPTOR_RANGE1> TextureRanges;
-	if (textureBinding.size() != 0)
-	{
-		TextureRanges.resize(textureBinding.size());
-		int i = 0;
-		for (auto& bindingPair : textureBinding)
+		ComPtr<ID3D12InfoQueue> d3dInfoQueue;
+		if (SUCCEEDED(Device->QueryInterface(__uuidof(ID3D12InfoQueue), (void**)&d3dInfoQueue)))
 		{
-			PipelineStateObject::BindingData& bindingData = bindingPair.second;
+			d3dInfoQueue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_CORRUPTION, true);
+			d3dInfoQueue->SetBreakOnSeverity(D3D12_MESSAGE_SEVERITY_ERROR, true);
 
-			CD3DX12_ROOT_PARAMETER1 TextureParam;
-			TextureRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
-			TextureParam.InitAsDescriptorTable(1, &TextureRanges[i], D3D12_SHADER_VISIBILITY_ALL);
-			rootParamVec.push_back(TextureParam);
-			i++;
-			bindingData.rootParamIndex = RootParamIndex++;
+			//D3D12_MESSAGE_ID blockedIds[] = {
+			//	/*	D3D12_MESSAGE_ID_CLEARRENDERTARGETVIEW_MISMATCHINGCLEARVALUE,
+			//		D3D12_MESSAGE_ID_CLEARDEPTHSTENCILVIEW_MISMATCHINGCLEARVALUE, */
+			//		D3D12_MESSAGE_ID_COPY_DESCRIPTORS_INVALID_RANGES
+			//};
+			//D3D12_INFO_QUEUE_FILTER filter = {};
+			//filter.DenyList.pIDList = blockedIds;
+			//filter.DenyList.NumIDs = 1;
+			//d3dInfoQueue->AddRetrievalFilterEntries(&filter);
+			//d3dInfoQueue->AddStorageFilterEntries(&filter);
 		}
+		break;
 	}
 
-	vector<CD3DX12_DESCRIPTOR_RANGE1> SamplerRanges;
-	if (samplerBinding.size() != 0)
-	{
-		SamplerRanges.resize(samplerBinding.size());
-		int i = 0;
-		for (auto& bindingPair : samplerBinding)
-		{
-			PipelineStateObject::BindingData& bindingData = bindingPair.second;
+	// Describe and create the swap chain.
+	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+	swapChainDesc.BufferCount = NumFrame;
+	swapChainDesc.Width = DisplayWidth;
+	swapChainDesc.Height = DisplayHeight;
+	swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+	swapChainDesc.SampleDesc.Count = 1;
 
-			CD3DX12_ROOT_PARAMETER1 SamplerParam;
-			SamplerRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, bindingData.numDescriptors, bindingData.baseRegister);
-			SamplerParam.InitAsDescriptorTable(1, &SamplerRanges[i], D3D12_SHADER_VISIBILITY_ALL);
-			rootParamVec.push_back(SamplerParam);
-			i++;
-			bindingData.rootParamIndex = RootParamIndex++;
-		}
-	}
+	g_dx12_rhi = this;
 
+	CmdQ = unique_ptr<CommandQueue>(new CommandQueue);
+	ComputeQ = unique_ptr<CommandQueue>(new CommandQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE));
+	CopyQ = unique_ptr<CommandQueue>(new CommandQueue(D3D12_COMMAND_LIST_TYPE_COPY));
 
-	if (rootBinding.size() != 0)
-	{
-		int i = 0;
-		for (auto& bindingPair : rootBinding)
-		{
-			PipelineStateObject::BindingData& bindingData = bindingPair.second;
 
-			CD3DX12_ROOT_PARAMETER1 ConstantParam;
-			ConstantParam.InitAsConstants(bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_SHADER_VISIBILITY_ALL);
-			rootParamVec.push_back(ConstantParam);
-			i++;
-			bindingData.rootParamIndex = RootParamIndex++;
-		}
-	}
+	ComPtr<IDXGISwapChain1> swapChain;
+	ThrowIfFailed(factory->CreateSwapChainForHwnd(
+		CmdQ->CmdQueue.Get(),		// Swap chain needs the queue so that it can force a flush on it.
+		hWnd,
+		&swapChainDesc,
+		nullptr,
+		nullptr,
+		&swapChain
+	));
 
-	vector<CD3DX12_DESCRIPTOR_RANGE1> CBRanges;
-	if (constantBufferBinding.size() != 0)
-	{
+	// This sample does not support fullscreen transitions.
+	//ThrowIfFailed(factory->MakeWindowAssociation(Win32Application::GetHwnd(), DXGI_MWA_NO_ALT_ENTER));
 
-		CBRanges.resize(constantBufferBinding.size());
-		int i = 0;
-		for (auto& bindingPair : constantBufferBinding)
-		{
-			PipelineStateObject::BindingData& bindingData = bindingPair.second;
+	ThrowIfFailed(swapChain.As(&m_swapChain));
+	//dx12_rhi->m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 
-			CD3DX12_ROOT_PARAMETER1 CBParam;
-			CBRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
-			CBParam.InitAsDescriptorTable(1, &CBRanges[i], D3D12_SHADER_VISIBILITY_ALL);
+	m_swapChain = m_swapChain;
 
-			rootParamVec.push_back(CBParam);
-			i++;
-			bindingData.rootParamIndex = RootParamIndex++;
-		}
-	}
+	
 
-	vector<CD3DX12_DESCRIPTOR_RANGE1> UAVRanges;
-	if (uavBinding.size() != 0)
-	{
-		UAVRanges.resize(uavBinding.size());
-		int i = 0;
-		for (auto& bindingPair : uavBinding)
-		{
-			PipelineStateObject::BindingData& bindingData = bindingPair.second;
-			CD3DX12_ROOT_PARAMETER1 TextureParam;
-			UAVRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
-			TextureParam.InitAsDescriptorTable(1, &UAVRanges[i], D3D12_SHADER_VISIBILITY_ALL);
-			rootParamVec.push_back(TextureParam);
-			i++;
-			bindingData.rootParamIndex = RootParamIndex++;
-		}
-	}
 
-	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-	rootSignatureDesc.Init_1_1(rootParamVec.size(), &rootParamVec[0], 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	//ThrowIfFailed(swapChain->SetFullscreenState(true, nullptr));
 
-	D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
-	featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
 
-	if (FAILED(g_dx12_rhi->Device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
-	{
-		featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
-	}
+#if USE_AFTERMATH
+	GFSDK_Aftermath_Result result = GFSDK_Aftermath_DX12_Initialize(GFSDK_Aftermath_Version::GFSDK_Aftermath_Version_API, GFSDK_Aftermath_FeatureFlags::GFSDK_Aftermath_FeatureFlags_Maximum, Device.Get());
+#endif
 
-	ComPtr<ID3DBlob> signature;
-	ComPtr<ID3DBlob> error;
 
-	try
-	{
-		ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
-	}
-	catch (const std::exception& e)
-	{
-		OutputDebugStringA(reinterpret_cast<const char*>(error->GetBufferPointer()));
-	}
+	FrameFenceValueVec.resize(NumFrame);
+
 
-	try
-	{
-		ThrowIfFailed(g_dx12_rhi->Device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&RS)));
-	}
-	catch (const std::exception& e)
 	{
-		OutputDebugStringA(reinterpret_cast<const char*>(error->GetBufferPointer()));
+		RTVDescriptorHeap = std::make_unique<DescriptorHeap>();
+		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+		HeapDesc.NumDescriptors = 90 + 256;
+		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		RTVDescriptorHeap->Init(HeapDesc);
+
+		NAME_D3D12_OBJECT(RTVDescriptorHeap->DH);
 	}
+	
 
-	NAME_D3D12_OBJECT(RS);
-	if (IsCompute)
 	{
-		computePSODesc.CS = CD3DX12_SHADER_BYTECODE(cs->GetBufferPointer(), cs->GetBufferSize());
-		computePSODesc.pRootSignature = RS.Get();
-		HRESULT hr;
-		ThrowIfFailed(hr = g_dx12_rhi->Device->CreateComputePipelineState(&computePSODesc, IID_PPV_ARGS(&PSO)));
-		NAME_D3D12_OBJECT(PSO);
-		return SUCCEEDED(hr);
+		DSVDescriptorHeap = std::make_unique<DescriptorHeap>();
 
+		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+		HeapDesc.NumDescriptors = 16;
+		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		DSVDescriptorHeap->Init(HeapDesc);
+
+		NAME_D3D12_OBJECT(DSVDescriptorHeap->DH);
 	}
-	else
+	
+	// shader visible CBV_SRV_UAV
 	{
-		graphicsPSODesc.VS = CD3DX12_SHADER_BYTECODE(vs->GetBufferPointer(), vs->GetBufferSize());
-		graphicsPSODesc.PS = CD3DX12_SHADER_BYTECODE(ps->GetBufferPointer(), ps->GetBufferSize());
+		SRVCBVDescriptorHeapShaderVisible = std::make_unique<DescriptorHeap>();
 
-		graphicsPSODesc.pRootSignature = RS.Get();
-		HRESULT hr;
-		ThrowIfFailed(hr = g_dx12_rhi->Device->CreateGraphicsPipelineState(&graphicsPSODesc, IID_PPV_ARGS(&PSO)));
-		NAME_D3D12_OBJECT(PSO);
-		return SUCCEEDED(hr);
+		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+		HeapDesc.NumDescriptors = 1000000;
+		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		SRVCBVDescriptorHeapShaderVisible->Init(HeapDesc);
+
+		NAME_D3D12_OBJECT(SRVCBVDescriptorHeapShaderVisible->DH);
 	}
-}
 
-void PipelineStateObject::Apply(ID3D12GraphicsCommandList* CommandList)
-{
-	if (IsCompute)
+	// non shader visible(storage) CBV_SRV_UAV
 	{
-		CommandList->SetComputeRootSignature(RS.Get());
-		CommandList->SetPipelineState(PSO.Get());
+		SRVCBVDescriptorHeapStorage = std::make_unique<DescriptorHeap>();
+
+		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+		HeapDesc.NumDescriptors = 2000000;
+		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		SRVCBVDescriptorHeapStorage->Init(HeapDesc);
+
+		NAME_D3D12_OBJECT(SRVCBVDescriptorHeapStorage->DH);
 	}
-	else
+
+	// shader visible sampler
 	{
-		CommandList->SetGraphicsRootSignature(RS.Get());
-		CommandList->SetPipelineState(PSO.Get());
+		SamplerDescriptorHeapShaderVisible = std::make_unique<DescriptorHeap>();
+
+		D3D12_DESCRIPTOR_HEAP_DESC HeapDesc = {};
+		HeapDesc.NumDescriptors = 1024*2;
+		HeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
+		HeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		SamplerDescriptorHeapShaderVisible->Init(HeapDesc);
+
+		NAME_D3D12_OBJECT(SamplerDescriptorHeapShaderVisible->DH);
 	}
-}
+	
 
-void Texture::MakeStaticSRV()
-{
-	g_dx12_rhi->TextureDHRing->AllocDescriptor(SRV.CpuHandle, SRV.GpuHandle);
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC SrvDesc = {};
-	SrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	SrvDesc.Format = textureDesc.Format;
+	GlobalDHRing = std::make_unique<DescriptorHeapRing>();
+	GlobalDHRing->Init(SRVCBVDescriptorHeapShaderVisible.get(), 10000, NumFrame);
 
-	if(textureDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
-		SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
-	else 
-		SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	SrvDesc.Texture2D.MipLevels = textureDesc.MipLevels;
-	g_dx12_rhi->Device->CreateShaderResourceView(resource.Get(), &SrvDesc, SRV.CpuHandle);
-}
+	GlobalCBRing = std::make_unique<ConstantBufferRingBuffer>(1024 * 1024 * 10, NumFrame);
+	
 
-void Texture::MakeDSV()
-{
-	g_dx12_rhi->DSVDescriptorHeap->AllocDescriptor(DSV.CpuHandle, DSV.GpuHandle);
+	GlobalRTDHRing = std::make_unique<DescriptorHeapRing>();
+	GlobalRTDHRing->Init(RTVDescriptorHeap.get(), 30, NumFrame);
 
-	D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
-	depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;// textureDesc.Format;// DXGI_FORMAT_D32_FLOAT;
-	depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-	depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
-	g_dx12_rhi->Device->CreateDepthStencilView(resource.Get(), &depthStencilDesc, DSV.CpuHandle);
-}
+	BufferPool = make_shared<PlacedHeapPool>(L"BufferHeap", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 64 * 1024 * 1024);
+	UploadBufferPool = make_shared<PlacedHeapPool>(L"UploadBufferHeap", D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 16 * 1024 * 1024);
+	TexturePool = make_shared<PlacedHeapPool>(L"TextureHeap", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, 64 * 1024 * 1024);
+	RenderTargetPool = make_shared<PlacedHeapPool>(L"RenderTargetHeap", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, 128 * 1024 * 1024);
+	AccelerationStructurePool = make_shared<PlacedHeapPool>(L"AccelerationStructureHeap", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, 32 * 1024 * 1024);
+	HeapPools = { BufferPool, UploadBufferPool, TexturePool, RenderTargetPool, AccelerationStructurePool };
 
-std::shared_ptr<Texture> SimpleDX12::CreateTexture2DFromResource(ComPtr<ID3D12Resource> InResource)
-{
-	Texture* tex = new Texture;
+	TransientTextures = make_unique<TransientTexturePool>();
 
-	if (InResource)
-	{
-		tex->resource = InResource;
-	}
+	Uploads = make_unique<UploadRing>(64 * 1024 * 1024, CopyQ.get());
 
-	return shared_ptr<Texture>(tex);
+	Timeline = make_unique<GpuTimeline>(NumFrame, 64);
+
+	InitShaderCompiler();
+
+	CmdQ->WaitGPU();
 }
 
-Texture* SimpleDX12::CreateTexture2D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int mipLevels, std::optional<glm::vec4> clearColor)
+SimpleDX12::~SimpleDX12()
 {
-	Texture* tex = new Texture;
-
-	D3D12_RESOURCE_DESC textureDesc = {};
-	textureDesc.MipLevels = mipLevels;
-	textureDesc.Format = format;
-	textureDesc.Width = width;
-	textureDesc.Height = height;
-	textureDesc.DepthOrArraySize = 1;
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	CmdQ->WaitGPU();
+	ComputeQ->WaitGPU();
 
-	textureDesc.Flags = resFlags;
+	// textures/buffers outliving the device don't give anything back
+	g_dx12_rhi = nullptr;
+}
 
-	tex->textureDesc = textureDesc;
+void PipelineStateObject::BindUAV(string name, int baseRegister)
+{
+	BindingData binding;
+	binding.name = name;
+	binding.baseRegister = baseRegister;
+	binding.numDescriptors = 1;
+	uavBinding.insert(pair<string, BindingData>(name, binding));
+}
 
-	D3D12_HEAP_PROPERTIES heapProp;
-	heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
-	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProp.CreationNodeMask = 1;
-	heapProp.VisibleNodeMask = 1;
+void PipelineStateObject::BindSRV(string name, int baseRegister, int num, int space /*= 0*/)
+{
+	BindingData binding;
+	binding.name = name;
+	binding.baseRegister = baseRegister;
+	binding.numDescriptors = num < 0 ? UINT_MAX : num;
+	binding.registerSpace = space;
+	textureBinding.insert(pair<string, BindingData>(name, binding));
+}
 
-	D3D12_RESOURCE_STATES ResStats = initResState;
-	if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
-	{
-		D3D12_CLEAR_VALUE optimizedClearValue = {};
-		optimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;
-		optimizedClearValue.DepthStencil = { 1.0f, 0 };
+void PipelineStateObject::BindCBV(string name, int baseRegister, int size)
+{
+	BindingData binding;
+	binding.name = name;
+	binding.baseRegister = baseRegister;
+	binding.numDescriptors = 1;
+	//binding.cbSize = size;
 
-		ThrowIfFailed(Device->CreateCommittedResource(
-			&heapProp,
-			D3D12_HEAP_FLAG_NONE,
-			&textureDesc,
-			ResStats,
-			&optimizedClearValue,
-			IID_PPV_ARGS(&tex->resource)));
+	int div = size / 256;
+	binding.cbSize = (div) * 256;
 
+	if (size % 256 > 0)
+		binding.cbSize += 256;
 
-		// create static dsv.
-		// TODO : should I make dsv dynamic? like rtv & uav.
-		g_dx12_rhi->DSVDescriptorHeap->AllocDescriptor(tex->DSV.CpuHandle, tex->DSV.GpuHandle);
+	constantBufferBinding.insert(pair<string, BindingData>(name, binding));
+}
 
-		D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
-		depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;// textureDesc.Format;// DXGI_FORMAT_D32_FLOAT;
-		depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-		depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
-		g_dx12_rhi->Device->CreateDepthStencilView(tex->resource.Get(), &depthStencilDesc, tex->DSV.CpuHandle);
-	}
-	else
-	{
-		D3D12_CLEAR_VALUE optimizedClearValue = {};
-		optimizedClearValue.Format = format;
+void PipelineStateObject::BindRootConstant(string name, int baseRegister)
+{
+	BindingData binding;
+	binding.name = name;
+	binding.baseRegister = baseRegister;
+	binding.numDescriptors = 1;
 
-		if (clearColor.has_value())
-		{
-			optimizedClearValue.Color[0] = clearColor.value().x;
-			optimizedClearValue.Color[1] = clearColor.value().y;
-			optimizedClearValue.Color[2] = clearColor.value().z;
-			optimizedClearValue.Color[3] = clearColor.value().w;
-		}
-		else
-		{
-			optimizedClearValue.Color[0] = 0.0f;
-			optimizedClearValue.Color[1] = 0.2f;
-			optimizedClearValue.Color[2] = 0.4f;
-			optimizedClearValue.Color[3] = 1.0f;
-		}
-		//D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+	rootBinding.insert(pair<string, BindingData>(name, binding));
+}
 
-		D3D12_CLEAR_VALUE* pClearValue = nullptr;
-		if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
-			pClearValue = &optimizedClearValue;
-		ThrowIfFailed(Device->CreateCommittedResource(
-			&heapProp,
-			D3D12_HEAP_FLAG_NONE,
-			&textureDesc,
-			ResStats,
-			pClearValue,
-			IID_PPV_ARGS(&tex->resource)));
-	}
+void PipelineStateObject::BindSampler(string name, int baseRegister)
+{
+	BindingData binding;
+	binding.name = name;
+	binding.baseRegister = baseRegister;
+	binding.numDescriptors = 1;
 
-	return tex;
+	samplerBinding.insert(pair<string, BindingData>(name, binding));
 }
 
-Texture* SimpleDX12::CreateTexture3D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int depth, int mipLevels)
+void PipelineStateObject::SetSRV(BindingSlot Slot, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList)
 {
-	Texture* tex = new Texture;
-
-	D3D12_RESOURCE_DESC textureDesc = {};
-	textureDesc.MipLevels = mipLevels;
-	textureDesc.Format = format;
-	textureDesc.Width = width;
-	textureDesc.Height = height;
-	textureDesc.DepthOrArraySize = depth;
-	textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
-	textureDesc.Flags = resFlags;
+	assert(Slot.IsValid());
+	UINT RPI = Slots[Slot.Index]->rootParamIndex;
+	if (IsCompute)
+		CommandList->SetComputeRootDescriptorTable(RPI, GpuHandleSRV);
+	else
+		CommandList->SetGraphicsRootDescriptorTable(RPI, GpuHandleSRV);
+}
 
-	tex->textureDesc = textureDesc;
+void PipelineStateObject::SetUAV(BindingSlot Slot, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList)
+{
+	assert(Slot.IsValid());
+	UINT RPI = Slots[Slot.Index]->rootParamIndex;
+	if (IsCompute)
+		CommandList->SetComputeRootDescriptorTable(RPI, GpuHandleUAV);
+	else
+		CommandList->SetGraphicsRootDescriptorTable(RPI, GpuHandleUAV);
+}
 
-	D3D12_HEAP_PROPERTIES heapProp;
-	heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
-	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProp.CreationNodeMask = 1;
-	heapProp.VisibleNodeMask = 1;
+void PipelineStateObject::SetSampler(BindingSlot Slot, Sampler* sampler, ID3D12GraphicsCommandList* CommandList)
+{
+	assert(Slot.IsValid());
 
-	D3D12_RESOURCE_STATES ResStats = initResState;
+	// nothing is stored on the binding, draws record on several threads against the same pso
+	const BindingData& binding = *Slots[Slot.Index];
+	if (IsCompute)
+		CommandList->SetComputeRootDescriptorTable(binding.rootParamIndex, sampler->Descriptor.GpuHandle);
+	else
+		CommandList->SetGraphicsRootDescriptorTable(binding.rootParamIndex, sampler->Descriptor.GpuHandle);
+}
 
-	D3D12_CLEAR_VALUE* pClearValue = nullptr;
+void PipelineStateObject::SetCBVValue(BindingSlot Slot, void* pData, ID3D12GraphicsCommandList* CommandList)
+{
+	assert(Slot.IsValid());
+	BindingData& binding = *Slots[Slot.Index];
+	auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(binding.cbSize);
+	UINT64 GPUAddr = std::get<0>(Alloc);
+	UINT8* pMapped = std::get<1>(Alloc);
 
-	ThrowIfFailed(Device->CreateCommittedResource(
-		&heapProp,
-		D3D12_HEAP_FLAG_NONE,
-		&textureDesc,
-		ResStats,
-		pClearValue,
-		IID_PPV_ARGS(&tex->resource)));
+	memcpy((void*)pMapped, pData, binding.cbSize);
 
-	//shared_ptr<Texture> texPtr = shared_ptr<Texture>(tex);
+	SetCBVValue(Slot, GPUAddr, CommandList);
+}
 
-	/*if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET || resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL || resFlags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
-		g_dx12_rhi->DynamicTextures.push_back(tex);
-	else*/
-		tex->MakeStaticSRV();
+void PipelineStateObject::SetCBVValue(BindingSlot Slot, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList)
+{
+	assert(Slot.IsValid());
 
-	return tex;
+	// constant buffers are root CBVs, no descriptor to write
+	UINT RPI = Slots[Slot.Index]->rootParamIndex;
+	if (IsCompute)
+		CommandList->SetComputeRootConstantBufferView(RPI, GPUAddr);
+	else
+		CommandList->SetGraphicsRootConstantBufferView(RPI, GPUAddr);
 }
 
-void Texture::UploadSRCData3D(D3D12_SUBRESOURCE_DATA* SrcData)
+void PipelineStateObject::SetRootConstant(BindingSlot Slot, UINT value, ID3D12GraphicsCommandList* CommandList)
 {
-	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
-
-	// upload src data
-	if (SrcData)
-	{
-		ComPtr<ID3D12Resource> textureUploadHeap;
+	assert(Slot.IsValid());
 
-		D3D12_PLACED_SUBRESOURCE_FOOTPRINT descFootPrint;
-		UINT Rows = 0;
-		UINT64 RowSize = 0;
-		UINT64 TotalBytes = 0;
-		g_dx12_rhi->Device->GetCopyableFootprints(&textureDesc, 0, 1, 0, &descFootPrint, &Rows, &RowSize, &TotalBytes);
+	// the value goes straight to the list, nothing is stored on the shared binding
+	UINT RPI = Slots[Slot.Index]->rootParamIndex;
+	if (IsCompute)
+		CommandList->SetComputeRoot32BitConstant(RPI, value, 0);
+	else
+		CommandList->SetGraphicsRoot32BitConstant(RPI, value, 0);
+}
 
+void PipelineStateObject::SetSRV(const string& name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetSRV(slot, GpuHandleSRV, CommandList);
+}
 
-		D3D12_HEAP_PROPERTIES heapProp;
-		heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
-		heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		heapProp.CreationNodeMask = 1;
-		heapProp.VisibleNodeMask = 1;
+void PipelineStateObject::SetUAV(const string& name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetUAV(slot, GpuHandleUAV, CommandList);
+}
 
-		D3D12_RESOURCE_DESC resDesc;
+void PipelineStateObject::SetSampler(const string& name, Sampler* sampler, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetSampler(slot, sampler, CommandList);
+}
 
-		resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resDesc.Alignment = 0;
-		resDesc.Width = TotalBytes;
-		resDesc.Height = 1;
-		resDesc.DepthOrArraySize = 1;
-		resDesc.MipLevels = textureDesc.MipLevels;
-		resDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resDesc.SampleDesc.Count = 1;
-		resDesc.SampleDesc.Quality = 0;
-		resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+void PipelineStateObject::SetCBVValue(const string& name, void* pData, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetCBVValue(slot, pData, CommandList);
+}
 
-		/*stringstream ss;
-		ss << "UploadSRCData : " << TotalBytes << "\n";
-		OutputDebugStringA(ss.str().c_str());*/
+void PipelineStateObject::SetCBVValue(const string& name, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetCBVValue(slot, GPUAddr, CommandList);
+}
 
 
-		ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
-			&heapProp,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&textureUploadHeap)));
+void PipelineStateObject::SetRootConstant(const string& name, UINT value, ID3D12GraphicsCommandList* CommandList)
+{
+	BindingSlot slot = GetSlot(name);
+	if (slot.IsValid())
+		SetRootConstant(slot, value, CommandList);
+}
 
-		NAME_D3D12_OBJECT(textureUploadHeap);
+bool PipelineStateObject::Init()
+{
+	if (!IsCompute &&(!vs || !ps)) return false;
+	if (IsCompute && !cs) return false;
 
-		UINT8* pData = nullptr;
-		textureUploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&pData));
-		memcpy(reinterpret_cast<void*>(pData), SrcData->pData, TotalBytes);
-		textureUploadHeap->Unmap(0, nullptr);
 
-		D3D12_TEXTURE_COPY_LOCATION dst = { };
-		dst.pResource = resource.Get();
-		dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		dst.SubresourceIndex = UINT32(0);
-		D3D12_TEXTURE_COPY_LOCATION src = { };
-		src.pResource = textureUploadHeap.Get();
-		src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-		src.PlacedFootprint = descFootPrint;
+	vector<CD3DX12_ROOT_PARAMETER1> rootParamVec;
 
-		D3D12_BOX sourceRegion;
-		sourceRegion.left = 0;
-		sourceRegion.top = 64;
-		sourceRegion.right = 64;
-		sourceRegion.bottom = 0;
-		sourceRegion.front = 64;
-		sourceRegion.back = 0;
-		cmd->CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	vector<CD3DX12_DESCRIPTOR_RANGE1> TextureRanges;
+	if (textureBinding.size() != 0)
+	{
+		TextureRanges.resize(textureBinding.size());
+		int i = 0;
+		for (auto& bindingPair : textureBinding)
+		{
+			PipelineStateObject::BindingData& bindingData = bindingPair.second;
 
+			CD3DX12_ROOT_PARAMETER1 TextureParam;
+			TextureRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, bindingData.numDescriptors, bindingData.baseRegister, bindingData.registerSpace, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
+			TextureParam.InitAsDescriptorTable(1, &TextureRanges[i], D3D12_SHADER_VISIBILITY_ALL);
+			rootParamVec.push_back(TextureParam);
+			i++;
+			bindingData.rootParamIndex = RootParamIndex++;
+		}
+	}
 
-		D3D12_RESOURCE_BARRIER BarrierDesc = {};
-		BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		BarrierDesc.Transition.pResource = resource.Get();
-		BarrierDesc.Transition.Subresource = 0;
-		BarrierDesc.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-		BarrierDesc.Transition.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-		cmd->CmdList->ResourceBarrier(1, &BarrierDesc);
+	vector<CD3DX12_DESCRIPTOR_RANGE1> SamplerRanges;
+	if (samplerBinding.size() != 0)
+	{
+		SamplerRanges.resize(samplerBinding.size());
+		int i = 0;
+		for (auto& bindingPair : samplerBinding)
+		{
+			PipelineStateObject::BindingData& bindingData = bindingPair.second;
 
-		g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
-		g_dx12_rhi->CmdQ->WaitGPU();
+			CD3DX12_ROOT_PARAMETER1 SamplerParam;
+			SamplerRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, bindingData.numDescriptors, bindingData.baseRegister);
+			SamplerParam.InitAsDescriptorTable(1, &SamplerRanges[i], D3D12_SHADER_VISIBILITY_ALL);
+			rootParamVec.push_back(SamplerParam);
+			i++;
+			bindingData.rootParamIndex = RootParamIndex++;
+		}
 	}
-}
 
-Texture* SimpleDX12::CreateTextureFromFile(wstring fileName, bool nonSRGB)
-{
-	if (FileExists(fileName.c_str()) == false)
-		return nullptr;
 
-	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+	if (rootBinding.size() != 0)
+	{
+		int i = 0;
+		for (auto& bindingPair : rootBinding)
+		{
+			PipelineStateObject::BindingData& bindingData = bindingPair.second;
 
+			CD3DX12_ROOT_PARAMETER1 ConstantParam;
+			ConstantParam.InitAsConstants(bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_SHADER_VISIBILITY_ALL);
+			rootParamVec.push_back(ConstantParam);
+			i++;
+			bindingData.rootParamIndex = RootParamIndex++;
+		}
+	}
 
-	Texture* tex = new Texture;
+	// root CBVs. 2 dwords of root signature each instead of a descriptor per SetCBVValue.
+	if (constantBufferBinding.size() != 0)
+	{
+		int i = 0;
+		for (auto& bindingPair : constantBufferBinding)
+		{
+			PipelineStateObject::BindingData& bindingData = bindingPair.second;
 
-	DirectX::ScratchImage image;
+			CD3DX12_ROOT_PARAMETER1 CBParam;
+			CBParam.InitAsConstantBufferView(bindingData.baseRegister, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_ALL);
 
-	const std::wstring extension = GetFileExtension(fileName.c_str());
+			rootParamVec.push_back(CBParam);
+			i++;
+			bindingData.rootParamIndex = RootParamIndex++;
+		}
+	}
 
-	if (extension == L"DDS" || extension == L"dds")
+	vector<CD3DX12_DESCRIPTOR_RANGE1> UAVRanges;
+	if (uavBinding.size() != 0)
 	{
-		DirectX::LoadFromDDSFile(fileName.c_str(), DirectX::DDS_FLAGS_NONE, nullptr, image);
-	}
-	else if (extension == L"TGA" || extension == L"tga")
-	{
-		DirectX::ScratchImage tempImage;
-		DirectX::LoadFromTGAFile(fileName.c_str(), nullptr, tempImage);
-		DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false);
+		UAVRanges.resize(uavBinding.size());
+		int i = 0;
+		for (auto& bindingPair : uavBinding)
+		{
+			PipelineStateObject::BindingData& bindingData = bindingPair.second;
+			CD3DX12_ROOT_PARAMETER1 TextureParam;
+			UAVRanges[i].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, bindingData.numDescriptors, bindingData.baseRegister, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE);
+			TextureParam.InitAsDescriptorTable(1, &UAVRanges[i], D3D12_SHADER_VISIBILITY_ALL);
+			rootParamVec.push_back(TextureParam);
+			i++;
+			bindingData.rootParamIndex = RootParamIndex++;
+		}
 	}
-	else
+
+	// names to slots. names are unique across all kinds, like in the shader.
+	Layout.Clear();
+	Slots.clear();
+	for (auto* bindings : { &textureBinding, &samplerBinding, &rootBinding, &constantBufferBinding, &uavBinding })
 	{
-		DirectX::ScratchImage tempImage;
-		DirectX::LoadFromWICFile(fileName.c_str(), DirectX::WIC_FLAGS_NONE, nullptr, tempImage);
-		DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false);
+		for (auto& bindingPair : *bindings)
+		{
+			BindingSlot slot = Layout.Add(bindingPair.first);
+			assert(slot.IsValid()); // same name twice or a hash collision
+			if (slot.IsValid())
+				Slots.push_back(&bindingPair.second);
+		}
 	}
 
-	const DirectX::TexMetadata& metaData = image.GetMetadata();
-	DXGI_FORMAT format = metaData.format;
+	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+	rootSignatureDesc.Init_1_1(rootParamVec.size(), &rootParamVec[0], 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-	if(!nonSRGB)
-		format = DirectX::MakeSRGB(format);
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+	featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
 
-	const bool is3D = metaData.dimension == DirectX::TEX_DIMENSION_TEXTURE3D;
+	if (FAILED(g_dx12_rhi->Device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+	{
+		featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+	}
 
-	D3D12_RESOURCE_DESC textureDesc = { };
-	textureDesc.MipLevels = UINT16(metaData.mipLevels);
-	textureDesc.Format = format;
-	textureDesc.Width = UINT64(metaData.width);
-	textureDesc.Height = UINT64(metaData.height);
-	textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-	textureDesc.DepthOrArraySize = is3D ? UINT16(metaData.depth) : UINT16(metaData.arraySize);
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Dimension = is3D ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	textureDesc.Alignment = 0;
+	ComPtr<ID3DBlob> signature;
+	ComPtr<ID3DBlob> error;
 
-	D3D12_HEAP_PROPERTIES heapProp;
-	heapProp.Type = D3D12_HEAP_TYPE_DEFAULT;
-	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProp.CreationNodeMask = 1;
-	heapProp.VisibleNodeMask = 1;
+	try
+	{
+		ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
+	}
+	catch (const std::exception& e)
+	{
+		OutputDebugStringA(reinterpret_cast<const char*>(error->GetBufferPointer()));
+	}
 
-	tex->textureDesc = textureDesc;
+	try
+	{
+		ThrowIfFailed(g_dx12_rhi->Device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&RS)));
+	}
+	catch (const std::exception& e)
+	{
+		OutputDebugStringA(reinterpret_cast<const char*>(error->GetBufferPointer()));
+	}
 
-	g_dx12_rhi->Device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &textureDesc,
-		D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&tex->resource));
-	tex->resource->SetName(fileName.c_str());
+	NAME_D3D12_OBJECT(RS);
+	if (IsCompute)
+	{
+		computePSODesc.CS = CD3DX12_SHADER_BYTECODE(cs->GetBufferPointer(), cs->GetBufferSize());
+		computePSODesc.pRootSignature = RS.Get();
+		HRESULT hr;
+		ThrowIfFailed(hr = g_dx12_rhi->Device->CreateComputePipelineState(&computePSODesc, IID_PPV_ARGS(&PSO)));
+		NAME_D3D12_OBJECT(PSO);
+		return SUCCEEDED(hr);
 
-	D3D12_HEAP_PROPERTIES heapPropUpload;
-	heapPropUpload.Type = D3D12_HEAP_TYPE_UPLOAD;
-	heapPropUpload.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapPropUpload.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapPropUpload.CreationNodeMask = 1;
-	heapPropUpload.VisibleNodeMask = 1;
+	}
+	else
+	{
+		graphicsPSODesc.VS = CD3DX12_SHADER_BYTECODE(vs->GetBufferPointer(), vs->GetBufferSize());
+		graphicsPSODesc.PS = CD3DX12_SHADER_BYTECODE(ps->GetBufferPointer(), ps->GetBufferSize());
 
-	ComPtr<ID3D12Resource> uploadHeap;
-	
-	const UINT subresourceCount = textureDesc.DepthOrArraySize * textureDesc.MipLevels;
-	const UINT64 uploadBufferSize = GetRequiredIntermediateSize(tex->resource.Get(), 0, subresourceCount);
-	D3D12_RESOURCE_DESC resDesc;
-	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	resDesc.Alignment = 0;
-	resDesc.Width = uploadBufferSize;
-	resDesc.Height = 1;
-	resDesc.DepthOrArraySize = 1;
-	resDesc.MipLevels = 1;// textureDesc.MipLevels;
-	resDesc.Format = DXGI_FORMAT_UNKNOWN;
-	resDesc.SampleDesc.Count = 1;
-	resDesc.SampleDesc.Quality = 0;
-	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		graphicsPSODesc.pRootSignature = RS.Get();
+		HRESULT hr;
+		ThrowIfFailed(hr = g_dx12_rhi->Device->CreateGraphicsPipelineState(&graphicsPSODesc, IID_PPV_ARGS(&PSO)));
+		NAME_D3D12_OBJECT(PSO);
+		return SUCCEEDED(hr);
+	}
+}
 
-	/*stringstream ss;
-	ss << "CreateTextureFromFile : " << uploadBufferSize << "\n";
-	OutputDebugStringA(ss.str().c_str());*/
+void PipelineStateObject::Apply(ID3D12GraphicsCommandList* CommandList)
+{
+	if (IsCompute)
+	{
+		CommandList->SetComputeRootSignature(RS.Get());
+		CommandList->SetPipelineState(PSO.Get());
+	}
+	else
+	{
+		CommandList->SetGraphicsRootSignature(RS.Get());
+		CommandList->SetPipelineState(PSO.Get());
+	}
+}
 
-	g_dx12_rhi->Device->CreateCommittedResource(&heapPropUpload, D3D12_HEAP_FLAG_NONE, &resDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&uploadHeap));
-	uploadHeap->SetName(L"TexUploadingHeap");
+// {9C4A7E21-5B3D-4F86-A0E2-6D1F38B7C455}
+static const GUID ResourceSerialGuid = { 0x9c4a7e21, 0x5b3d, 0x4f86, { 0xa0, 0xe2, 0x6d, 0x1f, 0x38, 0xb7, 0xc4, 0x55 } };
+static std::atomic<UINT64> NextResourceSerial = 1;
 
-	const UINT64 numSubResources = metaData.mipLevels * metaData.arraySize;
-	D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts = (D3D12_PLACED_SUBRESOURCE_FOOTPRINT*)_alloca(sizeof(D3D12_PLACED_SUBRESOURCE_FOOTPRINT) * numSubResources);
-	UINT32* numRows = (UINT32*)_alloca(sizeof(UINT32) * numSubResources);
-	UINT64* rowSizes = (UINT64*)_alloca(sizeof(UINT64) * numSubResources);
+UINT64 GetResourceSerial(ID3D12Resource* Resource)
+{
+	if (!Resource)
+		return 0;
+
+	UINT64 serial = 0;
+	UINT size = sizeof(serial);
+	if (SUCCEEDED(Resource->GetPrivateData(ResourceSerialGuid, &size, &serial)) && size == sizeof(serial))
+		return serial;
+
+	// first time this resource is asked for, it keeps the serial until it is released
+	serial = NextResourceSerial++;
+	ThrowIfFailed(Resource->SetPrivateData(ResourceSerialGuid, sizeof(serial), &serial));
+	return serial;
+}
 
-	UINT64 textureMemSize = 0;
-	g_dx12_rhi->Device->GetCopyableFootprints(&textureDesc, 0, UINT32(numSubResources), 0, layouts, numRows, rowSizes, &textureMemSize);
+void Texture::MakeStaticSRV()
+{
+	g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(SRV);
 
-	UINT8* uploadMem = nullptr;
+	D3D12_SHADER_RESOURCE_VIEW_DESC SrvDesc = {};
+	SrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	SrvDesc.Format = textureDesc.Format;
 
-	D3D12_RANGE readRange = { };
-	uploadHeap->Map(0, &readRange, reinterpret_cast<void**>(&uploadMem));
-	for (UINT64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
+	if(textureDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+		SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
+	else 
+		SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	SrvDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+	g_dx12_rhi->Device->CreateShaderResourceView(resource.Get(), &SrvDesc, SRV.CpuHandle);
+}
+
+void Texture::MakeFrameViews()
+{
+	ReleaseFrameViews();
+
+	if (textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
 	{
+		g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(UAV);
 
-		for (UINT64 mipIdx = 0; mipIdx < metaData.mipLevels; ++mipIdx)
-		{
-			const UINT64 subResourceIdx = mipIdx + (arrayIdx * metaData.mipLevels);
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+		uavDesc.Format = textureDesc.Format;
 
-			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& subResourceLayout = layouts[subResourceIdx];
-			const UINT64 subResourceHeight = numRows[subResourceIdx];
-			const UINT64 subResourcePitch = subResourceLayout.Footprint.RowPitch;
-			const UINT64 subResourceDepth = subResourceLayout.Footprint.Depth;
-			UINT8* dstSubResourceMem = reinterpret_cast<UINT8*>(uploadMem) + subResourceLayout.Offset;
+		g_dx12_rhi->Device->CreateUnorderedAccessView(resource.Get(), nullptr, &uavDesc, UAV.CpuHandle);
+		g_dx12_rhi->NumFrameViewsWritten++;
+	}
 
-			for (UINT64 z = 0; z < subResourceDepth; ++z)
-			{
-				const DirectX::Image* subImage = image.GetImage(mipIdx, arrayIdx, z);
-				const UINT8* srcSubResourceMem = subImage->pixels;
+	if (textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+	{
+		g_dx12_rhi->RTVDescriptorHeap->Alloc(RTV);
 
-				for (UINT64 y = 0; y < subResourceHeight; ++y)
-				{
-					memcpy(dstSubResourceMem, srcSubResourceMem, glm::min<float>(subResourcePitch, subImage->rowPitch));
-					dstSubResourceMem += subResourcePitch;
-					srcSubResourceMem += subImage->rowPitch;
-				}
-			}
-		}
+		g_dx12_rhi->Device->CreateRenderTargetView(resource.Get(), nullptr, RTV.CpuHandle);
+		g_dx12_rhi->NumFrameViewsWritten++;
 	}
-	uploadHeap->Unmap(0, nullptr);
 
-	for (UINT64 subResourceIdx = 0; subResourceIdx < numSubResources; ++subResourceIdx)
+	if (!isRT)
 	{
-		D3D12_TEXTURE_COPY_LOCATION dst = { };
-		dst.pResource = tex->resource.Get();
-		dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		dst.SubresourceIndex = UINT32(subResourceIdx);
-		D3D12_TEXTURE_COPY_LOCATION src = { };
-		src.pResource = uploadHeap.Get();
-		src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-		src.PlacedFootprint = layouts[subResourceIdx];
-		//src.PlacedFootprint.Offset += 0;// uploadContext.ResourceOffset;
-		//src.SubresourceIndex = UINT32(subResourceIdx);
+		g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(SRV);
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC SrvDesc = {};
+		SrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		if (textureDesc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+			SrvDesc.Format = DXGI_FORMAT_R32_FLOAT;// DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+		else
+			SrvDesc.Format = textureDesc.Format;
 
-		cmd->CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		SrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		SrvDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+		g_dx12_rhi->Device->CreateShaderResourceView(resource.Get(), &SrvDesc, SRV.CpuHandle);
+		g_dx12_rhi->NumFrameViewsWritten++;
 	}
 
-	D3D12_RESOURCE_BARRIER BarrierDesc = {};
-	BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	BarrierDesc.Transition.pResource = tex->resource.Get();
-	BarrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-	BarrierDesc.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-	BarrierDesc.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-	cmd->CmdList->ResourceBarrier(1, &BarrierDesc);
+	ViewResourceSerial = GetResourceSerial(resource.Get());
+}
 
-	g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
-	g_dx12_rhi->CmdQ->WaitGPU();
+void Texture::ReleaseFrameViews()
+{
+	if (!ViewResourceSerial)
+		return;
 
-	tex->MakeStaticSRV();
+	// the descriptors may still be read by frames in flight, the heaps hold them back until those are done
+	UAV.Free();
+	RTV.Free();
+	if (!isRT)
+		SRV.Free();
 
-	return tex;
+	ViewResourceSerial = 0;
 }
-static const D3D12_HEAP_PROPERTIES kDefaultHeapProps =
+
+UINT Texture::GetNumSubresources() const
 {
-	D3D12_HEAP_TYPE_DEFAULT,
-	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-	D3D12_MEMORY_POOL_UNKNOWN,
-	0,
-	0
-};
+	// a 3d texture's depth slices are in one subresource per mip
+	if (textureDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+		return textureDesc.MipLevels;
+	return UINT(textureDesc.MipLevels) * textureDesc.DepthOrArraySize;
+}
 
-static const D3D12_HEAP_PROPERTIES kUploadHeapProps =
+void Texture::MakeDSV()
 {
-	D3D12_HEAP_TYPE_UPLOAD,
-	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-	D3D12_MEMORY_POOL_UNKNOWN,
-	0,
-	0,
-};
+	g_dx12_rhi->DSVDescriptorHeap->Alloc(DSV);
 
-//RTAS* Mesh::CreateBLAS()
-//{
-//	RTAS* as = new  RTAS;
-//	as->mesh = this;
-//
-//	VertexBuffer* vb = static_cast<VertexBuffer*>(Vb.get());
-//	IndexBuffer* ib = static_cast<IndexBuffer*>(Ib.get());
-//	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
-//	geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-//	geomDesc.Triangles.VertexBuffer.StartAddress = vb->resource->GetGPUVirtualAddress();
-//	geomDesc.Triangles.VertexBuffer.StrideInBytes = VertexStride;;
-//	geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-//	geomDesc.Triangles.VertexCount = vb->numVertices;
-//	geomDesc.Triangles.IndexBuffer = ib->resource->GetGPUVirtualAddress();
-//	geomDesc.Triangles.IndexFormat = static_cast<DXGI_FORMAT>(IndexFormat);
-//	geomDesc.Triangles.IndexCount = ib->numIndices;
-//	geomDesc.Triangles.Transform3x4 = 0;
-//
-//	if(bTransparent)
-//		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
-//	else
-//		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
-//
-//
-//
-//	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
-//	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-//	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-//	inputs.NumDescs = 1;
-//	inputs.pGeometryDescs = &geomDesc;
-//	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-//
-//	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-//	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
-//
-//	{
-//		D3D12_RESOURCE_DESC bufDesc = {};
-//		bufDesc.Alignment = 0;
-//		bufDesc.DepthOrArraySize = 1;
-//		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-//		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-//		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-//		bufDesc.Height = 1;
-//		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-//		bufDesc.MipLevels = 1;
-//		bufDesc.SampleDesc.Count = 1;
-//		bufDesc.SampleDesc.Quality = 0;
-//		bufDesc.Width = info.ScratchDataSizeInBytes;
-//
-//		/*stringstream ss;
-//		ss << "blas->scratch : " << bufDesc.Width << "\n";
-//		OutputDebugStringA(ss.str().c_str());*/
-//
-//		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&as->Scratch));
-//	}
-//	
-//	{
-//		D3D12_RESOURCE_DESC bufDesc = {};
-//		bufDesc.Alignment = 0;
-//		bufDesc.DepthOrArraySize = 1;
-//		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-//		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-//		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-//		bufDesc.Height = 1;
-//		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-//		bufDesc.MipLevels = 1;
-//		bufDesc.SampleDesc.Count = 1;
-//		bufDesc.SampleDesc.Quality = 0;
-//		bufDesc.Width = info.ResultDataMaxSizeInBytes;
-//		
-//		/*stringstream ss;
-//		ss << "blas->result : " << bufDesc.Width << "\n";
-//		OutputDebugStringA(ss.str().c_str());*/
-//
-//
-//		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, IID_PPV_ARGS(&as->Result));
-//	}
-//
-//	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
-//
-//	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
-//	asDesc.Inputs = inputs;
-//	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
-//	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
-//
+	D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+	depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;// textureDesc.Format;// DXGI_FORMAT_D32_FLOAT;
+	depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
+	g_dx12_rhi->Device->CreateDepthStencilView(resource.Get(), &depthStencilDesc, DSV.CpuHandle);
+}
+
+std::shared_ptr<Texture> SimpleDX12::CreateTexture2DFromResource(ComPtr<ID3D12Resource> InResource)
+{
+	Texture* tex = new Texture;
+
+	if (InResource)
+	{
+		tex->resource = InResource;
+		tex->Tracked.Reset(D3D12_RESOURCE_STATE_PRESENT); // swap chain buffers
+	}
+
+	return shared_ptr<Texture>(tex);
+}
+
+ComPtr<ID3D12Resource> SimpleDX12::CreateResourceInPool(const shared_ptr<PlacedHeapPool>& Pool, D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitState, const D3D12_CLEAR_VALUE* ClearValue, shared_ptr<PlacedMemory>& OutMemory)
+{
+	ComPtr<ID3D12Resource> resource;
+
+	HeapAllocation allocation;
+	if (Pool && Pool->CreateResource(Desc, InitState, ClearValue, resource, allocation))
+	{
+		OutMemory = make_shared<PlacedMemory>();
+		OutMemory->Pool = Pool;
+		OutMemory->Allocation = allocation;
+		return resource;
+	}
+
+	D3D12_HEAP_PROPERTIES heapProp;
+	heapProp.Type = HeapType;
+	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapProp.CreationNodeMask = 1;
+	heapProp.VisibleNodeMask = 1;
+
+	ThrowIfFailed(Device->CreateCommittedResource(&heapProp, D3D12_HEAP_FLAG_NONE, &Desc, InitState, ClearValue, IID_PPV_ARGS(&resource)));
+	return resource;
+}
+
+shared_ptr<PlacedHeapPool> SimpleDX12::GetTexturePool(D3D12_RESOURCE_FLAGS Flags)
+{
+	if (Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		return RenderTargetPool;
+	return TexturePool;
+}
+
+shared_ptr<PlacedHeapPool> SimpleDX12::GetBufferPool(D3D12_HEAP_TYPE HeapType)
+{
+	if (HeapType == D3D12_HEAP_TYPE_DEFAULT)
+		return BufferPool;
+	if (HeapType == D3D12_HEAP_TYPE_UPLOAD)
+		return UploadBufferPool;
+	return nullptr;
+}
+
+Texture* SimpleDX12::CreateTexture2D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int mipLevels, std::optional<glm::vec4> clearColor)
+{
+	Texture* tex = new Texture;
+
+	D3D12_RESOURCE_DESC textureDesc = {};
+	textureDesc.MipLevels = mipLevels;
+	textureDesc.Format = format;
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.DepthOrArraySize = 1;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+
+	textureDesc.Flags = resFlags;
+
+	tex->textureDesc = textureDesc;
+
+	D3D12_RESOURCE_STATES ResStats = initResState;
+	if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+	{
+		D3D12_CLEAR_VALUE optimizedClearValue = {};
+		optimizedClearValue.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;
+		optimizedClearValue.DepthStencil = { 1.0f, 0 };
+
+		tex->resource = CreateResourceInPool(GetTexturePool(resFlags), D3D12_HEAP_TYPE_DEFAULT, textureDesc, ResStats, &optimizedClearValue, tex->Memory);
+
+
+		// create static dsv.
+		// TODO : should I make dsv dynamic? like rtv & uav.
+		g_dx12_rhi->DSVDescriptorHeap->Alloc(tex->DSV);
+
+		D3D12_DEPTH_STENCIL_VIEW_DESC depthStencilDesc = {};
+		depthStencilDesc.Format = DXGI_FORMAT_D32_FLOAT;// DXGI_FORMAT_D24_UNORM_S8_UINT;// textureDesc.Format;// DXGI_FORMAT_D32_FLOAT;
+		depthStencilDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+		depthStencilDesc.Flags = D3D12_DSV_FLAG_NONE;
+		g_dx12_rhi->Device->CreateDepthStencilView(tex->resource.Get(), &depthStencilDesc, tex->DSV.CpuHandle);
+	}
+	else
+	{
+		D3D12_CLEAR_VALUE optimizedClearValue = {};
+		optimizedClearValue.Format = format;
+
+		if (clearColor.has_value())
+		{
+			optimizedClearValue.Color[0] = clearColor.value().x;
+			optimizedClearValue.Color[1] = clearColor.value().y;
+			optimizedClearValue.Color[2] = clearColor.value().z;
+			optimizedClearValue.Color[3] = clearColor.value().w;
+		}
+		else
+		{
+			optimizedClearValue.Color[0] = 0.0f;
+			optimizedClearValue.Color[1] = 0.2f;
+			optimizedClearValue.Color[2] = 0.4f;
+			optimizedClearValue.Color[3] = 1.0f;
+		}
+		//D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
+
+		D3D12_CLEAR_VALUE* pClearValue = nullptr;
+		if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+			pClearValue = &optimizedClearValue;
+		tex->resource = CreateResourceInPool(GetTexturePool(resFlags), D3D12_HEAP_TYPE_DEFAULT, textureDesc, ResStats, pClearValue, tex->Memory);
+	}
+
+	// placed render targets start with undefined compression metadata, they have to be cleared, copied to or discarded before use
+	if (tex->Memory && (resFlags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)))
+	{
+		const D3D12_RESOURCE_STATES discardState = (resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) ? D3D12_RESOURCE_STATE_DEPTH_WRITE : D3D12_RESOURCE_STATE_RENDER_TARGET;
+
+		CommandList* cmd = CmdQ->AllocCmdList();
+		if (ResStats != discardState)
+			cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex->resource.Get(), ResStats, discardState));
+		cmd->CmdList->DiscardResource(tex->resource.Get(), nullptr);
+		if (ResStats != discardState)
+			cmd->CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tex->resource.Get(), discardState, ResStats));
+		CmdQ->ExecuteCommandList(cmd);
+	}
+
+	tex->Tracked.Reset(ResStats);
+
+	return tex;
+}
+
+Texture* SimpleDX12::CreateTexture3D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int depth, int mipLevels)
+{
+	Texture* tex = new Texture;
+
+	D3D12_RESOURCE_DESC textureDesc = {};
+	textureDesc.MipLevels = mipLevels;
+	textureDesc.Format = format;
+	textureDesc.Width = width;
+	textureDesc.Height = height;
+	textureDesc.DepthOrArraySize = depth;
+	textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+	textureDesc.Flags = resFlags;
+
+	tex->textureDesc = textureDesc;
+
+	D3D12_RESOURCE_STATES ResStats = initResState;
+
+	D3D12_CLEAR_VALUE* pClearValue = nullptr;
+
+	tex->resource = CreateResourceInPool(GetTexturePool(resFlags), D3D12_HEAP_TYPE_DEFAULT, textureDesc, ResStats, pClearValue, tex->Memory);
+	tex->Tracked.Reset(ResStats);
+
+	//shared_ptr<Texture> texPtr = shared_ptr<Texture>(tex);
+
+	/*if (resFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET || resFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL || resFlags & D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
+		g_dx12_rhi->DynamicTextures.push_back(tex);
+	else*/
+		tex->MakeStaticSRV();
+
+	return tex;
+}
+
+void Texture::UploadSRCData3D(D3D12_SUBRESOURCE_DATA* SrcData)
+{
+	// upload src data
+	if (SrcData)
+	{
+		UploadBatch immediate;
+		UploadBatch* batch = g_dx12_rhi->BeginUpload(immediate);
+
+		g_dx12_rhi->Uploads->UploadTexture(*batch, resource.Get(), 0, 1, SrcData);
+		g_dx12_rhi->Uploads->Acquire(*batch, resource.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+		g_dx12_rhi->EndUpload(batch);
+	}
+}
+
+Texture* SimpleDX12::CreateTextureFromFile(wstring fileName, bool nonSRGB)
+{
+	DirectX::ScratchImage image;
+	if (!LoadTextureImage(fileName, nonSRGB, image))
+		return nullptr;
+
+	return CreateTextureFromImage(image, fileName, nonSRGB);
+}
+
+Texture* SimpleDX12::CreateTextureFromImage(const DirectX::ScratchImage& image, const wstring& name, bool nonSRGB)
+{
+	UploadBatch immediate;
+	UploadBatch* batch = BeginUpload(immediate);
+
+	Texture* tex = CreateTextureFromImage(image, name, nonSRGB, *batch);
+
+	EndUpload(batch);
+
+	tex->MakeStaticSRV();
+
+	return tex;
+}
+
+bool SimpleDX12::ReadTextureFile(const wstring& fileName, bool nonSRGB, wstring& outFile, vector<UINT8>& outBytes)
+{
+	if (FileExists(fileName.c_str()) == false)
+		return false;
+
+	// a cooked dds (TextureCook) for this color space is already block compressed and has its mips, it's read in place of the source
+	// and takes the dds path in DecodeTextureImage
+	outFile = FindCookedTexture(fileName, nonSRGB);
+	if (outFile.empty())
+		outFile = fileName;
+
+	HANDLE file = CreateFileW(outFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	bool bRead = GetFileSizeEx(file, &size) && size.QuadPart < MAXDWORD;
+	if (bRead)
+	{
+		outBytes.resize(size_t(size.QuadPart));
+		DWORD read = 0;
+		bRead = ReadFile(file, outBytes.data(), DWORD(outBytes.size()), &read, nullptr) && read == outBytes.size();
+	}
+	CloseHandle(file);
+
+	return bRead;
+}
+
+bool SimpleDX12::DecodeTextureImage(const wstring& file, const vector<UINT8>& bytes, DirectX::ScratchImage& image)
+{
+	const std::wstring extension = GetFileExtension(file.c_str());
+
+	HRESULT hr;
+	if (extension == L"DDS" || extension == L"dds")
+	{
+		hr = DirectX::LoadFromDDSMemory(bytes.data(), bytes.size(), DirectX::DDS_FLAGS_NONE, nullptr, image);
+	}
+	else if (extension == L"TGA" || extension == L"tga")
+	{
+		DirectX::ScratchImage tempImage;
+		hr = DirectX::LoadFromTGAMemory(bytes.data(), bytes.size(), nullptr, tempImage);
+		if (SUCCEEDED(hr))
+			hr = DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false);
+	}
+	else
+	{
+		DirectX::ScratchImage tempImage;
+		hr = DirectX::LoadFromWICMemory(bytes.data(), bytes.size(), DirectX::WIC_FLAGS_NONE, nullptr, tempImage);
+		if (SUCCEEDED(hr))
+			hr = DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false);
+	}
+
+	return SUCCEEDED(hr);
+}
+
+bool SimpleDX12::LoadTextureImage(const wstring& fileName, bool nonSRGB, DirectX::ScratchImage& image)
+{
+	wstring file;
+	vector<UINT8> bytes;
+	return ReadTextureFile(fileName, nonSRGB, file, bytes) && DecodeTextureImage(file, bytes, image);
+}
+
+Texture* SimpleDX12::CreateTextureFromImage(const DirectX::ScratchImage& image, const wstring& name, bool nonSRGB, UploadBatch& Batch)
+{
+	Texture* tex = new Texture;
+
+	const DirectX::TexMetadata& metaData = image.GetMetadata();
+	DXGI_FORMAT format = metaData.format;
+
+	if(!nonSRGB)
+		format = DirectX::MakeSRGB(format);
+
+	const bool is3D = metaData.dimension == DirectX::TEX_DIMENSION_TEXTURE3D;
+
+	D3D12_RESOURCE_DESC textureDesc = { };
+	textureDesc.MipLevels = UINT16(metaData.mipLevels);
+	textureDesc.Format = format;
+	textureDesc.Width = UINT64(metaData.width);
+	textureDesc.Height = UINT64(metaData.height);
+	textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+	textureDesc.DepthOrArraySize = is3D ? UINT16(metaData.depth) : UINT16(metaData.arraySize);
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Dimension = is3D ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	textureDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	textureDesc.Alignment = 0;
+
+	tex->textureDesc = textureDesc;
+
+	tex->resource = CreateResourceInPool(TexturePool, D3D12_HEAP_TYPE_DEFAULT, textureDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, tex->Memory);
+	tex->resource->SetName(name.c_str());
+
+	const UINT numSubResources = UINT(metaData.mipLevels * metaData.arraySize);
+	vector<D3D12_SUBRESOURCE_DATA> subResources(numSubResources);
+	for (UINT64 arrayIdx = 0; arrayIdx < metaData.arraySize; ++arrayIdx)
+	{
+		for (UINT64 mipIdx = 0; mipIdx < metaData.mipLevels; ++mipIdx)
+		{
+			// depth slices of a 3d mip follow each other, SlicePitch apart
+			const DirectX::Image* subImage = image.GetImage(mipIdx, arrayIdx, 0);
+
+			D3D12_SUBRESOURCE_DATA& data = subResources[mipIdx + (arrayIdx * metaData.mipLevels)];
+			data.pData = subImage->pixels;
+			data.RowPitch = subImage->rowPitch;
+			data.SlicePitch = subImage->slicePitch;
+		}
+	}
+
+	Uploads->UploadTexture(Batch, tex->resource.Get(), 0, numSubResources, subResources.data());
+	Uploads->Acquire(Batch, tex->resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tex->Tracked.Reset(D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	return tex;
+}
+static const D3D12_HEAP_PROPERTIES kDefaultHeapProps =
+{
+	D3D12_HEAP_TYPE_DEFAULT,
+	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+	D3D12_MEMORY_POOL_UNKNOWN,
+	0,
+	0
+};
+
+static const D3D12_HEAP_PROPERTIES kUploadHeapProps =
+{
+	D3D12_HEAP_TYPE_UPLOAD,
+	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+	D3D12_MEMORY_POOL_UNKNOWN,
+	0,
+	0,
+};
+
+//RTAS* Mesh::CreateBLAS()
+//{
+//	RTAS* as = new  RTAS;
+//	as->mesh = this;
+//
+//	VertexBuffer* vb = static_cast<VertexBuffer*>(Vb.get());
+//	IndexBuffer* ib = static_cast<IndexBuffer*>(Ib.get());
+//	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+//	geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+//	geomDesc.Triangles.VertexBuffer.StartAddress = vb->resource->GetGPUVirtualAddress();
+//	geomDesc.Triangles.VertexBuffer.StrideInBytes = VertexStride;;
+//	geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+//	geomDesc.Triangles.VertexCount = vb->numVertices;
+//	geomDesc.Triangles.IndexBuffer = ib->resource->GetGPUVirtualAddress();
+//	geomDesc.Triangles.IndexFormat = static_cast<DXGI_FORMAT>(IndexFormat);
+//	geomDesc.Triangles.IndexCount = ib->numIndices;
+//	geomDesc.Triangles.Transform3x4 = 0;
+//
+//	if(bTransparent)
+//		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+//	else
+//		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+//
+//
+//
+//	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+//	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+//	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+//	inputs.NumDescs = 1;
+//	inputs.pGeometryDescs = &geomDesc;
+//	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+//
+//	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+//	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+//
+//	{
+//		D3D12_RESOURCE_DESC bufDesc = {};
+//		bufDesc.Alignment = 0;
+//		bufDesc.DepthOrArraySize = 1;
+//		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+//		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+//		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+//		bufDesc.Height = 1;
+//		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+//		bufDesc.MipLevels = 1;
+//		bufDesc.SampleDesc.Count = 1;
+//		bufDesc.SampleDesc.Quality = 0;
+//		bufDesc.Width = info.ScratchDataSizeInBytes;
+//
+//		/*stringstream ss;
+//		ss << "blas->scratch : " << bufDesc.Width << "\n";
+//		OutputDebugStringA(ss.str().c_str());*/
+//
+//		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&as->Scratch));
+//	}
+//	
+//	{
+//		D3D12_RESOURCE_DESC bufDesc = {};
+//		bufDesc.Alignment = 0;
+//		bufDesc.DepthOrArraySize = 1;
+//		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+//		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+//		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+//		bufDesc.Height = 1;
+//		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+//		bufDesc.MipLevels = 1;
+//		bufDesc.SampleDesc.Count = 1;
+//		bufDesc.SampleDesc.Quality = 0;
+//		bufDesc.Width = info.ResultDataMaxSizeInBytes;
+//		
+//		/*stringstream ss;
+//		ss << "blas->result : " << bufDesc.Width << "\n";
+//		OutputDebugStringA(ss.str().c_str());*/
+//
+//
+//		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, IID_PPV_ARGS(&as->Result));
+//	}
+//
+//	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+//
+//	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
+//	asDesc.Inputs = inputs;
+//	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
+//	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
+//
 //	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postInfo;
 //	cmd->CmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, &postInfo);
 //
@@ -1582,1601 +2141,2397 @@ static const D3D12_HEAP_PROPERTIES kUploadHeapProps =
 //	return as;
 //}
 
-RTAS* SimpleDX12::CreateTLAS(vector<RTAS*>& VecBottomLevelAS)
+RTAS* SimpleDX12::CreateTLAS(vector<RTAS*>& VecBottomLevelAS)
+{
+	RTAS* as = new  RTAS;
+
+	// First, get the size of the TLAS buffers and create them
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+	inputs.NumDescs = VecBottomLevelAS.size();
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
+	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+
+	{
+		D3D12_RESOURCE_DESC bufDesc = {};
+		bufDesc.Alignment = 0;
+		bufDesc.DepthOrArraySize = 1;
+		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufDesc.Height = 1;
+		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		bufDesc.MipLevels = 1;
+		bufDesc.SampleDesc.Count = 1;
+		bufDesc.SampleDesc.Quality = 0;
+		bufDesc.Width = info.ScratchDataSizeInBytes;
+
+		as->Scratch = CreateResourceInPool(AccelerationStructurePool, D3D12_HEAP_TYPE_DEFAULT, bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, as->ScratchMemory);
+	}
+
+	{
+		D3D12_RESOURCE_DESC bufDesc = {};
+		bufDesc.Alignment = 0;
+		bufDesc.DepthOrArraySize = 1;
+		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufDesc.Height = 1;
+		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		bufDesc.MipLevels = 1;
+		bufDesc.SampleDesc.Count = 1;
+		bufDesc.SampleDesc.Quality = 0;
+		bufDesc.Width = info.ResultDataMaxSizeInBytes;
+
+		as->Result = CreateResourceInPool(AccelerationStructurePool, D3D12_HEAP_TYPE_DEFAULT, bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, as->ResultMemory);
+	}
+
+	{
+		D3D12_RESOURCE_DESC bufDesc = {};
+		bufDesc.Alignment = 0;
+		bufDesc.DepthOrArraySize = 1;
+		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufDesc.Height = 1;
+		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		bufDesc.MipLevels = 1;
+		bufDesc.SampleDesc.Count = 1;
+		bufDesc.SampleDesc.Quality = 0;
+		bufDesc.Width = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * VecBottomLevelAS.size();
+
+		as->Instance = CreateResourceInPool(UploadBufferPool, D3D12_HEAP_TYPE_UPLOAD, bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, as->InstanceMemory);
+	}
+
+	if (VecBottomLevelAS.size() > 0)
+	{
+		D3D12_RAYTRACING_INSTANCE_DESC* pInstanceDesc;
+		as->Instance->Map(0, nullptr, (void**)&pInstanceDesc);
+		ZeroMemory(pInstanceDesc, sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * VecBottomLevelAS.size());
+
+		for (int i = 0; i < VecBottomLevelAS.size(); i++)
+		{
+			pInstanceDesc[i].InstanceID = i;                            // This value will be exposed to the shader via InstanceID()
+			pInstanceDesc[i].InstanceContributionToHitGroupIndex = i;   // This is the offset inside the shader-table. We only have a single geometry, so the offset 0
+			pInstanceDesc[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+			glm::mat4x4 mat = glm::transpose(VecBottomLevelAS[i]->mesh->transform);
+			memcpy(pInstanceDesc[i].Transform, &mat, sizeof(pInstanceDesc[i].Transform));
+			pInstanceDesc[i].AccelerationStructure = VecBottomLevelAS[i]->Result->GetGPUVirtualAddress();
+			pInstanceDesc[i].InstanceMask = 0xFF;
+		}
+		as->Instance->Unmap(0, nullptr);
+	}
+	
+	// Create the TLAS
+
+	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
+	asDesc.Inputs = inputs;
+
+	if (VecBottomLevelAS.size() > 0)
+		asDesc.Inputs.InstanceDescs = as->Instance->GetGPUVirtualAddress();
+	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
+	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postInfo;
+
+	cmd->CmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, &postInfo);
+
+	// We need to insert a UAV barrier before using the acceleration structures in a raytracing operation
+	D3D12_RESOURCE_BARRIER uavBarrier = {};
+	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	uavBarrier.UAV.pResource = as->Result.Get();
+	cmd->CmdList->ResourceBarrier(1, &uavBarrier);
+
+	// create acceleration structure srv (not shader-visible yet)
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.RaytracingAccelerationStructure.Location = as->Result->GetGPUVirtualAddress();
+
+	// copydescriptor needed when being used.
+	SRVCBVDescriptorHeapShaderVisible->Alloc(as->Descriptor);
+
+	g_dx12_rhi->Device->CreateShaderResourceView(nullptr, &srvDesc, as->Descriptor.CpuHandle);
+
+	g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
+
+	return as;
+}
+
+RTAS* SimpleDX12::CreateBLAS(GfxMesh* mesh)
+{
+	RTAS* as = new  RTAS;
+	as->mesh = mesh;
+
+	VertexBuffer* vb = static_cast<VertexBuffer*>(mesh->Vb.get());
+	IndexBuffer* ib = static_cast<IndexBuffer*>(mesh->Ib.get());
+
+	// mesh may live inside scene wide buffers. locate it with the offsets of its draw call.
+	GfxMesh::DrawCall& dc = mesh->Draws[0];
+	UINT indexStride = static_cast<DXGI_FORMAT>(mesh->IndexFormat) == DXGI_FORMAT_R32_UINT ? 4 : 2;
+
+	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+	geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+	geomDesc.Triangles.VertexBuffer.StartAddress = vb->resource->GetGPUVirtualAddress() + UINT64(dc.VertexBase) * mesh->VertexStride;
+	geomDesc.Triangles.VertexBuffer.StrideInBytes = mesh->VertexStride;;
+	geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+	geomDesc.Triangles.VertexCount = dc.VertexCount;
+	geomDesc.Triangles.IndexBuffer = ib->resource->GetGPUVirtualAddress() + UINT64(dc.IndexStart) * indexStride;
+	geomDesc.Triangles.IndexFormat = static_cast<DXGI_FORMAT>(mesh->IndexFormat);
+	geomDesc.Triangles.IndexCount = dc.IndexCount;
+	geomDesc.Triangles.Transform3x4 = 0;
+
+	if (mesh->bTransparent)
+		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+	else
+		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+
+
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+	inputs.NumDescs = 1;
+	inputs.pGeometryDescs = &geomDesc;
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+
+	{
+		D3D12_RESOURCE_DESC bufDesc = {};
+		bufDesc.Alignment = 0;
+		bufDesc.DepthOrArraySize = 1;
+		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufDesc.Height = 1;
+		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		bufDesc.MipLevels = 1;
+		bufDesc.SampleDesc.Count = 1;
+		bufDesc.SampleDesc.Quality = 0;
+		bufDesc.Width = info.ScratchDataSizeInBytes;
+
+		/*stringstream ss;
+		ss << "blas->scratch : " << bufDesc.Width << "\n";
+		OutputDebugStringA(ss.str().c_str());*/
+
+		as->Scratch = CreateResourceInPool(AccelerationStructurePool, D3D12_HEAP_TYPE_DEFAULT, bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, as->ScratchMemory);
+	}
+
+	{
+		D3D12_RESOURCE_DESC bufDesc = {};
+		bufDesc.Alignment = 0;
+		bufDesc.DepthOrArraySize = 1;
+		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufDesc.Height = 1;
+		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		bufDesc.MipLevels = 1;
+		bufDesc.SampleDesc.Count = 1;
+		bufDesc.SampleDesc.Quality = 0;
+		bufDesc.Width = info.ResultDataMaxSizeInBytes;
+
+		/*stringstream ss;
+		ss << "blas->result : " << bufDesc.Width << "\n";
+		OutputDebugStringA(ss.str().c_str());*/
+
+
+		as->Result = CreateResourceInPool(AccelerationStructurePool, D3D12_HEAP_TYPE_DEFAULT, bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, as->ResultMemory);
+	}
+
+	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
+	asDesc.Inputs = inputs;
+	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
+	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postInfo;
+	cmd->CmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, &postInfo);
+
+	/*D3D12_RESOURCE_BARRIER uavBarrier = {};
+	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	uavBarrier.UAV.pResource = as->Result.Get();
+	cmd->CmdList->ResourceBarrier(1, &uavBarrier);*/
+
+	g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
+
+	return as;
+}
+
+
+
+template<class BlotType>
+std::string convertBlobToString(BlotType* pBlob)
+{
+	std::vector<char> infoLog(pBlob->GetBufferSize() + 1);
+	memcpy(infoLog.data(), pBlob->GetBufferPointer(), pBlob->GetBufferSize());
+	infoLog[pBlob->GetBufferSize()] = 0;
+	return std::string(infoLog.data());
+}
+
+ComPtr<ID3DBlob> compileShaderLibrary(const WCHAR* filename, const WCHAR* targetString, std::optional<vector< DxcDefine>>  Defines)
+{
+	return g_dx12_rhi->CompileDXC(filename, L"", targetString, {}, Defines);
+}
+
+ComPtr<ID3DBlob> SimpleDX12::CreateShader(wstring FilePath, string EntryPoint, string Target)
+{
+	ComPtr<ID3DBlob> shader;
+
+#if defined(_DEBUG)
+	// Enable better shader debugging with the graphics debugging tools.
+	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	UINT compileFlags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif
+
+	ID3DBlob* compilationMsgs = nullptr;
+
+	try
+	{
+		ThrowIfFailed(D3DCompileFromFile(FilePath.c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, EntryPoint.c_str(), Target.c_str(), compileFlags, 0, &shader, &compilationMsgs));
+	}
+	catch (const std::exception& e)
+	{
+		string errorStr = reinterpret_cast<const char*>(compilationMsgs->GetBufferPointer());
+		OutputDebugStringA(errorStr.c_str());
+		g_dx12_rhi->errorString += errorStr;
+		compilationMsgs->Release();
+		return nullptr;
+	}
+
+	return shader;
+}
+
+ComPtr<ID3DBlob> SimpleDX12::CreateShaderDXC(wstring FileName, wstring EntryPoint, wstring Target, std::optional<vector< DxcDefine>> Defines)
+{
+	return CompileDXC(FileName, EntryPoint, Target, { L"/Zi" }, Defines);
+}
+
+void SimpleDX12::InitShaderCompiler()
+{
+	ThrowIfFailed(DxcHelper.Initialize());
+	ThrowIfFailed(DxcHelper.CreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), &DxcCompiler));
+	ThrowIfFailed(DxcHelper.CreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), &DxcLibrary));
+	ThrowIfFailed(DxcLibrary->CreateIncludeHandler(&DxcIncludeHandler));
+
+	// part of every key, another dxcompiler.dll compiles everything again
+	string version = "unknown";
+	ComPtr<IDxcVersionInfo> versionInfo;
+	if (SUCCEEDED(DxcCompiler.As(&versionInfo)))
+	{
+		UINT32 major = 0, minor = 0, flags = 0;
+		versionInfo->GetVersion(&major, &minor);
+		versionInfo->GetFlags(&flags);
+		version = to_string(major) + "." + to_string(minor) + " flags " + to_string(flags);
+
+		ComPtr<IDxcVersionInfo2> versionInfo2;
+		UINT32 commitCount = 0;
+		char* commitHash = nullptr;
+		if (SUCCEEDED(DxcCompiler.As(&versionInfo2)) && SUCCEEDED(versionInfo2->GetCommitInfo(&commitCount, &commitHash)))
+		{
+			version += " commit " + to_string(commitCount) + " " + commitHash;
+			CoTaskMemFree(commitHash);
+		}
+	}
+
+	Shaders = make_unique<ShaderCache>(L"ShaderCache", version);
+}
+
+ComPtr<ID3DBlob> SimpleDX12::CompileDXC(const wstring& FileName, const wstring& EntryPoint, const wstring& Target, vector<LPCWSTR> Arguments, const std::optional<vector<DxcDefine>>& Defines)
+{
+	ShaderCacheDesc desc;
+	desc.FileName = FileName;
+	desc.EntryPoint = EntryPoint;
+	desc.Target = Target;
+	if (Defines.has_value())
+	{
+		for (const DxcDefine& define : Defines.value())
+			desc.Defines.push_back(make_pair(wstring(define.Name), wstring(define.Value ? define.Value : L"")));
+	}
+	for (LPCWSTR argument : Arguments)
+		desc.Arguments.push_back(argument);
+
+	// Source is the file as the cache key hashed it, it isn't read again. includes go through the include handler.
+	auto compile = [&](const string& Source, vector<uint8_t>& OutBlob)
+	{
+		// the instances are shared, one compile at a time
+		lock_guard<mutex> lock(DxcMtx);
+
+		// Create blob from the string
+		ComPtr<IDxcBlobEncoding> pTextBlob;
+		DxcLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)Source.c_str(), (uint32_t)Source.size(), 0, &pTextBlob);
+
+		// Compile
+		ComPtr<IDxcOperationResult> pResult;
+		const DxcDefine* defines = nullptr;
+		UINT32 numDefines = 0;
+		if (Defines.has_value())
+		{
+			defines = Defines.value().data();
+			numDefines = (UINT32)Defines.value().size();
+		}
+		DxcCompiler->Compile(pTextBlob.Get(), FileName.c_str(), EntryPoint.c_str(), Target.c_str(), Arguments.data(), (UINT)Arguments.size(), defines, numDefines, DxcIncludeHandler.Get(), &pResult);
+
+		// Verify the result
+		HRESULT resultCode;
+		pResult->GetStatus(&resultCode);
+		if (FAILED(resultCode))
+		{
+			ComPtr<IDxcBlobEncoding> pError;
+			pResult->GetErrorBuffer(&pError);
+			std::string log = convertBlobToString(pError.Get());
+			g_dx12_rhi->errorString += log;
+			OutputDebugStringA(log.c_str());
+
+			return false;
+		}
+
+		ComPtr<IDxcBlob> pBlob;
+		pResult->GetResult(&pBlob);
+		const UINT8* data = static_cast<const UINT8*>(pBlob->GetBufferPointer());
+		OutBlob.assign(data, data + pBlob->GetBufferSize());
+		return true;
+	};
+
+	vector<uint8_t> dxil;
+	if (!Shaders->GetOrCompile(desc, compile, dxil))
+		return nullptr;
+
+	ComPtr<ID3DBlob> blob;
+	ThrowIfFailed(D3DCreateBlob(dxil.size(), &blob));
+	memcpy(blob->GetBufferPointer(), dxil.data(), dxil.size());
+	return blob;
+}
+
+struct DxilLibrary
+{
+	DxilLibrary(ComPtr<ID3DBlob> pBlob, const WCHAR* entryPoint[], uint32_t entryPointCount) : pShaderBlob(pBlob)
+	{
+		stateSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
+		stateSubobject.pDesc = &dxilLibDesc;
+
+		dxilLibDesc = {};
+		exportDesc.resize(entryPointCount);
+		exportName.resize(entryPointCount);
+		if (pBlob)
+		{
+			dxilLibDesc.DXILLibrary.pShaderBytecode = pBlob->GetBufferPointer();
+			dxilLibDesc.DXILLibrary.BytecodeLength = pBlob->GetBufferSize();
+			dxilLibDesc.NumExports = entryPointCount;
+			dxilLibDesc.pExports = exportDesc.data();
+
+			for (uint32_t i = 0; i < entryPointCount; i++)
+			{
+				exportName[i] = entryPoint[i];
+				exportDesc[i].Name = exportName[i].c_str();
+				exportDesc[i].Flags = D3D12_EXPORT_FLAG_NONE;
+				exportDesc[i].ExportToRename = nullptr;
+			}
+		}
+	};
+
+	DxilLibrary() : DxilLibrary(nullptr, nullptr, 0) {}
+
+	D3D12_DXIL_LIBRARY_DESC dxilLibDesc = {};
+	D3D12_STATE_SUBOBJECT stateSubobject{};
+	ComPtr<ID3DBlob> pShaderBlob;
+	std::vector<D3D12_EXPORT_DESC> exportDesc;
+	std::vector<std::wstring> exportName;
+};
+
+#define arraysize(a) (sizeof(a)/sizeof(a[0]))
+
+wstring StringToWString(const std::string &s)
+{
+	std::wstring wsTmp(s.begin(), s.end());
+
+	wstring ws = wsTmp;
+
+	return ws;
+}
+
+ComPtr<ID3D12RootSignature> CreateRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
+{
+	ComPtr<ID3DBlob> pSigBlob;
+	ComPtr<ID3DBlob> pErrorBlob;
+	HRESULT hr = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &pSigBlob, &pErrorBlob);
+	if (FAILED(hr))
+	{
+		std::string msg = convertBlobToString(pErrorBlob.Get());
+		OutputDebugStringA(msg.c_str());
+
+		return nullptr;
+	}
+	ComPtr<ID3D12RootSignature> pRootSig;
+	hr = pDevice->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&pRootSig));
+
+	return pRootSig;
+}
+
+struct HitProgram
 {
-	RTAS* as = new  RTAS;
+	HitProgram(LPCWSTR ahsExport, LPCWSTR chsExport, const std::wstring& name) : exportName(name)
+	{
+		desc = {};
+		desc.AnyHitShaderImport = ahsExport;
+		desc.ClosestHitShaderImport = chsExport;
+		desc.HitGroupExport = exportName.c_str();
 
-	// First, get the size of the TLAS buffers and create them
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
-	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-	inputs.NumDescs = VecBottomLevelAS.size();
-	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+		subObject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
+		subObject.pDesc = &desc;
+	}
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
-	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+	std::wstring exportName;
+	D3D12_HIT_GROUP_DESC desc;
+	D3D12_STATE_SUBOBJECT subObject;
+};
 
+struct ExportAssociation
+{
+	ExportAssociation(const WCHAR* exportNames[], uint32_t exportCount, const D3D12_STATE_SUBOBJECT* pSubobjectToAssociate)
 	{
-		D3D12_RESOURCE_DESC bufDesc = {};
-		bufDesc.Alignment = 0;
-		bufDesc.DepthOrArraySize = 1;
-		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-		bufDesc.Height = 1;
-		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		bufDesc.MipLevels = 1;
-		bufDesc.SampleDesc.Count = 1;
-		bufDesc.SampleDesc.Quality = 0;
-		bufDesc.Width = info.ScratchDataSizeInBytes;
+		association.NumExports = exportCount;
+		association.pExports = exportNames;
+		association.pSubobjectToAssociate = pSubobjectToAssociate;
 
-		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&as->Scratch));
+		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+		subobject.pDesc = &association;
 	}
 
+	D3D12_STATE_SUBOBJECT subobject = {};
+	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION association = {};
+};
+
+struct LocalRootSignature
+{
+	LocalRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
 	{
-		D3D12_RESOURCE_DESC bufDesc = {};
-		bufDesc.Alignment = 0;
-		bufDesc.DepthOrArraySize = 1;
-		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-		bufDesc.Height = 1;
-		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		bufDesc.MipLevels = 1;
-		bufDesc.SampleDesc.Count = 1;
-		bufDesc.SampleDesc.Quality = 0;
-		bufDesc.Width = info.ResultDataMaxSizeInBytes;
+		pRootSig = CreateRootSignature(pDevice, desc);
+		pInterface = pRootSig.Get();
+		subobject.pDesc = &pInterface;
+		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+	}
+	ComPtr<ID3D12RootSignature> pRootSig;
+	ID3D12RootSignature* pInterface = nullptr;
+	D3D12_STATE_SUBOBJECT subobject = {};
+};
 
-		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, IID_PPV_ARGS(&as->Result));
+struct GlobalRootSignature
+{
+	GlobalRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
+	{
+		pRootSig = CreateRootSignature(pDevice, desc);
+		pInterface = pRootSig.Get();
+		subobject.pDesc = &pInterface;
+		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
 	}
+	ComPtr<ID3D12RootSignature> pRootSig;
+	ID3D12RootSignature* pInterface = nullptr;
+	D3D12_STATE_SUBOBJECT subobject = {};
+};
 
+struct ShaderConfig
+{
+	ShaderConfig(uint32_t maxAttributeSizeInBytes, uint32_t maxPayloadSizeInBytes)
 	{
-		D3D12_RESOURCE_DESC bufDesc = {};
-		bufDesc.Alignment = 0;
-		bufDesc.DepthOrArraySize = 1;
-		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		bufDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-		bufDesc.Height = 1;
-		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		bufDesc.MipLevels = 1;
-		bufDesc.SampleDesc.Count = 1;
-		bufDesc.SampleDesc.Quality = 0;
-		bufDesc.Width = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * VecBottomLevelAS.size();
+		shaderConfig.MaxAttributeSizeInBytes = maxAttributeSizeInBytes;
+		shaderConfig.MaxPayloadSizeInBytes = maxPayloadSizeInBytes;
 
-		g_dx12_rhi->Device->CreateCommittedResource(&kUploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&as->Instance));
+		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
+		subobject.pDesc = &shaderConfig;
 	}
 
-	if (VecBottomLevelAS.size() > 0)
+	D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = {};
+	D3D12_STATE_SUBOBJECT subobject = {};
+};
+
+struct PipelineConfig
+{
+	PipelineConfig(uint32_t maxTraceRecursionDepth)
 	{
-		D3D12_RAYTRACING_INSTANCE_DESC* pInstanceDesc;
-		as->Instance->Map(0, nullptr, (void**)&pInstanceDesc);
-		ZeroMemory(pInstanceDesc, sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * VecBottomLevelAS.size());
+		config.MaxTraceRecursionDepth = maxTraceRecursionDepth;
 
-		for (int i = 0; i < VecBottomLevelAS.size(); i++)
-		{
-			pInstanceDesc[i].InstanceID = i;                            // This value will be exposed to the shader via InstanceID()
-			pInstanceDesc[i].InstanceContributionToHitGroupIndex = i;   // This is the offset inside the shader-table. We only have a single geometry, so the offset 0
-			pInstanceDesc[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-			glm::mat4x4 mat = glm::transpose(VecBottomLevelAS[i]->mesh->transform);
-			memcpy(pInstanceDesc[i].Transform, &mat, sizeof(pInstanceDesc[i].Transform));
-			pInstanceDesc[i].AccelerationStructure = VecBottomLevelAS[i]->Result->GetGPUVirtualAddress();
-			pInstanceDesc[i].InstanceMask = 0xFF;
-		}
-		as->Instance->Unmap(0, nullptr);
+		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG;
+		subobject.pDesc = &config;
 	}
-	
-	// Create the TLAS
 
-	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
-
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
-	asDesc.Inputs = inputs;
+	D3D12_RAYTRACING_PIPELINE_CONFIG config = {};
+	D3D12_STATE_SUBOBJECT subobject = {};
+};
 
-	if (VecBottomLevelAS.size() > 0)
-		asDesc.Inputs.InstanceDescs = as->Instance->GetGPUVirtualAddress();
-	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
-	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
+void RTPipelineStateObject::AddHitGroup(string name, string chs, string ahs)
+{
+	HitGroupInfo info;
+	info.name = StringToWString(name);
+	info.chs = StringToWString(chs);
+	info.ahs = StringToWString(ahs);
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postInfo;
+	VecHitGroup.push_back(info);
+}
 
-	cmd->CmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, &postInfo);
+void RTPipelineStateObject::AddShader(string shader, RTPipelineStateObject::ShaderType shaderType)
+{
+	ShaderBinding[shader].ShaderName = StringToWString(shader);;
+	ShaderBinding[shader].Type = shaderType;
+}
 
-	// We need to insert a UAV barrier before using the acceleration structures in a raytracing operation
-	D3D12_RESOURCE_BARRIER uavBarrier = {};
-	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-	uavBarrier.UAV.pResource = as->Result.Get();
-	cmd->CmdList->ResourceBarrier(1, &uavBarrier);
+void RTPipelineStateObject::BindUAV(string shader, string name, UINT baseRegister)
+{
+	if (shader == "global")
+	{
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
 
-	// create acceleration structure srv (not shader-visible yet)
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.RaytracingAccelerationStructure.Location = as->Result->GetGPUVirtualAddress();
+		binding.BaseRegister = baseRegister;
 
-	// copydescriptor needed when being used.
-	GeomtryDHRing->AllocDescriptor(as->Descriptor.CpuHandle, as->Descriptor.GpuHandle);
+		GlobalBinding.push_back(binding);
+	}
+	else
+	{
+		auto& bindingInfo = ShaderBinding[shader];
 
-	g_dx12_rhi->Device->CreateShaderResourceView(nullptr, &srvDesc, as->Descriptor.CpuHandle);
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
 
-	g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
+		binding.BaseRegister = baseRegister;
 
-	return as;
+		bindingInfo.Binding.push_back(binding);
+	}
 }
 
-RTAS* SimpleDX12::CreateBLAS(GfxMesh* mesh)
+void RTPipelineStateObject::BindSRV(string shader, string name, UINT baseRegister, UINT numDescriptors /*= 1*/, UINT registerSpace /*= 0*/)
 {
-	RTAS* as = new  RTAS;
-	as->mesh = mesh;
+	if (shader == "global")
+	{
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
 
-	VertexBuffer* vb = static_cast<VertexBuffer*>(mesh->Vb.get());
-	IndexBuffer* ib = static_cast<IndexBuffer*>(mesh->Ib.get());
-	D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
-	geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-	geomDesc.Triangles.VertexBuffer.StartAddress = vb->resource->GetGPUVirtualAddress();
-	geomDesc.Triangles.VertexBuffer.StrideInBytes = mesh->VertexStride;;
-	geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-	geomDesc.Triangles.VertexCount = vb->numVertices;
-	geomDesc.Triangles.IndexBuffer = ib->resource->GetGPUVirtualAddress();
-	geomDesc.Triangles.IndexFormat = static_cast<DXGI_FORMAT>(mesh->IndexFormat);
-	geomDesc.Triangles.IndexCount = ib->numIndices;
-	geomDesc.Triangles.Transform3x4 = 0;
+		binding.BaseRegister = baseRegister;
+		binding.NumDescriptors = numDescriptors;
+		binding.RegisterSpace = registerSpace;
 
-	if (mesh->bTransparent)
-		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+		GlobalBinding.push_back(binding);
+	}
 	else
-		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+	{
+		auto& bindingInfo = ShaderBinding[shader];
 
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
 
+		binding.BaseRegister = baseRegister;
+		binding.NumDescriptors = numDescriptors;
+		binding.RegisterSpace = registerSpace;
 
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
-	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-	inputs.NumDescs = 1;
-	inputs.pGeometryDescs = &geomDesc;
-	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+		bindingInfo.Binding.push_back(binding);
+	}
+}
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-	g_dx12_rhi->Device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
 
-	{
-		D3D12_RESOURCE_DESC bufDesc = {};
-		bufDesc.Alignment = 0;
-		bufDesc.DepthOrArraySize = 1;
-		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-		bufDesc.Height = 1;
-		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		bufDesc.MipLevels = 1;
-		bufDesc.SampleDesc.Count = 1;
-		bufDesc.SampleDesc.Quality = 0;
-		bufDesc.Width = info.ScratchDataSizeInBytes;
 
-		/*stringstream ss;
-		ss << "blas->scratch : " << bufDesc.Width << "\n";
-		OutputDebugStringA(ss.str().c_str());*/
+void RTPipelineStateObject::BindSampler(string shader, string name, UINT baseRegister)
+{
+	if (shader == "global")
+	{
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
 
-		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&as->Scratch));
-	}
+		binding.BaseRegister = baseRegister;
 
+		GlobalBinding.push_back(binding);
+	}
+	else
 	{
-		D3D12_RESOURCE_DESC bufDesc = {};
-		bufDesc.Alignment = 0;
-		bufDesc.DepthOrArraySize = 1;
-		bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		bufDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-		bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-		bufDesc.Height = 1;
-		bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		bufDesc.MipLevels = 1;
-		bufDesc.SampleDesc.Count = 1;
-		bufDesc.SampleDesc.Quality = 0;
-		bufDesc.Width = info.ResultDataMaxSizeInBytes;
+		auto& bindingInfo = ShaderBinding[shader];
 
-		/*stringstream ss;
-		ss << "blas->result : " << bufDesc.Width << "\n";
-		OutputDebugStringA(ss.str().c_str());*/
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
 
+		binding.BaseRegister = baseRegister;
 
-		g_dx12_rhi->Device->CreateCommittedResource(&kDefaultHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, IID_PPV_ARGS(&as->Result));
+		bindingInfo.Binding.push_back(binding);
 	}
+}
 
-	CommandList* cmd = g_dx12_rhi->CmdQ->AllocCmdList();
+void RTPipelineStateObject::BindCBV(string shader, string name, UINT baseRegister, UINT size)
+{
+	if (shader == "global")
+	{
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
 
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC asDesc = {};
-	asDesc.Inputs = inputs;
-	asDesc.DestAccelerationStructureData = as->Result->GetGPUVirtualAddress();
-	asDesc.ScratchAccelerationStructureData = as->Scratch->GetGPUVirtualAddress();
+		binding.BaseRegister = baseRegister;
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postInfo;
-	cmd->CmdList->BuildRaytracingAccelerationStructure(&asDesc, 0, &postInfo);
+		int div = size / 256;
+		binding.cbSize = (div) * 256;
 
-	/*D3D12_RESOURCE_BARRIER uavBarrier = {};
-	uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-	uavBarrier.UAV.pResource = as->Result.Get();
-	cmd->CmdList->ResourceBarrier(1, &uavBarrier);*/
+		if (size % 256 > 0)
+			binding.cbSize += 256;
 
-	g_dx12_rhi->CmdQ->ExecuteCommandList(cmd);
+		GlobalBinding.push_back(binding);
+	}
+	else
+	{
+		auto& bindingInfo = ShaderBinding[shader];
 
-	return as;
-}
+		BindingData binding;
+		binding.name = name;
+		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+
+		binding.BaseRegister = baseRegister;
 
+		int div = size / 256;
+		binding.cbSize = (div) * 256;
 
+		if (size % 256 > 0)
+			binding.cbSize += 256;
 
-template<class BlotType>
-std::string convertBlobToString(BlotType* pBlob)
-{
-	std::vector<char> infoLog(pBlob->GetBufferSize() + 1);
-	memcpy(infoLog.data(), pBlob->GetBufferPointer(), pBlob->GetBufferSize());
-	infoLog[pBlob->GetBufferSize()] = 0;
-	return std::string(infoLog.data());
+		bindingInfo.Binding.push_back(binding);
+	}
 }
 
-static dxc::DxcDllSupport gDxcDllHelper;
-
-ComPtr<ID3DBlob> compileShaderLibrary(const WCHAR* filename, const WCHAR* targetString, std::optional<vector< DxcDefine>>  Defines)
+void RTPipelineStateObject::BeginShaderTable()
 {
-	// Initialize the helper
-	gDxcDllHelper.Initialize();
-	ComPtr<IDxcCompiler> pCompiler;
-	ComPtr<IDxcLibrary> pLibrary;
-	ComPtr<IDxcIncludeHandler> dxcIncludeHandler;
-	gDxcDllHelper.CreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), &pCompiler);
-	gDxcDllHelper.CreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), &pLibrary);
-	pLibrary->CreateIncludeHandler(&dxcIncludeHandler);
+}
 
-	// Open and read the file
-	std::ifstream shaderFile(filename);
-	if (shaderFile.good() == false)
+void RTPipelineStateObject::SetGlobalBinding(CommandList* CommandList)
+{
+	UINT RPI = 0;
+	for (auto& bi : GlobalBinding)
 	{
-		//msgBox("Can't open file " + wstring_2_string(std::wstring(filename)));
-		return nullptr;
+		if (bi.Type == D3D12_DESCRIPTOR_RANGE_TYPE_CBV)
+			CommandList->CmdList.Get()->SetComputeRootConstantBufferView(RPI++, bi.GPUAddress);
+		else
+			CommandList->CmdList.Get()->SetComputeRootDescriptorTable(RPI++, bi.GPUHandle);
 	}
-	std::stringstream strStream;
-	strStream << shaderFile.rdbuf();
-	std::string shader = strStream.str();
+}
+
+void RTPipelineStateObject::EndShaderTable(UINT NumInstance)
+{
+	if (ShaderTable == nullptr)
+	{
+		// find biggiest binding size
+		ShaderTableEntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+		for (auto& sb : ShaderBinding)
+		{
+			UINT EntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 
-	// Create blob from the string
-	ComPtr<IDxcBlobEncoding> pTextBlob;
-	pLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)shader.c_str(), (uint32_t)shader.size(), 0, &pTextBlob);
+			BindingInfo& bindingInfo = sb.second;
 
-	// Compile
-	ComPtr<IDxcOperationResult> pResult;
+			D3D12_ROOT_PARAMETER RootParam = {};
+			for (auto& bindingData : bindingInfo.Binding)
+			{
+				EntrySize += 8;
+			}
 
-	DxcDefine* defines = nullptr;
-	UINT32 numDefines = 0;
-	if (Defines.has_value())
-	{
-		defines = &Defines.value()[0];
-		numDefines = Defines.value().size();
-	}
+			if (EntrySize > ShaderTableEntrySize)
+				ShaderTableEntrySize = EntrySize;
+		}
+		ShaderTableEntrySize = align_to(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, ShaderTableEntrySize);
 
-	pCompiler->Compile(pTextBlob.Get(), filename, L"", targetString, nullptr, 0, defines, numDefines, dxcIncludeHandler.Get(), &pResult);
 
-	// Verify the result
-	HRESULT resultCode;
-	pResult->GetStatus(&resultCode);
-	if (FAILED(resultCode))
-	{
-		ComPtr<IDxcBlobEncoding> pError;
-		pResult->GetErrorBuffer(&pError);
-		std::string log = convertBlobToString(pError.Get());
-		//msgBox("Compiler error:\n" + log);
-		g_dx12_rhi->errorString += log;
-		OutputDebugStringA(log.c_str());
+		UINT NumShaderTableEntry = 0;
+		for (auto& it : ShaderBinding)
+		{
+			BindingInfo& bi = it.second;
+			if (bi.Type == RAYGEN || bi.Type == MISS || bi.Type == ANYHIT)
+				NumShaderTableEntry++;
 
-		return nullptr;
+		}
+		NumShaderTableEntry += NumInstance * VecHitGroup.size();
+
+		ShaderTableSize = ShaderTableEntrySize * NumShaderTableEntry;
+
+		// allocate shader table
+		{
+			D3D12_RESOURCE_DESC bufDesc = {};
+			bufDesc.Alignment = 0;
+			bufDesc.DepthOrArraySize = 1;
+			bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			bufDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+			bufDesc.Format = DXGI_FORMAT_UNKNOWN;
+			bufDesc.Height = 1;
+			bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			bufDesc.MipLevels = 1;
+			bufDesc.SampleDesc.Count = 1;
+			bufDesc.SampleDesc.Quality = 0;
+			bufDesc.Width = ShaderTableSize * g_dx12_rhi->NumFrame;
+
+			ShaderTable = g_dx12_rhi->CreateResourceInPool(g_dx12_rhi->UploadBufferPool, D3D12_HEAP_TYPE_UPLOAD, bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, ShaderTableMemory);
+			NAME_D3D12_OBJECT(ShaderTable);
+		}
 	}
+	
 
-	ID3DBlob* pBlob;
-	pResult->GetResult((IDxcBlob**)&pBlob);
-	return ComPtr<ID3DBlob>(pBlob);
-}
+	// raygen : simple, it is just the begin of table
+	// miss : raygen + miss index * EntrySize
+	// hit : raygen + miss(N) + instanceIndex
+	uint8_t* pData;
+	HRESULT hr = ShaderTable->Map(0, nullptr, (void**)&pData);
 
-ComPtr<ID3DBlob> SimpleDX12::CreateShader(wstring FilePath, string EntryPoint, string Target)
-{
-	ComPtr<ID3DBlob> shader;
+	pData += ShaderTableSize * g_dx12_rhi->CurrentFrameIndex;;
 
-#if defined(_DEBUG)
-	// Enable better shader debugging with the graphics debugging tools.
-	UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#else
-	UINT compileFlags = D3DCOMPILE_OPTIMIZATION_LEVEL3;
-#endif
+	D3D12_GPU_VIRTUAL_ADDRESS va = ShaderTable->GetGPUVirtualAddress();
 
-	ID3DBlob* compilationMsgs = nullptr;
+	ComPtr<ID3D12StateObjectProperties> RtsoProps;
+	RTPipelineState->QueryInterface(IID_PPV_ARGS(&RtsoProps));
 
-	try
-	{
-		ThrowIfFailed(D3DCompileFromFile(FilePath.c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, EntryPoint.c_str(), Target.c_str(), compileFlags, 0, &shader, &compilationMsgs));
-	}
-	catch (const std::exception& e)
+	if (FAILED(hr))
 	{
-		string errorStr = reinterpret_cast<const char*>(compilationMsgs->GetBufferPointer());
-		OutputDebugStringA(errorStr.c_str());
-		g_dx12_rhi->errorString += errorStr;
-		compilationMsgs->Release();
-		return nullptr;
+		HRESULT hrRemoved = g_dx12_rhi->Device->GetDeviceRemovedReason();
+		if (FAILED(hrRemoved))
+		{
+			for (auto& sb : ShaderBinding)
+			{
+				BindingInfo& bindingInfo = sb.second;
+			}
+		}
+		
 	}
+	uint8_t* pDataThis = pData;
 
-	return shader;
-}
+	// calculate shader table offset for each shader
+	// raygen
+	int LastIndex = 0;
+	for (auto& sb : ShaderBinding)
+	{
+		BindingInfo& bindingInfo = sb.second;
+		if (bindingInfo.Type == ShaderType::RAYGEN)
+		{
+			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(bindingInfo.ShaderName.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+			pDataThis += D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 
-ComPtr<ID3DBlob> SimpleDX12::CreateShaderDXC(wstring FileName, wstring EntryPoint, wstring Target, std::optional<vector< DxcDefine>> Defines)
-{
-	// Initialize the helper
-	gDxcDllHelper.Initialize();
-	ComPtr<IDxcCompiler> pCompiler;
-	ComPtr<IDxcLibrary> pLibrary;
-	ComPtr<IDxcIncludeHandler> dxcIncludeHandler;
-	gDxcDllHelper.CreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), &pCompiler);
-	gDxcDllHelper.CreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), &pLibrary);
-	pLibrary->CreateIncludeHandler(&dxcIncludeHandler);
+			for (auto& bd : bindingInfo.Binding)
+			{
+				*(UINT64*)(pDataThis) = bd.GPUHandle.ptr;
 
-	// Open and read the file
-	std::ifstream shaderFile(FileName);
-	if (shaderFile.good() == false)
-	{
-		//msgBox("Can't open file " + wstring_2_string(std::wstring(filename)));
-		return nullptr;
+				pDataThis += sizeof(UINT64);
+			}
+		}
 	}
-	std::stringstream strStream;
-	strStream << shaderFile.rdbuf();
-	std::string shader = strStream.str();
-
-	// Create blob from the string
-	ComPtr<IDxcBlobEncoding> pTextBlob;
-	pLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)shader.c_str(), (uint32_t)shader.size(), 0, &pTextBlob);
+	LastIndex++;
 
-	// Compile
-	ComPtr<IDxcOperationResult> pResult;
-	DxcDefine* defines = nullptr;
-	UINT32 numDefines = 0;
-	if (Defines.has_value())
+	// miss
+	for (auto& sb : ShaderBinding)
 	{
-		defines = &Defines.value()[0];
-		numDefines = Defines.value().size();
-	}
+		pDataThis = pData + LastIndex * ShaderTableEntrySize;
 
-	vector<LPCWSTR> arguments;
-	arguments.push_back(L"/Zi");
-	pCompiler->Compile(pTextBlob.Get(), FileName.c_str(), EntryPoint.c_str(), Target.c_str(), arguments.data(), (UINT)arguments.size(), defines, numDefines, dxcIncludeHandler.Get(), &pResult);
+		BindingInfo& bindingInfo = sb.second;
+		if (bindingInfo.Type == ShaderType::MISS)
+		{
+			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(bindingInfo.ShaderName.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
 
-	// Verify the result
-	HRESULT resultCode;
-	pResult->GetStatus(&resultCode);
-	if (FAILED(resultCode))
-	{
-		ComPtr<IDxcBlobEncoding> pError;
-		pResult->GetErrorBuffer(&pError);
-		std::string log = convertBlobToString(pError.Get());
-		//msgBox("Compiler error:\n" + log);
-		g_dx12_rhi->errorString += log;
-		OutputDebugStringA(log.c_str());
+			LastIndex++;// multiple miss shader is available.
 
-		return nullptr;
+		}
 	}
 
-	ID3DBlob* pBlob;
-	pResult->GetResult((IDxcBlob**)&pBlob);
-	return ComPtr<ID3DBlob>(pBlob);
-}
-
-struct DxilLibrary
-{
-	DxilLibrary(ComPtr<ID3DBlob> pBlob, const WCHAR* entryPoint[], uint32_t entryPointCount) : pShaderBlob(pBlob)
+	// hit program 
+	for(int InstanceIndex=0;InstanceIndex<NumInstance;InstanceIndex++)
 	{
-		stateSubobject.Type = D3D12_STATE_SUBOBJECT_TYPE_DXIL_LIBRARY;
-		stateSubobject.pDesc = &dxilLibDesc;
 
-		dxilLibDesc = {};
-		exportDesc.resize(entryPointCount);
-		exportName.resize(entryPointCount);
-		if (pBlob)
+		//auto& HitProgramInfo = HitProgramBinding[InstanceIndex];
+		for (int iHitGroup = 0; iHitGroup < VecHitGroup.size(); iHitGroup++)
 		{
-			dxilLibDesc.DXILLibrary.pShaderBytecode = pBlob->GetBufferPointer();
-			dxilLibDesc.DXILLibrary.BytecodeLength = pBlob->GetBufferSize();
-			dxilLibDesc.NumExports = entryPointCount;
-			dxilLibDesc.pExports = exportDesc.data();
+			pDataThis = pData + LastIndex * ShaderTableEntrySize;
 
-			for (uint32_t i = 0; i < entryPointCount; i++)
+			map<UINT, HitProgramData>& HitProgram = VecHitGroup[iHitGroup].HitProgramBinding;
+			auto& HitProgramInfo = HitProgram[InstanceIndex];
+
+			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(VecHitGroup[iHitGroup].name.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+
+			pDataThis += D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+
+			for (auto& bd : HitProgramInfo.VecData)
 			{
-				exportName[i] = entryPoint[i];
-				exportDesc[i].Name = exportName[i].c_str();
-				exportDesc[i].Flags = D3D12_EXPORT_FLAG_NONE;
-				exportDesc[i].ExportToRename = nullptr;
+				*(UINT64*)(pDataThis) = bd.ptr;
+
+				pDataThis += sizeof(UINT64);
 			}
+			LastIndex++;
+
 		}
-	};
 
-	DxilLibrary() : DxilLibrary(nullptr, nullptr, 0) {}
+	}
 
-	D3D12_DXIL_LIBRARY_DESC dxilLibDesc = {};
-	D3D12_STATE_SUBOBJECT stateSubobject{};
-	ComPtr<ID3DBlob> pShaderBlob;
-	std::vector<D3D12_EXPORT_DESC> exportDesc;
-	std::vector<std::wstring> exportName;
-};
 
-#define arraysize(a) (sizeof(a)/sizeof(a[0]))
+	ShaderTable->Unmap(0, nullptr);
+}
 
-wstring StringToWString(const std::string &s)
+void RTPipelineStateObject::SetSRV(BindingSlot GlobalSlot, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle)
 {
-	std::wstring wsTmp(s.begin(), s.end());
+	assert(GlobalSlot.IsValid());
+	GlobalBinding[GlobalSlot.Index].GPUHandle = srvHandle;
+}
 
-	wstring ws = wsTmp;
+void RTPipelineStateObject::SetUAV(BindingSlot GlobalSlot, D3D12_GPU_DESCRIPTOR_HANDLE uavHandle)
+{
+	assert(GlobalSlot.IsValid());
+	GlobalBinding[GlobalSlot.Index].GPUHandle = uavHandle;
+}
 
-	return ws;
+void RTPipelineStateObject::SetSampler(BindingSlot GlobalSlot, Sampler* sampler)
+{
+	assert(GlobalSlot.IsValid());
+	GlobalBinding[GlobalSlot.Index].GPUHandle = sampler->Descriptor.GpuHandle;
 }
 
-ComPtr<ID3D12RootSignature> CreateRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
+void RTPipelineStateObject::SetCBVValue(BindingSlot GlobalSlot, void* pData)
 {
-	ComPtr<ID3DBlob> pSigBlob;
-	ComPtr<ID3DBlob> pErrorBlob;
-	HRESULT hr = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &pSigBlob, &pErrorBlob);
-	if (FAILED(hr))
-	{
-		std::string msg = convertBlobToString(pErrorBlob.Get());
-		OutputDebugStringA(msg.c_str());
+	assert(GlobalSlot.IsValid());
+	BindingData& bd = GlobalBinding[GlobalSlot.Index];
 
-		return nullptr;
-	}
-	ComPtr<ID3D12RootSignature> pRootSig;
-	hr = pDevice->CreateRootSignature(0, pSigBlob->GetBufferPointer(), pSigBlob->GetBufferSize(), IID_PPV_ARGS(&pRootSig));
+	auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
+	UINT64 GPUAddr = std::get<0>(Alloc);
+	UINT8* pMapped = std::get<1>(Alloc);
 
-	return pRootSig;
+	memcpy((void*)pMapped, pData, bd.cbSize);
+
+	// root CBV, see InitRS
+	bd.GPUAddress = GPUAddr;
 }
 
-struct HitProgram
+void RTPipelineStateObject::SetCBVValue(BindingSlot GlobalSlot, UINT64 GPUAddr)
 {
-	HitProgram(LPCWSTR ahsExport, LPCWSTR chsExport, const std::wstring& name) : exportName(name)
-	{
-		desc = {};
-		desc.AnyHitShaderImport = ahsExport;
-		desc.ClosestHitShaderImport = chsExport;
-		desc.HitGroupExport = exportName.c_str();
-
-		subObject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-		subObject.pDesc = &desc;
-	}
-
-	std::wstring exportName;
-	D3D12_HIT_GROUP_DESC desc;
-	D3D12_STATE_SUBOBJECT subObject;
-};
+	assert(GlobalSlot.IsValid());
+	GlobalBinding[GlobalSlot.Index].GPUAddress = GPUAddr;
+}
 
-struct ExportAssociation
+void RTPipelineStateObject::SetUAV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE uavHandle, INT instanceIndex /*= -1*/)
 {
-	ExportAssociation(const WCHAR* exportNames[], uint32_t exportCount, const D3D12_STATE_SUBOBJECT* pSubobjectToAssociate)
+	// each bindings of raygen/miss shader is unique to shader name.
+	if (instanceIndex == -1) // raygen, miss
 	{
-		association.NumExports = exportCount;
-		association.pExports = exportNames;
-		association.pSubobjectToAssociate = pSubobjectToAssociate;
+		if (shader == "global")
+		{
+			BindingSlot slot = GetGlobalSlot(bindingName);
+			if (slot.IsValid())
+				SetUAV(slot, uavHandle);
+		}
+		else
+		{
+			BindingInfo& bi = ShaderBinding[shader];
+			for (auto& bd : bi.Binding)
+			{
+				if (bd.name == bindingName)
+				{
+					bd.GPUHandle = uavHandle;
 
-		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-		subobject.pDesc = &association;
+				}
+			}
+		}
 	}
+	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
+	//{
+	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
+	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
+	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(uavHandle);
+	//}
+}
 
-	D3D12_STATE_SUBOBJECT subobject = {};
-	D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION association = {};
-};
-
-struct LocalRootSignature
+void RTPipelineStateObject::SetSRV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle, INT instanceIndex /*= -1*/)
 {
-	LocalRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
+	// each bindings of raygen/miss shader is unique to shader name.
+	if (instanceIndex == -1) // raygen, miss
 	{
-		pRootSig = CreateRootSignature(pDevice, desc);
-		pInterface = pRootSig.Get();
-		subobject.pDesc = &pInterface;
-		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+		if (shader == "global")
+		{
+			BindingSlot slot = GetGlobalSlot(bindingName);
+			if (slot.IsValid())
+				SetSRV(slot, srvHandle);
+		}
+		else
+		{
+			BindingInfo& bi = ShaderBinding[shader];
+			for (auto& bd : bi.Binding)
+			{
+				if (bd.name == bindingName)
+				{
+					bd.GPUHandle = srvHandle;
+				}
+			}
+		}
 	}
-	ComPtr<ID3D12RootSignature> pRootSig;
-	ID3D12RootSignature* pInterface = nullptr;
-	D3D12_STATE_SUBOBJECT subobject = {};
-};
+	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
+	//{
+	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
+	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
+	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(srvHandle);
+	//}
+}
 
-struct GlobalRootSignature
+void RTPipelineStateObject::ResetHitProgram(UINT instanceIndex)
 {
-	GlobalRootSignature(ComPtr<ID3D12Device5> pDevice, const D3D12_ROOT_SIGNATURE_DESC& desc)
+	for (auto& HG : VecHitGroup)
 	{
-		pRootSig = CreateRootSignature(pDevice, desc);
-		pInterface = pRootSig.Get();
-		subobject.pDesc = &pInterface;
-		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
+		HG.HitProgramBinding[instanceIndex].VecData.clear();
 	}
-	ComPtr<ID3D12RootSignature> pRootSig;
-	ID3D12RootSignature* pInterface = nullptr;
-	D3D12_STATE_SUBOBJECT subobject = {};
-};
+}
 
-struct ShaderConfig
+void RTPipelineStateObject::StartHitProgram(string HitGroup, UINT instanceIndex)
 {
-	ShaderConfig(uint32_t maxAttributeSizeInBytes, uint32_t maxPayloadSizeInBytes)
+	map<UINT, HitProgramData>* HitProgram =nullptr;
+	for (auto& HG : VecHitGroup)
 	{
-		shaderConfig.MaxAttributeSizeInBytes = maxAttributeSizeInBytes;
-		shaderConfig.MaxPayloadSizeInBytes = maxPayloadSizeInBytes;
-
-		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
-		subobject.pDesc = &shaderConfig;
+		if (HG.name == StringToWString(HitGroup))
+			HitProgram = &HG.HitProgramBinding;
 	}
+	//(*HitProgram)[instanceIndex].HitGroupName = StringToWString(HitGroup);
+	(*HitProgram)[instanceIndex].VecData.clear();
+}
 
-	D3D12_RAYTRACING_SHADER_CONFIG shaderConfig = {};
-	D3D12_STATE_SUBOBJECT subobject = {};
-};
-
-struct PipelineConfig
+void RTPipelineStateObject::AddDescriptor2HitProgram(string HitGroup, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle, UINT instanceIndex)
 {
-	PipelineConfig(uint32_t maxTraceRecursionDepth)
+	map<UINT, HitProgramData>* HitProgram = nullptr;
+	for (auto& HG : VecHitGroup)
 	{
-		config.MaxTraceRecursionDepth = maxTraceRecursionDepth;
-
-		subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_PIPELINE_CONFIG;
-		subobject.pDesc = &config;
+		if (HG.name == StringToWString(HitGroup))
+			HitProgram = &HG.HitProgramBinding;
 	}
 
-	D3D12_RAYTRACING_PIPELINE_CONFIG config = {};
-	D3D12_STATE_SUBOBJECT subobject = {};
-};
-
-void RTPipelineStateObject::AddHitGroup(string name, string chs, string ahs)
-{
-	HitGroupInfo info;
-	info.name = StringToWString(name);
-	info.chs = StringToWString(chs);
-	info.ahs = StringToWString(ahs);
-
-	VecHitGroup.push_back(info);
+	(*HitProgram)[instanceIndex].VecData.push_back(srvHandle);
 }
 
-void RTPipelineStateObject::AddShader(string shader, RTPipelineStateObject::ShaderType shaderType)
+void RTPipelineStateObject::SetSampler(string shader, string bindingName, Sampler* sampler, INT instanceIndex /*= -1*/)
 {
-	ShaderBinding[shader].ShaderName = StringToWString(shader);;
-	ShaderBinding[shader].Type = shaderType;
+	// each bindings of raygen/miss shader is unique to shader name.
+	if (instanceIndex == -1) // raygen, miss
+	{
+		if (shader == "global")
+		{
+			BindingSlot slot = GetGlobalSlot(bindingName);
+			if (slot.IsValid())
+				SetSampler(slot, sampler);
+		}
+		else
+		{
+			BindingInfo& bi = ShaderBinding[shader];
+			for (auto& bd : bi.Binding)
+			{
+				if (bd.name == bindingName)
+				{
+					bd.GPUHandle = sampler->Descriptor.GpuHandle;
+				}
+			}
+		}
+	}
+	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
+	//{
+	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
+	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
+	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(sampler->GpuHandle);
+	//}
 }
 
-void RTPipelineStateObject::BindUAV(string shader, string name, UINT baseRegister)
+void RTPipelineStateObject::SetCBVValue(string shader, string bindingName, void* pData, INT instanceIndex /*= -1*/)
 {
-	if (shader == "global")
-	{
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-
-		binding.BaseRegister = baseRegister;
-
-		GlobalBinding.push_back(binding);
-	}
-	else
+	// each bindings of raygen/miss shader is unique to shader name.
+	if (instanceIndex == -1) // raygen, miss
 	{
-		auto& bindingInfo = ShaderBinding[shader];
-
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+		if (shader == "global")
+		{
+			BindingSlot slot = GetGlobalSlot(bindingName);
+			assert(slot.IsValid());
+			SetCBVValue(slot, pData);
+		}
+		else
+		{
+			bool bFound = false;
 
-		binding.BaseRegister = baseRegister;
+			BindingInfo& bi = ShaderBinding[shader];
+			for (auto& bd : bi.Binding)
+			{
+				if (bd.name == bindingName)
+				{
+					auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
+					UINT64 GPUAddr = std::get<0>(Alloc);
+					UINT8* pMapped = std::get<1>(Alloc);
 
-		bindingInfo.Binding.push_back(binding);
-	}
-}
+					memcpy((void*)pMapped, pData, bd.cbSize);
 
-void RTPipelineStateObject::BindSRV(string shader, string name, UINT baseRegister)
-{
-	if (shader == "global")
-	{
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
+					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
 
-		binding.BaseRegister = baseRegister;
+					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
+					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
 
-		GlobalBinding.push_back(binding);
+					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+					cbvDesc.BufferLocation = GPUAddr;
+					cbvDesc.SizeInBytes = bd.cbSize;
+					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+
+					bd.GPUHandle = GpuHandle;
+				
+					bFound = true;
+				}
+			}
+			assert(bFound == true);
+		}
 	}
-	else
-	{
-		auto& bindingInfo = ShaderBinding[shader];
+	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
+	//{
+	//	// SetXXX should be called by the binding order, because it is "push_back"ed to vector.
+	//	BindingInfo& bi = ShaderBinding[shader];
+	//	for (auto&bd : bi.Binding)
+	//	{
+	//		if (bd.name == bindingName)
+	//		{
+	//			auto& cb = bd.cbs[g_dx12_rhi->CurrentFrameIndex];
+	//			UINT8* pMapped = (UINT8*)cb->MemMapped + size * instanceIndex;
+	//			memcpy((void*)pMapped, pData, size);
 
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+	//			HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
 
-		binding.BaseRegister = baseRegister;
+	//			D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
+	//			D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
 
-		bindingInfo.Binding.push_back(binding);
-	}
-}
+	//			// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
+	//			g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
 
+	//			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+	//			cbvDesc.BufferLocation = cb->resource->GetGPUVirtualAddress();
+	//			cbvDesc.SizeInBytes = cb->Size;
+	//			g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
 
+	//			HitProgramBindingCHS[instanceIndex].VecData.push_back(GpuHandle);
+	//		}
+	//	}
+	//}
+}
 
-void RTPipelineStateObject::BindSampler(string shader, string name, UINT baseRegister)
+void RTPipelineStateObject::SetCBVValue(string shader, string bindingName, UINT64 GPUAddr, INT instanceIndex /*= -1*/)
 {
-	if (shader == "global")
+	// each bindings of raygen/miss shader is unique to shader name.
+	if (instanceIndex == -1) // raygen, miss
 	{
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+		if (shader == "global")
+		{
+			BindingSlot slot = GetGlobalSlot(bindingName);
+			assert(slot.IsValid());
+			SetCBVValue(slot, GPUAddr);
+		}
+		else
+		{
+			bool bFound = false;
 
-		binding.BaseRegister = baseRegister;
+			BindingInfo& bi = ShaderBinding[shader];
+			for (auto& bd : bi.Binding)
+			{
+				if (bd.name == bindingName)
+				{
+					/*auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
+					UINT64 GPUAddr = std::get<0>(Alloc);
+					UINT8* pMapped = std::get<1>(Alloc);
 
-		GlobalBinding.push_back(binding);
-	}
-	else
-	{
-		auto& bindingInfo = ShaderBinding[shader];
+					memcpy((void*)pMapped, pData, bd.cbSize);*/
 
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER;
+					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
+					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
 
-		binding.BaseRegister = baseRegister;
+					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
+					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
 
-		bindingInfo.Binding.push_back(binding);
+					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+					cbvDesc.BufferLocation = GPUAddr;
+					cbvDesc.SizeInBytes = bd.cbSize;
+					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+
+					bd.GPUHandle = GpuHandle;
+
+					bFound = true;
+				}
+			}
+			assert(bFound == true);
+		}
 	}
 }
 
-void RTPipelineStateObject::BindCBV(string shader, string name, UINT baseRegister, UINT size)
+bool RTPipelineStateObject::InitRS(string ShaderFile, std::optional<vector< DxcDefine>>  Defines)
 {
-	if (shader == "global")
-	{
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+	vector<D3D12_STATE_SUBOBJECT> subobjects;
 
-		binding.BaseRegister = baseRegister;
+	// dxil + Hitgroup count + RS + Export + shaderconfig + export + pipelineconfig + global RS
+	int numSubobjects = 1 + VecHitGroup.size() + ShaderBinding.size() * 2 + 2 + 1 + 1;
+	subobjects.resize(numSubobjects);
 
-		int div = size / 256;
-		binding.cbSize = (div) * 256;
+	uint32_t index = 0;
 
-		if (size % 256 > 0)
-			binding.cbSize += 256;
+	// dxil lib
+	wstring wShaderFile = StringToWString(ShaderFile);
+	ComPtr<ID3DBlob> pDxilLib = compileShaderLibrary(wShaderFile.c_str(), L"lib_6_3", Defines);
 
-		GlobalBinding.push_back(binding);
-	}
-	else
+	vector<const WCHAR*> entryPoints;
+	entryPoints.reserve(ShaderBinding.size());
+	for (auto& sb : ShaderBinding)
 	{
-		auto& bindingInfo = ShaderBinding[shader];
+		entryPoints.push_back(sb.second.ShaderName.c_str());
+	}
 
-		BindingData binding;
-		binding.name = name;
-		binding.Type = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
 
-		binding.BaseRegister = baseRegister;
+	DxilLibrary dxilLib = DxilLibrary(pDxilLib, entryPoints.data(), entryPoints.size());
+	subobjects[index++] = dxilLib.stateSubobject; // 0 Library
 
-		int div = size / 256;
-		binding.cbSize = (div) * 256;
+	// hit group
+	vector<D3D12_HIT_GROUP_DESC> vecHitDesc;
+	vecHitDesc.reserve(VecHitGroup.size());
+	for (auto&hi : VecHitGroup)
+	{
+		const WCHAR* ahs = nullptr;
+		const WCHAR* chs = nullptr;
+		if (hi.chs.length() > 0)
+			chs = hi.chs.c_str();
+		if (hi.ahs.length() > 0)
+			ahs = hi.ahs.c_str();
 
-		if (size % 256 > 0)
-			binding.cbSize += 256;
 
-		bindingInfo.Binding.push_back(binding);
-	}
-}
+		//HitProgram hitProgram(ahs, chs, hi.name.c_str());
+		D3D12_HIT_GROUP_DESC HitGroupDesc = {};
+		HitGroupDesc.HitGroupExport = hi.name.c_str();
+		HitGroupDesc.ClosestHitShaderImport = chs;
+		HitGroupDesc.AnyHitShaderImport = ahs;
+		HitGroupDesc.IntersectionShaderImport = nullptr;
+		vecHitDesc.push_back(HitGroupDesc);
 
-void RTPipelineStateObject::BeginShaderTable()
-{
-}
+		D3D12_STATE_SUBOBJECT subObject;
+		subObject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
+		subObject.pDesc = &vecHitDesc.back();
 
-void RTPipelineStateObject::SetGlobalBinding(CommandList* CommandList)
-{
-	UINT RPI = 0;
-	for (auto& bi : GlobalBinding)
-	{
-		CommandList->CmdList.Get()->SetComputeRootDescriptorTable(RPI++, bi.GPUHandle);
+		subobjects[index++] = subObject; // 1 Hit Group
 	}
-}
 
-void RTPipelineStateObject::EndShaderTable(UINT NumInstance)
-{
-	if (ShaderTable == nullptr)
+	// root signature
+	BindingInfo* pBI = nullptr;
+	vector< D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION> vecAssociation;
+	vecAssociation.reserve(ShaderBinding.size());
+	for (auto& sb : ShaderBinding)
 	{
-		// find biggiest binding size
-		ShaderTableEntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-		for (auto& sb : ShaderBinding)
-		{
-			UINT EntrySize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
-
-			BindingInfo& bindingInfo = sb.second;
-
-			D3D12_ROOT_PARAMETER RootParam = {};
-			for (auto& bindingData : bindingInfo.Binding)
-			{
-				EntrySize += 8;
-			}
+		BindingInfo& bindingInfo = sb.second;
+		pBI = &bindingInfo;
+		
+		D3D12_ROOT_SIGNATURE_DESC Desc = {};
+		Desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 
-			if (EntrySize > ShaderTableEntrySize)
-				ShaderTableEntrySize = EntrySize;
-		}
-		ShaderTableEntrySize = align_to(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, ShaderTableEntrySize);
+		vector<D3D12_ROOT_PARAMETER> rootParamVec;
+		vector<D3D12_DESCRIPTOR_RANGE> Ranges;
+		Ranges.resize(bindingInfo.Binding.size());
 
+		int i = 0;
 
-		UINT NumShaderTableEntry = 0;
-		for (auto& it : ShaderBinding)
+		if (bindingInfo.Binding.size() > 0)
 		{
-			BindingInfo& bi = it.second;
-			if (bi.Type == RAYGEN || bi.Type == MISS || bi.Type == ANYHIT)
-				NumShaderTableEntry++;
-
-		}
-		NumShaderTableEntry += NumInstance * VecHitGroup.size();
+			// create root signature
+			
+			for (auto& bindingData : bindingInfo.Binding)
+			{
+				D3D12_DESCRIPTOR_RANGE& Range = Ranges[i++];;
+				Range.RangeType = bindingData.Type;
+				Range.BaseShaderRegister = bindingData.BaseRegister;
+				Range.NumDescriptors = bindingData.NumDescriptors;
+				Range.RegisterSpace = bindingData.RegisterSpace;
+				Range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+				//Ranges.push_back(Range);
 
-		ShaderTableSize = ShaderTableEntrySize * NumShaderTableEntry;
 
-		// allocate shader table
-		{
-			D3D12_RESOURCE_DESC bufDesc = {};
-			bufDesc.Alignment = 0;
-			bufDesc.DepthOrArraySize = 1;
-			bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-			bufDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-			bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-			bufDesc.Height = 1;
-			bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-			bufDesc.MipLevels = 1;
-			bufDesc.SampleDesc.Count = 1;
-			bufDesc.SampleDesc.Quality = 0;
-			bufDesc.Width = ShaderTableSize * g_dx12_rhi->NumFrame;
+				D3D12_ROOT_PARAMETER RootParam = {};
+				RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+				RootParam.DescriptorTable.NumDescriptorRanges = 1;// Ranges.size();
+				RootParam.DescriptorTable.pDescriptorRanges = &Range;// Ranges.data();
+				RootParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-			const D3D12_HEAP_PROPERTIES kUploadHeapProps =
-			{
-				D3D12_HEAP_TYPE_UPLOAD,
-				D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-				D3D12_MEMORY_POOL_UNKNOWN,
-				0,
-				0,
-			};
+				rootParamVec.push_back(RootParam);
+			}
 
-			g_dx12_rhi->Device->CreateCommittedResource(&kUploadHeapProps, D3D12_HEAP_FLAG_NONE, &bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&ShaderTable));
-			NAME_D3D12_OBJECT(ShaderTable);
-		}
-	}
-	
+			Desc.NumParameters = rootParamVec.size();
+			Desc.pParameters = rootParamVec.data();
+		}
 
-	// raygen : simple, it is just the begin of table
-	// miss : raygen + miss index * EntrySize
-	// hit : raygen + miss(N) + instanceIndex
-	uint8_t* pData;
-	HRESULT hr = ShaderTable->Map(0, nullptr, (void**)&pData);
+		bindingInfo.RS = CreateRootSignature(g_dx12_rhi->Device, Desc);
+		NAME_D3D12_OBJECT(bindingInfo.RS);
 
-	pData += ShaderTableSize * g_dx12_rhi->CurrentFrameIndex;;
+		bindingInfo.pInterface = bindingInfo.RS.Get();
+		bindingInfo.subobject.pDesc = &bindingInfo.pInterface;
+		bindingInfo.subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
+		subobjects[index] = bindingInfo.subobject;
+		uint32_t RSIndex = index++;
 
-	D3D12_GPU_VIRTUAL_ADDRESS va = ShaderTable->GetGPUVirtualAddress();
+		// export association
+		bindingInfo.ExportName = { bindingInfo.ShaderName.c_str() };
 
-	ComPtr<ID3D12StateObjectProperties> RtsoProps;
-	RTPipelineState->QueryInterface(IID_PPV_ARGS(&RtsoProps));
+		D3D12_STATE_SUBOBJECT subobjectAssociation = {};
+		D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION association = {};
+		association.NumExports = 1;
+		association.pExports = bindingInfo.ExportName.data();
+		association.pSubobjectToAssociate = &subobjects[RSIndex];
+		vecAssociation.push_back(association);
+		subobjectAssociation.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
+		subobjectAssociation.pDesc = &vecAssociation.back();
 
-	if (FAILED(hr))
-	{
-		HRESULT hrRemoved = g_dx12_rhi->Device->GetDeviceRemovedReason();
-		if (FAILED(hrRemoved))
-		{
-			for (auto& sb : ShaderBinding)
-			{
-				BindingInfo& bindingInfo = sb.second;
-			}
-		}
-		
+		subobjects[index++] = subobjectAssociation;
 	}
-	uint8_t* pDataThis = pData;
 
-	// calculate shader table offset for each shader
-	// raygen
-	int LastIndex = 0;
+	// shader config
+	ShaderConfig shaderConfig(MaxAttributeSizeInBytes, MaxPayloadSizeInBytes);
+	D3D12_STATE_SUBOBJECT* shaderConfigSubObject = &subobjects[index];
+	subobjects[index++] = shaderConfig.subobject;
+
+	// shaderconfig export association
+	vector<const WCHAR*> vecShaderExports;
+	entryPoints.reserve(ShaderBinding.size());
 	for (auto& sb : ShaderBinding)
 	{
-		BindingInfo& bindingInfo = sb.second;
-		if (bindingInfo.Type == ShaderType::RAYGEN)
-		{
-			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(bindingInfo.ShaderName.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
-			pDataThis += D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+		vecShaderExports.push_back(sb.second.ShaderName.c_str());
+	}
 
-			for (auto& bd : bindingInfo.Binding)
-			{
-				*(UINT64*)(pDataThis) = bd.GPUHandle.ptr;
+	ExportAssociation configAssociation(vecShaderExports.data(), vecShaderExports.size(), shaderConfigSubObject);
+	subobjects[index++] = configAssociation.subobject;
 
-				pDataThis += sizeof(UINT64);
-			}
-		}
-	}
-	LastIndex++;
 
-	// miss
-	for (auto& sb : ShaderBinding)
-	{
-		pDataThis = pData + LastIndex * ShaderTableEntrySize;
+	// pipeline config
+	PipelineConfig config(MaxRecursion);
+	subobjects[index++] = config.subobject;
 
-		BindingInfo& bindingInfo = sb.second;
-		if (bindingInfo.Type == ShaderType::MISS)
-		{
-			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(bindingInfo.ShaderName.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+	// global root signature
+	D3D12_STATE_SUBOBJECT subobjectGlobalRS = {};
+	ID3D12RootSignature* pInterfaceGlobalRS = nullptr;
+	D3D12_ROOT_SIGNATURE_DESC GlobalRSDesc = {};
+		
+	D3D12_ROOT_SIGNATURE_DESC Desc = {};
+	Desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
 
-			LastIndex++;// multiple miss shader is available.
+	vector<D3D12_ROOT_PARAMETER> rootParamVec;
+	vector<D3D12_DESCRIPTOR_RANGE> Ranges;
+	Ranges.resize(GlobalBinding.size());
 
-		}
+	int i = 0;
+
+	// names to slots, in GlobalBinding order
+	GlobalLayout.Clear();
+	for (auto& bindingData : GlobalBinding)
+	{
+		BindingSlot slot = GlobalLayout.Add(bindingData.name);
+		assert(slot.IsValid() && slot.Index == GlobalLayout.GetNumSlots() - 1); // same name twice or a hash collision
 	}
 
-	// hit program 
-	for(int InstanceIndex=0;InstanceIndex<NumInstance;InstanceIndex++)
+	// create root signature
+
+	for (auto& bindingData : GlobalBinding)
 	{
+		D3D12_DESCRIPTOR_RANGE& Range = Ranges[i++];;
+		Range.RangeType = bindingData.Type;
+		Range.BaseShaderRegister = bindingData.BaseRegister;
+		Range.NumDescriptors = bindingData.NumDescriptors;
+		Range.RegisterSpace = bindingData.RegisterSpace;
+		Range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
+		//Ranges.push_back(Range);
 
-		//auto& HitProgramInfo = HitProgramBinding[InstanceIndex];
-		for (int iHitGroup = 0; iHitGroup < VecHitGroup.size(); iHitGroup++)
+		// constant buffers are root CBVs, SetGlobalBinding sets them by address
+		if (bindingData.Type == D3D12_DESCRIPTOR_RANGE_TYPE_CBV)
 		{
-			pDataThis = pData + LastIndex * ShaderTableEntrySize;
+			D3D12_ROOT_PARAMETER RootParam = {};
+			RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+			RootParam.Descriptor.ShaderRegister = bindingData.BaseRegister;
+			RootParam.Descriptor.RegisterSpace = bindingData.RegisterSpace;
+			RootParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-			map<UINT, HitProgramData>& HitProgram = VecHitGroup[iHitGroup].HitProgramBinding;
-			auto& HitProgramInfo = HitProgram[InstanceIndex];
+			rootParamVec.push_back(RootParam);
+			continue;
+		}
 
-			memcpy(pDataThis, RtsoProps->GetShaderIdentifier(VecHitGroup[iHitGroup].name.c_str()), D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES);
+		D3D12_ROOT_PARAMETER RootParam = {};
+		RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		RootParam.DescriptorTable.NumDescriptorRanges = 1;// Ranges.size();
+		RootParam.DescriptorTable.pDescriptorRanges = &Range;// Ranges.data();
+		RootParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-			pDataThis += D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
+		rootParamVec.push_back(RootParam);
+	}
 
-			for (auto& bd : HitProgramInfo.VecData)
-			{
-				*(UINT64*)(pDataThis) = bd.ptr;
+	Desc.NumParameters = rootParamVec.size();
+	Desc.pParameters = rootParamVec.data();
 
-				pDataThis += sizeof(UINT64);
-			}
-			LastIndex++;
+	GlobalRS = CreateRootSignature(g_dx12_rhi->Device, Desc);
+	NAME_D3D12_OBJECT(GlobalRS);
 
-		}
+	pInterfaceGlobalRS = GlobalRS.Get();
+	subobjectGlobalRS.pDesc = &pInterfaceGlobalRS;
+	subobjectGlobalRS.Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
+
+	subobjects[index++] = subobjectGlobalRS;
+
+	
+	// Create the RTPSO
+	D3D12_STATE_OBJECT_DESC descRTSO;
+	descRTSO.NumSubobjects = subobjects.size(); // 10
+	descRTSO.pSubobjects = subobjects.data();
+	descRTSO.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
 
+	HRESULT hr = g_dx12_rhi->Device->CreateStateObject(&descRTSO, IID_PPV_ARGS(&RTPipelineState));
+	if (FAILED(hr))
+	{
+		stringstream ss;
+		ss << "Failed to compile shader : " << ShaderFile << "\n";
+		g_dx12_rhi->errorString += ss.str();
+		OutputDebugStringA(ss.str().c_str());
+		return false;
 	}
 
+	NAME_D3D12_OBJECT(RTPipelineState);
 
-	ShaderTable->Unmap(0, nullptr);
+	
+
+	return true;
 }
 
-void RTPipelineStateObject::SetUAV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE uavHandle, INT instanceIndex /*= -1*/)
+void RTPipelineStateObject::DispatchRay(UINT width, UINT height, CommandList* CommandList, UINT NumInstance)
 {
-	// each bindings of raygen/miss shader is unique to shader name.
-	if (instanceIndex == -1) // raygen, miss
-	{
-		if (shader == "global")
-		{
-			for (auto& bd : GlobalBinding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = uavHandle;
-				}
-			}
-		}
-		else
-		{
-			BindingInfo& bi = ShaderBinding[shader];
-			for (auto& bd : bi.Binding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = uavHandle;
+	D3D12_DISPATCH_RAYS_DESC raytraceDesc = {};
+	raytraceDesc.Width = width;
+	raytraceDesc.Height = height;
+	raytraceDesc.Depth = 1;
 
-				}
-			}
-		}
-	}
-	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
-	//{
-	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
-	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
-	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(uavHandle);
-	//}
-}
+	D3D12_GPU_VIRTUAL_ADDRESS StartAddress = ShaderTable->GetGPUVirtualAddress() + ShaderTableSize * g_dx12_rhi->CurrentFrameIndex;
 
-void RTPipelineStateObject::SetSRV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle, INT instanceIndex /*= -1*/)
-{
-	// each bindings of raygen/miss shader is unique to shader name.
-	if (instanceIndex == -1) // raygen, miss
-	{
-		if (shader == "global")
-		{
-			for (auto& bd : GlobalBinding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = srvHandle;
-				}
-			}
-		}
-		else
-		{
-			BindingInfo& bi = ShaderBinding[shader];
-			for (auto& bd : bi.Binding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = srvHandle;
-				}
-			}
-		}
-	}
-	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
-	//{
-	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
-	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
-	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(srvHandle);
-	//}
-}
+	raytraceDesc.RayGenerationShaderRecord.StartAddress = StartAddress ;
+	raytraceDesc.RayGenerationShaderRecord.SizeInBytes = ShaderTableEntrySize;
 
-void RTPipelineStateObject::ResetHitProgram(UINT instanceIndex)
-{
-	for (auto& HG : VecHitGroup)
+	// Miss is the second entry in the shader-table
+	UINT NumMissShader = 0;
+	for (auto& sb : ShaderBinding)
 	{
-		HG.HitProgramBinding[instanceIndex].VecData.clear();
+		if (sb.second.Type == MISS)
+			NumMissShader++;
 	}
+	size_t missOffset = ShaderTableEntrySize * 1;
+	raytraceDesc.MissShaderTable.StartAddress = StartAddress + missOffset;
+	raytraceDesc.MissShaderTable.StrideInBytes = ShaderTableEntrySize;
+	raytraceDesc.MissShaderTable.SizeInBytes = ShaderTableEntrySize * NumMissShader;
+
+	
+	 // Hit is the third entry in the shader-table
+	size_t hitOffset = missOffset + NumMissShader * ShaderTableEntrySize;
+	raytraceDesc.HitGroupTable.StartAddress = StartAddress + hitOffset;
+	raytraceDesc.HitGroupTable.StrideInBytes = ShaderTableEntrySize;
+	raytraceDesc.HitGroupTable.SizeInBytes = ShaderTableEntrySize * VecHitGroup.size() *NumInstance;
+
+	// Bind the empty root signature
+	g_dx12_rhi->GlobalCmdList->CmdList->SetComputeRootSignature(GlobalRS.Get());
+
+	SetGlobalBinding(CommandList);
+
+	g_dx12_rhi->GlobalCmdList->CmdList->SetPipelineState1(RTPipelineState.Get());
+
+	g_dx12_rhi->GlobalCmdList->FlushBarriers();
+	
+	g_dx12_rhi->GlobalCmdList->CmdList->DispatchRays(&raytraceDesc);
 }
 
-void RTPipelineStateObject::StartHitProgram(string HitGroup, UINT instanceIndex)
+void DescriptorHeapRing::Init(DescriptorHeap* InDHHeap, UINT InNumDescriptors, UINT InNumFrame)
 {
-	map<UINT, HitProgramData>* HitProgram =nullptr;
-	for (auto& HG : VecHitGroup)
-	{
-		if (HG.name == StringToWString(HitGroup))
-			HitProgram = &HG.HitProgramBinding;
-	}
-	//(*HitProgram)[instanceIndex].HitGroupName = StringToWString(HitGroup);
-	(*HitProgram)[instanceIndex].VecData.clear();
+	DHeap = InDHHeap;
+	NumDescriptors = InNumDescriptors;
+	NumFrame = InNumFrame;
+	DescriptorSize = DHeap->DescriptorSize;
+
+	DHeap->AllocDescriptors(CPUHeapStart, GPUHeapStart, NumDescriptors * NumFrame);
 }
 
-void RTPipelineStateObject::AddDescriptor2HitProgram(string HitGroup, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle, UINT instanceIndex)
+UINT DescriptorHeapRing::AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT32 Num)
 {
-	map<UINT, HitProgramData>* HitProgram = nullptr;
-	for (auto& HG : VecHitGroup)
-	{
-		if (HG.name == StringToWString(HitGroup))
-			HitProgram = &HG.HitProgramBinding;
-	}
+	const UINT index = NumAllocated.fetch_add(Num);
 
-	(*HitProgram)[instanceIndex].VecData.push_back(srvHandle);
+	// running over would write into the next frame's descriptors
+	if (index + Num > NumDescriptors)
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	UINT offset = index * DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
+	cpuHandle.ptr = CPUHeapStart.ptr + offset;// NumAllocated* DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
+	gpuHandle.ptr = GPUHeapStart.ptr + offset;//  NumAllocated* DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
+
+	return offset;
 }
 
-void RTPipelineStateObject::SetSampler(string shader, string bindingName, Sampler* sampler, INT instanceIndex /*= -1*/)
+void DescriptorHeapRing::Advance()
 {
-	// each bindings of raygen/miss shader is unique to shader name.
-	if (instanceIndex == -1) // raygen, miss
-	{
-		if (shader == "global")
-		{
-			for (auto& bd : GlobalBinding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = sampler->Descriptor.GpuHandle;
-				}
-			}
-		}
-		else
-		{
-			BindingInfo& bi = ShaderBinding[shader];
-			for (auto& bd : bi.Binding)
-			{
-				if (bd.name == bindingName)
-				{
-					bd.GPUHandle = sampler->Descriptor.GpuHandle;
-				}
-			}
-		}
-	}
-	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
-	//{
-	//	// SetXXX should be called according to the binding order, because it is push_backed to vector.
-	//	HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
-	//	HitProgramBindingCHS[instanceIndex].VecData.push_back(sampler->GpuHandle);
-	//}
+	CurrentFrame = (CurrentFrame + 1) % NumFrame;
+	LastFrameAllocated = NumAllocated;
+	NumAllocated = 0;
 }
 
-void RTPipelineStateObject::SetCBVValue(string shader, string bindingName, void* pData, INT instanceIndex /*= -1*/)
+void Scene::SetTransform(glm::mat4x4 inTransform)
 {
-	// each bindings of raygen/miss shader is unique to shader name.
-	if (instanceIndex == -1) // raygen, miss
+	for (auto& mesh : meshes)
 	{
-		if (shader == "global")
-		{
-			bool bFound = false;
-			for (auto& bd : GlobalBinding)
-			{
-				if (bd.name == bindingName)
-				{
-					auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
-					UINT64 GPUAddr = std::get<0>(Alloc);
-					UINT8* pMapped = std::get<1>(Alloc);
+		mesh->transform = inTransform;
+	}
+}
 
-					memcpy((void*)pMapped, pData, bd.cbSize);
+static std::atomic<UINT32> NextCommandQueueId = 0;
 
-					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+CommandQueue::CommandQueue(D3D12_COMMAND_LIST_TYPE InType)
+{
+	Id = NextCommandQueueId++;
+	Type = InType;
 
-					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+	// CurrentFenceValue is the next one signaled, it mustn't look done already
+	ThrowIfFailed(g_dx12_rhi->Device->CreateFence(CurrentFenceValue - 1, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
+	// Create an event handle to use for frame synchronization.
+	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 
-					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-					cbvDesc.BufferLocation = GPUAddr;
-					cbvDesc.SizeInBytes = bd.cbSize;
-					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	queueDesc.Type = Type;
 
-					bd.GPUHandle = GpuHandle;
+	ThrowIfFailed(g_dx12_rhi->Device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&CmdQueue)));
+	NAME_D3D12_OBJECT(CmdQueue);
+}
 
-					bFound = true;
-				}
-			}
-			assert(bFound == true);
-		}
-		else
-		{
-			bool bFound = false;
+CommandQueue::~CommandQueue()
+{
+}
 
-			BindingInfo& bi = ShaderBinding[shader];
-			for (auto& bd : bi.Binding)
-			{
-				if (bd.name == bindingName)
-				{
-					auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
-					UINT64 GPUAddr = std::get<0>(Alloc);
-					UINT8* pMapped = std::get<1>(Alloc);
+CommandListPool* CommandQueue::GetThreadPool()
+{
+	// (queue id, pool) for every queue this thread recorded on. ids aren't reused, so a pool of a deleted queue is never found.
+	thread_local vector<pair<UINT32, CommandListPool*>> threadPools;
+	for (auto& threadPool : threadPools)
+	{
+		if (threadPool.first == Id)
+			return threadPool.second;
+	}
 
-					memcpy((void*)pMapped, pData, bd.cbSize);
+	CommandListPool* pool = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(ThreadPoolMtx);
+		ThreadPools.push_back(make_unique<CommandListPool>());
+		pool = ThreadPools.back().get();
+	}
+	threadPools.push_back(make_pair(Id, pool));
+	return pool;
+}
 
-					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+UINT32 CommandQueue::GetNumThreadPools()
+{
+	std::lock_guard<std::mutex> lock(ThreadPoolMtx);
+	return UINT32(ThreadPools.size());
+}
 
-					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+BarrierStats CommandQueue::GetBarrierStats()
+{
+	std::lock_guard<std::mutex> lock(SubmitMtx);
+	return Barriers;
+}
 
-					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-					cbvDesc.BufferLocation = GPUAddr;
-					cbvDesc.SizeInBytes = bd.cbSize;
-					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+UINT64 CommandQueue::GetCurrentFenceValue()
+{
+	std::lock_guard<std::mutex> lock(SubmitMtx);
+	return CurrentFenceValue;
+}
 
-					bd.GPUHandle = GpuHandle;
-				
-					bFound = true;
-				}
-			}
-			assert(bFound == true);
+CommandList * CommandQueue::AllocCmdList()
+{
+	CommandListPool* pool = GetThreadPool();
+
+	// oldest first. lists still being recorded(Fence 0) or still on the gpu are skipped, they come back on a later call.
+	CommandList* cmdList = nullptr;
+	const UINT64 completedFenceValue = m_fence->GetCompletedValue();
+	for (auto it = pool->InUse.begin(); it != pool->InUse.end(); ++it)
+	{
+		const UINT64 fence = (*it)->Fence;
+		if (fence != 0 && fence <= completedFenceValue)
+		{
+			cmdList = *it;
+			pool->InUse.erase(it);
+			break;
 		}
 	}
-	//else // hitprogram : There can be multiple hitprogram entry with same shader name, so we need another data structure. (HitProgramBinding)
-	//{
-	//	// SetXXX should be called by the binding order, because it is "push_back"ed to vector.
-	//	BindingInfo& bi = ShaderBinding[shader];
-	//	for (auto&bd : bi.Binding)
-	//	{
-	//		if (bd.name == bindingName)
-	//		{
-	//			auto& cb = bd.cbs[g_dx12_rhi->CurrentFrameIndex];
-	//			UINT8* pMapped = (UINT8*)cb->MemMapped + size * instanceIndex;
-	//			memcpy((void*)pMapped, pData, size);
 
-	//			HitProgramBindingCHS[instanceIndex].HitGroupName = MapHitGroup[shader].name;
+	if (cmdList)
+	{
+		cmdList->Reset();
+	}
+	else
+	{
+		// nothing to reuse, make one. it is created open.
+		pool->Lists.push_back(make_unique<CommandList>());
+		cmdList = pool->Lists.back().get();
 
-	//			D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-	//			D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+		ThrowIfFailed(g_dx12_rhi->Device->CreateCommandAllocator(Type, IID_PPV_ARGS(&cmdList->CmdAllocator)));
+		NAME_D3D12_OBJECT(cmdList->CmdAllocator);
 
-	//			// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-	//			g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+		ThrowIfFailed(g_dx12_rhi->Device->CreateCommandList(0, Type, cmdList->CmdAllocator.Get(), nullptr, IID_PPV_ARGS(&cmdList->CmdList)));
+		NAME_D3D12_OBJECT(cmdList->CmdList);
 
-	//			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-	//			cbvDesc.BufferLocation = cb->resource->GetGPUVirtualAddress();
-	//			cbvDesc.SizeInBytes = cb->Size;
-	//			g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+		NumCommandLists++;
+	}
 
-	//			HitProgramBindingCHS[instanceIndex].VecData.push_back(GpuHandle);
-	//		}
-	//	}
-	//}
+	cmdList->Fence = 0;
+	pool->InUse.push_back(cmdList);
+	return cmdList;
 }
 
-void RTPipelineStateObject::SetCBVValue(string shader, string bindingName, UINT64 GPUAddr, INT instanceIndex /*= -1*/)
+void CommandQueue::ExecuteCommandList(CommandList * cmd)
 {
-	// each bindings of raygen/miss shader is unique to shader name.
-	if (instanceIndex == -1) // raygen, miss
-	{
-		if (shader == "global")
-		{
-			bool bFound = false;
-			for (auto& bd : GlobalBinding)
-			{
-				if (bd.name == bindingName)
-				{
-		/*			auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
-					UINT64 GPUAddr = std::get<0>(Alloc);
-					UINT8* pMapped = std::get<1>(Alloc);
+	ExecuteCommandLists(1, &cmd);
+}
 
-					memcpy((void*)pMapped, pData, bd.cbSize);*/
+void CommandQueue::ExecuteCommandLists(UINT Num, CommandList* const* cmds)
+{
+	vector<ID3D12CommandList*> ppCommandLists(Num);
+	for (UINT i = 0; i < Num; i++)
+	{
+		cmds[i]->Close();
+		ppCommandLists[i] = cmds[i]->CmdList.Get();
+	}
 
-					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+	std::lock_guard<std::mutex> lock(SubmitMtx);
+	CmdQueue->ExecuteCommandLists(Num, ppCommandLists.data());
+	// done when the next signal is
+	for (UINT i = 0; i < Num; i++)
+	{
+		cmds[i]->Fence = CurrentFenceValue;
+		Barriers += cmds[i]->Barriers;
+	}
+}
 
-					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+void CommandQueue::WaitGPU()
+{
+	UINT64 fenceValue;
+	{
+		std::lock_guard<std::mutex> lock(SubmitMtx);
+		fenceValue = CurrentFenceValue;
+		CmdQueue->Signal(m_fence.Get(), fenceValue);
+		CurrentFenceValue++;
+	}
 
-					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-					cbvDesc.BufferLocation = GPUAddr;
-					cbvDesc.SizeInBytes = bd.cbSize;
-					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+	m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent);
+	WaitForSingleObject(m_fenceEvent, INFINITE);
+}
 
-					bd.GPUHandle = GpuHandle;
+void CommandQueue::WaitFenceValue(UINT64 fenceValue)
+{
+	m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent);
+	WaitForSingleObject(m_fenceEvent, INFINITE);
+}
 
-					bFound = true;
-				}
-			}
-			assert(bFound == true);
-		}
-		else
-		{
-			bool bFound = false;
+UINT64 CommandQueue::SignalCurrentFence()
+{
+	std::lock_guard<std::mutex> lock(SubmitMtx);
+	const UINT64 fenceValue = CurrentFenceValue;
+	CmdQueue->Signal(m_fence.Get(), fenceValue);
+	CurrentFenceValue++;
+	return fenceValue;
+}
 
-			BindingInfo& bi = ShaderBinding[shader];
-			for (auto& bd : bi.Binding)
-			{
-				if (bd.name == bindingName)
-				{
-					/*auto Alloc = g_dx12_rhi->GlobalCBRing->AllocGPUMemory(bd.cbSize);
-					UINT64 GPUAddr = std::get<0>(Alloc);
-					UINT8* pMapped = std::get<1>(Alloc);
+void CommandQueue::WaitForQueue(CommandQueue* Other, UINT64 FenceValue)
+{
+	std::lock_guard<std::mutex> lock(SubmitMtx);
+	ThrowIfFailed(CmdQueue->Wait(Other->m_fence.Get(), FenceValue));
+}
 
-					memcpy((void*)pMapped, pData, bd.cbSize);*/
+void CommandList::Reset()
+{
+	CmdAllocator->Reset();
+	CmdList->Reset(CmdAllocator.Get(), nullptr);
 
-					D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
-					D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+	assert(PendingBarriers.empty() && OpenSplits.empty());
+	Barriers = BarrierStats();
+}
 
-					// ring is advanced at the begining of frame. so descriptors from multiple frame is not overlapped.
-					g_dx12_rhi->GlobalDHRing->AllocDescriptor(CpuHandle, GpuHandle);
+void CommandList::Close()
+{
+	while (OpenSplits.size() > 0)
+		EndSplit(OpenSplits.back().first, *OpenSplits.back().second);
 
-					D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-					cbvDesc.BufferLocation = GPUAddr;
-					cbvDesc.SizeInBytes = bd.cbSize;
-					g_dx12_rhi->Device->CreateConstantBufferView(&cbvDesc, CpuHandle);
+	FlushBarriers();
+	CmdList->Close();
+}
 
-					bd.GPUHandle = GpuHandle;
+void TrackedState::Reset(D3D12_RESOURCE_STATES InState)
+{
+	assert(!SplitList);
+	State = InState;
+	Subresources.clear();
+}
 
-					bFound = true;
-				}
-			}
-			assert(bFound == true);
-		}
-	}
+BarrierStats& BarrierStats::operator+=(const BarrierStats& Other)
+{
+	NumRequired += Other.NumRequired;
+	NumBarriers += Other.NumBarriers;
+	NumSplit += Other.NumSplit;
+	NumCalls += Other.NumCalls;
+	return *this;
 }
 
-bool RTPipelineStateObject::InitRS(string ShaderFile, std::optional<vector< DxcDefine>>  Defines)
+BarrierStats BarrierStats::operator-(const BarrierStats& Other) const
 {
-	vector<D3D12_STATE_SUBOBJECT> subobjects;
+	BarrierStats stats;
+	stats.NumRequired = NumRequired - Other.NumRequired;
+	stats.NumBarriers = NumBarriers - Other.NumBarriers;
+	stats.NumSplit = NumSplit - Other.NumSplit;
+	stats.NumCalls = NumCalls - Other.NumCalls;
+	return stats;
+}
 
-	// dxil + Hitgroup count + RS + Export + shaderconfig + export + pipelineconfig + global RS
-	int numSubobjects = 1 + VecHitGroup.size() + ShaderBinding.size() * 2 + 2 + 1 + 1;
-	subobjects.resize(numSubobjects);
+static const D3D12_RESOURCE_STATES ReadOnlyStates = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER |
+	D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+	D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_DEPTH_READ;
 
-	uint32_t index = 0;
+static bool IsStateMet(D3D12_RESOURCE_STATES Current, D3D12_RESOURCE_STATES Wanted)
+{
+	if (Current == Wanted)
+		return true;
 
-	// dxil lib
-	wstring wShaderFile = StringToWString(ShaderFile);
-	ComPtr<ID3DBlob> pDxilLib = compileShaderLibrary(wShaderFile.c_str(), L"lib_6_3", Defines);
+	// reads are met by a read state that covers them
+	const bool bReads = Wanted != D3D12_RESOURCE_STATE_COMMON && (Wanted & ~ReadOnlyStates) == 0 && (Current & ~ReadOnlyStates) == 0;
+	return bReads && (Current & Wanted) == Wanted;
+}
 
-	vector<const WCHAR*> entryPoints;
-	entryPoints.reserve(ShaderBinding.size());
-	for (auto& sb : ShaderBinding)
+void CommandList::AddTransition(ID3D12Resource* Resource, D3D12_RESOURCE_STATES Before, D3D12_RESOURCE_STATES After, UINT Subresource)
+{
+	// a transition of the same subresource that wasn't flushed yet just goes on to After
+	for (auto it = PendingBarriers.rbegin(); it != PendingBarriers.rend(); it++)
 	{
-		entryPoints.push_back(sb.second.ShaderName.c_str());
+		if (it->Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION || it->Transition.pResource != Resource)
+			continue;
+
+		if (it->Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE && it->Transition.Subresource == Subresource)
+		{
+			it->Transition.StateAfter = After;
+			if (it->Transition.StateBefore == After)
+				PendingBarriers.erase(std::next(it).base());
+			return;
+		}
+		break;
 	}
 
+	PendingBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(Resource, Before, After, Subresource));
+}
+
+void CommandList::EndSplit(ID3D12Resource* Resource, TrackedState& Tracked)
+{
+	// ended on the list it was begun on, Close ends the rest. so no other list can see a split that is still open.
+	assert(Tracked.SplitList == this);
 
-	DxilLibrary dxilLib = DxilLibrary(pDxilLib, entryPoints.data(), entryPoints.size());
-	subobjects[index++] = dxilLib.stateSubobject; // 0 Library
+	auto open = std::find(OpenSplits.begin(), OpenSplits.end(), make_pair(Resource, &Tracked));
+	if (open != OpenSplits.end())
+		OpenSplits.erase(open);
 
-	// hit group
-	vector<D3D12_HIT_GROUP_DESC> vecHitDesc;
-	vecHitDesc.reserve(VecHitGroup.size());
-	for (auto&hi : VecHitGroup)
+	// the begin wasn't flushed yet, nothing runs in between. make it a whole transition.
+	bool bBeginPending = false;
+	for (auto& barrier : PendingBarriers)
 	{
-		const WCHAR* ahs = nullptr;
-		const WCHAR* chs = nullptr;
-		if (hi.chs.length() > 0)
-			chs = hi.chs.c_str();
-		if (hi.ahs.length() > 0)
-			ahs = hi.ahs.c_str();
+		if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && barrier.Transition.pResource == Resource && barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+		{
+			barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			bBeginPending = true;
+		}
+	}
 
+	if (!bBeginPending)
+	{
+		PendingBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(Resource, Tracked.State, Tracked.SplitState,
+			D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+	}
 
-		//HitProgram hitProgram(ahs, chs, hi.name.c_str());
-		D3D12_HIT_GROUP_DESC HitGroupDesc = {};
-		HitGroupDesc.HitGroupExport = hi.name.c_str();
-		HitGroupDesc.ClosestHitShaderImport = chs;
-		HitGroupDesc.AnyHitShaderImport = ahs;
-		HitGroupDesc.IntersectionShaderImport = nullptr;
-		vecHitDesc.push_back(HitGroupDesc);
+	Tracked.State = Tracked.SplitState;
+	Tracked.SplitList = nullptr;
+}
 
-		D3D12_STATE_SUBOBJECT subObject;
-		subObject.Type = D3D12_STATE_SUBOBJECT_TYPE_HIT_GROUP;
-		subObject.pDesc = &vecHitDesc.back();
+void CommandList::RequireState(ID3D12Resource* Resource, TrackedState& Tracked, UINT NumSubresources, D3D12_RESOURCE_STATES State, UINT Subresource)
+{
+	Barriers.NumRequired++;
 
-		subobjects[index++] = subObject; // 1 Hit Group
-	}
+	// whatever is asked for now, the split has to be done first
+	if (Tracked.SplitList)
+		EndSplit(Resource, Tracked);
 
-	// root signature
-	BindingInfo* pBI = nullptr;
-	vector< D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION> vecAssociation;
-	vecAssociation.reserve(ShaderBinding.size());
-	for (auto& sb : ShaderBinding)
+	if (Subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
 	{
-		BindingInfo& bindingInfo = sb.second;
-		pBI = &bindingInfo;
-		
-		D3D12_ROOT_SIGNATURE_DESC Desc = {};
-		Desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
-
-		vector<D3D12_ROOT_PARAMETER> rootParamVec;
-		vector<D3D12_DESCRIPTOR_RANGE> Ranges;
-		Ranges.resize(bindingInfo.Binding.size());
+		if (Tracked.Subresources.empty())
+		{
+			if (!IsStateMet(Tracked.State, State))
+			{
+				AddTransition(Resource, Tracked.State, State, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+				Tracked.State = State;
+			}
+		}
+		else
+		{
+			// one state again, only the subresources that are in another one move
+			for (UINT i = 0; i < Tracked.Subresources.size(); i++)
+			{
+				if (Tracked.Subresources[i] != State)
+					AddTransition(Resource, Tracked.Subresources[i], State, i);
+			}
+			Tracked.State = State;
+			Tracked.Subresources.clear();
+		}
+	}
+	else
+	{
+		assert(Subresource < NumSubresources);
+		if (Tracked.Subresources.empty())
+			Tracked.Subresources.assign(NumSubresources, Tracked.State);
 
-		int i = 0;
+		if (!IsStateMet(Tracked.Subresources[Subresource], State))
+		{
+			AddTransition(Resource, Tracked.Subresources[Subresource], State, Subresource);
+			Tracked.Subresources[Subresource] = State;
+		}
 
-		if (bindingInfo.Binding.size() > 0)
+		if (std::all_of(Tracked.Subresources.begin(), Tracked.Subresources.end(), [&](D3D12_RESOURCE_STATES s) { return s == Tracked.Subresources[0]; }))
 		{
-			// create root signature
-			
-			for (auto& bindingData : bindingInfo.Binding)
-			{
-				D3D12_DESCRIPTOR_RANGE& Range = Ranges[i++];;
-				Range.RangeType = bindingData.Type;
-				Range.BaseShaderRegister = bindingData.BaseRegister;
-				Range.NumDescriptors = 1;
-				Range.RegisterSpace = 0;
-				Range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-				//Ranges.push_back(Range);
+			Tracked.State = Tracked.Subresources[0];
+			Tracked.Subresources.clear();
+		}
+	}
 
+	if (!g_dx12_rhi->bBatchBarriers)
+		FlushBarriers();
+}
 
-				D3D12_ROOT_PARAMETER RootParam = {};
-				RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-				RootParam.DescriptorTable.NumDescriptorRanges = 1;// Ranges.size();
-				RootParam.DescriptorTable.pDescriptorRanges = &Range;// Ranges.data();
-				RootParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+void CommandList::PrepareState(ID3D12Resource* Resource, TrackedState& Tracked, D3D12_RESOURCE_STATES State)
+{
+	// without batching the whole transition is made at the Require
+	if (!g_dx12_rhi->bBatchBarriers || Tracked.SplitList || !Tracked.Subresources.empty() || IsStateMet(Tracked.State, State))
+		return;
 
-				rootParamVec.push_back(RootParam);
-			}
+	PendingBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(Resource, Tracked.State, State,
+		D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
 
-			Desc.NumParameters = rootParamVec.size();
-			Desc.pParameters = rootParamVec.data();
-		}
+	Tracked.SplitList = this;
+	Tracked.SplitState = State;
+	OpenSplits.push_back(make_pair(Resource, &Tracked));
+}
 
-		bindingInfo.RS = CreateRootSignature(g_dx12_rhi->Device, Desc);
-		NAME_D3D12_OBJECT(bindingInfo.RS);
+void CommandList::Require(Texture* Tex, D3D12_RESOURCE_STATES State, UINT Subresource)
+{
+	RequireState(Tex->resource.Get(), Tex->Tracked, Tex->GetNumSubresources(), State, Subresource);
+}
 
-		bindingInfo.pInterface = bindingInfo.RS.Get();
-		bindingInfo.subobject.pDesc = &bindingInfo.pInterface;
-		bindingInfo.subobject.Type = D3D12_STATE_SUBOBJECT_TYPE_LOCAL_ROOT_SIGNATURE;
-		subobjects[index] = bindingInfo.subobject;
-		uint32_t RSIndex = index++;
+void CommandList::Require(Buffer* Buf, D3D12_RESOURCE_STATES State)
+{
+	RequireState(Buf->resource.Get(), Buf->Tracked, 1, State, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+}
 
-		// export association
-		bindingInfo.ExportName = { bindingInfo.ShaderName.c_str() };
+void CommandList::Prepare(Texture* Tex, D3D12_RESOURCE_STATES State)
+{
+	PrepareState(Tex->resource.Get(), Tex->Tracked, State);
+}
 
-		D3D12_STATE_SUBOBJECT subobjectAssociation = {};
-		D3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION association = {};
-		association.NumExports = 1;
-		association.pExports = bindingInfo.ExportName.data();
-		association.pSubobjectToAssociate = &subobjects[RSIndex];
-		vecAssociation.push_back(association);
-		subobjectAssociation.Type = D3D12_STATE_SUBOBJECT_TYPE_SUBOBJECT_TO_EXPORTS_ASSOCIATION;
-		subobjectAssociation.pDesc = &vecAssociation.back();
+void CommandList::Prepare(Buffer* Buf, D3D12_RESOURCE_STATES State)
+{
+	PrepareState(Buf->resource.Get(), Buf->Tracked, State);
+}
 
-		subobjects[index++] = subobjectAssociation;
+void CommandList::FlushBarriers()
+{
+	if (PendingBarriers.empty())
+		return;
+
+	for (auto& barrier : PendingBarriers)
+	{
+		if (barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY)
+			Barriers.NumSplit++;
+		else
+			Barriers.NumBarriers++;
 	}
+	Barriers.NumCalls++;
 
-	// shader config
-	ShaderConfig shaderConfig(MaxAttributeSizeInBytes, MaxPayloadSizeInBytes);
-	D3D12_STATE_SUBOBJECT* shaderConfigSubObject = &subobjects[index];
-	subobjects[index++] = shaderConfig.subobject;
+	CmdList->ResourceBarrier(UINT(PendingBarriers.size()), PendingBarriers.data());
+	PendingBarriers.clear();
+}
 
-	// shaderconfig export association
-	vector<const WCHAR*> vecShaderExports;
-	entryPoints.reserve(ShaderBinding.size());
-	for (auto& sb : ShaderBinding)
+static std::atomic<UINT64> NextRingGeneration = 1;
+
+// the part of a ring's frame the calling thread sub allocates from
+struct ThreadRingChunk
+{
+	UINT64 Generation = 0;
+	UINT Pos = 0;
+	UINT End = 0;
+};
+
+std::tuple<UINT64, UINT8*> ConstantBufferRingBuffer::AllocGPUMemory(UINT InSize)
+{
+	thread_local ThreadRingChunk chunk;
+
+	if (chunk.Generation != Generation || chunk.Pos + InSize > chunk.End)
 	{
-		vecShaderExports.push_back(sb.second.ShaderName.c_str());
+		const UINT chunkSize = glm::max(InSize, ThreadChunkSize);
+		const UINT pos = AllocPos.fetch_add(chunkSize);
+
+		// running over would write into the next frame's constants
+		if (pos + chunkSize > TotalSize)
+			ThrowIfFailed(E_OUTOFMEMORY);
+
+		chunk.Generation = Generation;
+		chunk.Pos = pos;
+		chunk.End = pos + chunkSize;
 	}
 
-	ExportAssociation configAssociation(vecShaderExports.data(), vecShaderExports.size(), shaderConfigSubObject);
-	subobjects[index++] = configAssociation.subobject;
+	UINT64 AllocGPUAddr = CBMem->GetGPUVirtualAddress() + CurrentFrame * TotalSize + chunk.Pos;
 
+	UINT8* pMapped = (UINT8*)MemMapped + CurrentFrame * TotalSize + chunk.Pos;
+	chunk.Pos += InSize;
+	
+	return std::make_tuple(AllocGPUAddr, pMapped);
+}
 
-	// pipeline config
-	PipelineConfig config(MaxRecursion);
-	subobjects[index++] = config.subobject;
+void ConstantBufferRingBuffer::Advance()
+{
+	CurrentFrame = (CurrentFrame + 1) % NumFrame;
+	AllocPos = 0;
+	Generation = NextRingGeneration++;
+}
 
-	// global root signature
-	D3D12_STATE_SUBOBJECT subobjectGlobalRS = {};
-	ID3D12RootSignature* pInterfaceGlobalRS = nullptr;
-	D3D12_ROOT_SIGNATURE_DESC GlobalRSDesc = {};
-		
-	D3D12_ROOT_SIGNATURE_DESC Desc = {};
-	Desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+ConstantBufferRingBuffer::ConstantBufferRingBuffer(UINT InSize, UINT InNumFrame)
+{
+	NumFrame = InNumFrame;
+	TotalSize = InSize;
+	Generation = NextRingGeneration++;
 
-	vector<D3D12_ROOT_PARAMETER> rootParamVec;
-	vector<D3D12_DESCRIPTOR_RANGE> Ranges;
-	Ranges.resize(GlobalBinding.size());
+	D3D12_HEAP_PROPERTIES heapProp;
+	heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
+	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heapProp.CreationNodeMask = 1;
+	heapProp.VisibleNodeMask = 1;
 
-	int i = 0;
+	D3D12_RESOURCE_DESC resDesc;
 
-	// create root signature
+	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resDesc.Alignment = 0;
+	resDesc.Width = InSize * g_dx12_rhi->NumFrame;;
+	resDesc.Height = 1;
+	resDesc.DepthOrArraySize = 1;
+	resDesc.MipLevels = 1;
+	resDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resDesc.SampleDesc.Count = 1;
+	resDesc.SampleDesc.Quality = 0;
+	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-	for (auto& bindingData : GlobalBinding)
-	{
-		D3D12_DESCRIPTOR_RANGE& Range = Ranges[i++];;
-		Range.RangeType = bindingData.Type;
-		Range.BaseShaderRegister = bindingData.BaseRegister;
-		Range.NumDescriptors = 1;
-		Range.RegisterSpace = 0;
-		Range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-		//Ranges.push_back(Range);
+	ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
+		&heapProp,
+		D3D12_HEAP_FLAG_NONE,
+		&resDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&CBMem)));
 
+	NAME_D3D12_OBJECT(CBMem);
 
-		D3D12_ROOT_PARAMETER RootParam = {};
-		RootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-		RootParam.DescriptorTable.NumDescriptorRanges = 1;// Ranges.size();
-		RootParam.DescriptorTable.pDescriptorRanges = &Range;// Ranges.data();
-		RootParam.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+	CD3DX12_RANGE readRange(0, 0);		// We do not intend to read from this resource on the CPU.
+	ThrowIfFailed(CBMem->Map(0, &readRange, reinterpret_cast<void**>(&MemMapped)));
+}
 
-		rootParamVec.push_back(RootParam);
-	}
+ConstantBufferRingBuffer::~ConstantBufferRingBuffer()
+{
+	CBMem->Unmap(0, nullptr);
+}
 
-	Desc.NumParameters = rootParamVec.size();
-	Desc.pParameters = rootParamVec.data();
+UploadRing::UploadRing(UINT64 InSize, CommandQueue* InQueue)
+{
+	Queue = InQueue;
+	Size = InSize;
+	ChunkSize = InSize / 4;
+	Stats.RingBytes = InSize;
+
+	ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(InSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&Resource)));
+	Resource->SetName(L"UploadRing");
 
-	GlobalRS = CreateRootSignature(g_dx12_rhi->Device, Desc);
-	NAME_D3D12_OBJECT(GlobalRS);
+	CD3DX12_RANGE readRange(0, 0);
+	ThrowIfFailed(Resource->Map(0, &readRange, reinterpret_cast<void**>(&MappedData)));
+}
 
-	pInterfaceGlobalRS = GlobalRS.Get();
-	subobjectGlobalRS.pDesc = &pInterfaceGlobalRS;
-	subobjectGlobalRS.Type = D3D12_STATE_SUBOBJECT_TYPE_GLOBAL_ROOT_SIGNATURE;
+UploadRing::~UploadRing()
+{
+	WaitIdle();
+	Resource->Unmap(0, nullptr);
+}
 
-	subobjects[index++] = subobjectGlobalRS;
+void UploadRing::Reclaim()
+{
+	const UINT64 completedFence = Queue->m_fence->GetCompletedValue();
+	while (!Regions.empty() && Regions.front().FenceValue != 0 && Regions.front().FenceValue <= completedFence)
+		Regions.pop_front();
+}
 
-	
-	// Create the RTPSO
-	D3D12_STATE_OBJECT_DESC descRTSO;
-	descRTSO.NumSubobjects = subobjects.size(); // 10
-	descRTSO.pSubobjects = subobjects.data();
-	descRTSO.Type = D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE;
+bool UploadRing::TryAllocate(UINT64 InSize, UINT64 Alignment, UINT64 BatchId, UINT64& OutOffset)
+{
+	Reclaim();
 
-	HRESULT hr = g_dx12_rhi->Device->CreateStateObject(&descRTSO, IID_PPV_ARGS(&RTPipelineState));
-	if (FAILED(hr))
+	UINT64 offset = 0;
+	if (!Regions.empty())
 	{
-		stringstream ss;
-		ss << "Failed to compile shader : " << ShaderFile << "\n";
-		g_dx12_rhi->errorString += ss.str();
-		OutputDebugStringA(ss.str().c_str());
-		return false;
-	}
-
-	NAME_D3D12_OBJECT(RTPipelineState);
+		const UINT64 head = Regions.back().End;
+		const UINT64 tail = Regions.front().Begin;
+		const bool bWrapped = Regions.back().Begin < tail;
 
-	
+		offset = align_to(Alignment, head);
+		if (bWrapped)
+		{
+			if (offset + InSize > tail)
+				return false;
+		}
+		else if (offset + InSize > Size)
+		{
+			// the end of the ring is skipped, it comes back when the oldest region before it is done
+			offset = 0;
+			if (InSize > tail)
+				return false;
+		}
+	}
 
+	Regions.push_back({ offset, offset + InSize, BatchId, 0 });
+	OutOffset = offset;
 	return true;
 }
 
-void RTPipelineStateObject::DispatchRay(UINT width, UINT height, CommandList* CommandList, UINT NumInstance)
+UINT64 UploadRing::Allocate(UploadBatch& Batch, UINT64 InSize, UINT64 Alignment)
 {
-	D3D12_DISPATCH_RAYS_DESC raytraceDesc = {};
-	raytraceDesc.Width = width;
-	raytraceDesc.Height = height;
-	raytraceDesc.Depth = 1;
-
-	D3D12_GPU_VIRTUAL_ADDRESS StartAddress = ShaderTable->GetGPUVirtualAddress() + ShaderTableSize * g_dx12_rhi->CurrentFrameIndex;
-
-	raytraceDesc.RayGenerationShaderRecord.StartAddress = StartAddress ;
-	raytraceDesc.RayGenerationShaderRecord.SizeInBytes = ShaderTableEntrySize;
-
-	// Miss is the second entry in the shader-table
-	UINT NumMissShader = 0;
-	for (auto& sb : ShaderBinding)
+	UINT64 offset = 0;
 	{
-		if (sb.second.Type == MISS)
-			NumMissShader++;
+		lock_guard<mutex> lock(Mtx);
+		if (TryAllocate(InSize, Alignment, Batch.Id, offset))
+			return offset;
 	}
-	size_t missOffset = ShaderTableEntrySize * 1;
-	raytraceDesc.MissShaderTable.StartAddress = StartAddress + missOffset;
-	raytraceDesc.MissShaderTable.StrideInBytes = ShaderTableEntrySize;
-	raytraceDesc.MissShaderTable.SizeInBytes = ShaderTableEntrySize * NumMissShader;
-
-	
-	 // Hit is the third entry in the shader-table
-	size_t hitOffset = missOffset + NumMissShader * ShaderTableEntrySize;
-	raytraceDesc.HitGroupTable.StartAddress = StartAddress + hitOffset;
-	raytraceDesc.HitGroupTable.StrideInBytes = ShaderTableEntrySize;
-	raytraceDesc.HitGroupTable.SizeInBytes = ShaderTableEntrySize * VecHitGroup.size() *NumInstance;
 
-	// Bind the empty root signature
-	g_dx12_rhi->GlobalCmdList->CmdList->SetComputeRootSignature(GlobalRS.Get());
+	// what this batch holds goes first, so everything waited on below gets submitted and the ring can't deadlock
+	Flush(Batch);
 
-	UINT RPI = 0;
-	for (auto& bi : GlobalBinding)
+	unique_lock<mutex> lock(Mtx);
+	Stats.NumStalls++;
+	while (!TryAllocate(InSize, Alignment, Batch.Id, offset))
 	{
-		CommandList->CmdList.Get()->SetComputeRootDescriptorTable(RPI++, bi.GPUHandle);
-	}
+		const UINT64 fenceValue = Regions.front().FenceValue;
+		if (fenceValue == 0)
+		{
+			SubmitCV.wait(lock);
+			continue;
+		}
 
-	g_dx12_rhi->GlobalCmdList->CmdList->SetPipelineState1(RTPipelineState.Get());
-	
-	g_dx12_rhi->GlobalCmdList->CmdList->DispatchRays(&raytraceDesc);
+		lock.unlock();
+		Wait(fenceValue);
+		lock.lock();
+	}
+	return offset;
 }
 
-void DescriptorHeapRing::Init(DescriptorHeap* InDHHeap, UINT InNumDescriptors, UINT InNumFrame)
+ID3D12GraphicsCommandList4* UploadRing::GetCommandList(UploadBatch& Batch)
 {
-	DHeap = InDHHeap;
-	NumDescriptors = InNumDescriptors;
-	NumFrame = InNumFrame;
-	DescriptorSize = DHeap->DescriptorSize;
-
-	DHeap->AllocDescriptors(CPUHeapStart, GPUHeapStart, NumDescriptors * NumFrame);
+	if (!Batch.Cmd)
+		Batch.Cmd = Queue->AllocCmdList();
+	return Batch.Cmd->CmdList.Get();
 }
 
-UINT DescriptorHeapRing::AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT32 Num)
+void UploadRing::Flush(UploadBatch& Batch)
 {
-	UINT offset = NumAllocated * DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
-	cpuHandle.ptr = CPUHeapStart.ptr + offset;// NumAllocated* DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
-	gpuHandle.ptr = GPUHeapStart.ptr + offset;//  NumAllocated* DescriptorSize + NumDescriptors * DescriptorSize * CurrentFrame;
-
-	NumAllocated += Num;
+	if (!Batch.Cmd)
+		return;
 
-	return offset;
+	Submit(Batch);
 }
 
-void DescriptorHeapRing::Advance()
+UploadBatch UploadRing::BeginBatch()
 {
-	CurrentFrame = (CurrentFrame + 1) % NumFrame;
-	NumAllocated = 0;
+	lock_guard<mutex> lock(Mtx);
+
+	UploadBatch batch;
+	batch.Id = NextBatchId++;
+	return batch;
 }
 
-void Scene::SetTransform(glm::mat4x4 inTransform)
+void UploadRing::UploadBuffer(UploadBatch& Batch, ID3D12Resource* Dst, UINT64 DstOffset, const void* SrcData, UINT64 InSize)
 {
-	for (auto& mesh : meshes)
+	const UINT8* src = reinterpret_cast<const UINT8*>(SrcData);
+
+	for (UINT64 copied = 0; copied < InSize;)
 	{
-		mesh->transform = inTransform;
+		const UINT64 bytes = glm::min(InSize - copied, ChunkSize);
+		const UINT64 offset = Allocate(Batch, bytes, 16);
+
+		memcpy(MappedData + offset, src + copied, bytes);
+		GetCommandList(Batch)->CopyBufferRegion(Dst, DstOffset + copied, Resource.Get(), offset, bytes);
+
+		copied += bytes;
 	}
+
+	lock_guard<mutex> lock(Mtx);
+	Stats.BytesUploaded += InSize;
+	Stats.NumCopies++;
+	if (InSize > ChunkSize)
+		Stats.NumChunkedCopies++;
 }
 
-CommandQueue::CommandQueue()
+void UploadRing::UploadTexture(UploadBatch& Batch, ID3D12Resource* Dst, UINT FirstSubresource, UINT NumSubresources, const D3D12_SUBRESOURCE_DATA* SrcData)
 {
-	ThrowIfFailed(g_dx12_rhi->Device->CreateFence(CurrentFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence)));
-	// Create an event handle to use for frame synchronization.
-	m_fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	const D3D12_RESOURCE_DESC desc = Dst->GetDesc();
 
-	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
-	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(NumSubresources);
+	vector<UINT> numRows(NumSubresources);
+	vector<UINT64> rowSizes(NumSubresources);
+	UINT64 totalBytes = 0;
+	g_dx12_rhi->Device->GetCopyableFootprints(&desc, FirstSubresource, NumSubresources, 0, layouts.data(), numRows.data(), rowSizes.data(), &totalBytes);
 
-	ThrowIfFailed(g_dx12_rhi->Device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&CmdQueue)));
-	NAME_D3D12_OBJECT(CmdQueue);
+	auto CopyRows = [&](UINT8* Dest, UINT i, UINT z, UINT FirstRow, UINT NumRows)
+	{
+		const UINT8* src = reinterpret_cast<const UINT8*>(SrcData[i].pData) + z * SrcData[i].SlicePitch + FirstRow * SrcData[i].RowPitch;
+		for (UINT y = 0; y < NumRows; ++y)
+			memcpy(Dest + y * layouts[i].Footprint.RowPitch, src + y * SrcData[i].RowPitch, rowSizes[i]);
+	};
 
-	CommandListPool.reserve(CommandListPoolSize);
-	for (int i = 0; i < CommandListPoolSize; i++)
+	auto SubresourceBytes = [&](UINT i)
 	{
-		CommandList * cmdList = new CommandList;
-		ThrowIfFailed(g_dx12_rhi->Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmdList->CmdAllocator)));
-		NAME_D3D12_OBJECT(cmdList->CmdAllocator);
+		return UINT64(layouts[i].Footprint.RowPitch) * numRows[i] * layouts[i].Footprint.Depth;
+	};
 
-		ThrowIfFailed(g_dx12_rhi->Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, cmdList->CmdAllocator.Get(), nullptr, IID_PPV_ARGS(&cmdList->CmdList)));
-		cmdList->CmdList->Close();
-		NAME_D3D12_OBJECT(cmdList->CmdList);
+	UINT i = 0;
+	while (i < NumSubresources)
+	{
+		// as many whole subresources as fit in a chunk. footprint offsets are already placement aligned relative to each other.
+		UINT end = i + 1;
+		while (end < NumSubresources && layouts[end].Offset + SubresourceBytes(end) - layouts[i].Offset <= ChunkSize)
+			end++;
+
+		const UINT64 spanBytes = layouts[end - 1].Offset + SubresourceBytes(end - 1) - layouts[i].Offset;
+		if (spanBytes <= ChunkSize)
+		{
+			const UINT64 offset = Allocate(Batch, spanBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+			for (UINT j = i; j < end; ++j)
+			{
+				D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = layouts[j];
+				footprint.Offset = offset + layouts[j].Offset - layouts[i].Offset;
+
+				UINT8* dest = MappedData + footprint.Offset;
+				for (UINT z = 0; z < footprint.Footprint.Depth; ++z)
+					CopyRows(dest + UINT64(z) * footprint.Footprint.RowPitch * numRows[j], j, z, 0, numRows[j]);
+
+				CD3DX12_TEXTURE_COPY_LOCATION dst(Dst, FirstSubresource + j);
+				CD3DX12_TEXTURE_COPY_LOCATION src(Resource.Get(), footprint);
+				GetCommandList(Batch)->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+			}
+
+			i = end;
+			continue;
+		}
+
+		// one subresource bigger than a chunk, streamed a few rows of a slice at a time
+		const D3D12_SUBRESOURCE_FOOTPRINT& footprint = layouts[i].Footprint;
+		const UINT blockHeight = footprint.Height / numRows[i];
+		const UINT mip = (FirstSubresource + i) % desc.MipLevels;
+		const UINT mipWidth = glm::max(UINT(desc.Width >> mip), 1u);
+		const UINT mipHeight = glm::max(desc.Height >> mip, 1u);
+		const UINT rowsPerChunk = UINT(glm::max<UINT64>(ChunkSize / footprint.RowPitch, 1));
+
+		for (UINT z = 0; z < footprint.Depth; ++z)
+		{
+			for (UINT row = 0; row < numRows[i]; row += rowsPerChunk)
+			{
+				const UINT rows = glm::min(rowsPerChunk, numRows[i] - row);
+				const UINT64 offset = Allocate(Batch, UINT64(rows) * footprint.RowPitch, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+				CopyRows(MappedData + offset, i, z, row, rows);
+
+				D3D12_PLACED_SUBRESOURCE_FOOTPRINT piece = {};
+				piece.Offset = offset;
+				piece.Footprint = footprint;
+				piece.Footprint.Height = rows * blockHeight;
+				piece.Footprint.Depth = 1;
+
+				const UINT top = row * blockHeight;
+				const D3D12_BOX box = { 0, 0, 0, mipWidth, glm::min(mipHeight - top, rows * blockHeight), 1 };
 
-		CommandListPool.emplace_back(shared_ptr<CommandList>(cmdList));
+				CD3DX12_TEXTURE_COPY_LOCATION dst(Dst, FirstSubresource + i);
+				CD3DX12_TEXTURE_COPY_LOCATION src(Resource.Get(), piece);
+				GetCommandList(Batch)->CopyTextureRegion(&dst, 0, top, z, &src, &box);
+			}
+		}
+
+		lock_guard<mutex> lock(Mtx);
+		Stats.NumChunkedCopies++;
+		i++;
 	}
+
+	lock_guard<mutex> lock(Mtx);
+	Stats.BytesUploaded += totalBytes;
+	Stats.NumCopies++;
 }
 
-CommandQueue::~CommandQueue()
+void UploadRing::Acquire(UploadBatch& Batch, ID3D12Resource* Dst, D3D12_RESOURCE_STATES StateAfter)
 {
+	Batch.Acquires.push_back(make_pair(ComPtr<ID3D12Resource>(Dst), StateAfter));
 }
 
-CommandList * CommandQueue::AllocCmdList()
+void UploadRing::TakeCompletedAcquires(vector<D3D12_RESOURCE_BARRIER>& OutBarriers)
+{
+	const UINT64 completedFence = Queue->m_fence->GetCompletedValue();
+
+	lock_guard<mutex> lock(Mtx);
+	while (!PendingAcquires.empty() && PendingAcquires.front().FenceValue <= completedFence)
+	{
+		PendingAcquire& acquire = PendingAcquires.front();
+		OutBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(acquire.Resource.Get(), D3D12_RESOURCE_STATE_COMMON, acquire.StateAfter));
+		PendingAcquires.pop_front();
+		Stats.NumAcquires++;
+	}
+}
+
+UINT64 UploadRing::Submit(UploadBatch& Batch)
 {
-	std::lock_guard<std::mutex> lock(CmdAllocMtx);
+	if (!Batch.Cmd)
+		return 0;
 
-	CommandList* cmdList = CommandListPool[CurrentIndex].get();
-	if(cmdList->Fence.has_value())
-		WaitFenceValue(cmdList->Fence.value());
+	UINT64 fenceValue = 0;
+	{
+		// fence values have to reach the queue in order
+		lock_guard<mutex> lock(Mtx);
 
-	CurrentIndex++;
+		Queue->ExecuteCommandList(Batch.Cmd);
+		fenceValue = Queue->SignalCurrentFence();
 
-	CurrentIndex = CurrentIndex % CommandListPoolSize;
+		for (auto& acquire : Batch.Acquires)
+			PendingAcquires.push_back({ fenceValue, acquire.first, acquire.second });
+		Batch.Acquires.clear();
 
-	cmdList->Fence = std::nullopt;
-	cmdList->Reset();
-	return cmdList;
+		for (Region& region : Regions)
+		{
+			if (region.BatchId == Batch.Id && region.FenceValue == 0)
+				region.FenceValue = fenceValue;
+		}
+
+		Stats.NumSubmissions++;
+	}
+	SubmitCV.notify_all();
+
+	Batch.Cmd = nullptr;
+	return fenceValue;
 }
 
-void CommandQueue::ExecuteCommandList(CommandList * cmd)
+void UploadRing::Wait(UINT64 FenceValue)
 {
-	cmd->CmdList->Close();
-	ID3D12CommandList* ppCommandListsEnd[] = { cmd->CmdList.Get() };
-	CmdQueue->ExecuteCommandLists(_countof(ppCommandListsEnd), ppCommandListsEnd);
+	// no event, the call blocks until the fence gets there. fine from any thread.
+	if (!IsComplete(FenceValue))
+		ThrowIfFailed(Queue->m_fence->SetEventOnCompletion(FenceValue, nullptr));
 }
 
-void CommandQueue::WaitGPU()
+void UploadRing::WaitIdle()
 {
-	CmdQueue->Signal(m_fence.Get(), CurrentFenceValue);
-	m_fence->SetEventOnCompletion(CurrentFenceValue, m_fenceEvent);
-	WaitForSingleObject(m_fenceEvent, INFINITE);
-	
-	CurrentFenceValue++;
+	UINT64 fenceValue = 0;
+	{
+		lock_guard<mutex> lock(Mtx);
+		fenceValue = Queue->CurrentFenceValue - 1;
+	}
+	Wait(fenceValue);
 }
 
-void CommandQueue::WaitFenceValue(UINT64 fenceValue)
+UploadRingStats UploadRing::GetStats()
 {
-	m_fence->SetEventOnCompletion(fenceValue, m_fenceEvent);
-	WaitForSingleObject(m_fenceEvent, INFINITE);
+	lock_guard<mutex> lock(Mtx);
+	return Stats;
 }
 
-void CommandQueue::SignalCurrentFence()
+GpuTimeline::GpuTimeline(UINT InNumFrame, UINT InMaxRanges)
 {
-	CmdQueue->Signal(m_fence.Get(), CurrentFenceValue);
-	CurrentFenceValue++;
+	NumFrame = InNumFrame;
+	MaxRanges = InMaxRanges;
+	SlotRanges.resize(NumFrame);
+	SlotFrameNumbers.resize(NumFrame, 0);
+
+	// a begin and an end timestamp per range
+	const UINT numQueries = NumFrame * MaxRanges * 2;
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = numQueries;
+	ThrowIfFailed(g_dx12_rhi->Device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&QueryHeap)));
+	NAME_D3D12_OBJECT(QueryHeap);
+
+	ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(numQueries * sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&Readback)));
+	Readback->SetName(L"GpuTimelineReadback");
 }
 
-void CommandList::Reset()
+GpuTimeline::~GpuTimeline()
 {
-	CmdAllocator->Reset();
-	CmdList->Reset(CmdAllocator.Get(), nullptr);
 }
 
-std::tuple<UINT64, UINT8*> ConstantBufferRingBuffer::AllocGPUMemory(UINT InSize)
+void GpuTimeline::BeginFrame(UINT Slot, CommandQueue* DirectQ, CommandQueue* ComputeQ)
 {
+	vector<SlotRange>& ranges = SlotRanges[Slot];
+	if (!ranges.empty())
+	{
+		// each queue has its own timestamp clock, calibrating both against QPC puts them on one timeline
+		struct QueueClock
+		{
+			UINT64 Frequency;
+			UINT64 GpuTimestamp;
+			UINT64 CpuTimestamp;
+		};
+		QueueClock clocks[2];
+		CommandQueue* queues[2] = { DirectQ, ComputeQ };
+		for (int i = 0; i < 2; i++)
+		{
+			ThrowIfFailed(queues[i]->CmdQueue->GetTimestampFrequency(&clocks[i].Frequency));
+			ThrowIfFailed(queues[i]->CmdQueue->GetClockCalibration(&clocks[i].GpuTimestamp, &clocks[i].CpuTimestamp));
+		}
 
-	UINT64 AllocGPUAddr = CBMem->GetGPUVirtualAddress() + CurrentFrame * TotalSize + AllocPos;
+		LARGE_INTEGER qpcFrequency;
+		QueryPerformanceFrequency(&qpcFrequency);
 
-	UINT8* pMapped = (UINT8*)MemMapped + CurrentFrame * TotalSize + AllocPos;
-	AllocPos += InSize;
-	
-	return std::make_tuple(AllocGPUAddr, pMapped);
+		const UINT firstQuery = GetQueryIndex(Slot, 0);
+		D3D12_RANGE readRange = { firstQuery * sizeof(UINT64), (firstQuery + ranges.size() * 2) * sizeof(UINT64) };
+		UINT64* timestamps = nullptr;
+		ThrowIfFailed(Readback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+		GpuTimelineFrame frame;
+		frame.FrameNumber = SlotFrameNumbers[Slot];
+		for (UINT i = 0; i < UINT(ranges.size()); i++)
+		{
+			if (!ranges[i].bEnded)
+				continue;
+
+			const QueueClock& clock = clocks[ranges[i].bCompute ? 1 : 0];
+			auto ToUs = [&](UINT64 Timestamp)
+			{
+				return double(clock.CpuTimestamp) * 1000000.0 / double(qpcFrequency.QuadPart) +
+					double(INT64(Timestamp - clock.GpuTimestamp)) * 1000000.0 / double(clock.Frequency);
+			};
+
+			const UINT query = GetQueryIndex(Slot, i);
+			GpuTimelineRange range;
+			range.Name = ranges[i].Name;
+			range.bCompute = ranges[i].bCompute;
+			range.BeginUs = ToUs(timestamps[query]);
+			range.EndUs = ToUs(timestamps[query + 1]);
+			frame.Ranges.push_back(range);
+		}
+
+		D3D12_RANGE writeRange = { 0, 0 };
+		Readback->Unmap(0, &writeRange);
+
+		History.push_back(move(frame));
+		while (History.size() > MaxHistory)
+			History.pop_front();
+	}
+
+	ranges.clear();
+	CurrentSlot = Slot;
+	SlotFrameNumbers[Slot] = NextFrameNumber++;
 }
 
-void ConstantBufferRingBuffer::Advance()
+UINT GpuTimeline::BeginRange(CommandList* Cmd, const char* Name, bool bCompute)
 {
-	CurrentFrame = (CurrentFrame + 1) % NumFrame;
-	AllocPos = 0;
+	vector<SlotRange>& ranges = SlotRanges[CurrentSlot];
+	if (ranges.size() >= MaxRanges)
+		return ~0u;
+
+	const UINT range = UINT(ranges.size());
+	ranges.push_back({ Name, bCompute, false });
+	Cmd->CmdList->EndQuery(QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, GetQueryIndex(CurrentSlot, range));
+	return range;
 }
 
-ConstantBufferRingBuffer::ConstantBufferRingBuffer(UINT InSize, UINT InNumFrame)
+void GpuTimeline::EndRange(CommandList* Cmd, UINT Range)
 {
-	NumFrame = InNumFrame;
-	TotalSize = InSize;
-
-	D3D12_HEAP_PROPERTIES heapProp;
-	heapProp.Type = D3D12_HEAP_TYPE_UPLOAD;
-	heapProp.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProp.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProp.CreationNodeMask = 1;
-	heapProp.VisibleNodeMask = 1;
+	if (Range == ~0u)
+		return;
 
-	D3D12_RESOURCE_DESC resDesc;
+	const UINT query = GetQueryIndex(CurrentSlot, Range);
+	Cmd->CmdList->EndQuery(QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query + 1);
+	Cmd->CmdList->ResolveQueryData(QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query, 2, Readback.Get(), query * sizeof(UINT64));
+	SlotRanges[CurrentSlot][Range].bEnded = true;
+}
 
-	resDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	resDesc.Alignment = 0;
-	resDesc.Width = InSize * g_dx12_rhi->NumFrame;;
-	resDesc.Height = 1;
-	resDesc.DepthOrArraySize = 1;
-	resDesc.MipLevels = 1;
-	resDesc.Format = DXGI_FORMAT_UNKNOWN;
-	resDesc.SampleDesc.Count = 1;
-	resDesc.SampleDesc.Quality = 0;
-	resDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	resDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+void GpuTimeline::GetComputeOverlap(const GpuTimelineFrame& Frame, double& OutComputeUs, double& OutOverlapUs)
+{
+	OutComputeUs = 0;
+	OutOverlapUs = 0;
 
-	ThrowIfFailed(g_dx12_rhi->Device->CreateCommittedResource(
-		&heapProp,
-		D3D12_HEAP_FLAG_NONE,
-		&resDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&CBMem)));
+	// direct queue ranges follow each other without overlapping, so adding up the intersections counts nothing twice
+	for (auto& compute : Frame.Ranges)
+	{
+		if (!compute.bCompute)
+			continue;
 
-	NAME_D3D12_OBJECT(CBMem);
+		OutComputeUs += compute.EndUs - compute.BeginUs;
+		for (auto& direct : Frame.Ranges)
+		{
+			if (direct.bCompute)
+				continue;
 
-	CD3DX12_RANGE readRange(0, 0);		// We do not intend to read from this resource on the CPU.
-	ThrowIfFailed(CBMem->Map(0, &readRange, reinterpret_cast<void**>(&MemMapped)));
+			const double begin = glm::max(compute.BeginUs, direct.BeginUs);
+			const double end = glm::min(compute.EndUs, direct.EndUs);
+			if (end > begin)
+				OutOverlapUs += end - begin;
+		}
+	}
 }
 
-ConstantBufferRingBuffer::~ConstantBufferRingBuffer()
+bool GpuTimeline::WriteChromeTrace(const string& FileName) const
 {
-	CBMem->Unmap(0, nullptr);
+	ofstream file(FileName);
+	if (!file)
+		return false;
+
+	// times from the first range on, the absolute QPC time doesn't say anything
+	double originUs = 0;
+	bool bHasOrigin = false;
+	for (auto& frame : History)
+	{
+		for (auto& range : frame.Ranges)
+		{
+			if (!bHasOrigin || range.BeginUs < originUs)
+				originUs = range.BeginUs;
+			bHasOrigin = true;
+		}
+	}
+
+	file << fixed << setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"direct queue\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"compute queue\"}}";
+	for (auto& frame : History)
+	{
+		for (auto& range : frame.Ranges)
+		{
+			file << ",\n{\"name\":\"" << range.Name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << (range.bCompute ? 1 : 0)
+				<< ",\"ts\":" << range.BeginUs - originUs << ",\"dur\":" << range.EndUs - range.BeginUs
+				<< ",\"args\":{\"frame\":" << frame.FrameNumber << "}}";
+		}
+	}
+	file << "\n]}\n";
+
+	return file.good();
 }
 
 void Buffer::MakeByteAddressBufferSRV()
@@ -3193,7 +4548,7 @@ void Buffer::MakeByteAddressBufferSRV()
 
 	// TODO : should be GlobalDHRing? if object instance are to move.
 	
-	g_dx12_rhi->TextureDHRing->AllocDescriptor(SRV.CpuHandle, SRV.GpuHandle);
+	g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(SRV);
 
 	g_dx12_rhi->Device->CreateShaderResourceView(resource.Get(), &bufferSRVDesc, SRV.CpuHandle);
 
@@ -3214,10 +4569,53 @@ void Buffer::MakeStructuredBufferSRV()
 
 	// TODO : should be GlobalDHRing? if object instance are to move.
 
-	g_dx12_rhi->TextureDHRing->AllocDescriptor(SRV.CpuHandle, SRV.GpuHandle);
+	g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(SRV);
 
 	g_dx12_rhi->Device->CreateShaderResourceView(resource.Get(), &bufferSRVDesc, SRV.CpuHandle);
 
 	Type = STRUCTURED;
 }
 
+void Buffer::MakeFrameViews()
+{
+	ReleaseFrameViews();
+
+	g_dx12_rhi->SRVCBVDescriptorHeapShaderVisible->Alloc(UAV);
+
+	if (Type == Buffer::BYTE_ADDRESS)
+	{
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+		uavDesc.Buffer.NumElements = NumElements;
+
+		g_dx12_rhi->Device->CreateUnorderedAccessView(resource.Get(), nullptr, &uavDesc, UAV.CpuHandle);
+		g_dx12_rhi->NumFrameViewsWritten++;
+	}
+	else if (Type == Buffer::STRUCTURED)
+	{
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+		uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+		uavDesc.Buffer.StructureByteStride = ElementSize;
+		uavDesc.Buffer.NumElements = NumElements;
+
+		g_dx12_rhi->Device->CreateUnorderedAccessView(resource.Get(), nullptr, &uavDesc, UAV.CpuHandle);
+		g_dx12_rhi->NumFrameViewsWritten++;
+	}
+
+	ViewResourceSerial = GetResourceSerial(resource.Get());
+	ViewType = Type;
+}
+
+void Buffer::ReleaseFrameViews()
+{
+	if (!ViewResourceSerial)
+		return;
+
+	UAV.Free();
+	ViewResourceSerial = 0;
+}
+
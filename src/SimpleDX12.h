@@ -14,7 +14,10 @@
 #include <string>
 #include <optional>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <array>
+#include <atomic>
 #define GLM_FORCE_CTOR_INIT
 
 #include "glm/glm.hpp"
@@ -35,6 +38,10 @@
 #include "DXSampleHelper.h"
 
 #include "AbstractGfxLayer.h"
+#include "HeapAllocator.h"
+#include "DescriptorAllocator.h"
+#include "BindingSlot.h"
+#include "ShaderCache.h"
 
 
 using namespace Microsoft::WRL;
@@ -75,14 +82,55 @@ inline void SetNameIndexed(ID3D12Object*, LPCWSTR, UINT)
 #define NAME_D3D12_TEXTURE(x) x->name = L#x;SetName(x->resource.Get(), L#x)
 
 class SimpleDX12;
+
+namespace DirectX
+{
+	class ScratchImage;
+}
 class Texture;
+class Buffer;
 class Sampler;
+class DescriptorHeap;
+class CommandList;
 //class ThreadDescriptorHeapPool;
 
 struct Descriptor : public GfxDescriptor
 {
 	D3D12_CPU_DESCRIPTOR_HANDLE CpuHandle;
 	D3D12_GPU_DESCRIPTOR_HANDLE GpuHandle;
+
+	// set by DescriptorHeap::Alloc. ring descriptors(GlobalDHRing..) don't have them and Free does nothing for them.
+	DescriptorHeap* Heap = nullptr;
+	DescriptorHandle Handle;
+
+	void Free();
+};
+
+// the state a texture/buffer is in at the point that is being recorded, so a pass only says which state it needs
+// (CommandList::Require) and the barrier is made from this. one state for the whole resource until a subresource is required
+// on its own. whatever changes the state without Require(hand written barriers, NRD, DLSS..) must not touch tracked resources.
+struct TrackedState
+{
+	D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+	vector<D3D12_RESOURCE_STATES> Subresources; // empty while they are all in State
+
+	// split barrier to SplitState begun(CommandList::Prepare) on SplitList and not ended yet
+	CommandList* SplitList = nullptr;
+	D3D12_RESOURCE_STATES SplitState = D3D12_RESOURCE_STATE_COMMON;
+
+	// the resource was made, or replaced, in InState
+	void Reset(D3D12_RESOURCE_STATES InState);
+};
+
+struct BarrierStats
+{
+	UINT64 NumRequired = 0; // Require calls
+	UINT64 NumBarriers = 0; // transitions recorded, a split one counts once
+	UINT64 NumSplit = 0; // of them split in begin/end
+	UINT64 NumCalls = 0; // ResourceBarrier calls
+
+	BarrierStats& operator+=(const BarrierStats& Other);
+	BarrierStats operator-(const BarrierStats& Other) const;
 };
 
 class CommandList : public GfxCommandList
@@ -90,40 +138,105 @@ class CommandList : public GfxCommandList
 public:
 	ComPtr<ID3D12GraphicsCommandList4> CmdList;
 	ComPtr<ID3D12CommandAllocator> CmdAllocator;
-	std::optional<UINT64> Fence;
+
+	// queue fence value that is signaled after this list, set by ExecuteCommandList. 0 while it's being recorded.
+	// the allocator can be reset once the fence is past it.
+	std::atomic<UINT64> Fence = 0;
+
+	// barriers of Require/Prepare since the last FlushBarriers, they go to the gpu in one ResourceBarrier call
+	vector<D3D12_RESOURCE_BARRIER> PendingBarriers;
+	vector<pair<ID3D12Resource*, TrackedState*>> OpenSplits; // begun on this list, Close ends the ones no Require did
+	BarrierStats Barriers; // since Reset, the queue adds them up when the list is submitted
+
+private:
+	void RequireState(ID3D12Resource* Resource, TrackedState& Tracked, UINT NumSubresources, D3D12_RESOURCE_STATES State, UINT Subresource);
+	void PrepareState(ID3D12Resource* Resource, TrackedState& Tracked, D3D12_RESOURCE_STATES State);
+	void EndSplit(ID3D12Resource* Resource, TrackedState& Tracked);
+	void AddTransition(ID3D12Resource* Resource, D3D12_RESOURCE_STATES Before, D3D12_RESOURCE_STATES After, UINT Subresource);
 
 public:
 	void Reset();
+
+	// ends the open split barriers, flushes and closes. ExecuteCommandLists calls it.
+	void Close();
+
+	// the resource has to be in State at the next draw/dispatch. a read state is also met by a read state that has all of its
+	// bits(NON_PIXEL|PIXEL is good for NON_PIXEL), queue hand offs that can't have PIXEL bits have to ask for a write state.
+	// nothing is recorded until FlushBarriers.
+	void Require(Texture* Tex, D3D12_RESOURCE_STATES State, UINT Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+	void Require(Buffer* Buf, D3D12_RESOURCE_STATES State);
+
+	// the resource isn't used again until it is required in State. its transition begins at the next flush(BEGIN_ONLY) and ends
+	// at that Require(END_ONLY), so the gpu can do it while the work in between runs. whole resources only.
+	void Prepare(Texture* Tex, D3D12_RESOURCE_STATES State);
+	void Prepare(Buffer* Buf, D3D12_RESOURCE_STATES State);
+
+	// records the pending barriers in one call. before every draw/dispatch that follows a Require.
+	void FlushBarriers();
+};
+
+// command lists of one recording thread. lists are made when there is none to reuse, they are reused in the order they
+// were handed out once the queue fence has passed them. only the owning thread touches it, ExecuteCommandList only sets
+// CommandList::Fence, so getting a list takes no lock.
+struct CommandListPool
+{
+	vector<unique_ptr<CommandList>> Lists;
+	deque<CommandList*> InUse; // handed out, oldest first
 };
 
 class CommandQueue
 {
 public:
-	const UINT32 CommandListPoolSize = 4096;
-
 	ComPtr<ID3D12CommandQueue> CmdQueue;
+	D3D12_COMMAND_LIST_TYPE Type; // of the queue and of the lists it hands out
 
-	std::vector<shared_ptr<CommandList>> CommandListPool;
-	UINT32 CurrentIndex = 0;
+	// one pool per thread that records, found through a thread_local cache. the mutex is only taken the first time a thread
+	// records on this queue.
+	UINT32 Id;
+	vector<unique_ptr<CommandListPool>> ThreadPools;
+	std::mutex ThreadPoolMtx;
+	std::atomic<UINT32> NumCommandLists = 0;
 
-	std::mutex CmdAllocMtx;
+	// ExecuteCommandList and the fence signals take it, so a list can't be tagged with a value that was already signaled before it
+	std::mutex SubmitMtx;
+
+	BarrierStats Barriers; // of every list submitted so far, under SubmitMtx
 
 	HANDLE m_fenceEvent;
 	ComPtr<ID3D12Fence> m_fence;
 	UINT64 CurrentFenceValue = 2;
+
+private:
+	CommandListPool* GetThreadPool();
+
 public:
-	CommandQueue();
+	CommandQueue(D3D12_COMMAND_LIST_TYPE InType = D3D12_COMMAND_LIST_TYPE_DIRECT);
 	virtual ~CommandQueue();
 
+	// a reset list from the calling thread's pool, recording can start right away
 	CommandList* AllocCmdList();
 
 	void ExecuteCommandList(CommandList* cmd);
+	// in one ExecuteCommandLists, in the given order
+	void ExecuteCommandLists(UINT Num, CommandList* const* cmds);
+
+	UINT32 GetNumCommandLists() const { return NumCommandLists; }
+	UINT32 GetNumThreadPools();
+	BarrierStats GetBarrierStats();
+
+	// the value the next signal uses, everything submitted so far is done once the fence reaches it.
+	// taken under SubmitMtx, for code that can run on any thread while the main thread submits.
+	UINT64 GetCurrentFenceValue();
 
 	void WaitGPU();
 	
 	void WaitFenceValue(UINT64 fenceValue);
 
-	void SignalCurrentFence();
+	// returns the value it signaled
+	UINT64 SignalCurrentFence();
+
+	// gpu side, work submitted to this queue after the call waits until Other's fence reaches FenceValue
+	void WaitForQueue(CommandQueue* Other, UINT64 FenceValue);
 };
 
 class FrameResource
@@ -132,6 +245,289 @@ public:
 	UINT64 FenceValue = 0;
 };
 
+// Places resources in ID3D12Heaps sub allocated by a HeapPool(HeapAllocator.h), one heap per pool block.
+// frees are held back until the gpu is past everything submitted when they were made, BeginFrame releases them.
+// thread safe, the texture streamer creates textures from its workers.
+class PlacedHeapPool
+{
+public:
+	struct PendingFree
+	{
+		HeapAllocation Allocation;
+		UINT64 FenceValue;
+	};
+
+	wstring Name;
+	D3D12_HEAP_TYPE HeapType;
+	D3D12_HEAP_FLAGS HeapFlags;
+
+	vector<ComPtr<ID3D12Heap>> Heaps; // indexed by HeapAllocation::Block
+	HeapPool Pool; // after Heaps, its destructor releases them
+
+	std::mutex Mtx;
+	std::list<PendingFree> PendingFrees;
+
+public:
+	// false when it can't be placed here(alignment over 64KB, heap creation failed), the caller makes it committed instead
+	bool CreateResource(const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitState, const D3D12_CLEAR_VALUE* ClearValue, ComPtr<ID3D12Resource>& OutResource, HeapAllocation& OutAllocation);
+
+	void Free(const HeapAllocation& Allocation);
+	void ProcessPendingFrees(UINT64 CompletedFenceValue);
+
+	HeapPoolStats GetStats();
+
+	PlacedHeapPool(const wstring& InName, D3D12_HEAP_TYPE InHeapType, D3D12_HEAP_FLAGS InHeapFlags, UINT64 BlockSize);
+	virtual ~PlacedHeapPool() {}
+};
+
+// owned by the resource it was placed for, gives the range back when that goes away.
+struct PlacedMemory
+{
+	shared_ptr<PlacedHeapPool> Pool;
+	HeapAllocation Allocation;
+
+	~PlacedMemory() { Pool->Free(Allocation); }
+};
+
+struct TransientTextureStats
+{
+	UINT NumTextures = 0;
+	UINT NumUsed = 0;
+	UINT64 UnaliasedBytes = 0; // every texture in its own range
+	UINT64 AliasedBytes = 0; // what the placement of the declared passes needs
+	UINT64 HeapBytes = 0; // heaps actually held. they only grow, so can be over AliasedBytes
+};
+
+// Render targets that only hold data for part of a frame, placed in heaps they share with each other.
+// every frame the app declares its passes in order and the transient textures each one touches, Compile() turns that into the
+// first and last pass of every texture and gives textures that are never alive together the same memory(PlanTransientOffsets).
+// BeginPass() issues the aliasing barriers, and discards for render targets, of the textures the pass is the first user of.
+// so the first pass using a transient texture has to write all of it, nothing is kept from one frame to the next.
+class TransientTexturePool
+{
+public:
+	struct Entry
+	{
+		shared_ptr<Texture> Tex;
+		D3D12_RESOURCE_STATES State; // the passes hand it over to each other in this state
+		std::optional<D3D12_CLEAR_VALUE> ClearValue;
+		UINT Group; // index of the heap it is placed in
+		TransientRange Range;
+	};
+
+	struct Pass
+	{
+		string Name;
+		vector<UINT> Entries;
+	};
+
+	// replaced heaps/resources, kept until the frames that used them are done
+	struct Retired
+	{
+		vector<ComPtr<ID3D12Pageable>> Objects;
+		UINT64 FenceValue;
+	};
+
+	vector<Entry> Entries;
+	std::map<GfxTexture*, UINT> EntryIndex;
+	vector<Pass> Passes;
+
+	// tier 1 can't mix render targets and other textures in a heap, so there is one heap per kind. tier 2 has one heap for both.
+	UINT NumGroups = 1;
+	D3D12_HEAP_FLAGS GroupHeapFlags[2];
+	ComPtr<ID3D12Heap> Heaps[2];
+	UINT64 HeapSizes[2] = {};
+	UINT64 PlannedSizes[2] = {};
+
+	vector<TransientRange> PlacedRanges; // lifetimes of the current layout
+	std::list<Retired> RetiredObjects;
+	UINT LayoutVersion = 0;
+
+	UINT GetGroup(D3D12_RESOURCE_FLAGS Flags) const;
+	D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(const D3D12_RESOURCE_DESC& Desc) const;
+
+	// plans every group, Ranges parallel to Entries. fills OutSizes[group] with the heap size each needs.
+	void PlanGroups(vector<TransientRange>& Ranges, UINT64 OutSizes[2]) const;
+
+public:
+	// the texture is committed until the first Compile, so it can be named and get views before any pass is declared.
+	// it is in InitState between passes, the pool keeps it alive.
+	shared_ptr<Texture> CreateTexture2D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES InitState, int width, int height, std::optional<glm::vec4> clearColor = std::nullopt);
+
+	// call in the order the passes are recorded, then Compile. textures that aren't transient are skipped.
+	void BeginDeclaration();
+	void DeclarePass(const string& Name, const vector<GfxTexture*>& Textures);
+
+	// places the textures again when the lifetimes differ from the last layout. before the views of the frame are made(BeginFrame).
+	void Compile();
+
+	void BeginPass(CommandList* cmd, const string& Name);
+
+	UINT GetLayoutVersion() const { return LayoutVersion; }
+	TransientTextureStats GetStats() const;
+
+	// the same passes with every texture scaled by Scale, for reporting other render sizes
+	TransientTextureStats Estimate(float Scale) const;
+
+	TransientTexturePool();
+	virtual ~TransientTexturePool() {}
+};
+
+struct UploadRingStats
+{
+	UINT64 RingBytes = 0;
+	UINT64 BytesUploaded = 0;
+	UINT64 NumCopies = 0; // UploadBuffer/UploadTexture calls
+	UINT64 NumChunkedCopies = 0; // ones that didn't fit in a chunk and were streamed through the ring in pieces
+	UINT64 NumSubmissions = 0;
+	UINT64 NumStalls = 0; // times a copy waited for the gpu to give ring space back
+	UINT64 NumAcquires = 0; // resources handed over to the direct queue
+};
+
+// copies recorded into one command list and submitted together by UploadRing::Submit.
+// one batch per thread, several threads can record their own batches at the same time.
+struct UploadBatch
+{
+	UINT64 Id = 0;
+	CommandList* Cmd = nullptr; // allocated on the first command, replaced when the batch is flushed to free ring space
+	vector<pair<ComPtr<ID3D12Resource>, D3D12_RESOURCE_STATES>> Acquires; // go to the ring with the next submit
+};
+
+// One persistently mapped upload buffer used as a ring for every copy to default heap resources,
+// instead of an upload heap and an ExecuteCommandLists + WaitGPU per resource.
+// the copies go to a copy queue(SimpleDX12::CopyQ), so they run next to the frames on the direct queue. a copy queue leaves
+// what it wrote in COMMON and can't transition to shader states. Acquire queues the COMMON -> StateAfter barrier instead, the direct
+// queue records it once the cpu has seen the copies finish(SimpleDX12::AcquireUploads), so it never waits on the copy queue.
+// ring space goes back once the fence of the batch that used it has passed. when there isn't enough the batch submits what it has
+// recorded so far and waits for older batches. copies bigger than a quarter of the ring are split in pieces(by subresource, then by rows).
+class UploadRing
+{
+	struct Region
+	{
+		UINT64 Begin;
+		UINT64 End;
+		UINT64 BatchId;
+		UINT64 FenceValue; // 0 until the batch is submitted
+	};
+
+	ComPtr<ID3D12Resource> Resource;
+	UINT8* MappedData = nullptr;
+	UINT64 Size = 0;
+	UINT64 ChunkSize = 0;
+
+	struct PendingAcquire
+	{
+		UINT64 FenceValue;
+		ComPtr<ID3D12Resource> Resource;
+		D3D12_RESOURCE_STATES StateAfter;
+	};
+
+	// its fence is the timeline of the ring, one value per submit
+	CommandQueue* Queue = nullptr;
+
+	std::mutex Mtx;
+	std::deque<PendingAcquire> PendingAcquires; // in fence order
+	std::condition_variable SubmitCV; // waiting for another thread to submit the oldest region
+	std::deque<Region> Regions; // in ring order, oldest first
+	UINT64 NextBatchId = 1;
+	UploadRingStats Stats;
+
+	bool TryAllocate(UINT64 InSize, UINT64 Alignment, UINT64 BatchId, UINT64& OutOffset);
+	void Reclaim();
+
+	// ring offset of InSize bytes(at most ChunkSize) for Batch, waits for space when needed
+	UINT64 Allocate(UploadBatch& Batch, UINT64 InSize, UINT64 Alignment);
+	ID3D12GraphicsCommandList4* GetCommandList(UploadBatch& Batch);
+	void Flush(UploadBatch& Batch);
+
+public:
+	UploadBatch BeginBatch();
+
+	// Dst has to be in COPY_DEST or COMMON and not used by another queue until its acquire is done
+	void UploadBuffer(UploadBatch& Batch, ID3D12Resource* Dst, UINT64 DstOffset, const void* SrcData, UINT64 InSize);
+	void UploadTexture(UploadBatch& Batch, ID3D12Resource* Dst, UINT FirstSubresource, UINT NumSubresources, const D3D12_SUBRESOURCE_DATA* SrcData);
+
+	// after the last copy to Dst in the batch. it is in StateAfter on the direct queue once TakeCompletedAcquires gave it out.
+	void Acquire(UploadBatch& Batch, ID3D12Resource* Dst, D3D12_RESOURCE_STATES StateAfter);
+	// COMMON -> StateAfter barriers of the submits the gpu is done with, to record on the direct queue before the resources are used
+	void TakeCompletedAcquires(vector<D3D12_RESOURCE_BARRIER>& OutBarriers);
+
+	// one ExecuteCommandLists for everything recorded. returns the fence value the copies are done at, 0 for an empty batch.
+	UINT64 Submit(UploadBatch& Batch);
+
+	bool IsComplete(UINT64 FenceValue) const { return Queue->m_fence->GetCompletedValue() >= FenceValue; }
+	void Wait(UINT64 FenceValue);
+	void WaitIdle();
+
+	UploadRingStats GetStats();
+
+	UploadRing(UINT64 InSize, CommandQueue* InQueue);
+	virtual ~UploadRing();
+};
+
+struct GpuTimelineRange
+{
+	string Name;
+	bool bCompute = false;
+	double BeginUs = 0; // cpu QPC time in microseconds
+	double EndUs = 0;
+};
+
+struct GpuTimelineFrame
+{
+	UINT64 FrameNumber = 0;
+	vector<GpuTimelineRange> Ranges;
+};
+
+// Timestamps around passes on the direct and the compute queue, to see what async compute overlaps.
+// one query heap with MaxRanges ranges per frame in flight. a frame's ranges are read back in BeginFrame once the frame fence of
+// its slot has passed and are put on the cpu QPC clock with each queue's clock calibration, so both queues are on one timeline.
+// main thread only.
+class GpuTimeline
+{
+	struct SlotRange
+	{
+		string Name;
+		bool bCompute;
+		bool bEnded;
+	};
+
+	ComPtr<ID3D12QueryHeap> QueryHeap;
+	ComPtr<ID3D12Resource> Readback;
+	UINT NumFrame = 0;
+	UINT MaxRanges = 0;
+
+	UINT CurrentSlot = 0;
+	UINT64 NextFrameNumber = 0;
+	vector<vector<SlotRange>> SlotRanges; // ranges recorded in each frame slot, by range index
+	vector<UINT64> SlotFrameNumbers;
+	deque<GpuTimelineFrame> History; // oldest first
+
+	UINT GetQueryIndex(UINT Slot, UINT Range) const { return (Slot * MaxRanges + Range) * 2; }
+
+public:
+	UINT MaxHistory = 120;
+
+	// the gpu has to be past the last frame that used Slot
+	void BeginFrame(UINT Slot, CommandQueue* DirectQ, CommandQueue* ComputeQ);
+
+	// returns the range index, ~0u when the frame has no ranges left. Cmd has to go to the compute queue when bCompute is set.
+	UINT BeginRange(CommandList* Cmd, const char* Name, bool bCompute);
+	// ~0u is ignored
+	void EndRange(CommandList* Cmd, UINT Range);
+
+	const deque<GpuTimelineFrame>& GetHistory() const { return History; }
+
+	// time on the compute queue and the part of it the direct queue was inside a range too
+	static void GetComputeOverlap(const GpuTimelineFrame& Frame, double& OutComputeUs, double& OutOverlapUs);
+
+	// the history as chrome://tracing json, one row per queue
+	bool WriteChromeTrace(const string& FileName) const;
+
+	GpuTimeline(UINT InNumFrame, UINT InMaxRanges);
+	virtual ~GpuTimeline();
+};
+
 class PipelineStateObject : public GfxPipelineStateObject
 {
 public:
@@ -142,12 +538,10 @@ public:
 		UINT rootParamIndex;
 		UINT baseRegister;
 		UINT numDescriptors;
+		UINT registerSpace = 0;
 		UINT cbSize;
 
 		Texture* texture;
-		Sampler* sampler;
-
-		UINT rootConst;
 	};
 
 
@@ -182,20 +576,36 @@ public:
 	void Apply(ID3D12GraphicsCommandList* CommandList);
 
 	void BindUAV(string name, int baseRegister);
-	void BindSRV(string name, int baseRegister, int num);
+	// num -1 : unbounded range, e.g. the bindless texture table
+	void BindSRV(string name, int baseRegister, int num, int space = 0);
 	void BindCBV(string name, int baseRegister, int size);
 	void BindRootConstant(string name, int baseRegister);
 	void BindSampler(string name, int baseRegister);
 
-	void SetSRV(string name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList);
-	void SetUAV(string name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList);
+	// every binding by slot, filled by Init
+	BindingLayout Layout;
+	vector<BindingData*> Slots;
+
+	// resolve once after Init and keep it. invalid when there is no binding with that name.
+	BindingSlot GetSlot(const BindingName& Name) const { return Layout.Find(Name); }
+
+	void SetSRV(BindingSlot Slot, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList);
+	void SetUAV(BindingSlot Slot, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList);
+	void SetSampler(BindingSlot Slot, Sampler* sampler, ID3D12GraphicsCommandList* CommandList);
+	void SetCBVValue(BindingSlot Slot, void* pData, ID3D12GraphicsCommandList* CommandList);
+	void SetCBVValue(BindingSlot Slot, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList);
+	void SetRootConstant(BindingSlot Slot, UINT value, ID3D12GraphicsCommandList* CommandList);
 
-	void SetSampler(string name, Sampler* sampler, ID3D12GraphicsCommandList* CommandList);
+	// by name, look the slot up on every call. a name the pso doesn't bind is skipped.
+	void SetSRV(const string& name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleSRV, ID3D12GraphicsCommandList* CommandList);
+	void SetUAV(const string& name, D3D12_GPU_DESCRIPTOR_HANDLE GpuHandleUAV, ID3D12GraphicsCommandList* CommandList);
 
-	void SetCBVValue(string name, void* pData, ID3D12GraphicsCommandList* CommandList);
-	void SetCBVValue(string name, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList);
+	void SetSampler(const string& name, Sampler* sampler, ID3D12GraphicsCommandList* CommandList);
 
-	void SetRootConstant(string, UINT value, ID3D12GraphicsCommandList* CommandList);
+	void SetCBVValue(const string& name, void* pData, ID3D12GraphicsCommandList* CommandList);
+	void SetCBVValue(const string& name, UINT64 GPUAddr, ID3D12GraphicsCommandList* CommandList);
+
+	void SetRootConstant(const string& name, UINT value, ID3D12GraphicsCommandList* CommandList);
 
 	PipelineStateObject() {}
 	virtual ~PipelineStateObject() {}
@@ -214,8 +624,11 @@ class RTPipelineStateObject : public GfxRTPipelineStateObject
 		Sampler* sampler;
 
 		UINT BaseRegister;
+		UINT NumDescriptors = 1; // UINT_MAX : unbounded
+		UINT RegisterSpace = 0;
 		D3D12_CPU_DESCRIPTOR_HANDLE CPUHandle; // for multiple instances
 		D3D12_GPU_DESCRIPTOR_HANDLE GPUHandle; // for multiple instances
+		UINT64 GPUAddress = 0; // global constant buffers, bound as root CBV
 	};
 	vector<BindingData> RaygenBinding;
 
@@ -282,6 +695,7 @@ public:
 	uint32_t ShaderTableEntrySize;
 	UINT ShaderTableSize;
 	ComPtr<ID3D12Resource> ShaderTable;
+	shared_ptr<PlacedMemory> ShaderTableMemory;
 
 	//UINT NumInstance;
 
@@ -290,7 +704,7 @@ public:
 	// new binding interface
 	void AddShader(string shader, RTPipelineStateObject::ShaderType shaderType);
 	void BindUAV(string shader, string name, UINT baseRegister);
-	void BindSRV(string shader, string name, UINT baseRegister);
+	void BindSRV(string shader, string name, UINT baseRegister, UINT numDescriptors = 1, UINT registerSpace = 0);
 	void BindSampler(string shader, string name, UINT baseRegister);
 	void BindCBV(string shader, string name, UINT baseRegister, UINT size);
 
@@ -298,6 +712,19 @@ public:
 	void EndShaderTable(UINT NumInstance);
 	void SetGlobalBinding(CommandList* CommandList);
 	
+	// global bindings by slot(index into GlobalBinding), filled by InitRS
+	BindingLayout GlobalLayout;
+
+	// resolve once after InitRS and keep it. invalid when there is no global binding with that name.
+	BindingSlot GetGlobalSlot(const BindingName& Name) const { return GlobalLayout.Find(Name); }
+
+	void SetSRV(BindingSlot GlobalSlot, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle);
+	void SetUAV(BindingSlot GlobalSlot, D3D12_GPU_DESCRIPTOR_HANDLE uavHandle);
+	void SetSampler(BindingSlot GlobalSlot, Sampler* sampler);
+	void SetCBVValue(BindingSlot GlobalSlot, void* pData);
+	void SetCBVValue(BindingSlot GlobalSlot, UINT64 GPUAddr);
+
+	// by name. "global" looks the slot up on every call, shaders search their bindings.
 	void SetUAV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE uavHandle, INT instanceIndex = -1);
 	void SetSRV(string shader, string bindingName, D3D12_GPU_DESCRIPTOR_HANDLE srvHandle, INT instanceIndex = -1);
 	void SetSampler(string shader, string bindingName, Sampler* sampler, INT instanceIndex = -1);
@@ -315,6 +742,10 @@ public:
 	virtual ~RTPipelineStateObject() {}
 };
 
+// process wide serial of a resource, kept in its private data. 0 for null.
+// a freed resource's address can come back with the next one placed or created, its serial never does.
+UINT64 GetResourceSerial(ID3D12Resource* Resource);
+
 class Buffer : public GfxBuffer
 {
 public:
@@ -330,16 +761,29 @@ public:
 	UINT NumElements;
 	UINT ElementSize;
 	ComPtr<ID3D12Resource> resource;
+	shared_ptr<PlacedMemory> Memory; // null when committed
 
 	Descriptor SRV;
 	Descriptor UAV;
 
+	// what UAV was made for by BeginFrame(GetResourceSerial of resource). it is made again only when resource or Type changes.
+	UINT64 ViewResourceSerial = 0;
+	BufferType ViewType = UNKNOWN;
+
+	TrackedState Tracked; // for CommandList::Require
 
 	void MakeByteAddressBufferSRV();
 	void MakeStructuredBufferSRV();
 
+	void MakeFrameViews();
+	void ReleaseFrameViews();
+
 	Buffer() {}
-	virtual ~Buffer() {}
+	virtual ~Buffer()
+	{
+		ReleaseFrameViews();
+		SRV.Free();
+	}
 };
 
 class IndexBuffer : public GfxIndexBuffer
@@ -347,12 +791,13 @@ class IndexBuffer : public GfxIndexBuffer
 public:
 	int numIndices;
 	ComPtr<ID3D12Resource> resource;
+	shared_ptr<PlacedMemory> Memory;
 	D3D12_INDEX_BUFFER_VIEW view;
 
 	Descriptor Descriptor;
 
 	IndexBuffer() {}
-	virtual ~IndexBuffer() {}
+	virtual ~IndexBuffer() { Descriptor.Free(); }
 };
 
 class VertexBuffer : public GfxVertexBuffer
@@ -360,12 +805,13 @@ class VertexBuffer : public GfxVertexBuffer
 public:
 	int numVertices;
 	ComPtr<ID3D12Resource> resource;
+	shared_ptr<PlacedMemory> Memory;
 	D3D12_VERTEX_BUFFER_VIEW view;
 
 	Descriptor Descriptor;
 
 	VertexBuffer() {}
-	virtual ~VertexBuffer() {}
+	virtual ~VertexBuffer() { Descriptor.Free(); }
 
 };
 
@@ -378,7 +824,7 @@ public:
 	Descriptor Descriptor;
 
 	Sampler(){}
-	virtual ~Sampler(){}
+	virtual ~Sampler() { Descriptor.Free(); }
 };
 
 class Texture : public GfxTexture
@@ -389,19 +835,34 @@ public:
 	D3D12_RESOURCE_DESC textureDesc;
 
 	ComPtr<ID3D12Resource> resource;
+	shared_ptr<PlacedMemory> Memory; // null when committed or not owned(swap chain)
 
 	Descriptor UAV;
 	Descriptor RTV;
 	Descriptor DSV;
 	Descriptor SRV;
 
+	// GetResourceSerial of the resource UAV/RTV/SRV were made for by BeginFrame, they are made again only when resource changes.
+	// a serial, not the pointer : a new resource placed where a freed one was can get the same address.
+	UINT64 ViewResourceSerial = 0;
+
+	TrackedState Tracked; // for CommandList::Require
+
+	UINT GetNumSubresources() const;
+
 	void MakeStaticSRV();
 	void MakeDSV();
 
+	void MakeFrameViews();
+	void ReleaseFrameViews();
+
 	void UploadSRCData3D(D3D12_SUBRESOURCE_DATA* SrcData);
 	Texture(){}
 	virtual ~Texture()
 	{
+		ReleaseFrameViews();
+		SRV.Free();
+		DSV.Free();
 	}
 };
 
@@ -415,14 +876,28 @@ public:
 	UINT64 CPUHeapStart;
 	UINT64 GPUHeapStart;
 
-	UINT NumAllocated = 0;
 	UINT MaxNumDescriptors = 0;
+
+	DescriptorAllocator Allocator;
+	DescriptorAddressing Addressing;
+	std::mutex Mtx;
+
 public:
 	DescriptorHeap()
 	{
 	}
 	void Init(D3D12_DESCRIPTOR_HEAP_DESC& InHeapDesc);
 
+	// Num contiguous descriptors that stay until Free. throws E_OUTOFMEMORY when the heap is full instead of wrapping around.
+	void Alloc(Descriptor& OutDescriptor, UINT Num = 1);
+
+	// the range is reused once the gpu is past everything recorded so far(same as PlacedHeapPool).
+	void Free(Descriptor& InDescriptor);
+	void ProcessPendingFrees(UINT64 CompletedFenceValue);
+
+	DescriptorAllocatorStats GetStats();
+
+	// permanent ranges, for the rings
 	void AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle);
 
 	void AllocDescriptors(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT num);
@@ -439,12 +914,15 @@ public:
 	UINT NumFrame = 0;
 	UINT CurrentFrame = 0;
 	UINT NumDescriptors = 0;
-	UINT NumAllocated = 0;
+	std::atomic<UINT> NumAllocated = 0;
+	UINT LastFrameAllocated = 0;
 	UINT DescriptorSize;
 
 public:
 	void Init(DescriptorHeap* InDHHeap, UINT InNumDescriptors, UINT InNumFrame);
+	// thread safe. g-buffer draws don't take any(root CBVs, static SRVs), so one atomic add is enough here.
 	UINT AllocDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle, D3D12_GPU_DESCRIPTOR_HANDLE& gpuHandle, UINT32 Num = 1);
+	// between frames, nothing may be allocating
 	void Advance();
 
 	DescriptorHeapRing(){}
@@ -458,7 +936,11 @@ class ConstantBufferRingBuffer
 	UINT CurrentFrame = 0;
 	UINT TotalSize;
 
-	UINT AllocPos = 0;
+	// every thread takes ThreadChunkSize bytes of the frame at a time and sub allocates from that, so threads recording draws
+	// at the same time only meet on AllocPos once per chunk.
+	static const UINT ThreadChunkSize = 64 * 1024;
+	std::atomic<UINT> AllocPos = 0;
+	UINT64 Generation = 0; // new for every frame and ring, chunks of another one are dropped
 	
 	void* MemMapped = nullptr;
 
@@ -466,7 +948,9 @@ class ConstantBufferRingBuffer
 
 public:
 
+	// thread safe
 	std::tuple<UINT64, UINT8*> AllocGPUMemory(UINT InSize);
+	// between frames, nothing may be allocating
 	void Advance();
 
 	ConstantBufferRingBuffer(UINT InSize, UINT InNumFrame);
@@ -510,8 +994,12 @@ public:
 	ComPtr<ID3D12Resource> Result;
 	ComPtr<ID3D12Resource> Instance;
 
+	shared_ptr<PlacedMemory> ScratchMemory;
+	shared_ptr<PlacedMemory> ResultMemory;
+	shared_ptr<PlacedMemory> InstanceMemory;
+
 	RTAS() {}
-	virtual ~RTAS() {}
+	virtual ~RTAS() { Descriptor.Free(); }
 };
 
 
@@ -531,6 +1019,10 @@ public:
 	unique_ptr<CommandQueue> CmdQ;
 	CommandList* GlobalCmdList = nullptr;
 
+	unique_ptr<CommandQueue> ComputeQ; // async compute, see BeginAsyncCompute
+	unique_ptr<CommandQueue> CopyQ; // UploadRing copies
+	UINT64 UnwaitedComputeFence = 0; // EndAsyncCompute that no WaitAsyncCompute has covered yet
+
 	vector<UINT32> FrameFenceValueVec;
 
 	std::unique_ptr<DescriptorHeap> RTVDescriptorHeap;
@@ -540,17 +1032,53 @@ public:
 	std::unique_ptr<DescriptorHeap> SRVCBVDescriptorHeapStorage;
 
 	std::unique_ptr<DescriptorHeapRing> GlobalDHRing; // resources that changes every frame.
-	std::unique_ptr<DescriptorHeapRing> TextureDHRing; // can be changed only when new texture is added or removed. it works like static at this moment.
-	std::unique_ptr<DescriptorHeapRing> GeomtryDHRing;
 
 	std::unique_ptr<ConstantBufferRingBuffer> GlobalCBRing;
 
 	std::unique_ptr<DescriptorHeapRing> GlobalRTDHRing; // can be changed only when new texture is added or removed. it works like static at this moment.
 
+	// views of the textures/buffers passed to BeginFrame
+	bool bCacheFrameViews = true; // false makes every view again each frame, like before, to compare
+	double BeginFrameCpuMs = 0; // BeginFrame without the wait for the frame's fence
+	UINT NumFrameViewsWritten = 0;
+
+	// tracked barriers(CommandList::Require). false flushes every Require on its own and makes no split barriers, to compare.
+	bool bBatchBarriers = true;
+	BarrierStats FrameBarriers; // of the lists submitted during the last frame, direct and compute queue
+	BarrierStats SubmittedBarriers; // totals when FrameBarriers was taken
+
+	// placed resource pools. separate heaps per kind so tier 1 heaps work and render targets don't fragment the texture heaps.
+	shared_ptr<PlacedHeapPool> BufferPool;
+	shared_ptr<PlacedHeapPool> UploadBufferPool;
+	shared_ptr<PlacedHeapPool> TexturePool;
+	shared_ptr<PlacedHeapPool> RenderTargetPool;
+	shared_ptr<PlacedHeapPool> AccelerationStructurePool;
+	vector<shared_ptr<PlacedHeapPool>> HeapPools;
+
+	unique_ptr<TransientTexturePool> TransientTextures;
+
+	unique_ptr<UploadRing> Uploads;
+	unique_ptr<UploadBatch> LoadBatch; // open between BeginLoadBatch/EndLoadBatch
+
+	unique_ptr<GpuTimeline> Timeline;
+
+	// dxc is loaded once, every shader goes through the same compiler/library/include handler
+	dxc::DxcDllSupport DxcHelper;
+	ComPtr<IDxcCompiler> DxcCompiler;
+	ComPtr<IDxcLibrary> DxcLibrary;
+	ComPtr<IDxcIncludeHandler> DxcIncludeHandler;
+	mutex DxcMtx;
+
+	// compiled dxil on disk, keyed by the shader with its includes, defines, target and the dxc version
+	unique_ptr<ShaderCache> Shaders;
+
 
 	std::vector<std::shared_ptr<Texture>> renderTargetTextures;
 	std::list<Buffer*> DynamicBuffers;
 
+	// dropped in BeginFrame once the gpu is past every frame recorded before DeferRelease
+	std::list<pair<shared_ptr<void>, UINT64>> DeferredReleases;
+
 
 	bool m_windowedMode;
 
@@ -569,12 +1097,62 @@ public:
 	void BeginFrame(std::list<Texture*>& DynamicTexture);
 	void EndFrame();
 
+	// keeps Object alive until frames in flight are done with it, e.g. a buffer replaced while the gpu may still read the old one
+	void DeferRelease(shared_ptr<void> Object);
+
+	// submits what GlobalCmdList has recorded so far followed by Lists, then the frame goes on in a new GlobalCmdList.
+	// Lists are recorded on other threads(multithreaded g-buffer) and have to set all of their state themselves.
+	void InsertCommandLists(const vector<CommandList*>& Lists);
+
+	// async compute. BeginAsyncCompute gives a list of ComputeQ with the descriptor heaps set. only compute work and states a compute
+	// queue takes(no PIXEL_SHADER_RESOURCE, no render target) can be recorded in it. EndAsyncCompute submits it after everything
+	// submitted to CmdQ so far and returns its fence value on ComputeQ. WaitAsyncCompute submits GlobalCmdList and makes the rest of
+	// the frame wait for that value. it has to come before EndFrame of the same frame, then the frame fence covers the compute work too
+	// (constant buffer ring, descriptor ring, pending frees).
+	CommandList* BeginAsyncCompute();
+	UINT64 EndAsyncCompute(CommandList* Cmd);
+	void WaitAsyncCompute(UINT64 FenceValue);
+
+	// the whole shader visible SRV heap as one table(bindless textures). a static SRV is at index SRV.Handle.Index in it.
+	D3D12_GPU_DESCRIPTOR_HANDLE GetBindlessTable();
+
+	// while a load batch is open CreateBuffer/CreateIndexBuffer/CreateVertexBuffer/CreateTextureFromFile/UploadSRCData3D only record
+	// their copies, EndLoadBatch submits them all at once and waits. nothing may read those resources on gpu before that. main thread only.
+	void BeginLoadBatch();
+	void EndLoadBatch();
+
+	// the open load batch, or a new one that EndUpload submits and waits for right away
+	UploadBatch* BeginUpload(UploadBatch& Immediate);
+	void EndUpload(UploadBatch* Batch);
+
+	// hands the resources of finished uploads to the direct queue, recorded on Cmd or on a list of their own that is submitted
+	// right away when Cmd is null. BeginFrame does it for GlobalCmdList, EndUpload/EndLoadBatch after their wait.
+	void AcquireUploads(CommandList* Cmd);
+
 	Texture* CreateTexture2D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int mipLevels, std::optional<glm::vec4> clearColor = std::nullopt);
 	Texture* CreateTexture3D(DXGI_FORMAT format, D3D12_RESOURCE_FLAGS resFlags, D3D12_RESOURCE_STATES initResState, int width, int height, int depth, int mipLevels);
 	Texture* CreateTextureFromFile(wstring fileName, bool nonSRGB);
 
+	// CreateTextureFromFile in steps so reading, decoding and upload can run off the main thread.
+	// ReadTextureFile reads what fileName loads from whole : its cooked dds for the color space (TextureCook) when it is up to date,
+	// otherwise the file itself. DecodeTextureImage decodes those bytes and builds mips on the cpu, the extension of the file that
+	// was read picks the loader. LoadTextureImage does both. CreateTextureFromImage records the upload into Batch,
+	// the texture can be used once the batch is submitted and done. SRV is left to the caller(MakeStaticSRV).
+	static bool ReadTextureFile(const wstring& fileName, bool nonSRGB, wstring& outFile, vector<UINT8>& outBytes);
+	static bool DecodeTextureImage(const wstring& file, const vector<UINT8>& bytes, DirectX::ScratchImage& image);
+	static bool LoadTextureImage(const wstring& fileName, bool nonSRGB, DirectX::ScratchImage& image);
+	Texture* CreateTextureFromImage(const DirectX::ScratchImage& image, const wstring& name, bool nonSRGB, UploadBatch& Batch);
+
+	// uploads right away and makes the srv, like CreateTextureFromFile
+	Texture* CreateTextureFromImage(const DirectX::ScratchImage& image, const wstring& name, bool nonSRGB);
+
 	shared_ptr<Texture> CreateTexture2DFromResource(ComPtr<ID3D12Resource> InResource); // used only by SimpleDX12
 
+	// placed in Pool when it fits, committed otherwise(OutMemory stays null). Pool may be null for heap types without a pool.
+	ComPtr<ID3D12Resource> CreateResourceInPool(const shared_ptr<PlacedHeapPool>& Pool, D3D12_HEAP_TYPE HeapType, const D3D12_RESOURCE_DESC& Desc, D3D12_RESOURCE_STATES InitState, const D3D12_CLEAR_VALUE* ClearValue, shared_ptr<PlacedMemory>& OutMemory);
+	shared_ptr<PlacedHeapPool> GetTexturePool(D3D12_RESOURCE_FLAGS Flags);
+	shared_ptr<PlacedHeapPool> GetBufferPool(D3D12_HEAP_TYPE HeapType);
+
 
 	Sampler* CreateSampler(D3D12_SAMPLER_DESC& InSamplerDesc);
 	Buffer* CreateBuffer(UINT InNumElements, UINT InElementSize, D3D12_HEAP_TYPE InType, D3D12_RESOURCE_STATES initResState, D3D12_RESOURCE_FLAGS InFlags, void* SrcData = nullptr);
@@ -587,6 +1165,9 @@ public:
 
 	ComPtr<ID3DBlob> CreateShader(wstring FileName, string EntryPoint, string Target);
 	ComPtr<ID3DBlob> CreateShaderDXC(wstring FileName, wstring EntryPoint, wstring Target, std::optional<vector< DxcDefine>>  Defines);
+	// a hit in Shaders loads the dxil, a miss compiles it with dxc and stores it. nullptr on errors, they go to errorString.
+	ComPtr<ID3DBlob> CompileDXC(const wstring& FileName, const wstring& EntryPoint, const wstring& Target, vector<LPCWSTR> Arguments, const std::optional<vector<DxcDefine>>& Defines);
+	void InitShaderCompiler();
 
 
 	void PresentBarrier(Texture* rt);
@@ -599,4 +1180,5 @@ public:
 	virtual ~SimpleDX12();
 };
 
+extern SimpleDX12* g_dx12_rhi;
 
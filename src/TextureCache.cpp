@@ -0,0 +1,158 @@
+#include "TextureCache.h"
+#include "SimpleDX12.h"
+#include "Utils.h"
+
+#include <vector>
+#include <cwctype>
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+wstring NormalizeTexturePath(const wstring& FileName)
+{
+	wstring path = FileName;
+
+	DWORD length = GetFullPathNameW(FileName.c_str(), 0, nullptr, nullptr);
+	if (length > 0)
+	{
+		path.resize(length);
+		length = GetFullPathNameW(FileName.c_str(), length, &path[0], nullptr);
+		path.resize(length);
+	}
+
+	for (auto& c : path)
+		c = c == L'/' ? L'\\' : towlower(c);
+	return path;
+}
+
+bool HashTextureData(const vector<UINT8>& Bytes, bool nonSRGB, TextureContentKey& OutKey)
+{
+	// the provider handle can be used from several threads at once, it's opened on first use and kept
+	static BCRYPT_ALG_HANDLE algorithm = []()
+	{
+		BCRYPT_ALG_HANDLE handle = nullptr;
+		if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&handle, BCRYPT_SHA256_ALGORITHM, nullptr, 0)))
+			return BCRYPT_ALG_HANDLE(nullptr);
+		return handle;
+	}();
+
+	if (!algorithm || !BCRYPT_SUCCESS(BCryptHash(algorithm, nullptr, 0, const_cast<PUCHAR>(Bytes.data()), ULONG(Bytes.size()), OutKey.Hash, sizeof(OutKey.Hash))))
+		return false;
+
+	OutKey.Size = Bytes.size();
+	OutKey.bNonSRGB = nonSRGB;
+	return true;
+}
+
+// srgb and linear views of the same file are different textures
+wstring GetTexturePathKey(const wstring& FileName, bool nonSRGB)
+{
+	return NormalizeTexturePath(FileName) + (nonSRGB ? L"|linear" : L"|srgb");
+}
+
+static UINT64 GetTextureGpuSize(GfxTexture* Tex)
+{
+	Texture* tex = static_cast<Texture*>(Tex);
+
+	ComPtr<ID3D12Device> device;
+	if (!tex->resource || FAILED(tex->resource->GetDevice(IID_PPV_ARGS(&device))))
+		return 0;
+
+	return device->GetResourceAllocationInfo(0, 1, &tex->textureDesc).SizeInBytes;
+}
+
+shared_ptr<GfxTexture> TextureCache::Load(const wstring& FileName, bool nonSRGB)
+{
+	if (shared_ptr<GfxTexture> tex = FindPath(FileName, nonSRGB))
+		return tex;
+
+	wstring file;
+	vector<UINT8> bytes;
+	TextureContentKey contentKey;
+	if (!SimpleDX12::ReadTextureFile(FileName, nonSRGB, file, bytes) || !HashTextureData(bytes, nonSRGB, contentKey))
+		return nullptr;
+
+	if (shared_ptr<GfxTexture> tex = FindContent(FileName, contentKey))
+		return tex;
+
+	DirectX::ScratchImage image;
+	if (!SimpleDX12::DecodeTextureImage(file, bytes, image))
+		return nullptr;
+
+	shared_ptr<GfxTexture> tex = shared_ptr<GfxTexture>(g_dx12_rhi->CreateTextureFromImage(image, FileName, nonSRGB));
+
+	Add(FileName, contentKey, tex);
+	return tex;
+}
+
+shared_ptr<GfxTexture> TextureCache::FindPath(const wstring& FileName, bool nonSRGB)
+{
+	wstring pathKey = GetTexturePathKey(FileName, nonSRGB);
+
+	lock_guard<mutex> lock(Mtx);
+
+	auto pathIt = PathEntries.find(pathKey);
+	if (pathIt == PathEntries.end())
+		return nullptr;
+
+	shared_ptr<GfxTexture> tex = pathIt->second.Texture.lock();
+	if (tex)
+	{
+		Stats.NumPathHits++;
+		Stats.FileBytesSaved += pathIt->second.FileSize;
+		Stats.GpuBytesSaved += pathIt->second.GpuSize;
+	}
+	return tex;
+}
+
+shared_ptr<GfxTexture> TextureCache::FindContent(const wstring& FileName, const TextureContentKey& Key)
+{
+	wstring pathKey = GetTexturePathKey(FileName, Key.bNonSRGB);
+
+	lock_guard<mutex> lock(Mtx);
+
+	auto contentIt = ContentEntries.find(Key);
+	if (contentIt == ContentEntries.end())
+		return nullptr;
+
+	shared_ptr<GfxTexture> tex = contentIt->second.Texture.lock();
+	if (tex)
+	{
+		Stats.NumContentHits++;
+		Stats.FileBytesSaved += contentIt->second.FileSize;
+		Stats.GpuBytesSaved += contentIt->second.GpuSize;
+		PathEntries[pathKey] = contentIt->second;
+	}
+	return tex;
+}
+
+void TextureCache::Add(const wstring& FileName, const TextureContentKey& Key, shared_ptr<GfxTexture> Tex)
+{
+	Entry entry;
+	entry.Texture = Tex;
+	entry.FileSize = Key.Size;
+	entry.GpuSize = GetTextureGpuSize(Tex.get());
+
+	wstring pathKey = GetTexturePathKey(FileName, Key.bNonSRGB);
+
+	lock_guard<mutex> lock(Mtx);
+
+	Stats.NumMisses++;
+	PathEntries[pathKey] = entry;
+	ContentEntries[Key] = entry;
+}
+
+void TextureCache::Clear()
+{
+	lock_guard<mutex> lock(Mtx);
+
+	PathEntries.clear();
+	ContentEntries.clear();
+	Stats = TextureCacheStats();
+}
+
+TextureCacheStats TextureCache::GetStatsSnapshot()
+{
+	lock_guard<mutex> lock(Mtx);
+	return Stats;
+}
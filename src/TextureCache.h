@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "AbstractGfxLayer.h"
+
+using namespace std;
+
+// Texture cache in front of SimpleDX12's texture loading.
+// same file through a different relative path, and byte identical files under different names, share one GfxTexture.
+// a miss reads the file once (SimpleDX12::ReadTextureFile), the bytes are hashed for the content key and then decoded.
+// entries are weak, a texture is freed as usual once no material holds it anymore.
+
+struct TextureCacheStats
+{
+	UINT NumPathHits = 0;
+	UINT NumContentHits = 0; // different path, identical bytes
+	UINT NumMisses = 0;
+	UINT64 FileBytesSaved = 0; // file bytes not decoded again
+	UINT64 GpuBytesSaved = 0; // texture memory not allocated again
+};
+
+// sha-256 of the bytes that get decoded, so equal keys are taken as equal files and the texture is shared without comparing them.
+struct TextureContentKey
+{
+	UINT8 Hash[32] = {};
+	UINT64 Size = 0;
+	bool bNonSRGB = false;
+
+	bool operator<(const TextureContentKey& Other) const
+	{
+		int order = memcmp(Hash, Other.Hash, sizeof(Hash));
+		if (order != 0) return order < 0;
+		if (Size != Other.Size) return Size < Other.Size;
+		return bNonSRGB < Other.bNonSRGB;
+	}
+};
+
+class TextureCache
+{
+	struct Entry
+	{
+		weak_ptr<GfxTexture> Texture;
+		UINT64 FileSize = 0;
+		UINT64 GpuSize = 0;
+	};
+
+	mutex Mtx;
+	map<wstring, Entry> PathEntries; // normalized path, srgb flag appended
+	map<TextureContentKey, Entry> ContentEntries;
+	TextureCacheStats Stats; // under Mtx, streaming workers count into it while the ui reads
+
+public:
+
+	// nullptr when the file doesn't exist or can't be loaded, like CreateTextureFromFile.
+	shared_ptr<GfxTexture> Load(const wstring& FileName, bool nonSRGB);
+
+	// the steps of Load for loaders that create the texture themselves (TextureStreamer).
+	// lookups count hits, Add counts a miss. safe to call from worker threads.
+	shared_ptr<GfxTexture> FindPath(const wstring& FileName, bool nonSRGB);
+	shared_ptr<GfxTexture> FindContent(const wstring& FileName, const TextureContentKey& Key);
+	void Add(const wstring& FileName, const TextureContentKey& Key, shared_ptr<GfxTexture> Tex);
+
+	void Clear();
+
+	// copy taken under the lock
+	TextureCacheStats GetStatsSnapshot();
+};
+
+// false when the hash provider isn't available.
+bool HashTextureData(const vector<UINT8>& Bytes, bool nonSRGB, TextureContentKey& OutKey);
+
+// absolute, lower case, backslash separated.
+wstring NormalizeTexturePath(const wstring& FileName);
+
+// normalized path with the srgb flag appended
+wstring GetTexturePathKey(const wstring& FileName, bool nonSRGB);
@@ -0,0 +1,259 @@
+#include "TextureCooker.h"
+#include "enkiTS/TaskScheduler.h"
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifdef _DEBUG
+#pragma comment(lib, "Debug/DirectXTex.lib")
+#else
+#pragma comment(lib, "Release/DirectXTex.lib")
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+// rows per compression job, a multiple of the 4x4 block height
+static const UINT CompressStripHeight = 64;
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+static bool GetWriteTime(const wstring& File, fs::file_time_type& OutWriteTime)
+{
+	error_code ec;
+	OutWriteTime = fs::last_write_time(File, ec);
+	return !ec;
+}
+
+wstring GetCookedTexturePath(const wstring& SourceFile, bool nonSRGB)
+{
+	return SourceFile + (nonSRGB ? L".linear.cooked.dds" : L".srgb.cooked.dds");
+}
+
+wstring FindCookedTexture(const wstring& SourceFile, bool nonSRGB)
+{
+	wstring cookedFile = GetCookedTexturePath(SourceFile, nonSRGB);
+
+	fs::file_time_type sourceTime, cookedTime;
+	if (!GetWriteTime(cookedFile, cookedTime) || !GetWriteTime(SourceFile, sourceTime) || cookedTime < sourceTime)
+		return wstring();
+	return cookedFile;
+}
+
+DXGI_FORMAT GetCookedTextureFormat(TextureCookType Type)
+{
+	switch (Type)
+	{
+	case TEXTURE_COOK_ALBEDO: return DXGI_FORMAT_BC7_UNORM_SRGB;
+	case TEXTURE_COOK_NORMAL: return DXGI_FORMAT_BC5_UNORM;
+	default: return DXGI_FORMAT_BC4_UNORM;
+	}
+}
+
+bool IsCookedTextureSRGB(TextureCookType Type)
+{
+	return DirectX::IsSRGB(GetCookedTextureFormat(Type));
+}
+
+bool DecodeTextureSource(const wstring& SourceFile, TextureCookType Type, DirectX::ScratchImage& OutMips)
+{
+	error_code ec;
+	if (!fs::is_regular_file(SourceFile, ec))
+		return false;
+
+	wstring extension = fs::path(SourceFile).extension().wstring();
+	for (auto& c : extension)
+		c = towlower(c);
+
+	DirectX::ScratchImage decoded;
+	HRESULT hr;
+	if (extension == L".dds")
+		hr = DirectX::LoadFromDDSFile(SourceFile.c_str(), DirectX::DDS_FLAGS_NONE, nullptr, decoded);
+	else if (extension == L".tga")
+		hr = DirectX::LoadFromTGAFile(SourceFile.c_str(), nullptr, decoded);
+#ifdef _WIN32
+	else
+		hr = DirectX::LoadFromWICFile(SourceFile.c_str(), DirectX::WIC_FLAGS_NONE, nullptr, decoded);
+#else
+	// no WIC outside windows, png/jpg sources have to be converted first
+	else
+		return false;
+#endif
+	if (FAILED(hr))
+		return false;
+
+	return BuildTextureMips(*decoded.GetImage(0, 0, 0), Type, OutMips);
+}
+
+bool BuildTextureMips(const DirectX::Image& Source, TextureCookType Type, DirectX::ScratchImage& OutMips)
+{
+	// everything goes through rgba8 so the compressors and the psnr see the same bytes the runtime would
+	const DirectX::Image* top = &Source;
+	DirectX::ScratchImage rgba;
+	HRESULT hr;
+	if (DirectX::IsCompressed(top->format))
+		hr = DirectX::Decompress(*top, DXGI_FORMAT_R8G8B8A8_UNORM, rgba);
+	else if (top->format != DXGI_FORMAT_R8G8B8A8_UNORM)
+		hr = DirectX::Convert(*top, DXGI_FORMAT_R8G8B8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, rgba);
+	else
+		hr = rgba.InitializeFromImage(*top);
+	if (FAILED(hr))
+		return false;
+
+	// albedo is filtered in linear space, like the gpu samples it
+	if (Type == TEXTURE_COOK_ALBEDO)
+		rgba.OverrideFormat(DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+
+	return SUCCEEDED(DirectX::GenerateMipMaps(*rgba.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, OutMips, false));
+}
+
+struct CompressStrip
+{
+	const DirectX::Image* Src;
+	const DirectX::Image* Dst;
+	UINT Y;
+	UINT Height;
+};
+
+struct CompressTaskSet : public enki::ITaskSet
+{
+	const vector<CompressStrip>* Strips;
+	DXGI_FORMAT Format;
+	DWORD Flags;
+	atomic<bool> bFailed = false;
+
+	virtual void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum)
+	{
+		for (UINT i = range.start; i < range.end; i++)
+		{
+			const CompressStrip& strip = (*Strips)[i];
+
+			DirectX::Image src = *strip.Src;
+			src.height = strip.Height;
+			src.pixels += strip.Y * src.rowPitch;
+			src.slicePitch = src.rowPitch * strip.Height;
+
+			DirectX::ScratchImage out;
+			if (FAILED(DirectX::Compress(src, Format, Flags, DirectX::TEX_THRESHOLD_DEFAULT, out)))
+			{
+				bFailed = true;
+				continue;
+			}
+
+			// same width, so the block rows have the same pitch as the destination mip
+			memcpy(strip.Dst->pixels + (strip.Y / 4) * strip.Dst->rowPitch, out.GetPixels(), out.GetPixelsSize());
+		}
+	}
+};
+
+bool CompressTexture(const DirectX::ScratchImage& Mips, TextureCookType Type, bool bQuick, enki::TaskScheduler* TS, DirectX::ScratchImage& OutCompressed)
+{
+	const DirectX::TexMetadata& metaData = Mips.GetMetadata();
+	const DXGI_FORMAT format = GetCookedTextureFormat(Type);
+
+	// d3d12 wants the top level of a block compressed texture in whole blocks
+	if (metaData.width % 4 != 0 || metaData.height % 4 != 0)
+		return false;
+
+	if (FAILED(OutCompressed.Initialize2D(format, metaData.width, metaData.height, 1, metaData.mipLevels)))
+		return false;
+
+	vector<CompressStrip> strips;
+	for (UINT mip = 0; mip < metaData.mipLevels; mip++)
+	{
+		const DirectX::Image* src = Mips.GetImage(mip, 0, 0);
+		const DirectX::Image* dst = OutCompressed.GetImage(mip, 0, 0);
+		for (UINT y = 0; y < src->height; y += CompressStripHeight)
+		{
+			UINT height = UINT(src->height) - y;
+			strips.push_back({ src, dst, y, height < CompressStripHeight ? height : CompressStripHeight });
+		}
+	}
+
+	CompressTaskSet task;
+	task.Strips = &strips;
+	task.Format = format;
+	task.Flags = DirectX::TEX_COMPRESS_DEFAULT | (bQuick ? DirectX::TEX_COMPRESS_BC7_QUICK : 0);
+	task.m_SetSize = UINT(strips.size());
+
+	TS->AddTaskSetToPipe(&task);
+	TS->WaitforTask(&task);
+
+	return !task.bFailed;
+}
+
+float ComputeTexturePSNR(const DirectX::ScratchImage& Mips, const DirectX::ScratchImage& Compressed, TextureCookType Type)
+{
+	const DirectX::Image* src = Mips.GetImage(0, 0, 0);
+
+	DirectX::ScratchImage decoded;
+	if (FAILED(DirectX::Decompress(*Compressed.GetImage(0, 0, 0), src->format, decoded)))
+		return 0;
+	const DirectX::Image* dst = decoded.GetImage(0, 0, 0);
+
+	// rgb for albedo (mostly opaque alpha would only inflate the number). BC5 keeps xy, BC4 keeps x.
+	const UINT numChannels = Type == TEXTURE_COOK_ALBEDO ? 3 : Type == TEXTURE_COOK_NORMAL ? 2 : 1;
+
+	double sum = 0;
+	for (size_t y = 0; y < src->height; y++)
+	{
+		const UINT8* a = src->pixels + y * src->rowPitch;
+		const UINT8* b = dst->pixels + y * dst->rowPitch;
+		for (size_t x = 0; x < src->width; x++)
+		{
+			for (UINT c = 0; c < numChannels; c++)
+			{
+				double d = double(a[x * 4 + c]) - double(b[x * 4 + c]);
+				sum += d * d;
+			}
+		}
+	}
+
+	double mse = sum / (double(src->width) * src->height * numChannels);
+	if (mse == 0)
+		return 99.0f;
+	return float(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+bool CookTexture(const wstring& SourceFile, TextureCookType Type, bool bQuick, enki::TaskScheduler* TS, TextureCookResult* OutResult)
+{
+	auto start = chrono::high_resolution_clock::now();
+	DirectX::ScratchImage mips;
+	if (!DecodeTextureSource(SourceFile, Type, mips))
+		return false;
+	double decodeMS = ElapsedMS(start);
+
+	start = chrono::high_resolution_clock::now();
+	DirectX::ScratchImage compressed;
+	if (!CompressTexture(mips, Type, bQuick, TS, compressed))
+		return false;
+	double compressMS = ElapsedMS(start);
+
+	if (FAILED(DirectX::SaveToDDSFile(compressed.GetImages(), compressed.GetImageCount(), compressed.GetMetadata(), DirectX::DDS_FLAGS_NONE,
+		GetCookedTexturePath(SourceFile, !IsCookedTextureSRGB(Type)).c_str())))
+		return false;
+
+	if (OutResult)
+	{
+		const DirectX::TexMetadata& metaData = compressed.GetMetadata();
+		OutResult->Width = UINT(metaData.width);
+		OutResult->Height = UINT(metaData.height);
+		OutResult->NumMips = UINT(metaData.mipLevels);
+		OutResult->Format = metaData.format;
+		OutResult->UncompressedBytes = mips.GetPixelsSize();
+		OutResult->CookedBytes = compressed.GetPixelsSize();
+		OutResult->PSNR = ComputeTexturePSNR(mips, compressed, Type);
+		OutResult->DecodeMS = decodeMS;
+		OutResult->CompressMS = compressMS;
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string>
+
+#include "DirectXTex.h"
+
+using namespace std;
+
+namespace enki
+{
+	class TaskScheduler;
+}
+
+// Offline texture cooking.
+// a source image is decoded once, gets its full mip chain and is block compressed to "<texture>.srgb.cooked.dds" or
+// "<texture>.linear.cooked.dds". LoadTextureImage loads the one for the color space it was asked for through its dds path
+// instead of the source when it is newer, so nothing is decoded or mipped at runtime.
+// only DirectXTex and enkiTS are needed here, so it also builds outside windows (see the top of tools/TextureCook.cpp).
+
+enum TextureCookType
+{
+	TEXTURE_COOK_ALBEDO, // BC7 srgb, alpha kept
+	TEXTURE_COOK_NORMAL, // BC5, xy only. shaders rebuild z
+	TEXTURE_COOK_MASK, // BC4, roughness/metallic are read from .x
+};
+
+struct TextureCookResult
+{
+	UINT Width = 0;
+	UINT Height = 0;
+	UINT NumMips = 0;
+	DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+	UINT64 UncompressedBytes = 0; // rgba8 with the same mips, what CreateTextureFromFile makes from the source
+	UINT64 CookedBytes = 0;
+	float PSNR = 0; // top mip, over the channels the format keeps
+	double DecodeMS = 0; // decode + mips
+	double CompressMS = 0;
+};
+
+// albedo is cooked srgb, normals and masks linear. a texture used both ways (an albedo used as a mask) gets one file per color space.
+wstring GetCookedTexturePath(const wstring& SourceFile, bool nonSRGB);
+
+// the cooked file for that color space when it exists and is at least as new as the source, otherwise empty.
+wstring FindCookedTexture(const wstring& SourceFile, bool nonSRGB);
+
+DXGI_FORMAT GetCookedTextureFormat(TextureCookType Type);
+
+bool IsCookedTextureSRGB(TextureCookType Type);
+
+// rgba8 (srgb for albedo) with every mip down to 1x1.
+bool DecodeTextureSource(const wstring& SourceFile, TextureCookType Type, DirectX::ScratchImage& OutMips);
+
+// same for an image already in memory
+bool BuildTextureMips(const DirectX::Image& Source, TextureCookType Type, DirectX::ScratchImage& OutMips);
+
+// the mips are cut into strips of block rows which are compressed in parallel on TS.
+// bQuick trades some BC7 quality for several times the speed.
+bool CompressTexture(const DirectX::ScratchImage& Mips, TextureCookType Type, bool bQuick, enki::TaskScheduler* TS, DirectX::ScratchImage& OutCompressed);
+
+float ComputeTexturePSNR(const DirectX::ScratchImage& Mips, const DirectX::ScratchImage& Compressed, TextureCookType Type);
+
+// decode, compress and write GetCookedTexturePath(SourceFile, !IsCookedTextureSRGB(Type)).
+bool CookTexture(const wstring& SourceFile, TextureCookType Type, bool bQuick, enki::TaskScheduler* TS, TextureCookResult* OutResult = nullptr);
@@ -0,0 +1,184 @@
+#include "TextureStreamer.h"
+#include "SimpleDX12.h"
+#include "DirectXTex.h"
+
+void TextureStreamer::Job::Execute()
+{
+	Streamer->LoadJob(this);
+}
+
+void TextureStreamer::Initialize(enki::TaskScheduler* InTS, TextureCache* InCache)
+{
+	TS = InTS;
+	Cache = InCache;
+}
+
+void TextureStreamer::Request(const wstring& FileName, bool nonSRGB, shared_ptr<GfxMaterial> Material, shared_ptr<GfxTexture> GfxMaterial::* Member)
+{
+	if (shared_ptr<GfxTexture> tex = Cache->FindPath(FileName, nonSRGB))
+	{
+		(*Material).*Member = tex;
+		return;
+	}
+
+	wstring pathKey = GetTexturePathKey(FileName, nonSRGB);
+
+	auto pendingIt = PendingPaths.find(pathKey);
+	if (pendingIt != PendingPaths.end())
+	{
+		pendingIt->second->Slots.push_back({ Material, Member });
+		return;
+	}
+
+	// pinned to the workers round robin. a main thread WaitforTask never picks them up, so decoding can't stall a frame.
+	const UINT32 numThreads = TS->GetNumTaskThreads();
+	const UINT32 thread = numThreads > 1 ? 1 + NextThread++ % (numThreads - 1) : 0;
+
+	shared_ptr<Job> job = make_shared<Job>(thread);
+	job->Streamer = this;
+	job->FileName = FileName;
+	job->PathKey = pathKey;
+	job->bNonSRGB = nonSRGB;
+	job->Slots.push_back({ Material, Member });
+
+	Jobs.push_back(job);
+	PendingPaths[pathKey] = job;
+
+	TS->AddPinnedTask(job.get());
+}
+
+void TextureStreamer::LoadJob(Job* job)
+{
+	// read once, the same bytes are hashed and decoded
+	wstring file;
+	vector<UINT8> bytes;
+	if (!SimpleDX12::ReadTextureFile(job->FileName, job->bNonSRGB, file, bytes) || !HashTextureData(bytes, job->bNonSRGB, job->Key))
+	{
+		job->bFailed = true;
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(Mtx);
+
+		job->Result = Cache->FindContent(job->FileName, job->Key);
+		if (job->Result)
+			return;
+
+		auto contentIt = ContentJobs.find(job->Key);
+		if (contentIt != ContentJobs.end())
+		{
+			job->Leader = contentIt->second;
+			return;
+		}
+
+		ContentJobs[job->Key] = job->shared_from_this();
+	}
+
+	// WIC needs com on every thread that decodes
+	static thread_local bool bComInitialized = false;
+	if (!bComInitialized)
+	{
+		CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+		bComInitialized = true;
+	}
+
+	DirectX::ScratchImage image;
+	if (!SimpleDX12::DecodeTextureImage(file, bytes, image))
+	{
+		job->bFailed = true;
+		return;
+	}
+
+	UploadBatch batch = g_dx12_rhi->Uploads->BeginBatch();
+	job->Tex = g_dx12_rhi->CreateTextureFromImage(image, job->FileName, job->bNonSRGB, batch);
+	job->FenceValue = g_dx12_rhi->Uploads->Submit(batch);
+}
+
+void TextureStreamer::AssignSlots(Job* job, shared_ptr<GfxTexture> Tex)
+{
+	for (Slot& slot : job->Slots)
+	{
+		if (shared_ptr<GfxMaterial> mat = slot.Material.lock())
+			(*mat).*slot.Member = Tex;
+	}
+}
+
+void TextureStreamer::Update()
+{
+	if (TS->GetNumTaskThreads() == 1)
+		TS->RunPinnedTasks();
+
+	for (auto it = Jobs.begin(); it != Jobs.end();)
+	{
+		Job* job = it->get();
+
+		if (!job->GetIsComplete() || !g_dx12_rhi->Uploads->IsComplete(job->FenceValue) || (job->Leader && !job->Leader->bFinalized))
+		{
+			++it;
+			continue;
+		}
+
+		if (job->Tex)
+		{
+			// srv allocation isn't thread safe, so the texture only becomes visible here
+			job->Tex->MakeStaticSRV();
+			job->Result = shared_ptr<GfxTexture>(job->Tex);
+			job->Tex = nullptr;
+
+			Cache->Add(job->FileName, job->Key, job->Result);
+		}
+		else if (job->Leader && !job->Leader->bFailed)
+		{
+			job->Result = Cache->FindContent(job->FileName, job->Key);
+			if (!job->Result)
+				job->Result = job->Leader->Result;
+		}
+
+		{
+			lock_guard<mutex> lock(Mtx);
+			auto contentIt = ContentJobs.find(job->Key);
+			if (contentIt != ContentJobs.end() && contentIt->second.get() == job)
+				ContentJobs.erase(contentIt);
+		}
+
+		// failed loads keep their placeholders
+		if (job->Result)
+		{
+			AssignSlots(job, job->Result);
+			NumLoaded++;
+		}
+		else
+		{
+			job->bFailed = true;
+			NumFailed++;
+		}
+
+		job->bFinalized = true;
+		PendingPaths.erase(job->PathKey);
+		it = Jobs.erase(it);
+	}
+}
+
+void TextureStreamer::Shutdown()
+{
+	if (!TS)
+		return;
+
+	for (auto& job : Jobs)
+		TS->WaitforTask(job.get());
+
+	g_dx12_rhi->Uploads->WaitIdle();
+
+	for (auto& job : Jobs)
+	{
+		delete job->Tex;
+		job->Tex = nullptr;
+		job->Leader = nullptr;
+	}
+
+	Jobs.clear();
+	PendingPaths.clear();
+	ContentJobs.clear();
+	TS = nullptr;
+}
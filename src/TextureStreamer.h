@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "AbstractGfxLayer.h"
+#include "TextureCache.h"
+#include "enkiTS/TaskScheduler.h"
+
+using namespace std;
+using Microsoft::WRL::ComPtr;
+
+class Texture;
+
+// Loads material textures in the background.
+// worker threads read the file once, hash and decode it, build mips and submit the copy through the upload ring on their own, the main thread only creates
+// the srv and swaps the material slot from its placeholder to the real texture once the copy's fence has passed.
+// requests and Update are main thread only.
+
+class TextureStreamer
+{
+	struct Slot
+	{
+		weak_ptr<GfxMaterial> Material;
+		shared_ptr<GfxTexture> GfxMaterial::* Member;
+	};
+
+	struct Job : public enki::IPinnedTask, public enable_shared_from_this<Job>
+	{
+		TextureStreamer* Streamer = nullptr;
+		wstring FileName;
+		wstring PathKey;
+		bool bNonSRGB = false;
+		vector<Slot> Slots;
+
+		TextureContentKey Key;
+		bool bFailed = false;
+		bool bFinalized = false;
+
+		shared_ptr<GfxTexture> Result; // set by the worker when the content was already resident
+		shared_ptr<Job> Leader; // same content is being loaded by another job
+
+		Texture* Tex = nullptr;
+		UINT64 FenceValue = 0; // UploadRing fence
+
+		Job(UINT32 ThreadNum) : enki::IPinnedTask(ThreadNum) {}
+		void Execute() override;
+	};
+
+	enki::TaskScheduler* TS = nullptr;
+	TextureCache* Cache = nullptr;
+	UINT32 NextThread = 0;
+
+	list<shared_ptr<Job>> Jobs;
+	map<wstring, shared_ptr<Job>> PendingPaths; // dedups requests of the same file while it is loading
+
+	mutex Mtx; // guards ContentJobs and the cache lookup in front of it
+	map<TextureContentKey, shared_ptr<Job>> ContentJobs;
+
+	UINT NumLoaded = 0;
+	UINT NumFailed = 0;
+
+	void LoadJob(Job* job);
+	void AssignSlots(Job* job, shared_ptr<GfxTexture> Tex);
+
+public:
+	void Initialize(enki::TaskScheduler* InTS, TextureCache* InCache);
+
+	// Member of Material keeps its current (placeholder) texture until FileName is resident.
+	void Request(const wstring& FileName, bool nonSRGB, shared_ptr<GfxMaterial> Material, shared_ptr<GfxTexture> GfxMaterial::* Member);
+
+	// swaps in finished textures. call before recording the frame.
+	void Update();
+
+	// waits for every job and its copy, then drops whatever did not finish.
+	void Shutdown();
+
+	bool IsIdle() const { return Jobs.empty(); }
+	UINT GetNumPending() const { return UINT(Jobs.size()); }
+	UINT GetNumLoaded() const { return NumLoaded; }
+	UINT GetNumFailed() const { return NumFailed; }
+};
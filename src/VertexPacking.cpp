@@ -0,0 +1,151 @@
+#include "VertexPacking.h"
+
+#include "glm/gtc/packing.hpp"
+
+static int16_t ToSnorm16(float v)
+{
+	return int16_t(glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+static float FromSnorm16(int16_t v)
+{
+	return glm::max(float(v) / 32767.0f, -1.0f);
+}
+
+static glm::vec2 SignNotZero(glm::vec2 v)
+{
+	return glm::vec2(v.x >= 0 ? 1.0f : -1.0f, v.y >= 0 ? 1.0f : -1.0f);
+}
+
+glm::vec2 OctEncode(glm::vec3 n)
+{
+	float l1 = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+
+	// missing attribute, decodes to +z
+	if (l1 == 0)
+		return glm::vec2(0, 0);
+
+	n /= l1;
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0)
+		p = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * SignNotZero(p);
+	return p;
+}
+
+glm::vec3 OctDecode(glm::vec2 p)
+{
+	glm::vec3 n(p.x, p.y, 1.0f - glm::abs(p.x) - glm::abs(p.y));
+	float t = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return glm::normalize(n);
+}
+
+PositionQuantization ComputePositionQuantization(const CookedVertex* Vertices, uint32_t NumVertices)
+{
+	PositionQuantization q;
+	if (NumVertices == 0)
+		return q;
+
+	glm::vec3 aabbMin = Vertices[0].Position;
+	glm::vec3 aabbMax = Vertices[0].Position;
+	for (uint32_t i = 1; i < NumVertices; i++)
+	{
+		aabbMin = glm::min(aabbMin, Vertices[i].Position);
+		aabbMax = glm::max(aabbMax, Vertices[i].Position);
+	}
+
+	q.Scale = glm::vec4((aabbMax - aabbMin) / 65535.0f, 0);
+	q.Bias = glm::vec4(aabbMin, 0);
+	return q;
+}
+
+PackedVertex PackVertex(const CookedVertex& Vertex, const PositionQuantization& Quantization)
+{
+	PackedVertex v;
+
+	for (int i = 0; i < 3; i++)
+	{
+		float q = Quantization.Scale[i] > 0 ? (Vertex.Position[i] - Quantization.Bias[i]) / Quantization.Scale[i] : 0;
+		v.Position[i] = uint16_t(glm::clamp(glm::round(q), 0.0f, 65535.0f));
+	}
+	v.Position[3] = 0;
+
+	glm::vec2 n = OctEncode(Vertex.Normal);
+	v.Normal[0] = ToSnorm16(n.x);
+	v.Normal[1] = ToSnorm16(n.y);
+
+	glm::vec2 t = OctEncode(Vertex.Tangent);
+	v.Tangent[0] = ToSnorm16(t.x);
+	v.Tangent[1] = ToSnorm16(t.y);
+
+	v.UV[0] = glm::packHalf1x16(Vertex.UV.x);
+	v.UV[1] = glm::packHalf1x16(Vertex.UV.y);
+
+	return v;
+}
+
+CookedVertex UnpackVertex(const PackedVertex& Vertex, const PositionQuantization& Quantization)
+{
+	CookedVertex v;
+
+	v.Position = DecodePackedPosition(Vertex.Position, Quantization);
+
+	v.Normal = OctDecode(glm::vec2(FromSnorm16(Vertex.Normal[0]), FromSnorm16(Vertex.Normal[1])));
+	v.Tangent = OctDecode(glm::vec2(FromSnorm16(Vertex.Tangent[0]), FromSnorm16(Vertex.Tangent[1])));
+	v.UV = glm::vec2(glm::unpackHalf1x16(Vertex.UV[0]), glm::unpackHalf1x16(Vertex.UV[1]));
+
+	return v;
+}
+
+void PackMeshVertices(const CookedVertex* Vertices, uint32_t NumVertices, PackedVertex* OutVertices, PositionQuantization& OutQuantization)
+{
+	OutQuantization = ComputePositionQuantization(Vertices, NumVertices);
+
+	for (uint32_t i = 0; i < NumVertices; i++)
+		OutVertices[i] = PackVertex(Vertices[i], OutQuantization);
+}
+
+void VertexPackingError::Merge(const VertexPackingError& Other)
+{
+	MaxPosition = glm::max(MaxPosition, Other.MaxPosition);
+	MaxNormalDegrees = glm::max(MaxNormalDegrees, Other.MaxNormalDegrees);
+	MaxTangentDegrees = glm::max(MaxTangentDegrees, Other.MaxTangentDegrees);
+	MaxUV = glm::max(MaxUV, Other.MaxUV);
+}
+
+static float AngleDegrees(glm::vec3 a, glm::vec3 b)
+{
+	float la = glm::length(a);
+	float lb = glm::length(b);
+
+	// nothing to compare when the source attribute is missing
+	if (la == 0 || lb == 0)
+		return 0;
+
+	return glm::degrees(glm::acos(glm::clamp(glm::dot(a / la, b / lb), -1.0f, 1.0f)));
+}
+
+VertexPackingError MeasureVertexPackingError(const CookedVertex* Vertices, uint32_t NumVertices)
+{
+	VertexPackingError error;
+
+	PositionQuantization q = ComputePositionQuantization(Vertices, NumVertices);
+	float extent = glm::max(glm::max(q.Scale.x, q.Scale.y), q.Scale.z) * 65535.0f;
+
+	for (uint32_t i = 0; i < NumVertices; i++)
+	{
+		const CookedVertex& src = Vertices[i];
+		CookedVertex dst = UnpackVertex(PackVertex(src, q), q);
+
+		if (extent > 0)
+			error.MaxPosition = glm::max(error.MaxPosition, glm::length(dst.Position - src.Position) / extent);
+		error.MaxNormalDegrees = glm::max(error.MaxNormalDegrees, AngleDegrees(src.Normal, dst.Normal));
+		error.MaxTangentDegrees = glm::max(error.MaxTangentDegrees, AngleDegrees(src.Tangent, dst.Tangent));
+
+		glm::vec2 uvError = glm::abs(dst.UV - src.UV);
+		error.MaxUV = glm::max(error.MaxUV, glm::max(uvError.x, uvError.y));
+	}
+
+	return error;
+}
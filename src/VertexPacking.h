@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CookedVertex.h"
+#include "Shaders/VertexFormat.h"
+
+#include <cstdint>
+
+// Packed vertex layout used when USE_PACKED_VERTEX is on. decode side lives in Shaders/Common.hlsl.
+
+struct PackedVertex
+{
+	uint16_t Position[4]; // 16 bit integers against the mesh AABB, read as uint4 by the input layout. w unused
+	int16_t Normal[2]; // octahedral snorm16
+	int16_t Tangent[2]; // octahedral snorm16
+	uint16_t UV[2]; // half
+};
+
+static_assert(sizeof(PackedVertex) == PACKED_VERTEX_STRIDE, "PackedVertex doesn't match PACKED_VERTEX_STRIDE");
+static_assert(sizeof(CookedVertex) == UNPACKED_VERTEX_STRIDE, "CookedVertex doesn't match UNPACKED_VERTEX_STRIDE");
+
+// position = integer * Scale + Bias, Scale is the AABB extent / 65535
+struct PositionQuantization
+{
+	glm::vec4 Scale = glm::vec4(1, 1, 1, 0);
+	glm::vec4 Bias = glm::vec4(0, 0, 0, 0);
+};
+
+// same formula as DecodePackedPosition in Shaders/Common.hlsl and VSMain in Shaders/GBuffer.hlsl
+inline glm::vec3 DecodePackedPosition(const uint16_t Position[4], const PositionQuantization& Quantization)
+{
+	return glm::vec3(Position[0], Position[1], Position[2]) * glm::vec3(Quantization.Scale) + glm::vec3(Quantization.Bias);
+}
+
+glm::vec2 OctEncode(glm::vec3 n);
+glm::vec3 OctDecode(glm::vec2 p);
+
+PositionQuantization ComputePositionQuantization(const CookedVertex* Vertices, uint32_t NumVertices);
+
+PackedVertex PackVertex(const CookedVertex& Vertex, const PositionQuantization& Quantization);
+CookedVertex UnpackVertex(const PackedVertex& Vertex, const PositionQuantization& Quantization);
+
+// packs one mesh against its own AABB.
+void PackMeshVertices(const CookedVertex* Vertices, uint32_t NumVertices, PackedVertex* OutVertices, PositionQuantization& OutQuantization);
+
+// worst case round trip error of a mesh.
+struct VertexPackingError
+{
+	float MaxPosition = 0; // relative to the largest AABB extent
+	float MaxNormalDegrees = 0;
+	float MaxTangentDegrees = 0;
+	float MaxUV = 0;
+
+	void Merge(const VertexPackingError& Other);
+};
+
+VertexPackingError MeasureVertexPackingError(const CookedVertex* Vertices, uint32_t NumVertices);
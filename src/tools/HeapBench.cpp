@@ -0,0 +1,673 @@
+// HeapBench : checks and times the heap sub allocator (HeapAllocator.h), the descriptor allocator (DescriptorAllocator.h) and the binding
+// slots (BindingSlot.h) without a gpu.
+// only depends on the standard library, so it builds anywhere : g++ -O2 -std=c++17 tools/HeapBench.cpp HeapAllocator.cpp DescriptorAllocator.cpp BindingSlot.cpp
+//
+// usage : HeapBench [-ops N] [-seed S]
+//   validation  random alloc/free against a shadow list, every range and the free lists are checked while it runs
+//   throughput  allocate + free per second for the size mix the renderer places (buffers, textures, render targets)
+//   churn       steady state with a pool of 64MB heaps : fragmentation and heap count over time, then a defragmentation pass
+//   transient   random frames of render targets with pass lifetimes, aliased heap size against one range per target
+//   descriptors random alloc/free of descriptor ranges with fence retirement, stale handle detection, occupancy and throughput
+//   bindings    name -> slot layout checks, then the cpu cost of the per draw g-buffer binds by string map, by name lookup and by slot
+
+#include "../HeapAllocator.h"
+#include "../DescriptorAllocator.h"
+#include "../BindingSlot.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using namespace std;
+
+static const uint64_t KB = 1024;
+static const uint64_t MB = 1024 * 1024;
+
+static int NumErrors = 0;
+
+#define CHECK(x) do { if (!(x)) { cout << "  FAILED " << #x << " (line " << __LINE__ << ")" << endl; NumErrors++; } } while (0)
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+// placement alignments the d3d12 backend asks for : 4KB small textures, 64KB buffers/textures, 4MB msaa
+static uint64_t RandomAlignment(mt19937_64& Rng)
+{
+	switch (Rng() % 8)
+	{
+	case 0: case 1: case 2: return 4 * KB;
+	case 7: return 4 * MB;
+	default: return 64 * KB;
+	}
+}
+
+// mostly small meshes/textures with a tail of big ones
+static uint64_t RandomSize(mt19937_64& Rng, uint64_t MaxSize)
+{
+	const double t = uniform_real_distribution<double>(0.0, 1.0)(Rng);
+	uint64_t size = uint64_t(4.0 * KB * pow(double(MaxSize) / (4.0 * KB), t * t * t));
+	return max<uint64_t>(1, min(size, MaxSize));
+}
+
+static void TestTLSF(uint64_t Seed, uint32_t NumOps)
+{
+	cout << "validation" << endl;
+
+	// exact fit, alignment and merging
+	{
+		TLSFAllocator allocator(1 * MB);
+		TLSFAllocation all = allocator.Allocate(1 * MB, 64 * KB);
+		CHECK(all.IsValid() && all.Offset == 0);
+		CHECK(!allocator.Allocate(256, 1).IsValid());
+		allocator.Free(all);
+		CHECK(allocator.GetStats().LargestFreeBlock == 1 * MB);
+
+		TLSFAllocation a = allocator.Allocate(100, 1);
+		TLSFAllocation b = allocator.Allocate(10 * KB, 64 * KB);
+		TLSFAllocation c = allocator.Allocate(3 * KB, 4 * KB);
+		CHECK(a.IsValid() && b.IsValid() && c.IsValid());
+		CHECK(a.Size == HEAP_ALLOCATOR_GRANULARITY);
+		CHECK(b.Offset % (64 * KB) == 0);
+		CHECK(c.Offset % (4 * KB) == 0);
+		CHECK(allocator.Validate());
+
+		allocator.Free(b);
+		allocator.Free(a);
+		CHECK(allocator.Validate());
+		allocator.Free(c);
+		CHECK(allocator.Validate());
+		HeapAllocatorStats stats = allocator.GetStats();
+		CHECK(stats.NumFreeBlocks == 1 && stats.UsedBytes == 0 && stats.LargestFreeBlock == 1 * MB);
+	}
+
+	// random against a shadow copy of the live ranges
+	{
+		mt19937_64 rng(Seed);
+		TLSFAllocator allocator(256 * MB);
+		vector<TLSFAllocation> live;
+		uint32_t numFailed = 0;
+
+		for (uint32_t i = 0; i < NumOps; i++)
+		{
+			if (live.size() > 0 && (rng() % 100 < 45 || live.size() > 4000))
+			{
+				size_t pick = rng() % live.size();
+				allocator.Free(live[pick]);
+				live[pick] = live.back();
+				live.pop_back();
+			}
+			else
+			{
+				const uint64_t alignment = RandomAlignment(rng);
+				TLSFAllocation allocation = allocator.Allocate(RandomSize(rng, 32 * MB), alignment);
+				if (allocation.IsValid())
+				{
+					CHECK(allocation.Offset % alignment == 0);
+					CHECK(allocation.Offset + allocation.Size <= allocator.GetSize());
+					live.push_back(allocation);
+				}
+				else
+				{
+					numFailed++;
+				}
+			}
+
+			if (i % 997 == 0)
+			{
+				CHECK(allocator.Validate());
+
+				vector<TLSFAllocation> sorted = live;
+				sort(sorted.begin(), sorted.end(), [](const TLSFAllocation& a, const TLSFAllocation& b) { return a.Offset < b.Offset; });
+				for (size_t j = 1; j < sorted.size(); j++)
+					CHECK(sorted[j - 1].Offset + sorted[j - 1].Size <= sorted[j].Offset);
+			}
+
+			if (NumErrors > 10)
+				return;
+		}
+
+		for (auto& allocation : live)
+			allocator.Free(allocation);
+		CHECK(allocator.Validate());
+		CHECK(allocator.GetStats().NumFreeBlocks == 1);
+
+		cout << "  " << NumOps << " random ops, " << numFailed << " out of space, " << (NumErrors == 0 ? "ok" : "errors") << endl;
+	}
+
+	// pool : dedicated blocks, block release and defragmentation
+	{
+		HeapPool pool(64 * MB, 64 * KB);
+		uint32_t numHeaps = 0;
+		pool.OnCreateBlock = [&](uint32_t, uint64_t) { numHeaps++; return true; };
+		pool.OnDestroyBlock = [&](uint32_t) { numHeaps--; };
+
+		HeapAllocation big = pool.Allocate(100 * MB, 64 * KB);
+		CHECK(big.IsValid() && pool.GetStats().NumDedicatedBlocks == 1);
+		pool.Free(big);
+		CHECK(numHeaps == 0);
+
+		vector<HeapAllocation> live;
+		for (uint32_t i = 0; i < 64; i++)
+			live.push_back(pool.Allocate(8 * MB, 64 * KB));
+		CHECK(pool.GetStats().NumBlocks == 8);
+
+		// keep every 4th, then pack them into as few heaps as possible
+		for (uint32_t i = 0; i < live.size(); i++)
+		{
+			if (i % 4 != 0)
+				pool.Free(live[i]);
+		}
+
+		vector<HeapMove> moves = pool.PlanDefragmentation(1000);
+		for (HeapMove& move : moves)
+			pool.Free(move.From);
+		CHECK(pool.Validate());
+		CHECK(pool.GetStats().NumBlocks <= 3);
+
+		pool.OnDestroyBlock = nullptr;
+	}
+}
+
+static void BenchThroughput(uint64_t Seed, uint32_t NumOps)
+{
+	cout << "throughput" << endl;
+
+	mt19937_64 rng(Seed);
+	vector<uint64_t> sizes(NumOps);
+	vector<uint64_t> alignments(NumOps);
+	vector<uint32_t> freeOrder(NumOps);
+	for (uint32_t i = 0; i < NumOps; i++)
+	{
+		sizes[i] = RandomSize(rng, 4 * MB);
+		alignments[i] = RandomAlignment(rng) == 4 * MB ? 64 * KB : 4 * KB;
+		freeOrder[i] = i;
+	}
+	shuffle(freeOrder.begin(), freeOrder.end(), rng);
+
+	// random order frees, so neighbours are merged in every combination
+	TLSFAllocator allocator(~0ull >> 8);
+	vector<TLSFAllocation> allocations(NumOps);
+
+	auto start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < NumOps; i++)
+		allocations[i] = allocator.Allocate(sizes[i], alignments[i]);
+	const double allocMS = ElapsedMS(start);
+
+	start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < NumOps; i++)
+		allocator.Free(allocations[freeOrder[i]]);
+	const double freeMS = ElapsedMS(start);
+
+	CHECK(allocator.Validate() && allocator.GetStats().NumFreeBlocks == 1);
+
+	// interleaved, what a level streaming in and out looks like
+	vector<TLSFAllocation> live;
+	live.reserve(NumOps);
+	start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < NumOps; i++)
+	{
+		if (live.size() > 1024 && (freeOrder[i] & 1))
+		{
+			size_t pick = freeOrder[i] % live.size();
+			allocator.Free(live[pick]);
+			live[pick] = live.back();
+			live.pop_back();
+		}
+		live.push_back(allocator.Allocate(sizes[i], alignments[i]));
+	}
+	const double mixedMS = ElapsedMS(start);
+
+	cout << "  allocate " << allocMS * 1e6 / NumOps << " ns, free " << freeMS * 1e6 / NumOps << " ns, mixed "
+		<< mixedMS * 1e6 / NumOps << " ns per op (" << NumOps / max(allocMS + freeMS, 0.001) * 2000.0 / 1e6 << " M ops/s)" << endl;
+}
+
+static void BenchChurn(uint64_t Seed, uint32_t NumOps)
+{
+	cout << "churn (64MB heaps, ~1.5GB live)" << endl;
+
+	mt19937_64 rng(Seed);
+	HeapPool pool(64 * MB, 64 * KB);
+
+	struct Live
+	{
+		HeapAllocation Allocation;
+		uint64_t Size;
+	};
+	vector<Live> live;
+	uint64_t liveBytes = 0;
+	const uint64_t targetBytes = 1536 * MB;
+
+	auto PrintStats = [&](const char* Label)
+	{
+		HeapPoolStats stats = pool.GetStats();
+		cout << "  " << Label << " : " << stats.NumBlocks << " heaps (" << stats.NumDedicatedBlocks << " dedicated), "
+			<< stats.Allocator.TotalBytes / MB << " MB reserved, " << stats.Allocator.UsedBytes / MB << " MB used ("
+			<< 100.0 * double(stats.Allocator.UsedBytes) / double(max<uint64_t>(stats.Allocator.TotalBytes, 1)) << "%), fragmentation "
+			<< stats.Allocator.GetFragmentation() << ", " << stats.Allocator.NumFreeBlocks << " free ranges" << endl;
+	};
+
+	auto start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < NumOps; i++)
+	{
+		if (live.size() > 0 && liveBytes > targetBytes)
+		{
+			size_t pick = rng() % live.size();
+			pool.Free(live[pick].Allocation);
+			liveBytes -= live[pick].Size;
+			live[pick] = live.back();
+			live.pop_back();
+		}
+		else
+		{
+			uint64_t size = RandomSize(rng, 96 * MB);
+			HeapAllocation allocation = pool.Allocate(size, RandomAlignment(rng));
+			CHECK(allocation.IsValid());
+			live.push_back({ allocation, size });
+			liveBytes += size;
+		}
+
+		if (i == NumOps / 4)
+			PrintStats("warm  ");
+	}
+	const double churnMS = ElapsedMS(start);
+	PrintStats("steady");
+
+	CHECK(pool.Validate());
+
+	// drop half the live set, the way a level unload would, then pack what's left
+	for (size_t i = 0; i < live.size(); i++)
+	{
+		if (i % 2)
+			pool.Free(live[i].Allocation);
+	}
+	PrintStats("unload");
+
+	start = chrono::high_resolution_clock::now();
+	vector<HeapMove> moves = pool.PlanDefragmentation(100000);
+	const double planMS = ElapsedMS(start);
+
+	uint64_t movedBytes = 0;
+	for (HeapMove& move : moves)
+	{
+		movedBytes += move.From.Range.Size;
+		pool.Free(move.From);
+	}
+	PrintStats("defrag");
+	cout << "  " << moves.size() << " moves (" << movedBytes / MB << " MB) planned in " << planMS << " ms, churn "
+		<< churnMS * 1e6 / NumOps << " ns per op" << endl;
+
+	CHECK(pool.Validate());
+}
+
+static void TestTransient(uint64_t Seed)
+{
+	cout << "transient" << endl;
+
+	mt19937_64 rng(Seed);
+	uint64_t unaliasedBytes = 0;
+	uint64_t aliasedBytes = 0;
+
+	for (uint32_t frame = 0; frame < 1000; frame++)
+	{
+		const uint32_t numPasses = 4 + uint32_t(rng() % 16);
+		vector<TransientRange> ranges(1 + rng() % 48);
+		for (TransientRange& range : ranges)
+		{
+			range.Size = RandomSize(rng, 64 * MB);
+			range.Alignment = RandomAlignment(rng);
+			if (rng() % 8 != 0)
+			{
+				range.FirstPass = uint32_t(rng() % numPasses);
+				range.LastPass = range.FirstPass + uint32_t(rng() % (numPasses - range.FirstPass));
+			}
+			unaliasedBytes += range.Size;
+		}
+
+		const uint64_t heapSize = PlanTransientOffsets(ranges);
+		aliasedBytes += heapSize;
+
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			CHECK(ranges[i].Offset % ranges[i].Alignment == 0);
+			CHECK(ranges[i].Offset + ranges[i].Size <= heapSize);
+
+			for (size_t j = i + 1; j < ranges.size(); j++)
+			{
+				if (ranges[i].IsUsed() && ranges[j].IsUsed() && ranges[i].Overlaps(ranges[j]))
+					CHECK(ranges[i].Offset + ranges[i].Size <= ranges[j].Offset || ranges[j].Offset + ranges[j].Size <= ranges[i].Offset);
+			}
+		}
+
+		if (NumErrors > 10)
+			return;
+	}
+
+	cout << "  1000 frames, " << unaliasedBytes / MB << " MB unaliased -> " << aliasedBytes / MB << " MB aliased ("
+		<< 100.0 * double(aliasedBytes) / double(max<uint64_t>(unaliasedBytes, 1)) << "%), " << (NumErrors == 0 ? "ok" : "errors") << endl;
+}
+
+static void TestDescriptors(uint64_t Seed, uint32_t NumOps)
+{
+	cout << "descriptors" << endl;
+
+	// full heap, merging, deferred frees and stale handles
+	{
+		DescriptorAllocator allocator(64);
+		DescriptorHandle all = allocator.Allocate(64);
+		CHECK(all.IsValid() && all.Index == 0);
+		CHECK(!allocator.Allocate(1).IsValid());
+		CHECK(allocator.GetStats().NumFailed == 1);
+
+		// nothing comes back before its fence
+		CHECK(allocator.Free(all, 5));
+		CHECK(!allocator.Allocate(1).IsValid());
+		CHECK(allocator.GetStats().NumPending == 64);
+		allocator.ProcessPendingFrees(4);
+		CHECK(!allocator.Allocate(1).IsValid());
+		allocator.ProcessPendingFrees(5);
+		CHECK(allocator.GetStats().LargestFreeRange == 64);
+
+		DescriptorHandle a = allocator.Allocate(5);
+		DescriptorHandle b = allocator.Allocate(1);
+		DescriptorHandle c = allocator.Allocate(10);
+		CHECK(a.IsValid() && b.IsValid() && c.IsValid());
+		CHECK(b.Index == a.Index + 5 && c.Index == b.Index + 1);
+		CHECK(allocator.Validate());
+
+		// double free and a handle outliving its range
+		CHECK(allocator.Free(b, 0));
+		CHECK(!allocator.Free(b, 0));
+		CHECK(!allocator.IsValid(b));
+		DescriptorHandle reused = allocator.Allocate(1);
+		CHECK(reused.Index == b.Index && reused.Generation != b.Generation);
+		CHECK(!allocator.Free(b, 0));
+		CHECK(allocator.IsValid(reused));
+
+		// wrong count at a live index
+		DescriptorHandle forged = c;
+		forged.Count = 3;
+		CHECK(!allocator.Free(forged, 0));
+		CHECK(allocator.GetStats().NumStaleFrees == 3);
+
+		CHECK(allocator.Free(a, 0) && allocator.Free(reused, 0) && allocator.Free(c, 0));
+		CHECK(allocator.Validate());
+		DescriptorAllocatorStats stats = allocator.GetStats();
+		CHECK(stats.NumFreeRanges == 1 && stats.NumUsed == 0 && stats.LargestFreeRange == 64);
+	}
+
+	// handle arithmetic
+	{
+		DescriptorAddressing addressing;
+		addressing.CpuStart = 0x10000;
+		addressing.GpuStart = 0xff00000000ull;
+		addressing.Increment = 32;
+		CHECK(addressing.GetCpu(7) == 0x10000 + 7 * 32);
+		CHECK(addressing.GetGpu(7) == 0xff00000000ull + 7 * 32);
+		CHECK(addressing.GetIndex(addressing.GetCpu(999999)) == 999999);
+	}
+
+	// random, frees retire 3 frames later like the renderer's frames in flight
+	{
+		mt19937_64 rng(Seed);
+		DescriptorAllocator allocator(8192);
+		vector<DescriptorHandle> live;
+		vector<DescriptorHandle> freed;
+		uint64_t fence = 1;
+		uint32_t numFailed = 0;
+
+		for (uint32_t i = 0; i < NumOps; i++)
+		{
+			if (i % 256 == 0)
+			{
+				fence++;
+				allocator.ProcessPendingFrees(fence - 3);
+			}
+
+			if (live.size() > 0 && (rng() % 100 < 48 || live.size() > 20000))
+			{
+				size_t pick = rng() % live.size();
+				CHECK(allocator.Free(live[pick], fence));
+				if (freed.size() < 1000)
+					freed.push_back(live[pick]);
+				live[pick] = live.back();
+				live.pop_back();
+			}
+			else
+			{
+				// mostly single views, some material/volume tables
+				const uint32_t count = rng() % 8 == 0 ? 1 + uint32_t(rng() % 16) : 1;
+				DescriptorHandle handle = allocator.Allocate(count);
+				if (handle.IsValid())
+				{
+					CHECK(handle.Index + handle.Count <= allocator.GetCapacity());
+					live.push_back(handle);
+				}
+				else
+				{
+					numFailed++;
+				}
+			}
+
+			if (i % 997 == 0)
+			{
+				CHECK(allocator.Validate());
+
+				vector<DescriptorHandle> sorted = live;
+				sort(sorted.begin(), sorted.end(), [](const DescriptorHandle& a, const DescriptorHandle& b) { return a.Index < b.Index; });
+				for (size_t j = 1; j < sorted.size(); j++)
+					CHECK(sorted[j - 1].Index + sorted[j - 1].Count <= sorted[j].Index);
+			}
+
+			if (NumErrors > 10)
+				return;
+		}
+
+		// every freed handle stays dead, whether its range was reused or not
+		for (auto& handle : freed)
+			CHECK(!allocator.IsValid(handle));
+
+		DescriptorAllocatorStats stats = allocator.GetStats();
+		cout << "  " << NumOps << " random ops, " << numFailed << " out of space, occupancy " << 100.0f * stats.GetOccupancy() << "% ("
+			<< stats.NumUsed << " used, " << stats.NumPending << " pending), peak " << stats.PeakUsed << ", " << stats.NumFreeRanges
+			<< " free ranges, largest " << stats.LargestFreeRange << endl;
+
+		for (auto& handle : live)
+			allocator.Free(handle, fence);
+		allocator.ProcessPendingFrees(fence);
+		CHECK(allocator.Validate());
+		CHECK(allocator.GetStats().NumFreeRanges == 1);
+	}
+
+	// throughput at the size of the shader visible heap, steady state around 20000 views
+	{
+		mt19937_64 rng(Seed);
+		DescriptorAllocator allocator(1000000);
+		vector<DescriptorHandle> live;
+		live.reserve(20000);
+		for (uint32_t i = 0; i < 20000; i++)
+			live.push_back(allocator.Allocate(1 + uint32_t(rng() % 4 == 0 ? rng() % 8 : 0)));
+
+		auto start = chrono::high_resolution_clock::now();
+		uint64_t fence = 1;
+		for (uint32_t i = 0; i < NumOps; i++)
+		{
+			if (i % 256 == 0)
+			{
+				fence++;
+				allocator.ProcessPendingFrees(fence - 3);
+			}
+
+			size_t pick = rng() % live.size();
+			allocator.Free(live[pick], fence);
+			live[pick] = allocator.Allocate(1 + uint32_t(rng() % 4 == 0 ? rng() % 8 : 0));
+		}
+		const double ms = ElapsedMS(start);
+
+		cout << "  " << NumOps << " free + alloc in " << ms << " ms, " << double(NumOps) / ms / 1000.0 << " M/s, " << (NumErrors == 0 ? "ok" : "errors") << endl;
+	}
+}
+
+// what a Set* call does after finding its binding : SetGraphicsRootDescriptorTable/ConstantBufferView with the root parameter index
+struct BenchBinding
+{
+	uint32_t RootParamIndex;
+};
+
+static volatile uint64_t BindSink = 0;
+
+// the string path before slots : a std::string per call and a map lookup per binding kind
+static map<string, BenchBinding> BenchTextureBinding;
+static map<string, BenchBinding> BenchConstantBufferBinding;
+
+static void BenchSetSRVByString(string Name, uint64_t GpuHandle)
+{
+	BindSink = BindSink + BenchTextureBinding[Name].RootParamIndex + GpuHandle;
+}
+
+static void BenchSetCBVByString(string Name, uint64_t GpuAddr)
+{
+	BindSink = BindSink + BenchConstantBufferBinding[Name].RootParamIndex + GpuAddr;
+}
+
+static void TestBindingSlots(uint32_t NumOps)
+{
+	cout << "bindings" << endl;
+
+	// layout
+	{
+		static_assert(HashBindingName("") == 2166136261u, "fnv-1a offset basis");
+		constexpr BindingName albedo("AlbedoTex");
+		static_assert(albedo.Hash == HashBindingName("AlbedoTex"), "names hash at compile time");
+
+		BindingLayout layout;
+		CHECK(layout.Add("GBufferConstantBuffer").Index == 0);
+		CHECK(layout.Add("AlbedoTex").Index == 1);
+		CHECK(layout.Add("NormalTex").Index == 2);
+		CHECK(!layout.Add("AlbedoTex").IsValid());
+		CHECK(layout.GetNumSlots() == 3);
+
+		CHECK(layout.Find(albedo).Index == 1);
+		CHECK(layout.Find(string("NormalTex")).Index == 2);
+		CHECK(layout.Find("GBufferConstantBuffer").Index == 0);
+		CHECK(!layout.Find("MetallicTex").IsValid());
+		CHECK(!layout.Find("").IsValid());
+		CHECK(layout.GetName(layout.Find("NormalTex")) == "NormalTex");
+
+		// many names, every one comes back to its own slot
+		BindingLayout big;
+		for (uint32_t i = 0; i < 1000; i++)
+			CHECK(big.Add("Binding" + to_string(i)).Index == i);
+		for (uint32_t i = 0; i < 1000; i++)
+		{
+			const string name = "Binding" + to_string(i);
+			BindingSlot slot = big.Find(name);
+			CHECK(slot.Index == i && big.GetName(slot) == name);
+		}
+		CHECK(!big.Find("Binding1000").IsValid());
+
+		layout.Clear();
+		CHECK(layout.GetNumSlots() == 0 && !layout.Find(albedo).IsValid());
+	}
+
+	// per draw binds of the g-buffer pass without bindless materials : one constant buffer and 4 textures
+	const char* textureNames[] = { "AlbedoTex", "NormalTex", "RoughnessTex", "MetallicTex" };
+	const char* otherNames[] = { "BindlessTextures", "Materials", "samplerWrap" };
+
+	BenchTextureBinding.clear();
+	BenchConstantBufferBinding.clear();
+	BindingLayout layout;
+	vector<BenchBinding> slots;
+	uint32_t rootParamIndex = 0;
+
+	BenchConstantBufferBinding["GBufferConstantBuffer"] = { rootParamIndex };
+	layout.Add("GBufferConstantBuffer");
+	slots.push_back({ rootParamIndex++ });
+	for (const char* name : textureNames)
+	{
+		BenchTextureBinding[name] = { rootParamIndex };
+		layout.Add(name);
+		slots.push_back({ rootParamIndex++ });
+	}
+	for (const char* name : otherNames)
+	{
+		BenchTextureBinding[name] = { rootParamIndex };
+		layout.Add(name);
+		slots.push_back({ rootParamIndex++ });
+	}
+
+	const uint32_t numDraws = max<uint32_t>(1, NumOps);
+
+	auto start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < numDraws; i++)
+	{
+		BenchSetCBVByString("GBufferConstantBuffer", i);
+		for (const char* name : textureNames)
+			BenchSetSRVByString(name, i);
+	}
+	const double msMap = ElapsedMS(start);
+
+	start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < numDraws; i++)
+	{
+		BindSink = BindSink + slots[layout.Find("GBufferConstantBuffer").Index].RootParamIndex + i;
+		for (const char* name : textureNames)
+			BindSink = BindSink + slots[layout.Find(name).Index].RootParamIndex + i;
+	}
+	const double msFind = ElapsedMS(start);
+
+	const BindingSlot cbSlot = layout.Find("GBufferConstantBuffer");
+	BindingSlot textureSlots[4];
+	for (int t = 0; t < 4; t++)
+		textureSlots[t] = layout.Find(textureNames[t]);
+
+	start = chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < numDraws; i++)
+	{
+		BindSink = BindSink + slots[cbSlot.Index].RootParamIndex + i;
+		for (BindingSlot slot : textureSlots)
+			BindSink = BindSink + slots[slot.Index].RootParamIndex + i;
+	}
+	const double msSlot = ElapsedMS(start);
+
+	const double toNs = 1000000.0 / double(numDraws);
+	cout << "  " << numDraws << " draws x 5 binds, ns per draw : string map " << msMap * toNs << ", name lookup "
+		<< msFind * toNs << ", slot " << msSlot * toNs << " (" << (NumErrors == 0 ? "ok" : "errors") << ")" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t numOps = 1000000;
+	uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-ops" && i + 1 < argc)
+			numOps = uint32_t(stoul(argv[++i]));
+		else if (arg == "-seed" && i + 1 < argc)
+			seed = stoull(argv[++i]);
+		else
+		{
+			cout << "usage : HeapBench [-ops N] [-seed S]" << endl;
+			return 1;
+		}
+	}
+
+	TestTLSF(seed, numOps / 10);
+	BenchThroughput(seed, numOps);
+	BenchChurn(seed, numOps);
+	TestTransient(seed);
+	TestDescriptors(seed, numOps / 10);
+	TestBindingSlots(numOps);
+
+	if (NumErrors > 0)
+		cout << NumErrors << " checks failed" << endl;
+
+	return NumErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,403 @@
+// MeshCook : headless cooker for LoadModel's mesh cache.
+//
+// usage : MeshCook.exe [-validate] [-nooptimize] [-bench N] [-stats] [-pack] [-meshlets] model.fbx [model2.fbx ...]
+//   (default)   import with assimp, write "<model>.cooked", reopen and validate it
+//   -validate   only validate the existing cooked file, don't cook
+//   -nooptimize cook without the vertex cache/fetch reorder. the option is stored in the file, LoadModel cooks such a file again
+//   -bench N    after cooking, time N loads of LoadModel's assimp path vs N of its cooked path
+//   -stats     simulated ACMR/ATVR of the index buffers before and after mesh optimization
+//   -pack      packed vertex size and worst case round trip error (see VertexPacking.h)
+//   -meshlets  check the cooked meshlets against the index buffers and time BuildMeshlets on 1..N threads
+
+#include "../MeshCache.h"
+#include "../MeshOptimize.h"
+#include "../VertexPacking.h"
+#include "../MeshletBuilder.h"
+#include "../Utils.h"
+#include "enkiTS/TaskScheduler.h"
+
+#include <iostream>
+#include <chrono>
+#include <codecvt>
+
+using namespace std;
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+// what LoadModel does with a scene once it is open, without the device : the streams it hands to CreateVertexBuffer/CreateIndexBuffer
+// are copied like the upload ring copies them, the meshlets of every mesh are copied out and the materials and LOD tables are read.
+static UINT64 UploadLikeLoadModel(const CookedScene& Cooked, vector<UINT8>& Upload)
+{
+	const CookedSceneHeader* header = Cooked.Header;
+	size_t offset = 0;
+	auto Copy = [&](const void* Src, size_t Size)
+	{
+		if (Upload.size() < offset + Size)
+			Upload.resize(offset + Size);
+		if (Size > 0)
+			memcpy(&Upload[offset], Src, Size);
+		offset += Size;
+	};
+
+#if USE_PACKED_VERTEX
+	Copy(Cooked.PackedVertices, sizeof(PackedVertex) * header->NumVertices);
+	Copy(Cooked.Positions, sizeof(glm::vec3) * header->NumVertices);
+#else
+	Copy(Cooked.Vertices, sizeof(CookedVertex) * header->NumVertices);
+#endif
+	Copy(Cooked.Indices, header->IndexStreamSize);
+
+	UINT64 sum = offset;
+	for (UINT i = 0; i < header->NumMaterials; i++)
+		sum += Cooked.Materials[i].Diffuse[0] + Cooked.Materials[i].bHasAlpha;
+
+	MeshletData meshlets;
+	for (UINT i = 0; i < header->NumMeshes; i++)
+	{
+		const CookedMesh& mesh = Cooked.Meshes[i];
+		Cooked.GetMeshlets(i, meshlets);
+		sum += meshlets.Meshlets.size() + mesh.NumLods + Cooked.Quantizations[i].Bias.x;
+	}
+	return sum;
+}
+
+// sum of the simulated cache stats over every mesh of the import.
+static VertexCacheStats AnalyzeImport(const MeshImportData& Data, UINT CacheSize)
+{
+	VertexCacheStats total;
+	for (auto& mesh : Data.Meshes)
+	{
+		vector<UINT32> indices(mesh.NumIndices);
+		const UINT8* src = Data.Indices.data() + mesh.IndexByteOffset;
+		for (UINT i = 0; i < mesh.NumIndices; i++)
+			indices[i] = mesh.IndexStride == sizeof(UINT16) ? ((const UINT16*)src)[i] : ((const UINT32*)src)[i];
+
+		total.Add(AnalyzeVertexCache(indices.data(), mesh.NumIndices, mesh.NumVertices, CacheSize));
+	}
+	return total;
+}
+
+static void PrintVertexCacheStats(const string& File, enki::TaskScheduler& TS)
+{
+	auto start = chrono::high_resolution_clock::now();
+	MeshImportData original;
+	ImportMeshFromFile(File, original, &TS, false);
+	double originalMS = ElapsedMS(start);
+
+	start = chrono::high_resolution_clock::now();
+	MeshImportData optimized;
+	ImportMeshFromFile(File, optimized, &TS, true);
+	double optimizedMS = ElapsedMS(start);
+
+	cout << "  " << original.Meshes.size() << " meshes, import " << originalMS << " ms, with optimization " << optimizedMS << " ms" << endl;
+
+	for (UINT cacheSize : { 16u, 32u })
+	{
+		VertexCacheStats before = AnalyzeImport(original, cacheSize);
+		VertexCacheStats after = AnalyzeImport(optimized, cacheSize);
+
+		cout << "  fifo " << cacheSize << " : ACMR " << before.ACMR() << " -> " << after.ACMR()
+			<< ", ATVR " << before.ATVR() << " -> " << after.ATVR() << endl;
+	}
+}
+
+static bool PrintVertexPackingReport(const wstring& CookedFile, const wstring& SourceFile, bool bOptimize)
+{
+	CookedScene cooked;
+	if (!cooked.Open(CookedFile, SourceFile, bOptimize))
+		return false;
+
+	VertexPackingError error;
+	for (UINT i = 0; i < cooked.Header->NumMeshes; i++)
+	{
+		const CookedMesh& mesh = cooked.Meshes[i];
+		error.Merge(MeasureVertexPackingError(cooked.Vertices + mesh.VertexOffset, mesh.NumVertices));
+	}
+
+	UINT64 numVertices = cooked.Header->NumVertices;
+	UINT64 floatSize = numVertices * sizeof(CookedVertex);
+	UINT64 packedSize = numVertices * sizeof(PackedVertex);
+	UINT64 positionSize = numVertices * sizeof(glm::vec3);
+
+	cout << "  vertex buffer : " << floatSize / 1024 << " KB -> " << packedSize / 1024 << " KB packed (+" << positionSize / 1024
+		<< " KB float positions for BLAS)" << endl;
+	cout << "  round trip error : position " << error.MaxPosition << " of mesh extent, normal " << error.MaxNormalDegrees
+		<< " deg, tangent " << error.MaxTangentDegrees << " deg, uv " << error.MaxUV << endl;
+	return true;
+}
+
+static void GetMeshIndices(const CookedScene& Cooked, UINT MeshIndex, vector<UINT32>& OutIndices)
+{
+	const CookedMesh& mesh = Cooked.Meshes[MeshIndex];
+	const UINT8* src = Cooked.Indices + mesh.IndexByteOffset;
+
+	OutIndices.resize(mesh.NumIndices);
+	for (UINT i = 0; i < mesh.NumIndices; i++)
+		OutIndices[i] = mesh.IndexStride == sizeof(UINT16) ? ((const UINT16*)src)[i] : ((const UINT32*)src)[i];
+}
+
+// one task per mesh, same granularity as FinalizeMeshTaskSet in the importer.
+struct BuildMeshletsTaskSet : enki::ITaskSet
+{
+	const CookedScene* Cooked = nullptr;
+	const vector<vector<UINT32>>* Indices = nullptr;
+	vector<MeshletData>* Out = nullptr;
+
+	void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum) override
+	{
+		for (uint32_t i = range.start; i < range.end; i++)
+		{
+			const CookedMesh& mesh = Cooked->Meshes[i];
+			const vector<UINT32>& indices = (*Indices)[i];
+			BuildMeshlets(indices.data(), mesh.NumIndices, &Cooked->Vertices[mesh.VertexOffset].Position.x, sizeof(CookedVertex), mesh.NumVertices, (*Out)[i]);
+		}
+	}
+};
+
+static bool PrintMeshletReport(const wstring& CookedFile, const wstring& SourceFile, bool bOptimize)
+{
+	CookedScene cooked;
+	if (!cooked.Open(CookedFile, SourceFile, bOptimize))
+		return false;
+
+	const UINT numMeshes = cooked.Header->NumMeshes;
+	vector<vector<UINT32>> indices(numMeshes);
+	UINT64 numTriangles = 0;
+	for (UINT i = 0; i < numMeshes; i++)
+	{
+		GetMeshIndices(cooked, i, indices[i]);
+		numTriangles += cooked.Meshes[i].NumIndices / 3;
+	}
+
+	bool bValid = true;
+	UINT64 numMeshletVertices = 0;
+	for (UINT i = 0; i < numMeshes; i++)
+	{
+		const CookedMesh& mesh = cooked.Meshes[i];
+
+		MeshletData meshlets;
+		cooked.GetMeshlets(i, meshlets);
+		numMeshletVertices += meshlets.Vertices.size();
+
+		string error;
+		if (!ValidateMeshlets(meshlets, indices[i].data(), mesh.NumIndices, &cooked.Vertices[mesh.VertexOffset].Position.x, sizeof(CookedVertex), mesh.NumVertices, error))
+		{
+			cout << "  mesh " << i << " meshlets failed :\n" << error;
+			bValid = false;
+		}
+	}
+
+	const UINT numMeshlets = cooked.Header->NumMeshlets;
+	cout << "  " << numMeshlets << " meshlets, " << double(numTriangles) / glm::max(numMeshlets, 1u) << " triangles and "
+		<< double(numMeshletVertices) / glm::max(numMeshlets, 1u) << " vertices per meshlet" << (bValid ? ", valid" : "") << endl;
+
+	// the largest mesh bounds the speedup since a mesh is never split across threads.
+	const int NumRepeat = 4;
+	const UINT numHardwareThreads = enki::GetNumHardwareThreads();
+	double singleMS = 0;
+	for (UINT numThreads = 1; ; numThreads = glm::min(numThreads * 2, numHardwareThreads))
+	{
+		enki::TaskScheduler TS;
+		TS.Initialize(numThreads);
+
+		vector<MeshletData> out(numMeshes);
+		BuildMeshletsTaskSet task;
+		task.Cooked = &cooked;
+		task.Indices = &indices;
+		task.Out = &out;
+		task.m_SetSize = numMeshes;
+
+		auto start = chrono::high_resolution_clock::now();
+		for (int i = 0; i < NumRepeat; i++)
+		{
+			TS.AddTaskSetToPipe(&task);
+			TS.WaitforTask(&task);
+		}
+		double ms = ElapsedMS(start) / NumRepeat;
+		if (numThreads == 1)
+			singleMS = ms;
+
+		cout << "  BuildMeshlets " << numThreads << " threads : " << ms << " ms, " << double(numTriangles) / glm::max(ms, 0.001) / 1000.0
+			<< " M triangles/s, x" << singleMS / glm::max(ms, 0.001) << endl;
+
+		if (numThreads >= numHardwareThreads)
+			break;
+	}
+
+	return bValid;
+}
+
+static bool ValidateCooked(const wstring& CookedFile, const wstring& SourceFile, bool bOptimize)
+{
+	CookedScene cooked;
+	if (!cooked.Open(CookedFile, SourceFile, bOptimize))
+	{
+		wcout << L"  failed to open " << CookedFile << L" (missing, stale, wrong version or cooked with other options)" << endl;
+		return false;
+	}
+
+	string error;
+	if (!cooked.Validate(error))
+	{
+		cout << "  validation failed :\n" << error;
+		return false;
+	}
+
+	cout << "  ok : " << cooked.Header->NumMeshes << " meshes, " << cooked.Header->NumMaterials << " materials, "
+		<< cooked.Header->NumVertices << " vertices, " << cooked.Header->IndexStreamSize << " index bytes" << endl;
+
+	// meshes without a coarser LOD count at their last one
+	UINT64 lodTriangles[MESH_MAX_LODS] = {};
+	for (UINT i = 0; i < cooked.Header->NumMeshes; i++)
+	{
+		const CookedMesh& mesh = cooked.Meshes[i];
+		for (UINT lod = 0; lod < MESH_MAX_LODS; lod++)
+			lodTriangles[lod] += mesh.Lods[glm::min(lod, mesh.NumLods - 1)].NumIndices / 3;
+	}
+
+	cout << "  LOD triangles :";
+	for (UINT lod = 0; lod < MESH_MAX_LODS; lod++)
+		cout << (lod > 0 ? " / " : " ") << lodTriangles[lod];
+	cout << endl;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool bValidateOnly = false;
+	bool bOptimize = true;
+	bool bStats = false;
+	bool bPack = false;
+	bool bMeshlets = false;
+	int NumBench = 0;
+	vector<string> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-validate")
+			bValidateOnly = true;
+		else if (arg == "-nooptimize")
+			bOptimize = false;
+		else if (arg == "-stats")
+			bStats = true;
+		else if (arg == "-pack")
+			bPack = true;
+		else if (arg == "-meshlets")
+			bMeshlets = true;
+		else if (arg == "-bench" && i + 1 < argc)
+			NumBench = atoi(argv[++i]);
+		else
+			files.push_back(arg);
+	}
+
+	if (files.size() == 0)
+	{
+		cout << "usage : MeshCook.exe [-validate] [-nooptimize] [-bench N] [-stats] [-pack] [-meshlets] model.fbx [model2.fbx ...]" << endl;
+		return 1;
+	}
+
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+
+	enki::TaskScheduler TS;
+	TS.Initialize();
+
+	int NumFailed = 0;
+	for (auto& file : files)
+	{
+		wstring wide = converter.from_bytes(file);
+		wstring cookedFile = GetCookedScenePath(wide);
+
+		cout << file << endl;
+
+		if (!bValidateOnly)
+		{
+			auto start = chrono::high_resolution_clock::now();
+			MeshImportData data;
+			if (!ImportMeshFromFile(file, data, &TS, bOptimize))
+			{
+				cout << "  assimp import failed" << endl;
+				NumFailed++;
+				continue;
+			}
+			double importMS = ElapsedMS(start);
+
+			if (!WriteCookedScene(cookedFile, wide, data))
+			{
+				wcout << L"  failed to write " << cookedFile << endl;
+				NumFailed++;
+				continue;
+			}
+			cout << "  cooked in " << importMS << " ms" << endl;
+		}
+
+		if (!ValidateCooked(cookedFile, wide, bOptimize))
+		{
+			NumFailed++;
+			continue;
+		}
+
+		if (bStats)
+			PrintVertexCacheStats(file, TS);
+
+		if (bPack)
+			PrintVertexPackingReport(cookedFile, wide, bOptimize);
+
+		if (bMeshlets && !PrintMeshletReport(cookedFile, wide, bOptimize))
+			NumFailed++;
+
+		// both sides do what LoadModel does up to the device calls. assimp : import and view it from memory(not validated, like LoadModel).
+		// cooked : map, Validate, and the same copies out of the mapped file.
+		if (NumBench > 0)
+		{
+			UINT64 sink = 0;
+			vector<UINT8> upload;
+
+			auto start = chrono::high_resolution_clock::now();
+			for (int i = 0; i < NumBench; i++)
+			{
+				MeshImportData data;
+				ImportMeshFromFile(file, data, &TS, bOptimize);
+				CookedScene scene;
+				scene.OpenFromMemory(data);
+				sink += UploadLikeLoadModel(scene, upload);
+			}
+			double assimpMS = ElapsedMS(start) / NumBench;
+
+			double openMS = 0, validateMS = 0, uploadMS = 0;
+			for (int i = 0; i < NumBench; i++)
+			{
+				start = chrono::high_resolution_clock::now();
+				CookedScene cooked;
+				if (!cooked.Open(cookedFile, wide, bOptimize))
+				{
+					cout << "  cooked file didn't open" << endl;
+					NumFailed++;
+					break;
+				}
+				openMS += ElapsedMS(start);
+
+				start = chrono::high_resolution_clock::now();
+				string error;
+				sink += cooked.Validate(error);
+				validateMS += ElapsedMS(start);
+
+				start = chrono::high_resolution_clock::now();
+				sink += UploadLikeLoadModel(cooked, upload);
+				uploadMS += ElapsedMS(start);
+			}
+			openMS /= NumBench;
+			validateMS /= NumBench;
+			uploadMS /= NumBench;
+			const double cookedMS = openMS + validateMS + uploadMS;
+
+			cout << "  assimp : " << assimpMS << " ms, cooked : " << cookedMS << " ms (open " << openMS << ", validate " << validateMS << ", copies "
+				<< uploadMS << "), x" << assimpMS / glm::max(cookedMS, 0.001) << " (" << sink % 2 << ")" << endl;
+		}
+	}
+
+	return NumFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,552 @@
+// MeshTest : checks the cpu side mesh cooking code without a gpu : the vertex cache optimizer (MeshOptimize.h), the meshlet builder
+// (MeshletBuilder.h), the LOD simplifier (MeshSimplify.h) and the vertex packing (VertexPacking.h).
+// only depends on the standard library and glm, so it builds anywhere :
+// g++ -O2 -std=c++17 -Iexternal tools/MeshTest.cpp MeshOptimize.cpp MeshletBuilder.cpp MeshSimplify.cpp VertexPacking.cpp
+//
+// usage : MeshTest [-seed S]
+//   optimize  shuffled grids and spheres : ACMR goes down, the same triangles come out, vertices are numbered in order of first use
+//   meshlets  grids, spheres and a triangle soup : every triangle in exactly one meshlet, vertex/triangle limits, bounding spheres hold
+//             their vertices, and a meshlet the cone test culls has every triangle facing away from random cameras
+//   lods      planar grid collapses without error, sphere LODs keep winding, valid indices and an error that grows with the reduction
+//   packing   positions decoded the way the shaders do (input layout and ByteAddressBuffer) land within half a step of the source
+
+#include "../MeshOptimize.h"
+#include "../MeshletBuilder.h"
+#include "../MeshSimplify.h"
+#include "../VertexPacking.h"
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <array>
+#include <cstring>
+#include <cfloat>
+
+using namespace std;
+
+static int NumErrors = 0;
+
+#define CHECK(x) do { if (!(x)) { cout << "  FAILED " << #x << " (line " << __LINE__ << ")" << endl; NumErrors++; } } while (0)
+
+struct TestMesh
+{
+	string Name;
+	vector<CookedVertex> Vertices;
+	vector<uint32_t> Indices;
+};
+
+static CookedVertex MakeVertex(const glm::vec3& Position, const glm::vec3& Normal, const glm::vec2& UV)
+{
+	CookedVertex v;
+	v.Position = Position;
+	v.Normal = Normal;
+	v.UV = UV;
+	v.Tangent = glm::vec3(1, 0, 0);
+	return v;
+}
+
+// N x N quads on z = 0, counter clockwise seen from +z
+static TestMesh MakeGrid(uint32_t N)
+{
+	TestMesh mesh;
+	mesh.Name = "grid " + to_string(N) + "x" + to_string(N);
+	for (uint32_t y = 0; y <= N; y++)
+		for (uint32_t x = 0; x <= N; x++)
+			mesh.Vertices.push_back(MakeVertex(glm::vec3(float(x), float(y), 0), glm::vec3(0, 0, 1), glm::vec2(float(x) / N, float(y) / N)));
+
+	for (uint32_t y = 0; y < N; y++)
+	{
+		for (uint32_t x = 0; x < N; x++)
+		{
+			uint32_t i = y * (N + 1) + x;
+			mesh.Indices.insert(mesh.Indices.end(), { i, i + 1, i + N + 2, i, i + N + 2, i + N + 1 });
+		}
+	}
+	return mesh;
+}
+
+// latitude/longitude sphere with one vertex per pole, counter clockwise seen from outside
+static TestMesh MakeSphere(uint32_t Rings, uint32_t Segments, float Radius)
+{
+	TestMesh mesh;
+	mesh.Name = "sphere " + to_string(Rings) + "x" + to_string(Segments);
+
+	const float pi = 3.14159265f;
+	auto Add = [&](const glm::vec3& n) { mesh.Vertices.push_back(MakeVertex(n * Radius, n, glm::vec2(0, 0))); };
+
+	Add(glm::vec3(0, 0, 1));
+	for (uint32_t r = 1; r < Rings; r++)
+	{
+		float theta = pi * r / Rings;
+		for (uint32_t s = 0; s < Segments; s++)
+		{
+			float phi = 2 * pi * s / Segments;
+			Add(glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)));
+		}
+	}
+	Add(glm::vec3(0, 0, -1));
+
+	const uint32_t south = uint32_t(mesh.Vertices.size() - 1);
+	auto Ring = [&](uint32_t r, uint32_t s) { return 1 + (r - 1) * Segments + s % Segments; };
+	for (uint32_t s = 0; s < Segments; s++)
+	{
+		mesh.Indices.insert(mesh.Indices.end(), { 0, Ring(1, s), Ring(1, s + 1) });
+		for (uint32_t r = 1; r + 1 < Rings; r++)
+			mesh.Indices.insert(mesh.Indices.end(), { Ring(r, s), Ring(r + 1, s), Ring(r + 1, s + 1), Ring(r, s), Ring(r + 1, s + 1), Ring(r, s + 1) });
+		mesh.Indices.insert(mesh.Indices.end(), { Ring(Rings - 1, s), south, Ring(Rings - 1, s + 1) });
+	}
+	return mesh;
+}
+
+// every triangle has its own vertices, meshlets are bound by the vertex limit
+static TestMesh MakeSoup(mt19937_64& Rng, uint32_t NumTriangles)
+{
+	TestMesh mesh;
+	mesh.Name = "soup " + to_string(NumTriangles);
+
+	uniform_real_distribution<float> coord(-10.0f, 10.0f);
+	for (uint32_t t = 0; t < NumTriangles; t++)
+	{
+		glm::vec3 p(coord(Rng), coord(Rng), coord(Rng));
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			mesh.Indices.push_back(uint32_t(mesh.Vertices.size()));
+			mesh.Vertices.push_back(MakeVertex(p + glm::vec3(coord(Rng), coord(Rng), coord(Rng)) * 0.1f, glm::vec3(0, 0, 1), glm::vec2(0, 0)));
+		}
+	}
+	return mesh;
+}
+
+static glm::vec3 TriangleNormal(const TestMesh& Mesh, const uint32_t* Tri)
+{
+	const glm::vec3& a = Mesh.Vertices[Tri[0]].Position;
+	return glm::cross(Mesh.Vertices[Tri[1]].Position - a, Mesh.Vertices[Tri[2]].Position - a);
+}
+
+// triangles rotated so the smallest index comes first, sorted. winding is kept, the order of triangles and of their corners isn't.
+static vector<uint32_t> SortedTriangles(const vector<uint32_t>& Indices, const vector<uint32_t>& Remap)
+{
+	vector<array<uint32_t, 3>> triangles;
+	for (size_t i = 0; i + 2 < Indices.size(); i += 3)
+	{
+		array<uint32_t, 3> tri = { Remap[Indices[i]], Remap[Indices[i + 1]], Remap[Indices[i + 2]] };
+		rotate(tri.begin(), min_element(tri.begin(), tri.end()), tri.end());
+		triangles.push_back(tri);
+	}
+	sort(triangles.begin(), triangles.end());
+
+	vector<uint32_t> out;
+	for (auto& tri : triangles)
+		out.insert(out.end(), tri.begin(), tri.end());
+	return out;
+}
+
+static void CheckOptimize(TestMesh Mesh, mt19937_64& Rng)
+{
+	const uint32_t numIndices = uint32_t(Mesh.Indices.size());
+	const uint32_t numVertices = uint32_t(Mesh.Vertices.size());
+
+	// what an importer hands over at worst : triangles and vertices in random order
+	vector<uint32_t> shuffle(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+		shuffle[v] = v;
+	std::shuffle(shuffle.begin(), shuffle.end(), Rng);
+
+	vector<CookedVertex> vertices(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+		vertices[shuffle[v]] = Mesh.Vertices[v];
+	for (uint32_t& i : Mesh.Indices)
+		i = shuffle[i];
+
+	vector<uint32_t> triangleOrder(numIndices / 3);
+	for (uint32_t t = 0; t < triangleOrder.size(); t++)
+		triangleOrder[t] = t;
+	std::shuffle(triangleOrder.begin(), triangleOrder.end(), Rng);
+
+	vector<uint32_t> indices;
+	for (uint32_t t : triangleOrder)
+		indices.insert(indices.end(), &Mesh.Indices[t * 3], &Mesh.Indices[t * 3] + 3);
+
+	// the vertex's index before optimizing rides along in the tangent, that is how the triangles are compared afterwards
+	for (uint32_t v = 0; v < numVertices; v++)
+		vertices[v].Tangent.x = float(v);
+
+	vector<uint32_t> identity(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++)
+		identity[v] = v;
+	const vector<uint32_t> sourceTriangles = SortedTriangles(indices, identity);
+
+	const VertexCacheStats before = AnalyzeVertexCache(indices.data(), numIndices, numVertices, VERTEX_CACHE_SIZE);
+	OptimizeMesh(indices.data(), numIndices, vertices.data(), numVertices);
+	const VertexCacheStats after = AnalyzeVertexCache(indices.data(), numIndices, numVertices, VERTEX_CACHE_SIZE);
+
+	CHECK(after.NumTriangles == before.NumTriangles && after.NumReferenced == before.NumReferenced);
+	CHECK(after.ACMR() < before.ACMR());
+
+	// vertices were only renumbered : every source vertex is still there once
+	vector<uint32_t> original(numVertices);
+	vector<bool> bSeen(numVertices, false);
+	bool bPermutation = true;
+	for (uint32_t v = 0; v < numVertices; v++)
+	{
+		const uint32_t o = uint32_t(vertices[v].Tangent.x);
+		bPermutation = bPermutation && o < numVertices && !bSeen[o];
+		if (o < numVertices)
+			bSeen[o] = true;
+		original[v] = o < numVertices ? o : 0;
+	}
+	CHECK(bPermutation);
+	CHECK(SortedTriangles(indices, original) == sourceTriangles);
+
+	// numbered in order of first use
+	uint32_t next = 0;
+	bool bFetchOrder = true;
+	for (uint32_t i : indices)
+	{
+		bFetchOrder = bFetchOrder && i <= next;
+		if (i == next)
+			next++;
+	}
+	CHECK(bFetchOrder);
+
+	cout << "  " << Mesh.Name << " : ACMR " << before.ACMR() << " -> " << after.ACMR() << ", ATVR " << before.ATVR() << " -> " << after.ATVR() << endl;
+}
+
+static void TestOptimize(uint64_t Seed)
+{
+	cout << "optimize" << endl;
+	mt19937_64 rng(Seed);
+
+	CheckOptimize(MakeGrid(64), rng);
+	CheckOptimize(MakeSphere(32, 64, 2.0f), rng);
+	CheckOptimize(MakeSphere(96, 192, 1.0f), rng);
+
+	// the vertex cache pass alone keeps every triangle as it was, corners included
+	{
+		TestMesh mesh = MakeSphere(16, 32, 1.0f);
+		vector<uint32_t> indices = mesh.Indices;
+		OptimizeVertexCache(indices.data(), uint32_t(indices.size()), uint32_t(mesh.Vertices.size()));
+
+		vector<array<uint32_t, 3>> source, optimized;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			source.push_back({ mesh.Indices[i], mesh.Indices[i + 1], mesh.Indices[i + 2] });
+			optimized.push_back({ indices[i], indices[i + 1], indices[i + 2] });
+		}
+		sort(source.begin(), source.end());
+		sort(optimized.begin(), optimized.end());
+		CHECK(source == optimized);
+	}
+}
+
+static void CheckMeshlets(const TestMesh& Mesh, mt19937_64& Rng)
+{
+	const uint32_t numIndices = uint32_t(Mesh.Indices.size());
+	const uint32_t numVertices = uint32_t(Mesh.Vertices.size());
+	const float* positions = &Mesh.Vertices[0].Position.x;
+
+	MeshletData data;
+	BuildMeshlets(Mesh.Indices.data(), numIndices, positions, sizeof(CookedVertex), numVertices, data);
+
+	string error;
+	const bool bValid = ValidateMeshlets(data, Mesh.Indices.data(), numIndices, positions, sizeof(CookedVertex), numVertices, error);
+	CHECK(bValid);
+	if (!bValid)
+		cout << "  " << error;
+
+	// checked here again without ValidateMeshlets, a bug in it would hide one in the builder
+	map<vector<uint32_t>, int> coverage;
+	for (uint32_t i = 0; i < numIndices; i += 3)
+		coverage[{ Mesh.Indices[i], Mesh.Indices[i + 1], Mesh.Indices[i + 2] }]--;
+
+	uint32_t maxVertices = 0, maxTriangles = 0, numCulled = 0, numSamples = 0;
+	uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	for (const Meshlet& m : data.Meshlets)
+	{
+		CHECK(m.VertexCount > 0 && m.VertexCount <= MESHLET_MAX_VERTICES);
+		CHECK(m.TriangleCount > 0 && m.TriangleCount <= MESHLET_MAX_TRIANGLES);
+		CHECK(m.VertexOffset + m.VertexCount <= data.Vertices.size());
+		CHECK((m.TriangleOffset + m.TriangleCount) * 3 <= data.Triangles.size());
+		if (m.VertexOffset + m.VertexCount > data.Vertices.size() || (m.TriangleOffset + m.TriangleCount) * 3 > data.Triangles.size())
+			continue;
+		maxVertices = max(maxVertices, m.VertexCount);
+		maxTriangles = max(maxTriangles, m.TriangleCount);
+
+		const uint32_t* vertices = &data.Vertices[m.VertexOffset];
+		vector<uint32_t> unique(vertices, vertices + m.VertexCount);
+		sort(unique.begin(), unique.end());
+		CHECK(adjacent_find(unique.begin(), unique.end()) == unique.end());
+
+		for (uint32_t i = 0; i < m.VertexCount; i++)
+			CHECK(glm::length(Mesh.Vertices[vertices[i]].Position - m.Center) <= m.Radius * 1.0001f + 1e-5f);
+
+		vector<uint32_t> triangles;
+		for (uint32_t t = 0; t < m.TriangleCount; t++)
+		{
+			const uint8_t* local = &data.Triangles[(m.TriangleOffset + t) * 3];
+			CHECK(local[0] < m.VertexCount && local[1] < m.VertexCount && local[2] < m.VertexCount);
+			uint32_t tri[3] = { vertices[local[0] % m.VertexCount], vertices[local[1] % m.VertexCount], vertices[local[2] % m.VertexCount] };
+			coverage[{ tri[0], tri[1], tri[2] }]++;
+			triangles.insert(triangles.end(), tri, tri + 3);
+		}
+
+		// culling has to be conservative : a culled meshlet can't have a triangle facing the camera
+		CHECK(m.ConeCutoff >= 0 && m.ConeCutoff <= 1);
+		for (uint32_t s = 0; s < 64; s++)
+		{
+			glm::vec3 camera = m.Center + glm::vec3(direction(Rng), direction(Rng), direction(Rng)) * m.Radius * 8.0f;
+			numSamples++;
+			if (!IsMeshletBackfacing(m, camera))
+				continue;
+
+			numCulled++;
+			for (size_t t = 0; t < triangles.size(); t += 3)
+			{
+				glm::vec3 n = TriangleNormal(Mesh, &triangles[t]);
+				CHECK(glm::dot(n, Mesh.Vertices[triangles[t]].Position - camera) >= -1e-4f * glm::length(n));
+			}
+		}
+	}
+
+	uint32_t numMissing = 0, numDuplicated = 0;
+	for (auto& it : coverage)
+	{
+		numMissing += it.second < 0;
+		numDuplicated += it.second > 0;
+	}
+	CHECK(numMissing == 0);
+	CHECK(numDuplicated == 0);
+
+	cout << "  " << Mesh.Name << " : " << numIndices / 3 << " triangles in " << data.Meshlets.size() << " meshlets, max " << maxVertices << " vertices / "
+		<< maxTriangles << " triangles, cone culled " << (numSamples ? 100.0 * numCulled / numSamples : 0.0) << "% of the camera samples" << endl;
+}
+
+static void TestMeshlets(uint64_t Seed)
+{
+	cout << "meshlets" << endl;
+	mt19937_64 rng(Seed);
+
+	// one triangle, and an empty mesh that mustn't produce a meshlet
+	{
+		TestMesh mesh = MakeGrid(1);
+		mesh.Indices.resize(3);
+		CheckMeshlets(mesh, rng);
+
+		MeshletData data;
+		BuildMeshlets(mesh.Indices.data(), 0, &mesh.Vertices[0].Position.x, sizeof(CookedVertex), uint32_t(mesh.Vertices.size()), data);
+		CHECK(data.Meshlets.empty() && data.Vertices.empty() && data.Triangles.empty());
+	}
+
+	CheckMeshlets(MakeGrid(7), rng);
+	CheckMeshlets(MakeGrid(64), rng);
+	CheckMeshlets(MakeSphere(32, 64, 2.0f), rng);
+	CheckMeshlets(MakeSoup(rng, 1000), rng);
+
+	// a flat grid is one normal, its meshlets must cull from behind and not from the front
+	{
+		TestMesh mesh = MakeGrid(16);
+		MeshletData data;
+		BuildMeshlets(mesh.Indices.data(), uint32_t(mesh.Indices.size()), &mesh.Vertices[0].Position.x, sizeof(CookedVertex), uint32_t(mesh.Vertices.size()), data);
+		for (const Meshlet& m : data.Meshlets)
+		{
+			CHECK(glm::dot(m.ConeAxis, glm::vec3(0, 0, 1)) > 0.999f);
+			CHECK(IsMeshletBackfacing(m, m.Center - glm::vec3(0, 0, 100)));
+			CHECK(!IsMeshletBackfacing(m, m.Center + glm::vec3(0, 0, 100)));
+		}
+	}
+}
+
+// indices in range, no collapsed triangle left behind
+static bool CheckLodIndices(const vector<uint32_t>& Indices, uint32_t NumVertices)
+{
+	if (Indices.size() % 3 != 0)
+		return false;
+	for (size_t i = 0; i < Indices.size(); i += 3)
+	{
+		if (Indices[i] >= NumVertices || Indices[i + 1] >= NumVertices || Indices[i + 2] >= NumVertices)
+			return false;
+		if (Indices[i] == Indices[i + 1] || Indices[i + 1] == Indices[i + 2] || Indices[i] == Indices[i + 2])
+			return false;
+	}
+	return true;
+}
+
+static void TestLods()
+{
+	cout << "lods" << endl;
+
+	// planar : collapses cost nothing, area and normal are kept
+	{
+		TestMesh mesh = MakeGrid(32);
+		const uint32_t numVertices = uint32_t(mesh.Vertices.size());
+		vector<uint32_t> lod;
+		float error = -1;
+		SimplifyMesh(mesh.Indices.data(), uint32_t(mesh.Indices.size()), mesh.Vertices.data(), numVertices, uint32_t(mesh.Indices.size() / 4), lod, error);
+
+		CHECK(CheckLodIndices(lod, numVertices));
+		CHECK(lod.size() < mesh.Indices.size() / 2);
+		CHECK(error >= 0 && error < 1e-3f);
+
+		float area = 0;
+		for (size_t i = 0; i < lod.size(); i += 3)
+		{
+			glm::vec3 n = TriangleNormal(mesh, &lod[i]);
+			CHECK(n.z > 0);
+			area += 0.5f * glm::length(n);
+		}
+		CHECK(fabs(area - 32.0f * 32.0f) < 0.01f);
+		cout << "  " << mesh.Name << " : " << mesh.Indices.size() / 3 << " -> " << lod.size() / 3 << " triangles, error " << error << endl;
+	}
+
+	// curved : every halving costs more, triangles keep facing out and the vertices stay on the sphere, so the error is bound by the radius
+	{
+		const float radius = 2.0f;
+		TestMesh mesh = MakeSphere(32, 64, radius);
+		const uint32_t numVertices = uint32_t(mesh.Vertices.size());
+
+		vector<uint32_t> source = mesh.Indices;
+		float previousError = 0;
+		for (uint32_t level = 1; level <= 4 && source.size() / 3 >= MESH_LOD_MIN_TRIANGLES; level++)
+		{
+			vector<uint32_t> lod;
+			float error = -1;
+			SimplifyMesh(source.data(), uint32_t(source.size()), mesh.Vertices.data(), numVertices, uint32_t(source.size() / 3 / 2 * 3), lod, error);
+
+			CHECK(CheckLodIndices(lod, numVertices));
+			CHECK(lod.size() < source.size());
+			CHECK(error > 0 && error < radius);
+			CHECK(error >= previousError);
+
+			uint32_t numInward = 0;
+			for (size_t i = 0; i < lod.size(); i += 3)
+			{
+				glm::vec3 centroid = (mesh.Vertices[lod[i]].Position + mesh.Vertices[lod[i + 1]].Position + mesh.Vertices[lod[i + 2]].Position) / 3.0f;
+				numInward += glm::dot(TriangleNormal(mesh, &lod[i]), centroid) <= 0;
+			}
+			CHECK(numInward == 0);
+
+			cout << "  " << mesh.Name << " lod " << level << " : " << source.size() / 3 << " -> " << lod.size() / 3 << " triangles, error " << error << endl;
+			previousError = error;
+			source.swap(lod);
+		}
+	}
+
+	// below the minimum nothing is asked for, the source has to come back untouched
+	{
+		TestMesh mesh = MakeGrid(2);
+		vector<uint32_t> lod;
+		float error = -1;
+		SimplifyMesh(mesh.Indices.data(), uint32_t(mesh.Indices.size()), mesh.Vertices.data(), uint32_t(mesh.Vertices.size()), uint32_t(mesh.Indices.size()), lod, error);
+		CHECK(lod == mesh.Indices);
+		CHECK(error == 0);
+	}
+}
+
+// Shaders/Common.hlsl DecodePackedPosition on what ByteAddressBuffer.Load2 returns for the vertex
+static glm::vec3 DecodeLikeByteAddressBuffer(const PackedVertex& Vertex, const PositionQuantization& Quantization)
+{
+	uint32_t packed[2];
+	memcpy(packed, &Vertex, sizeof(packed));
+	glm::vec3 q(float(packed[0] & 0xffff), float(packed[0] >> 16), float(packed[1] & 0xffff));
+	return q * glm::vec3(Quantization.Scale) + glm::vec3(Quantization.Bias);
+}
+
+// Shaders/GBuffer.hlsl VSMain : R16G16B16A16_UINT gives the integers as they are, float3(position.xyz) * PositionScale + PositionBias
+static glm::vec3 DecodeLikeInputLayout(const PackedVertex& Vertex, const PositionQuantization& Quantization)
+{
+	glm::uvec4 position(Vertex.Position[0], Vertex.Position[1], Vertex.Position[2], Vertex.Position[3]);
+	return glm::vec3(position) * glm::vec3(Quantization.Scale) + glm::vec3(Quantization.Bias);
+}
+
+static void CheckPacking(const string& Name, const vector<CookedVertex>& Vertices)
+{
+	vector<PackedVertex> packed(Vertices.size());
+	PositionQuantization quantization;
+	PackMeshVertices(Vertices.data(), uint32_t(Vertices.size()), packed.data(), quantization);
+
+	// half a quantization step per axis, plus float rounding of the decode
+	const glm::vec3 step = glm::vec3(quantization.Scale);
+	const glm::vec3 extent = step * 65535.0f;
+	const glm::vec3 tolerance = step * 0.5f + glm::max(glm::abs(glm::vec3(quantization.Bias)), extent) * 1e-6f;
+
+	float maxError = 0;
+	uint32_t numOutside = 0, numMismatch = 0;
+	glm::vec3 decodedMin(FLT_MAX), decodedMax(-FLT_MAX);
+	for (size_t i = 0; i < Vertices.size(); i++)
+	{
+		glm::vec3 cpu = UnpackVertex(packed[i], quantization).Position;
+		glm::vec3 buffer = DecodeLikeByteAddressBuffer(packed[i], quantization);
+		glm::vec3 layout = DecodeLikeInputLayout(packed[i], quantization);
+		numMismatch += cpu != buffer || cpu != layout;
+
+		glm::vec3 error = glm::abs(layout - Vertices[i].Position);
+		numOutside += glm::any(glm::greaterThan(error, tolerance));
+		if (extent.x + extent.y + extent.z > 0)
+			maxError = glm::max(maxError, glm::length(error) / glm::max(glm::max(extent.x, extent.y), extent.z));
+
+		decodedMin = glm::min(decodedMin, layout);
+		decodedMax = glm::max(decodedMax, layout);
+	}
+	CHECK(numMismatch == 0);
+	CHECK(numOutside == 0);
+
+	// the decoded mesh has the source AABB, nothing collapses onto a corner
+	const glm::vec3 aabbMin = glm::vec3(quantization.Bias);
+	CHECK(glm::all(glm::lessThanEqual(glm::abs(decodedMin - aabbMin), tolerance)));
+	CHECK(glm::all(glm::lessThanEqual(glm::abs(decodedMax - (aabbMin + extent)), tolerance)));
+
+	VertexPackingError error = MeasureVertexPackingError(Vertices.data(), uint32_t(Vertices.size()));
+	CHECK(error.MaxNormalDegrees < 0.1f && error.MaxTangentDegrees < 0.1f);
+
+	cout << "  " << Name << " : " << Vertices.size() << " vertices, max position error " << maxError << " of the extent, normal "
+		<< error.MaxNormalDegrees << " degrees" << endl;
+}
+
+static void TestPacking(uint64_t Seed)
+{
+	cout << "packing" << endl;
+	mt19937_64 rng(Seed);
+
+	CheckPacking("sphere", MakeSphere(32, 64, 2.0f).Vertices);
+	CheckPacking("grid", MakeGrid(64).Vertices);
+
+	// away from the origin and very flat on one axis
+	TestMesh soup = MakeSoup(rng, 1000);
+	for (CookedVertex& v : soup.Vertices)
+	{
+		v.Position = v.Position * glm::vec3(100.0f, 0.01f, 3.0f) + glm::vec3(-5000.0f, 250.0f, 12345.0f);
+		v.Normal = glm::normalize(v.Position - glm::vec3(-5000.0f, 250.0f, 12345.0f));
+	}
+	CheckPacking("offset soup", soup.Vertices);
+
+	// one vertex has no extent at all
+	CheckPacking("single vertex", vector<CookedVertex>(1, MakeVertex(glm::vec3(1, 2, 3), glm::vec3(0, 1, 0), glm::vec2(0.5f, 0.5f))));
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t seed = 1234;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-seed" && i + 1 < argc)
+			seed = strtoull(argv[++i], nullptr, 10);
+	}
+
+	TestOptimize(seed);
+	TestMeshlets(seed);
+	TestLods();
+	TestPacking(seed);
+
+	if (NumErrors)
+	{
+		cout << NumErrors << " checks failed" << endl;
+		return 1;
+	}
+
+	cout << "all checks passed" << endl;
+	return 0;
+}
@@ -0,0 +1,416 @@
+// RenderGraphTest : checks and times the render graph compiler (RenderGraph.h) without a gpu.
+// only depends on the standard library, so it builds anywhere : g++ -O2 -std=c++17 tools/RenderGraphTest.cpp RenderGraph.cpp HeapAllocator.cpp
+//
+// usage : RenderGraphTest [-seed S]
+//   culling/queues/transitions of a small frame, random graphs checked against their dependencies, compile time for 128..1024 passes
+
+#include "../RenderGraph.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static const uint64_t KB = 1024;
+static const uint64_t MB = 1024 * 1024;
+
+static int NumErrors = 0;
+
+#define CHECK(x) do { if (!(x)) { cout << "  FAILED " << #x << " (line " << __LINE__ << ")" << endl; NumErrors++; } } while (0)
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+// placement alignments the d3d12 backend asks for, like HeapBench : 4KB small textures, 64KB buffers/textures, 4MB msaa
+static uint64_t RandomAlignment(mt19937_64& Rng)
+{
+	switch (Rng() % 8)
+	{
+	case 0: case 1: case 2: return 4 * KB;
+	case 7: return 4 * MB;
+	default: return 64 * KB;
+	}
+}
+
+// mostly small targets with a tail of big ones
+static uint64_t RandomSize(mt19937_64& Rng, uint64_t MaxSize)
+{
+	const double t = uniform_real_distribution<double>(0.0, 1.0)(Rng);
+	uint64_t size = uint64_t(4.0 * KB * pow(double(MaxSize) / (4.0 * KB), t * t * t));
+	return max<uint64_t>(1, min(size, MaxSize));
+}
+
+// states for the render graph tests, like the d3d12 ones : reads can be or'd together, writes can't
+static const uint32_t RG_NON_PIXEL = 1;
+static const uint32_t RG_PIXEL = 2;
+static const uint32_t RG_UAV = 4;
+static const uint32_t RG_RT = 8;
+static const uint32_t RG_PRESENT = 16;
+
+static void BuildRandomGraph(RenderGraph& Graph, mt19937_64& Rng, uint32_t NumPasses)
+{
+	Graph.Clear();
+
+	const uint32_t importedStates[] = { RG_NON_PIXEL, RG_PIXEL, RG_NON_PIXEL | RG_PIXEL, RG_UAV, RG_RT };
+	const uint32_t numResources = NumPasses / 2 + 4;
+	for (uint32_t r = 0; r < numResources; r++)
+	{
+		if (Rng() % 4 == 0)
+		{
+			const uint32_t finalState = Rng() % 2 ? RENDER_GRAPH_ANY_STATE : importedStates[Rng() % 5];
+			Graph.ImportResource("Imported" + to_string(r), importedStates[Rng() % 5], finalState, Rng() % 2 == 0);
+		}
+		else
+		{
+			Graph.CreateResource("Transient" + to_string(r), RandomSize(Rng, 64 * MB), RandomAlignment(Rng));
+		}
+	}
+
+	for (uint32_t p = 0; p < NumPasses; p++)
+	{
+		const uint32_t pass = Graph.AddPass("Pass" + to_string(p), Rng() % 6 == 0 ? RENDER_GRAPH_COMPUTE : RENDER_GRAPH_DIRECT, Rng() % 8 == 0);
+
+		// mostly nearby resources, like a frame where a pass reads what the last few wrote
+		auto pick = [&]()
+		{
+			const uint32_t center = uint32_t(uint64_t(p) * numResources / NumPasses);
+			const uint32_t spread = 8;
+			return (center + numResources - spread / 2 + uint32_t(Rng() % spread)) % numResources;
+		};
+
+		const uint32_t numReads = uint32_t(Rng() % 4);
+		for (uint32_t i = 0; i < numReads; i++)
+			Graph.Read(pass, pick(), Rng() % 2 ? RG_NON_PIXEL : RG_PIXEL);
+
+		const uint32_t numWrites = 1 + uint32_t(Rng() % 2);
+		for (uint32_t i = 0; i < numWrites; i++)
+		{
+			if (Rng() % 4 == 0)
+				Graph.Modify(pass, pick(), Rng() % 2 ? RG_UAV : RG_RT);
+			else
+				Graph.Write(pass, pick(), Rng() % 2 ? RG_UAV : RG_RT);
+		}
+	}
+}
+
+// everything Compile promises, worked out again the slow way
+static void CheckCompiledGraph(const RenderGraph& Graph)
+{
+	const vector<RenderGraphStep>& steps = Graph.GetSteps();
+	const uint32_t numPasses = Graph.GetNumPasses();
+	const uint32_t numResources = Graph.GetNumResources();
+
+	// culling : a live pass gets what it reads from a live pass, outputs and side effects are kept
+	{
+		vector<uint32_t> lastWriter(numResources, RENDER_GRAPH_INVALID);
+		for (uint32_t p = 0; p < numPasses; p++)
+		{
+			const RenderGraphPass& pass = Graph.GetPass(p);
+			if (pass.bSideEffect)
+				CHECK(pass.Step != RENDER_GRAPH_INVALID);
+
+			for (const RenderGraphAccess& access : pass.Accesses)
+			{
+				if (pass.Step != RENDER_GRAPH_INVALID && (access.Flags & RENDER_GRAPH_READ) && lastWriter[access.Resource] != RENDER_GRAPH_INVALID)
+					CHECK(Graph.GetPass(lastWriter[access.Resource]).Step != RENDER_GRAPH_INVALID);
+			}
+			for (const RenderGraphAccess& access : pass.Accesses)
+			{
+				if (access.Flags & RENDER_GRAPH_WRITE)
+					lastWriter[access.Resource] = p;
+			}
+		}
+		for (uint32_t r = 0; r < numResources; r++)
+		{
+			if (Graph.GetResource(r).bOutput && lastWriter[r] != RENDER_GRAPH_INVALID)
+				CHECK(Graph.GetPass(lastWriter[r]).Step != RENDER_GRAPH_INVALID);
+		}
+
+		uint32_t numLive = 0;
+		for (uint32_t p = 0; p < numPasses; p++)
+			numLive += Graph.GetPass(p).Step != RENDER_GRAPH_INVALID ? 1 : 0;
+		CHECK(numLive == steps.size());
+		CHECK(Graph.GetStats().NumCulled == numPasses - numLive);
+	}
+
+	// every read after write, write after read and write after write between live passes keeps its order. the queues wait for
+	// the other one when the two passes aren't on the same queue.
+	vector<pair<uint32_t, uint32_t>> deps; // step -> step that has to be done before it
+	{
+		vector<uint32_t> lastWriter(numResources, RENDER_GRAPH_INVALID);
+		vector<vector<uint32_t>> readers(numResources);
+		for (uint32_t p = 0; p < numPasses; p++)
+		{
+			const RenderGraphPass& pass = Graph.GetPass(p);
+			if (pass.Step == RENDER_GRAPH_INVALID)
+				continue;
+
+			for (const RenderGraphAccess& access : pass.Accesses)
+			{
+				if (lastWriter[access.Resource] != RENDER_GRAPH_INVALID)
+					deps.push_back(make_pair(pass.Step, Graph.GetPass(lastWriter[access.Resource]).Step));
+				if (access.Flags & RENDER_GRAPH_WRITE)
+				{
+					for (uint32_t reader : readers[access.Resource])
+					{
+						if (reader != p)
+							deps.push_back(make_pair(pass.Step, Graph.GetPass(reader).Step));
+					}
+				}
+			}
+			for (const RenderGraphAccess& access : pass.Accesses)
+			{
+				if (access.Flags & RENDER_GRAPH_WRITE)
+				{
+					lastWriter[access.Resource] = p;
+					readers[access.Resource].clear();
+				}
+				else
+				{
+					readers[access.Resource].push_back(p);
+				}
+			}
+		}
+	}
+
+	for (const pair<uint32_t, uint32_t>& dep : deps)
+		CHECK(dep.second < dep.first);
+
+	// waited[q] : last step of the other queue queue q waited for before each step
+	vector<uint32_t> waitedBefore(steps.size(), RENDER_GRAPH_INVALID);
+	{
+		uint32_t waited[RENDER_GRAPH_NUM_QUEUES] = { RENDER_GRAPH_INVALID, RENDER_GRAPH_INVALID };
+		for (uint32_t s = 0; s < steps.size(); s++)
+		{
+			if (steps[s].WaitStep != RENDER_GRAPH_INVALID)
+			{
+				CHECK(steps[steps[s].WaitStep].Queue != steps[s].Queue && steps[s].WaitStep < s);
+				waited[steps[s].Queue] = steps[s].WaitStep;
+			}
+			waitedBefore[s] = waited[steps[s].Queue];
+		}
+	}
+	for (const pair<uint32_t, uint32_t>& dep : deps)
+	{
+		if (steps[dep.first].Queue != steps[dep.second].Queue)
+			CHECK(waitedBefore[dep.first] != RENDER_GRAPH_INVALID && waitedBefore[dep.first] >= dep.second);
+	}
+
+	// transitions : each one starts from the state the resource is in, every access finds the state it declared
+	vector<uint32_t> state(numResources);
+	for (uint32_t r = 0; r < numResources; r++)
+		state[r] = Graph.GetResource(r).bImported ? Graph.GetResource(r).InitialState : RENDER_GRAPH_UNDEFINED_STATE;
+
+	for (uint32_t s = 0; s < steps.size(); s++)
+	{
+		for (const RenderGraphTransition& transition : steps[s].Transitions)
+		{
+			CHECK(transition.Before == state[transition.Resource] && transition.Before != transition.After);
+			state[transition.Resource] = transition.After;
+			if (transition.SplitStep != RENDER_GRAPH_INVALID)
+				CHECK(transition.SplitStep < s && steps[transition.SplitStep].Queue == steps[s].Queue);
+		}
+		for (const RenderGraphTransition& transition : steps[s].SplitBegins)
+			CHECK(transition.SplitStep == s);
+
+		for (const RenderGraphAccess& access : Graph.GetPass(steps[s].Pass).Accesses)
+		{
+			const RenderGraphResource& res = Graph.GetResource(access.Resource);
+			CHECK(res.FirstStep <= s && s <= res.LastStep);
+
+			if (access.Flags & RENDER_GRAPH_WRITE)
+				CHECK(state[access.Resource] == access.State);
+			else
+				CHECK(state[access.Resource] != RENDER_GRAPH_UNDEFINED_STATE && (access.State & ~state[access.Resource]) == 0);
+		}
+	}
+
+	for (const RenderGraphTransition& transition : Graph.GetFinalTransitions())
+	{
+		CHECK(transition.Before == state[transition.Resource]);
+		state[transition.Resource] = transition.After;
+	}
+	for (uint32_t r = 0; r < numResources; r++)
+	{
+		const RenderGraphResource& res = Graph.GetResource(r);
+		if (res.bImported && res.FinalState != RENDER_GRAPH_ANY_STATE)
+			CHECK(state[r] == res.FinalState);
+	}
+
+	// the direct queue has waited for all the compute work at the end
+	uint32_t lastCompute = RENDER_GRAPH_INVALID;
+	uint32_t lastDirectWait = RENDER_GRAPH_INVALID;
+	for (uint32_t s = 0; s < steps.size(); s++)
+	{
+		if (steps[s].Queue == RENDER_GRAPH_COMPUTE)
+			lastCompute = s;
+		else if (steps[s].WaitStep != RENDER_GRAPH_INVALID)
+			lastDirectWait = steps[s].WaitStep;
+	}
+	if (Graph.GetFinalWaitStep() != RENDER_GRAPH_INVALID)
+		lastDirectWait = Graph.GetFinalWaitStep();
+	if (lastCompute != RENDER_GRAPH_INVALID)
+		CHECK(lastDirectWait != RENDER_GRAPH_INVALID && lastDirectWait >= lastCompute);
+
+	// lifetimes alias only when they don't overlap
+	vector<TransientRange> ranges = Graph.GetTransientRanges();
+	const uint64_t heapSize = PlanTransientOffsets(ranges);
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		CHECK(ranges[i].Offset + ranges[i].Size <= heapSize);
+		for (size_t j = i + 1; j < ranges.size(); j++)
+		{
+			if (ranges[i].IsUsed() && ranges[j].IsUsed() && ranges[i].Overlaps(ranges[j]))
+				CHECK(ranges[i].Offset + ranges[i].Size <= ranges[j].Offset || ranges[j].Offset + ranges[j].Size <= ranges[i].Offset);
+		}
+	}
+}
+
+static void TestRenderGraph(uint64_t Seed)
+{
+	cout << "rendergraph" << endl;
+
+	// a small frame : a culled pass, a compute pass next to the direct queue, reads sharing a transition, an overlay on the backbuffer
+	{
+		RenderGraph graph;
+		const uint32_t backbuffer = graph.ImportResource("Backbuffer", RG_PRESENT, RG_PRESENT, true);
+		const uint32_t history = graph.ImportResource("History", RG_PIXEL, RENDER_GRAPH_ANY_STATE, true);
+		const uint32_t exposure = graph.ImportResource("Exposure", RG_NON_PIXEL, RG_UAV, true);
+		const uint32_t gbuffer = graph.CreateResource("GBuffer", 8 * MB, 64 * KB);
+		const uint32_t unused = graph.CreateResource("Unused", 8 * MB, 64 * KB);
+		const uint32_t lighting = graph.CreateResource("Lighting", 16 * MB, 64 * KB);
+
+		const uint32_t gbufferPass = graph.AddPass("GBuffer");
+		graph.Write(gbufferPass, gbuffer, RG_RT);
+		const uint32_t unusedPass = graph.AddPass("Unused");
+		graph.Read(unusedPass, gbuffer, RG_NON_PIXEL);
+		graph.Write(unusedPass, unused, RG_UAV);
+		const uint32_t lightingPass = graph.AddPass("Lighting");
+		graph.Read(lightingPass, gbuffer, RG_PIXEL);
+		graph.Write(lightingPass, lighting, RG_RT);
+		const uint32_t exposurePass = graph.AddPass("Exposure", RENDER_GRAPH_COMPUTE);
+		graph.Read(exposurePass, lighting, RG_NON_PIXEL);
+		graph.Modify(exposurePass, exposure, RG_UAV);
+		const uint32_t temporalPass = graph.AddPass("Temporal");
+		graph.Read(temporalPass, lighting, RG_PIXEL);
+		graph.Modify(temporalPass, history, RG_UAV);
+		const uint32_t toneMapPass = graph.AddPass("ToneMap");
+		graph.Read(toneMapPass, lighting, RG_PIXEL);
+		graph.Read(toneMapPass, exposure, RG_PIXEL);
+		graph.Write(toneMapPass, backbuffer, RG_RT);
+		const uint32_t debugPass = graph.AddPass("Debug");
+		graph.Modify(debugPass, backbuffer, RG_RT);
+		const uint32_t readbackPass = graph.AddPass("Readback", RENDER_GRAPH_DIRECT, true);
+		graph.Read(readbackPass, gbuffer, RG_NON_PIXEL);
+
+		graph.Compile(true);
+		CheckCompiledGraph(graph);
+
+		const vector<RenderGraphStep>& steps = graph.GetSteps();
+		const RenderGraphStats& stats = graph.GetStats();
+		CHECK(graph.GetPass(unusedPass).Step == RENDER_GRAPH_INVALID);
+		CHECK(stats.NumCulled == 1 && steps.size() == 7);
+		CHECK(graph.GetPass(readbackPass).Step != RENDER_GRAPH_INVALID);
+
+		// the compute pass goes right after what it reads and waits for it, the direct queue waits for it once
+		CHECK(graph.GetPass(exposurePass).Step == graph.GetPass(lightingPass).Step + 1);
+		CHECK(steps[graph.GetPass(exposurePass).Step].Queue == RENDER_GRAPH_COMPUTE);
+		CHECK(steps[graph.GetPass(exposurePass).Step].WaitStep == graph.GetPass(lightingPass).Step);
+		CHECK(steps[graph.GetPass(temporalPass).Step].WaitStep == graph.GetPass(exposurePass).Step);
+		CHECK(steps[graph.GetPass(toneMapPass).Step].WaitStep == RENDER_GRAPH_INVALID);
+		CHECK(stats.NumWaits == 2 && graph.GetFinalWaitStep() == RENDER_GRAPH_INVALID);
+
+		// Lighting and Readback read the g-buffer in one transition
+		const vector<RenderGraphTransition>& lightingTransitions = steps[graph.GetPass(lightingPass).Step].Transitions;
+		bool bMerged = false;
+		for (const RenderGraphTransition& transition : lightingTransitions)
+			bMerged |= transition.Resource == gbuffer && transition.Before == RG_RT && transition.After == (RG_PIXEL | RG_NON_PIXEL);
+		CHECK(bMerged && stats.NumMergedReads >= 1);
+		CHECK(steps[graph.GetPass(readbackPass).Step].Transitions.empty());
+
+		// the overlay finds the backbuffer as the tone map left it, it goes back to present at the end
+		CHECK(steps[graph.GetPass(debugPass).Step].Transitions.empty());
+		bool bPresent = false;
+		for (const RenderGraphTransition& transition : graph.GetFinalTransitions())
+			bPresent |= transition.Resource == backbuffer && transition.Before == RG_RT && transition.After == RG_PRESENT;
+		CHECK(bPresent);
+
+		CHECK(graph.GetResource(gbuffer).FirstStep == 0 && graph.GetResource(gbuffer).LastStep == graph.GetPass(readbackPass).Step);
+		CHECK(graph.GetResource(unused).FirstStep == RENDER_GRAPH_INVALID);
+
+		// without async compute it is one queue and nothing waits
+		graph.Compile(false);
+		CheckCompiledGraph(graph);
+		CHECK(graph.GetStats().NumCompute == 0 && graph.GetStats().NumWaits == 0 && graph.GetFinalWaitStep() == RENDER_GRAPH_INVALID);
+	}
+
+	// random graphs
+	mt19937_64 rng(Seed);
+	RenderGraph graph;
+	uint64_t numPasses = 0, numCulled = 0, numTransitions = 0, numMerged = 0, numWaits = 0;
+	for (uint32_t i = 0; i < 500; i++)
+	{
+		BuildRandomGraph(graph, rng, 4 + uint32_t(rng() % 160));
+		graph.Compile(rng() % 4 != 0);
+		CheckCompiledGraph(graph);
+
+		const RenderGraphStats& stats = graph.GetStats();
+		numPasses += stats.NumPasses;
+		numCulled += stats.NumCulled;
+		numTransitions += stats.NumTransitions;
+		numMerged += stats.NumMergedReads;
+		numWaits += stats.NumWaits;
+
+		if (NumErrors > 10)
+			return;
+	}
+	cout << "  500 random graphs, " << numPasses << " passes : " << numCulled << " culled, " << numTransitions << " transitions, "
+		<< numMerged << " merged reads, " << numWaits << " waits (" << (NumErrors == 0 ? "ok" : "errors") << ")" << endl;
+
+	// compile time. the renderer only compiles when a setting changes, but it should stay well under a frame for big graphs too.
+	for (uint32_t size : { 128u, 256u, 512u, 1024u })
+	{
+		BuildRandomGraph(graph, rng, size);
+		graph.Compile(true);
+
+		const uint32_t numCompiles = max(10u, 200000u / size);
+		auto start = chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numCompiles; i++)
+			graph.Compile(true);
+		const double ms = ElapsedMS(start);
+
+		const RenderGraphStats& stats = graph.GetStats();
+		cout << "  " << size << " passes : " << 1000.0 * ms / numCompiles << " us per compile (" << stats.NumCulled << " culled, "
+			<< stats.NumTransitions << " transitions, " << stats.NumSplit << " split, " << stats.NumWaits << " waits)" << endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-seed" && i + 1 < argc)
+			seed = stoull(argv[++i]);
+		else
+		{
+			cout << "usage : RenderGraphTest [-seed S]" << endl;
+			return 1;
+		}
+	}
+
+	TestRenderGraph(seed);
+
+	if (NumErrors > 0)
+		cout << NumErrors << " checks failed" << endl;
+
+	return NumErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+// ShaderCacheTest : checks and times the shader cache (ShaderCache.h) without a gpu. a stand in compiler makes the blobs for the checks,
+// the renderer's shaders also go through the real dxc executable when there is one.
+// only depends on the standard library, so it builds anywhere : g++ -O2 -std=c++17 tools/ShaderCacheTest.cpp ShaderCache.cpp
+//
+// usage : ShaderCacheTest [-seed S] [-shaders DIR] [-dxc PATH]
+//   keys/invalidation/corrupt entries with the stand in compiler, then hit rate and key/load time of the renderer's shaders cold and warm.
+//   with dxc (-dxc, or found on PATH) the same shaders are compiled for real : compile time cold, hit rate and time warm.
+
+#include "../ShaderCache.h"
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const uint64_t KB = 1024;
+
+static int NumErrors = 0;
+
+#define CHECK(x) do { if (!(x)) { cout << "  FAILED " << #x << " (line " << __LINE__ << ")" << endl; NumErrors++; } } while (0)
+
+static void WriteText(const fs::path& Path, const string& Text)
+{
+	fs::create_directories(Path.parent_path());
+	ofstream file(Path, ios::binary | ios::trunc);
+	file << Text;
+}
+
+static string ReadText(const fs::path& Path)
+{
+	ifstream file(Path, ios::binary);
+	return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+// the entry points the renderer compiles, found in the source : VSMain/PSMain, every [numthreads] function, one library for ray tracing.
+// files with none are only included.
+static void FindEntryPoints(const fs::path& File, vector<ShaderCacheDesc>& OutDescs)
+{
+	const string source = ReadText(File);
+
+	ShaderCacheDesc desc;
+	desc.FileName = File.wstring();
+
+	if (source.find("[shader(\"") != string::npos)
+	{
+		desc.Target = L"lib_6_3";
+		OutDescs.push_back(desc);
+		return;
+	}
+
+	for (const char* entry : { "VSMain", "PSMain" })
+	{
+		if (source.find(string(entry) + "(") == string::npos)
+			continue;
+		desc.EntryPoint = fs::path(entry).wstring();
+		desc.Target = entry[0] == 'V' ? L"vs_6_0" : L"ps_6_0";
+		OutDescs.push_back(desc);
+	}
+
+	// the name in front of the first ( after the attribute
+	for (size_t pos = source.find("[numthreads"); pos != string::npos; pos = source.find("[numthreads", pos + 1))
+	{
+		const size_t close = source.find(']', pos);
+		const size_t paren = close == string::npos ? string::npos : source.find('(', close);
+		if (paren == string::npos)
+			break;
+
+		size_t end = paren;
+		while (end > close && isspace(uint8_t(source[end - 1])))
+			end--;
+		size_t begin = end;
+		while (begin > close && (isalnum(uint8_t(source[begin - 1])) || source[begin - 1] == '_'))
+			begin--;
+		if (begin == end)
+			continue;
+
+		desc.EntryPoint = fs::path(source.substr(begin, end - begin)).wstring();
+		desc.Target = L"cs_6_0";
+		OutDescs.push_back(desc);
+	}
+}
+
+static string Quote(const fs::path& Path)
+{
+	return "\"" + Path.string() + "\"";
+}
+
+static fs::path FindDxc()
+{
+#ifdef _WIN32
+	const char* name = "dxc.exe";
+	const char separator = ';';
+#else
+	const char* name = "dxc";
+	const char separator = ':';
+#endif
+	const char* path = getenv("PATH");
+	string dirs = path ? path : "";
+
+	size_t begin = 0;
+	while (begin <= dirs.size())
+	{
+		size_t end = dirs.find(separator, begin);
+		if (end == string::npos)
+			end = dirs.size();
+
+		error_code ec;
+		const fs::path candidate = fs::path(dirs.substr(begin, end - begin)) / name;
+		if (end > begin && fs::is_regular_file(candidate, ec))
+			return candidate;
+		begin = end + 1;
+	}
+	return fs::path();
+}
+
+static int RunCommand(string Command)
+{
+#ifdef _WIN32
+	// cmd /c drops the outer quotes, the quoted paths inside stay intact
+	Command = "\"" + Command + "\"";
+#endif
+	return system(Command.c_str());
+}
+
+// one dxc process per shader on the source the key was made from. it's written to WorkDir under its own name, the source's directory
+// goes in as -I so quoted includes resolve as they would next to it.
+static bool CompileWithDxc(const fs::path& Dxc, const fs::path& WorkDir, const ShaderCacheDesc& Desc, const string& Source, vector<uint8_t>& OutBlob)
+{
+	const fs::path input = WorkDir / fs::path(Desc.FileName).filename();
+	const fs::path output = WorkDir / "out.dxil";
+	const fs::path log = WorkDir / "dxc.log";
+	WriteText(input, Source);
+	error_code ec;
+	fs::remove(output, ec);
+
+	string command = Quote(Dxc) + " -T " + fs::path(Desc.Target).string();
+	if (!Desc.EntryPoint.empty())
+		command += " -E " + fs::path(Desc.EntryPoint).string();
+	for (auto& define : Desc.Defines)
+		command += " -D " + fs::path(define.first).string() + (define.second.empty() ? "" : "=" + fs::path(define.second).string());
+	for (auto& argument : Desc.Arguments)
+	{
+		string arg = fs::path(argument).string();
+#ifndef _WIN32
+		// /Zi style options only parse on windows
+		if (!arg.empty() && arg[0] == '/')
+			arg[0] = '-';
+#endif
+		command += " " + arg;
+	}
+	command += " -I " + Quote(fs::path(Desc.FileName).parent_path()) + " -Fo " + Quote(output) + " " + Quote(input) + " > " + Quote(log) + " 2>&1";
+
+	if (RunCommand(command) != 0)
+		return false;
+
+	const string blob = ReadText(output);
+	OutBlob.assign(blob.begin(), blob.end());
+	return !OutBlob.empty();
+}
+
+// the renderer's shaders through the real compiler, cold then warm. cold is what a first start or a compiler update costs,
+// warm is every start after it. shaders that need the renderer's defines (rtxgi) fail here and are counted, errors aren't cached.
+static void TestWithDxc(const fs::path& Dxc, const vector<ShaderCacheDesc>& Descs, const fs::path& Root)
+{
+	const fs::path workDir = Root / "dxc";
+	fs::create_directories(workDir);
+
+	// part of the key, like the version the renderer reads from the dll
+	RunCommand(Quote(Dxc) + " --version > " + Quote(workDir / "version.txt") + " 2>&1");
+	string version = ReadText(workDir / "version.txt");
+	version = version.substr(0, version.find('\n'));
+	cout << "  dxc " << Dxc.string() << " : " << version << endl;
+
+	const wstring cacheDir = (Root / "dxcshaders").wstring();
+	uint32_t numCompiled = 0;
+	double runMs[2] = {};
+	for (int run = 0; run < 2; run++)
+	{
+		ShaderCache cache(cacheDir, version);
+		uint32_t numOk = 0;
+		auto start = chrono::high_resolution_clock::now();
+		vector<uint8_t> blob;
+		for (const ShaderCacheDesc& shader : Descs)
+		{
+			auto compile = [&](const string& Source, vector<uint8_t>& OutBlob) { return CompileWithDxc(Dxc, workDir, shader, Source, OutBlob); };
+			if (cache.GetOrCompile(shader, compile, blob))
+				numOk++;
+		}
+		runMs[run] = ElapsedMS(start);
+
+		const ShaderCacheStats stats = cache.GetStats();
+		if (run == 0)
+			numCompiled = numOk;
+		else
+			CHECK(stats.NumHits == numCompiled && numOk == numCompiled);
+
+		cout << "  dxc " << (run == 0 ? "cold" : "warm") << " : " << Descs.size() << " shaders, " << numOk << " ok, " << stats.NumFailed << " failed, "
+			<< stats.NumHits << " hits (" << (Descs.empty() ? 0.0 : 100.0 * stats.NumHits / Descs.size()) << "%), compile " << stats.CompileMs
+			<< " ms, keys " << stats.KeyMs << " ms, loads " << stats.LoadMs << " ms, total " << runMs[run] << " ms" << endl;
+	}
+	cout << "  dxc warm start x" << runMs[0] / max(runMs[1], 0.001) << " faster (the failed shaders are compiled again in both)" << endl;
+}
+
+static void TestShaderCache(uint64_t Seed, const string& ShaderDir, const fs::path& Dxc)
+{
+	cout << "shadercache" << endl;
+
+	const fs::path root = fs::temp_directory_path() / ("shadercachetest_" + to_string(Seed));
+	error_code ec;
+	fs::remove_all(root, ec);
+
+	// stands in for dxc : the blob is what the compile saw, a hit has to give the same bytes
+	uint32_t numCompiles = 0;
+	auto compileFor = [&](const ShaderCacheDesc& Desc)
+	{
+		return [&numCompiles, Desc](const string& Source, vector<uint8_t>& OutBlob)
+		{
+			numCompiles++;
+			if (Desc.EntryPoint == L"broken")
+				return false;
+
+			OutBlob.assign(Source.begin(), Source.end());
+			OutBlob.resize(OutBlob.size() + 4 * KB, 0xdc);
+			return true;
+		};
+	};
+
+	// includes next to the includer and next to the source, one included twice, a commented one and one that doesn't exist
+	const fs::path srcDir = root / "src";
+	WriteText(srcDir / "Main.hlsl", "#include \"Common.hlsl\"\n#include \"sub/Inc.hlsl\"\n// #include \"Commented.hlsl\"\n  #  include <Missing.hlsl>\n[numthreads(8, 8, 1)] void main() {}\n");
+	WriteText(srcDir / "Common.hlsl", "float4 Common;\n");
+	WriteText(srcDir / "Commented.hlsl", "float4 Commented;\n");
+	WriteText(srcDir / "sub" / "Inc.hlsl", "#include \"../Common.hlsl\"\n#include \"Deep.hlsl\"\n");
+	WriteText(srcDir / "sub" / "Deep.hlsl", "float Deep;\n");
+
+	ShaderCacheDesc desc;
+	desc.FileName = (srcDir / "Main.hlsl").wstring();
+	desc.EntryPoint = L"main";
+	desc.Target = L"cs_6_0";
+	desc.Defines = { { L"USE_FOO", L"1" } };
+	desc.Arguments = { L"/Zi" };
+
+	const wstring cacheDir = (root / "cache").wstring();
+	{
+		ShaderCache cache(cacheDir, "dxc 1.0");
+
+		ShaderCacheKey key;
+		vector<wstring> files;
+		CHECK(cache.MakeKey(desc, key, &files));
+		CHECK(files.size() == 4);
+
+		vector<uint8_t> blob, again;
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob));
+		CHECK(numCompiles == 1 && cache.GetStats().NumMisses == 1 && fs::exists(cache.GetEntryPath(key)));
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), again));
+		CHECK(numCompiles == 1 && cache.GetStats().NumHits == 1 && again == blob);
+	}
+
+	// a new run finds it on disk
+	ShaderCache cache(cacheDir, "dxc 1.0");
+	ShaderCacheKey baseKey;
+	cache.MakeKey(desc, baseKey);
+	{
+		vector<uint8_t> blob;
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 1);
+	}
+
+	auto keyOf = [&](const ShaderCacheDesc& Desc, ShaderCache& Cache)
+	{
+		ShaderCacheKey key;
+		Cache.MakeKey(Desc, key);
+		return key.Hash;
+	};
+
+	// an edit deep in the includes is a miss, going back finds the old entry
+	{
+		WriteText(srcDir / "sub" / "Deep.hlsl", "float Deep2;\n");
+		vector<uint8_t> blob;
+		CHECK(keyOf(desc, cache) != baseKey.Hash);
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 2);
+		WriteText(srcDir / "sub" / "Deep.hlsl", "float Deep;\n");
+		CHECK(keyOf(desc, cache) == baseKey.Hash);
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 2);
+
+		// the include that wasn't there shows up
+		WriteText(srcDir / "Missing.hlsl", "float Missing;\n");
+		CHECK(keyOf(desc, cache) != baseKey.Hash);
+		fs::remove(srcDir / "Missing.hlsl", ec);
+		CHECK(keyOf(desc, cache) == baseKey.Hash);
+	}
+
+	// everything else that goes to the compiler
+	{
+		ShaderCacheDesc other = desc;
+		other.EntryPoint = L"main2";
+		CHECK(keyOf(other, cache) != baseKey.Hash);
+		other = desc;
+		other.Target = L"cs_6_5";
+		CHECK(keyOf(other, cache) != baseKey.Hash);
+		other = desc;
+		other.Defines[0].second = L"0";
+		CHECK(keyOf(other, cache) != baseKey.Hash);
+		other = desc;
+		other.Defines = { { L"USE_FOO1", L"" } };
+		CHECK(keyOf(other, cache) != baseKey.Hash);
+		other = desc;
+		other.Arguments.clear();
+		CHECK(keyOf(other, cache) != baseKey.Hash);
+
+		ShaderCache newCompiler(cacheDir, "dxc 1.1");
+		CHECK(keyOf(desc, newCompiler) != baseKey.Hash);
+	}
+
+	// includes only found through the include directories of the arguments, both spellings, joined or as the next argument
+	{
+		const fs::path incDir1 = root / "inc1";
+		const fs::path incDir2 = root / "inc2";
+		WriteText(incDir1 / "Inc1.hlsl", "float Inc1;\n");
+		WriteText(incDir2 / "Inc2.hlsl", "float Inc2;\n");
+		WriteText(srcDir / "Dirs.hlsl", "#include \"Inc1.hlsl\"\n#include <Inc2.hlsl>\n");
+
+		ShaderCacheDesc dirs = desc;
+		dirs.FileName = (srcDir / "Dirs.hlsl").wstring();
+		dirs.Arguments = { L"-I", incDir1.wstring(), L"/I" + incDir2.wstring() };
+
+		ShaderCacheKey key;
+		vector<wstring> files;
+		CHECK(cache.MakeKey(dirs, key, &files) && files.size() == 3);
+
+		WriteText(incDir2 / "Inc2.hlsl", "float Inc2b;\n");
+		CHECK(keyOf(dirs, cache) != key.Hash);
+
+		dirs.Arguments = { L"-I" + incDir1.wstring(), L"/I", incDir2.wstring() };
+		CHECK(cache.MakeKey(dirs, key, &files) && files.size() == 3);
+
+		dirs.Arguments.clear();
+		CHECK(cache.MakeKey(dirs, key, &files) && files.size() == 1);
+	}
+
+	// the compile gets the bytes the key was made from. an edit that lands while it runs doesn't end up under the old key,
+	// the next call sees the new source.
+	{
+		ShaderCacheDesc race = desc;
+		race.FileName = (srcDir / "Race.hlsl").wstring();
+		WriteText(race.FileName, "float Before;\n");
+
+		auto editWhileCompiling = [&](const string& Source, vector<uint8_t>& OutBlob)
+		{
+			numCompiles++;
+			WriteText(race.FileName, "float After;\n");
+			OutBlob.assign(Source.begin(), Source.end());
+			return true;
+		};
+
+		vector<uint8_t> blob;
+		CHECK(cache.GetOrCompile(race, editWhileCompiling, blob) && string(blob.begin(), blob.end()) == "float Before;\n");
+		CHECK(cache.GetOrCompile(race, compileFor(race), blob) && numCompiles == 4);
+		CHECK(string(blob.begin(), blob.begin() + 13) == "float After;\n");
+	}
+
+	// a truncated entry is a miss and gets written again
+	{
+		fs::resize_file(cache.GetEntryPath(baseKey), 16, ec);
+		vector<uint8_t> blob;
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 5);
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 5);
+	}
+
+	// errors aren't stored, the next try compiles again. a source that doesn't exist never gets to the compiler.
+	{
+		ShaderCacheDesc broken = desc;
+		broken.EntryPoint = L"broken";
+		ShaderCacheKey key;
+		cache.MakeKey(broken, key);
+		vector<uint8_t> blob;
+		const uint32_t numFailed = cache.GetStats().NumFailed;
+		CHECK(!cache.GetOrCompile(broken, compileFor(broken), blob) && numCompiles == 6);
+		CHECK(!cache.GetOrCompile(broken, compileFor(broken), blob) && numCompiles == 7);
+		CHECK(!fs::exists(cache.GetEntryPath(key)) && cache.GetStats().NumFailed == numFailed + 2);
+
+		ShaderCacheDesc missing = desc;
+		missing.FileName = (srcDir / "NoSuchFile.hlsl").wstring();
+		CHECK(!cache.GetOrCompile(missing, compileFor(missing), blob) && numCompiles == 7);
+
+		// switched off it always compiles
+		cache.bEnabled = false;
+		CHECK(cache.GetOrCompile(desc, compileFor(desc), blob) && numCompiles == 8);
+		cache.bEnabled = true;
+	}
+	cout << "  keys, include directories, hits, invalidation, corrupt entries, errors (" << (NumErrors == 0 ? "ok" : "errors") << ")" << endl;
+
+	// the renderer's shaders, cold then warm as the next startup sees them. the stand-in compile makes the cold time meaningless,
+	// what counts is that the warm run compiles nothing and what the keys and loads cost.
+	if (fs::is_directory(ShaderDir, ec))
+	{
+		vector<fs::path> files;
+		for (auto& entry : fs::recursive_directory_iterator(ShaderDir, ec))
+		{
+			if (entry.path().extension() == ".hlsl")
+				files.push_back(entry.path());
+		}
+		sort(files.begin(), files.end());
+
+		vector<ShaderCacheDesc> descs;
+		for (const fs::path& file : files)
+			FindEntryPoints(file, descs);
+
+		const wstring shaderCacheDir = (root / "shaders").wstring();
+		for (int run = 0; run < 2; run++)
+		{
+			ShaderCache shaderCache(shaderCacheDir, "dxc 1.0");
+			const uint32_t compilesBefore = numCompiles;
+			vector<uint8_t> blob;
+			for (const ShaderCacheDesc& shader : descs)
+				CHECK(shaderCache.GetOrCompile(shader, compileFor(shader), blob));
+
+			const ShaderCacheStats stats = shaderCache.GetStats();
+			if (run == 1)
+				CHECK(numCompiles == compilesBefore && stats.NumHits == descs.size());
+			cout << "  " << (run == 0 ? "cold" : "warm") << " : " << descs.size() << " shaders, " << stats.NumHits << " hits ("
+				<< (descs.empty() ? 0.0 : 100.0 * stats.NumHits / descs.size()) << "%), " << numCompiles - compilesBefore << " compiled, "
+				<< stats.NumFiles << " files " << stats.BytesHashed / KB << " KB hashed in " << stats.KeyMs << " ms, loads " << stats.LoadMs
+				<< " ms" << endl;
+		}
+
+		if (!Dxc.empty())
+			TestWithDxc(Dxc, descs, root);
+		else
+			cout << "  no dxc on PATH, pass -dxc PATH to compile the renderer's shaders for real" << endl;
+	}
+	else
+	{
+		cout << "  no " << ShaderDir << " directory, run from src or pass -shaders DIR for the timing of the renderer's shaders" << endl;
+	}
+
+	fs::remove_all(root, ec);
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t seed = 1;
+	string shaderDir = "Shaders";
+	fs::path dxc = FindDxc();
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-seed" && i + 1 < argc)
+			seed = stoull(argv[++i]);
+		else if (arg == "-shaders" && i + 1 < argc)
+			shaderDir = argv[++i];
+		else if (arg == "-dxc" && i + 1 < argc)
+			dxc = argv[++i];
+		else
+		{
+			cout << "usage : ShaderCacheTest [-seed S] [-shaders DIR] [-dxc PATH]" << endl;
+			return 1;
+		}
+	}
+
+	TestShaderCache(seed, shaderDir, dxc);
+
+	if (NumErrors > 0)
+		cout << NumErrors << " checks failed" << endl;
+
+	return NumErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,415 @@
+// TextureCook : offline block compression for the textures LoadModel's materials use.
+//
+// usage : TextureCook.exe [-quick] [-bench] [-synthetic] [-albedo|-normal|-mask texture ...] [model.fbx ...]
+//   (default)  write "<texture>.srgb.cooked.dds" / "<texture>.linear.cooked.dds" next to every material texture with full mips.
+//              diffuse -> BC7 srgb, normal -> BC5, roughness/metallic -> BC4. prints psnr, size and load time.
+//   -albedo/-normal/-mask FILE  cook one texture as that type, without a model
+//   -quick     faster BC7 mode search, a bit lower quality
+//   -bench     time the compression of the whole set on 1..N threads
+//   -synthetic compression throughput of every format on generated textures, no files needed
+//
+// the models are read through MeshCache, which is windows only. the rest only needs DirectXTex and enkiTS and builds on linux
+// against DirectXTex's github cmake project (its BC encoders are portable, WIC isn't so sources there are dds/tga) :
+//   g++ -O2 -std=c++17 -Iexternal -I$DXTEX/DirectXTex -I$DXMATH/Inc -I$DXHEADERS/include -I$DXHEADERS/include/wsl/stubs
+//       tools/TextureCook.cpp TextureCooker.cpp external/enkiTS/TaskScheduler.cpp -L$DXTEX/build/lib -lDirectXTex -lpthread
+
+#ifdef _WIN32
+#include "../MeshCache.h"
+#include "../Utils.h"
+#endif
+#include "../TextureCooker.h"
+#include "enkiTS/TaskScheduler.h"
+
+#include <iostream>
+#include <chrono>
+#include <codecvt>
+#include <map>
+#include <cwctype>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+struct CookEntry
+{
+	wstring File;
+	TextureCookType Type;
+};
+
+static double ElapsedMS(chrono::high_resolution_clock::time_point Start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - Start).count();
+}
+
+static const char* GetTypeName(TextureCookType Type)
+{
+	switch (Type)
+	{
+	case TEXTURE_COOK_ALBEDO: return "BC7";
+	case TEXTURE_COOK_NORMAL: return "BC5";
+	default: return "BC4";
+	}
+}
+
+#ifdef _WIN32
+// every texture referenced by the model's materials, once per color space. normal and mask share the linear file,
+// the first of those slots a file shows up in decides its format.
+static bool CollectTextures(const string& File, enki::TaskScheduler& TS, vector<CookEntry>& OutEntries)
+{
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+	wstring wide = converter.from_bytes(File);
+	wstring dir = GetDirectoryFromFilePath(wide.c_str());
+
+	CookedScene cooked;
+	MeshImportData importData;
+	if (!cooked.Open(GetCookedScenePath(wide), wide))
+	{
+		if (!ImportMeshFromFile(File, importData, &TS))
+			return false;
+		cooked.OpenFromMemory(importData);
+	}
+
+	map<wstring, TextureCookType> seen;
+	auto Add = [&](const wchar_t* TexName, TextureCookType Type)
+	{
+		if (TexName[0] == 0)
+			return;
+
+		wstring file = dir + TexName;
+		wstring key = file;
+		for (auto& c : key)
+			c = c == L'/' ? L'\\' : towlower(c);
+		key += IsCookedTextureSRGB(Type) ? L"|srgb" : L"|linear";
+
+		auto it = seen.find(key);
+		if (it != seen.end())
+		{
+			if (it->second != Type)
+				wcout << L"  " << TexName << L" is used as " << GetTypeName(it->second) << L" and " << GetTypeName(Type) << L", cooking " << GetTypeName(it->second) << endl;
+			return;
+		}
+
+		seen[key] = Type;
+		OutEntries.push_back({ file, Type });
+	};
+
+	for (UINT i = 0; i < cooked.Header->NumMaterials; i++)
+	{
+		const CookedMaterial& mat = cooked.Materials[i];
+		Add(mat.Diffuse, TEXTURE_COOK_ALBEDO);
+		Add(mat.Normal, TEXTURE_COOK_NORMAL);
+		Add(mat.Roughness, TEXTURE_COOK_MASK);
+		Add(mat.Metallic, TEXTURE_COOK_MASK);
+	}
+	return true;
+}
+#endif
+
+static bool CookTextures(const vector<CookEntry>& Entries, bool bQuick, enki::TaskScheduler& TS)
+{
+	UINT64 uncompressedBytes = 0;
+	UINT64 cookedBytes = 0;
+	UINT64 numPixels = 0;
+	double compressMS = 0;
+	double sourceLoadMS = 0;
+	double cookedLoadMS = 0;
+	double psnrSum[3] = {};
+	UINT psnrCount[3] = {};
+	UINT numCooked = 0;
+	bool bAllCooked = true;
+
+	for (auto& entry : Entries)
+	{
+		wstring name = fs::path(entry.File).filename().wstring();
+
+		TextureCookResult result;
+		if (!CookTexture(entry.File, entry.Type, bQuick, &TS, &result))
+		{
+			wcout << L"  " << name << L" : failed (missing, undecodable or not a multiple of 4)" << endl;
+			bAllCooked = false;
+			continue;
+		}
+
+		// what LoadTextureImage does with the cooked file at runtime, against decode + mips of the source
+		auto start = chrono::high_resolution_clock::now();
+		DirectX::ScratchImage loaded;
+		DirectX::LoadFromDDSFile(GetCookedTexturePath(entry.File, !IsCookedTextureSRGB(entry.Type)).c_str(), DirectX::DDS_FLAGS_NONE, nullptr, loaded);
+		cookedLoadMS += ElapsedMS(start);
+		sourceLoadMS += result.DecodeMS;
+
+		wcout << L"  " << name << L" ";
+		cout << result.Width << "x" << result.Height << " " << GetTypeName(entry.Type) << " : " << result.PSNR << " dB, "
+			<< result.UncompressedBytes / 1024 << " -> " << result.CookedBytes / 1024 << " KB, " << result.CompressMS << " ms" << endl;
+
+		uncompressedBytes += result.UncompressedBytes;
+		cookedBytes += result.CookedBytes;
+		numPixels += UINT64(result.Width) * result.Height;
+		compressMS += result.CompressMS;
+		psnrSum[entry.Type] += result.PSNR;
+		psnrCount[entry.Type]++;
+		numCooked++;
+	}
+
+	cout << "  " << numCooked << " textures : " << uncompressedBytes / (1024 * 1024) << " -> " << cookedBytes / (1024 * 1024) << " MB (x"
+		<< double(uncompressedBytes) / max(double(cookedBytes), 1.0) << "), " << double(numPixels) / max(compressMS, 0.001) / 1000.0 << " MPix/s" << endl;
+
+	cout << "  psnr :";
+	for (UINT type = 0; type < 3; type++)
+		cout << " " << GetTypeName(TextureCookType(type)) << " " << psnrSum[type] / max(psnrCount[type], 1u) << " dB";
+	cout << endl;
+
+	cout << "  load : source " << sourceLoadMS << " ms, cooked " << cookedLoadMS << " ms, x" << sourceLoadMS / max(cookedLoadMS, 0.001) << endl;
+
+	return bAllCooked;
+}
+
+// sources are decoded up front so only the compression is timed.
+static void PrintCompressBench(const vector<CookEntry>& Entries, bool bQuick)
+{
+	vector<DirectX::ScratchImage> mips(Entries.size());
+	UINT64 numPixels = 0;
+	for (size_t i = 0; i < Entries.size(); i++)
+	{
+		if (DecodeTextureSource(Entries[i].File, Entries[i].Type, mips[i]))
+			numPixels += mips[i].GetMetadata().width * mips[i].GetMetadata().height;
+	}
+
+	const UINT numHardwareThreads = enki::GetNumHardwareThreads();
+	double singleMS = 0;
+	for (UINT numThreads = 1; ; numThreads = min(numThreads * 2, numHardwareThreads))
+	{
+		enki::TaskScheduler TS;
+		TS.Initialize(numThreads);
+
+		auto start = chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < Entries.size(); i++)
+		{
+			DirectX::ScratchImage compressed;
+			if (mips[i].GetImageCount() > 0)
+				CompressTexture(mips[i], Entries[i].Type, bQuick, &TS, compressed);
+		}
+		double ms = ElapsedMS(start);
+		if (numThreads == 1)
+			singleMS = ms;
+
+		cout << "  compress " << numThreads << " threads : " << ms << " ms, " << double(numPixels) / max(ms, 0.001) / 1000.0
+			<< " MPix/s, x" << singleMS / max(ms, 0.001) << endl;
+
+		if (numThreads >= numHardwareThreads)
+			break;
+	}
+}
+
+// value noise on a periodic lattice, smoothstep between the corners
+static float LatticeNoise(const vector<float>& Lattice, UINT GridSize, float X, float Y)
+{
+	float fx = X - floor(X);
+	float fy = Y - floor(Y);
+	UINT x0 = UINT(floor(X)) % GridSize;
+	UINT y0 = UINT(floor(Y)) % GridSize;
+	UINT x1 = (x0 + 1) % GridSize;
+	UINT y1 = (y0 + 1) % GridSize;
+	fx = fx * fx * (3 - 2 * fx);
+	fy = fy * fy * (3 - 2 * fy);
+
+	float a = Lattice[y0 * GridSize + x0] + (Lattice[y0 * GridSize + x1] - Lattice[y0 * GridSize + x0]) * fx;
+	float b = Lattice[y1 * GridSize + x0] + (Lattice[y1 * GridSize + x1] - Lattice[y1 * GridSize + x0]) * fx;
+	return a + (b - a) * fy;
+}
+
+// tiles with grout lines over three octaves of noise, so every block has gradients, edges or both and the BC7 mode
+// search does the work it would on a real material. albedo gets color, normal is the noise as a height field, mask is x.
+static bool MakeSyntheticSource(UINT Size, TextureCookType Type, UINT Seed, DirectX::ScratchImage& OutMips)
+{
+	const UINT gridSize = 64;
+	mt19937 rng(Seed);
+	uniform_real_distribution<float> dist(0.0f, 1.0f);
+	vector<float> lattice[4];
+	for (auto& l : lattice)
+	{
+		l.resize(gridSize * gridSize);
+		for (auto& v : l)
+			v = dist(rng);
+	}
+
+	auto Height = [&](float U, float V)
+	{
+		float h = 0.6f * LatticeNoise(lattice[0], gridSize, U * 4, V * 4) + 0.3f * LatticeNoise(lattice[0], gridSize, U * 16, V * 16)
+			+ 0.1f * LatticeNoise(lattice[0], gridSize, U * 64, V * 64);
+		bool bGrout = U * 8 - floor(U * 8) < 0.04f || V * 8 - floor(V * 8) < 0.04f;
+		return bGrout ? h * 0.2f : h;
+	};
+
+	DirectX::ScratchImage top;
+	if (FAILED(top.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, Size, Size, 1, 1)))
+		return false;
+	const DirectX::Image* image = top.GetImage(0, 0, 0);
+
+	auto ToByte = [](float V) { return UINT8(min(max(V, 0.0f), 1.0f) * 255.0f + 0.5f); };
+
+	for (UINT y = 0; y < Size; y++)
+	{
+		UINT8* row = image->pixels + y * image->rowPitch;
+		for (UINT x = 0; x < Size; x++)
+		{
+			float u = (x + 0.5f) / Size;
+			float v = (y + 0.5f) / Size;
+			float h = Height(u, v);
+			float rgba[4] = { h, h, h, 1.0f };
+
+			if (Type == TEXTURE_COOK_ALBEDO)
+			{
+				for (UINT c = 0; c < 3; c++)
+					rgba[c] = h * (0.4f + 0.6f * LatticeNoise(lattice[1 + c], gridSize, u * 8, v * 8));
+			}
+			else if (Type == TEXTURE_COOK_NORMAL)
+			{
+				float dx = (Height(u + 1.0f / Size, v) - h) * Size * 0.05f;
+				float dy = (Height(u, v + 1.0f / Size) - h) * Size * 0.05f;
+				float len = sqrt(dx * dx + dy * dy + 1.0f);
+				rgba[0] = -dx / len * 0.5f + 0.5f;
+				rgba[1] = -dy / len * 0.5f + 0.5f;
+				rgba[2] = 1.0f / len * 0.5f + 0.5f;
+			}
+
+			for (UINT c = 0; c < 4; c++)
+				row[x * 4 + c] = ToByte(rgba[c]);
+		}
+	}
+
+	return BuildTextureMips(*image, Type, OutMips);
+}
+
+// MPix/s of every format on 1..N threads, top mip pixels like the per model numbers. the psnr shows what the speed buys.
+static void PrintSyntheticBench(bool bQuick)
+{
+	const UINT size = 1024;
+	const UINT numTextures = 4;
+
+	for (UINT type = 0; type < 3; type++)
+	{
+		vector<DirectX::ScratchImage> mips(numTextures);
+		for (UINT i = 0; i < numTextures; i++)
+			MakeSyntheticSource(size, TextureCookType(type), 1 + i, mips[i]);
+		const double numPixels = double(size) * size * numTextures;
+
+		const UINT numHardwareThreads = enki::GetNumHardwareThreads();
+		double singleMS = 0;
+		float psnr = 0;
+		for (UINT numThreads = 1; ; numThreads = min(numThreads * 2, numHardwareThreads))
+		{
+			enki::TaskScheduler TS;
+			TS.Initialize(numThreads);
+
+			vector<DirectX::ScratchImage> compressed(numTextures);
+			auto start = chrono::high_resolution_clock::now();
+			for (UINT i = 0; i < numTextures; i++)
+				CompressTexture(mips[i], TextureCookType(type), bQuick, &TS, compressed[i]);
+			double ms = ElapsedMS(start);
+
+			if (numThreads == 1)
+			{
+				singleMS = ms;
+				for (UINT i = 0; i < numTextures; i++)
+					psnr += ComputeTexturePSNR(mips[i], compressed[i], TextureCookType(type)) / numTextures;
+			}
+
+			cout << "  " << GetTypeName(TextureCookType(type)) << (type == TEXTURE_COOK_ALBEDO && bQuick ? " quick" : "") << " " << numThreads
+				<< " threads : " << ms << " ms, " << numPixels / max(ms, 0.001) / 1000.0 << " MPix/s, x" << singleMS / max(ms, 0.001) << endl;
+
+			if (numThreads >= numHardwareThreads)
+				break;
+		}
+		cout << "  " << GetTypeName(TextureCookType(type)) << " psnr " << psnr << " dB (" << numTextures << " x " << size << "x" << size << ")" << endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool bQuick = false;
+	bool bBench = false;
+	bool bSynthetic = false;
+	vector<string> files;
+	vector<CookEntry> textures;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "-quick")
+			bQuick = true;
+		else if (arg == "-bench")
+			bBench = true;
+		else if (arg == "-synthetic")
+			bSynthetic = true;
+		else if (arg == "-albedo" && i + 1 < argc)
+			textures.push_back({ fs::path(argv[++i]).wstring(), TEXTURE_COOK_ALBEDO });
+		else if (arg == "-normal" && i + 1 < argc)
+			textures.push_back({ fs::path(argv[++i]).wstring(), TEXTURE_COOK_NORMAL });
+		else if (arg == "-mask" && i + 1 < argc)
+			textures.push_back({ fs::path(argv[++i]).wstring(), TEXTURE_COOK_MASK });
+		else
+			files.push_back(arg);
+	}
+
+	if (files.size() == 0 && textures.size() == 0 && !bSynthetic)
+	{
+		cout << "usage : TextureCook.exe [-quick] [-bench] [-synthetic] [-albedo|-normal|-mask texture ...] [model.fbx ...]" << endl;
+		return 1;
+	}
+
+#ifdef _WIN32
+	// WIC decoding
+	CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+	enki::TaskScheduler TS;
+	TS.Initialize();
+
+	int NumFailed = 0;
+	if (textures.size() > 0)
+	{
+		cout << "textures" << endl;
+
+		if (!CookTextures(textures, bQuick, TS))
+			NumFailed++;
+
+		if (bBench)
+			PrintCompressBench(textures, bQuick);
+	}
+
+	for (auto& file : files)
+	{
+		cout << file << endl;
+
+#ifdef _WIN32
+		vector<CookEntry> entries;
+		if (!CollectTextures(file, TS, entries))
+		{
+			cout << "  assimp import failed" << endl;
+			NumFailed++;
+			continue;
+		}
+
+		if (!CookTextures(entries, bQuick, TS))
+			NumFailed++;
+
+		if (bBench)
+			PrintCompressBench(entries, bQuick);
+#else
+		cout << "  models are read through MeshCache, which needs the windows build. pass the textures with -albedo/-normal/-mask" << endl;
+		NumFailed++;
+#endif
+	}
+
+	if (bSynthetic)
+	{
+		cout << "synthetic" << endl;
+		PrintSyntheticBench(bQuick);
+	}
+
+	return NumFailed == 0 ? 0 : 1;
+}